@@ -56,6 +56,7 @@
 #endif
 
 #include "libserveez.h"
+#include "prefork.h"
 #include "control-proto.h"
 
 #if ENABLE_HTTP_PROTO
@@ -180,13 +181,7 @@ ctrl_detect_proto (UNUSED svz_server_t *server, svz_socket_t *sock)
   /* control protocol detected */
   if (ret)
     {
-      if (ret < sock->recv_buffer_fill)
-        {
-          memmove (sock->recv_buffer,
-                   sock->recv_buffer + ret,
-                   sock->recv_buffer_fill - ret);
-        }
-      sock->recv_buffer_fill -= ret;
+      svz_sock_reduce_recv (sock, ret);
 #if ENABLE_DEBUG
       svz_log (SVZ_LOG_DEBUG, "control protocol client detected\n");
 #endif
@@ -232,7 +227,7 @@ ctrl_connect_socket (UNUSED svz_server_t *server, svz_socket_t *sock)
   sock->boundary = CTRL_PACKET_DELIMITER;
   sock->boundary_size = CTRL_PACKET_DELIMITER_LEN;
   sock->idle_func = ctrl_idle;
-  sock->idle_counter = CTRL_LOAD_UPDATE;
+  svz_sock_idle_arm (sock, CTRL_LOAD_UPDATE * 1000);
 
 #if HAVE_PROC_STAT
   cpu_state.cpufile = CPU_FILE_NAME;
@@ -568,49 +563,73 @@ ctrl_stat (svz_socket_t *sock, int flag, char *arg)
   svz_sock_printf (sock, "Proc-Load : %s\r\n", cpu_state.pinfo);
 
   /* show general state */
-  svz_sock_printf (sock, "\r\n * %d connected sockets (hard limit is %d)\r\n",
-                   svz_sock_nconnections (), SVZ_RUNPARM (MAX_SOCKETS));
-  svz_sock_printf (sock, " * uptime is %s\r\n", uptime (ut));
-#if ENABLE_DEBUG
   {
-    size_t cur[2];
+    int connections = svz_sock_nconnections ();
+    size_t cur[4];
+    prefork_stat_t *w;
 
     svz_get_curalloc (cur);
+    svz_get_pooled (cur + 2);
+
+    /* add what the other worker processes published */
+    for (w = prefork_stat; w < prefork_stat + prefork_workers; w++)
+      if (w != prefork_stat + prefork_self)
+        {
+          connections += w->connections;
+          cur[2] += w->pooled[0];
+          cur[3] += w->pooled[1];
+        }
+
+    svz_sock_printf (sock, "\r\n * %d connected sockets "
+                     "(hard limit is %d)\r\n",
+                     connections, SVZ_RUNPARM (MAX_SOCKETS));
+    svz_sock_printf (sock, " * uptime is %s\r\n", uptime (ut));
+#if ENABLE_DEBUG
     svz_sock_printf (sock, " * %d bytes of memory in %d blocks allocated\r\n",
                      cur[0], cur[1]);
-  }
 #endif /* ENABLE_DEBUG */
+    svz_sock_printf (sock, " * %zu bytes of memory in %zu blocks pooled\r\n",
+                     cur[2], cur[3]);
+
+    if (prefork_workers)
+      svz_sock_printf (sock, " * %d worker processes, "
+                       "this is worker %d\r\n",
+                       prefork_workers, prefork_self);
+    for (w = prefork_stat; w < prefork_stat + prefork_workers; w++)
+      if (!w->pid)
+        svz_sock_printf (sock, "   worker %d: not running\r\n",
+                         (int) (w - prefork_stat));
+      else
+        svz_sock_printf (sock, "   worker %d: pid %d, %d connections, "
+                         "%d restarts, up %s\r\n",
+                         (int) (w - prefork_stat), (int) w->pid,
+                         w == prefork_stat + prefork_self
+                         ? svz_sock_nconnections () : w->connections,
+                         w->restarts, uptime (time (NULL) - w->started));
+  }
   svz_sock_printf (sock, "\r\n");
 
   return flag;
 }
 
-static int
-stat_con_internal (svz_socket_t *sock, void *closure)
+static void
+stat_con_line (svz_socket_t *to, prefork_con_t *con)
 {
-  svz_socket_t *to = closure;
-  char *id;
-  char linet[64];
-  char rinet[64];
-  svz_server_t *server;
-
-  if (sock->flags & SVZ_SOFLG_LISTENING)
-    id = "Listener";
-  else if (sock->flags & SVZ_SOFLG_COSERVER)
-    id = "Co-Server";
-  else if ((server = svz_server_find (sock->cfg)) != NULL)
-    id = server->name;
-  else
-    id = "None";
-
   svz_sock_printf (to,
                    "%-16s %4d %6d %6d "
                    "%-20s %-20s"        /* FIXME: IPv4 */
-                   "\r\n", id,
-                   sock->id, sock->recv_buffer_fill,
-                   sock->send_buffer_fill,
-                   SVZ_PP_ADDR_PORT (linet, sock->local_addr, sock->local_port),
-                   SVZ_PP_ADDR_PORT (rinet, sock->remote_addr, sock->remote_port));
+                   "\r\n", con->proto,
+                   con->id, con->recvq, con->sendq,
+                   con->local, con->foreign);
+}
+
+static int
+stat_con_internal (svz_socket_t *sock, void *closure)
+{
+  prefork_con_t con;
+
+  prefork_describe (sock, &con);
+  stat_con_line (closure, &con);
   return 0;
 }
 
@@ -621,10 +640,30 @@ stat_con_internal (svz_socket_t *sock, void *closure)
 int
 ctrl_stat_con (svz_socket_t *sock, int flag, UNUSED char *arg)
 {
+  prefork_stat_t *w;
+  int i;
+
   svz_sock_printf (sock, "\r\n%s",
                    "Proto              Id  RecvQ  SendQ "
                    "Local                Foreign\r\n");
-  svz_foreach_socket (stat_con_internal, sock);
+  if (!prefork_workers)
+    svz_foreach_socket (stat_con_internal, sock);
+
+  /* the other worker processes' lists are up to a second old */
+  for (w = prefork_stat; w < prefork_stat + prefork_workers; w++)
+    {
+      svz_sock_printf (sock, "-- worker %d (pid %d)\r\n",
+                       (int) (w - prefork_stat), (int) w->pid);
+      if (w == prefork_stat + prefork_self)
+        svz_foreach_socket (stat_con_internal, sock);
+      else
+        {
+          for (i = 0; i < w->ncon && i < PREFORK_MAX_CON; i++)
+            stat_con_line (sock, &w->con[i]);
+          if (w->more)
+            svz_sock_printf (sock, "(%d more)\r\n", w->more);
+        }
+    }
   svz_sock_printf (sock, "\r\n");
 
   return flag;
@@ -658,12 +697,13 @@ ctrl_stat_cache (svz_socket_t *sock, int flag, UNUSED char *arg)
       if (p != cache->file) p++;
       svz_sock_printf (sock, "%-30s %6d %6d %5d %6d %-5s\r\n", p,
                        cache->size, cache->usage, cache->hits, n,
-                       cache->ready ? "Yes" : "No");
+                       cache->mapped ? "Map" : cache->ready ? "Yes" : "No");
     }
 
   /* print cache summary */
-  svz_sock_printf (sock, "\r\nTotal : %d byte in %d cache entries\r\n\r\n",
-                   total, files);
+  svz_sock_printf (sock, "\r\nTotal : %d byte in %d cache entries\r\n"
+                   "Limit : %zu byte in %zu cache entries\r\n\r\n",
+                   total, files, http_cache_limit, http_cache_entries);
 
   return flag;
 }
@@ -677,7 +717,7 @@ ctrl_kill_cache (svz_socket_t *sock, int flag, UNUSED char *arg)
   svz_sock_printf (sock, "%d HTTP cache entries reinitialized.\r\n",
                    http_cache_entries);
   http_free_cache ();
-  http_alloc_cache (http_cache_entries);
+  http_alloc_cache (http_cache_entries, http_cache_limit);
   return flag;
 }
 #endif /* ENABLE_HTTP_PROTO */
@@ -710,8 +750,22 @@ stat_coservers_internal (const svz_coserver_t *coserver,
 int
 ctrl_stat_coservers (svz_socket_t *sock, int flag, UNUSED char *arg)
 {
+  svz_coserver_cache_stats_t stats;
+  int type;
+
   /* go through all internal coserver instances */
   svz_foreach_coserver (stat_coservers_internal, sock);
+
+  /* and the result caches of all coserver types */
+  for (type = 0; svz_coserver_cache_stats (type, &stats) == 0; type++)
+    svz_sock_printf (sock,
+                     "\r\n%s coserver cache:\r\n"
+                     " hits       : %lu\r\n"
+                     " joined     : %lu\r\n"
+                     " misses     : %lu\r\n"
+                     " entries    : %lu\r\n",
+                     stats.name, stats.hits, stats.joined,
+                     stats.misses, stats.entries);
   svz_sock_printf (sock, "\r\n");
   return flag;
 }
@@ -1148,6 +1202,6 @@ ctrl_idle (svz_socket_t *sock)
     }
 
   c->index = n;
-  sock->idle_counter = CTRL_LOAD_UPDATE;
+  svz_sock_idle_arm (sock, CTRL_LOAD_UPDATE * 1000);
   return 0;
 }
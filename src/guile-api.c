@@ -294,6 +294,7 @@ socket @var{sock} as a binary smob.  */)
 #define FUNC_NAME s_guile_sock_receive_buffer
   svz_socket_t *xsock;
   CHECK_SMOB_ARG (socket, sock, SCM_ARG1, "svz-socket", xsock);
+  svz_sock_alloc_buffers (xsock, SVZ_SOFLG_INBUF);
   return guile_data_to_bin (xsock->recv_buffer, xsock->recv_buffer_fill);
 #undef FUNC_NAME
 }
@@ -335,6 +336,7 @@ socket @var{sock} as a binary smob.  */)
 #define FUNC_NAME s_guile_sock_send_buffer
   svz_socket_t *xsock;
   CHECK_SMOB_ARG (socket, sock, SCM_ARG1, "svz-socket", xsock);
+  svz_sock_alloc_buffers (xsock, SVZ_SOFLG_OUTBUF);
   return guile_data_to_bin (xsock->send_buffer, xsock->send_buffer_fill);
 #undef FUNC_NAME
 }
@@ -710,11 +712,11 @@ SCM_DEFINE
  doc: /***********
 Set the @code{idle} callback of the socket structure
 @var{sock} to @var{proc}.  Return any previously
-set procedure.  The callback is run by the periodic task scheduler when the
-@code{idle-counter} of the socket structure drops to zero.  If this counter
-is not zero it gets decremented once a second.  The @code{idle}
-callback can reset @code{idle-counter} to some value and thus can
-re-schedule itself for a later task.  */)
+set procedure.  The callback is run when the idle timer of the socket
+structure expires.  Setting the @code{idle-counter} to some number of
+seconds arms this timer.  The @code{idle} callback can reset
+@code{idle-counter} to some value and thus can re-schedule itself for
+a later task.  */)
 {
 #define FUNC_NAME s_guile_sock_idle_func
   SOCK_CALLBACK_BODY (idle_func, sfn_idle);
@@ -756,7 +758,10 @@ given, the set the @code{idle-counter}.  Please have a look at the
   if (BOUNDP (counter))
     {
       ASSERT_EXACT (2, counter);
-      xsock->idle_counter = gi_scm2int (counter);
+      if (gi_scm2int (counter) > 0)
+        svz_sock_idle_arm (xsock, gi_scm2int (counter) * 1000L);
+      else
+        svz_sock_idle_cancel (xsock);
     }
   return gi_integer2scm (ocounter);
 #undef FUNC_NAME
@@ -1134,6 +1139,95 @@ runs the procedure @var{callback} as @code{(callback user)}, where
 #undef FUNC_NAME
 }
 
+/* Blocking routine of the coserver types registered by Guile.  This
+   runs in a coserver process, never in a coserver thread.  */
+static char *
+guile_coserver_handle (char *request, void *data)
+{
+  static char result[256];
+  SCM ret;
+
+  ret = guile_call ((SCM) data, 1, gi_string2scm (request));
+  if (GI_GET_XREP_MAYBE (result, ret))
+    return result;
+  return NULL;
+}
+
+SCM_DEFINE
+(guile_coserver_register,
+ "svz:coserver:register", 2, 1, 0,
+ (SCM name, SCM handler, SCM instances),
+ doc: /***********
+Register a type of coserver named by the string @var{name}.  Its
+@var{instances} (default 1) coserver processes run the blocking
+procedure @var{handler} as @code{(handler request)} for each request,
+which should return a string of less than 256 bytes, or @code{#f} if
+there is no result.  Return the type (an integer) to pass to
+@code{svz:coserver:invoke}, or @code{#f} on failure.  */)
+{
+#define FUNC_NAME s_guile_coserver_register
+  char str[64];
+  int type, n = 1;
+
+  ASSERT_STRING (1, name);
+  VALIDATE_CALLBACK (handler);
+  if (BOUNDP (instances))
+    {
+      ASSERT_EXACT (3, instances);
+      n = gi_scm2int (instances);
+    }
+
+  if (0 > GI_GET_XREP (str, name))
+    return SCM_BOOL_F;
+  type = svz_coserver_register (str, guile_coserver_handle, (void *) handler,
+                                n, SVZ_COSERVER_PROCESS);
+  return type < 0 ? SCM_BOOL_F : gi_integer2scm (type);
+#undef FUNC_NAME
+}
+
+/* Callback wrapper for the results of ‘svz:coserver:invoke’.  */
+static int
+guile_coserver_result (char *res, void *closure)
+{
+  SCM callback = (SCM) closure;
+
+  guile_call (callback, 1, res ? gi_string2scm (res) : SCM_BOOL_F);
+  gi_gc_unprotect (callback);
+  return 0;
+}
+
+SCM_DEFINE
+(guile_coserver_invoke,
+ "svz:coserver:invoke", 3, 0, 0,
+ (SCM type, SCM request, SCM callback),
+ doc: /***********
+Enqueue the string @var{request} for the coservers of type @var{type},
+as returned by @code{svz:coserver:register}.  When they respond, the
+procedure @var{callback} is run as @code{(callback result)}, where
+@var{result} is a string, or @code{#f} if there is none.  Return
+@code{#t} if the request is enqueued, otherwise @code{#f}.  */)
+{
+#define FUNC_NAME s_guile_coserver_invoke
+  char str[256];
+
+  ASSERT_EXACT (1, type);
+  ASSERT_STRING (2, request);
+  SCM_ASSERT_TYPE (SCM_PROCEDUREP (callback), callback,
+                   SCM_ARG3, FUNC_NAME, "procedure");
+
+  if (0 > GI_GET_XREP (str, request))
+    return SCM_BOOL_F;
+  gi_gc_protect (callback);
+  if (svz_coserver_invoke (gi_scm2int (type), str,
+                           guile_coserver_result, (void *) callback))
+    {
+      gi_gc_unprotect (callback);
+      return SCM_BOOL_F;
+    }
+  return SCM_BOOL_T;
+#undef FUNC_NAME
+}
+
 SCM_DEFINE
 (guile_sock_find,
  "svz:sock:find", 1, 0, 0,
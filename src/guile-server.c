@@ -861,6 +861,7 @@ sock_callback_body (const struct sock_callback_details *d,
       SCM_ASSERT_TYPE (SCM_PROCEDUREP (proc), proc, SCM_ARG2,
                        FUNC_NAME, "procedure");
       *place = d->getset;
+      svz_sock_touch (xsock);
 
       functions = scm_hashq_ref (all_sockets, sock, SCM_BOOL_F);
       if (! gi_nfalsep (functions))
@@ -73,6 +73,8 @@
 /* Miscellaneous definitions.  */
 #define PORTCFG_SEND_BUFSIZE "send-buffer-size"
 #define PORTCFG_RECV_BUFSIZE "recv-buffer-size"
+#define PORTCFG_QUANTUM_MIN  "write-quantum-min"
+#define PORTCFG_QUANTUM_MAX  "write-quantum-max"
 #define PORTCFG_FREQ         "connect-frequency"
 #define PORTCFG_ALLOW        "allow"
 #define PORTCFG_DENY         "deny"
@@ -1306,6 +1308,15 @@ Emit error messages (to stderr).  */)
   err |= optionhash_extract_int (options, PORTCFG_RECV_BUFSIZE, 1, 0,
                                  &(cfg->recv_buffer_size), action);
 
+  /* Access the bounds of the write quantum.  */
+  if (cfg->proto & SVZ_PROTO_TCP)
+    {
+      err |= optionhash_extract_int (options, PORTCFG_QUANTUM_MIN, 1, 0,
+                                     &(cfg->write_quantum_min), action);
+      err |= optionhash_extract_int (options, PORTCFG_QUANTUM_MAX, 1, 0,
+                                     &(cfg->write_quantum_max), action);
+    }
+
   /* Acquire the connect frequency.  */
   if (cfg->proto & SVZ_PROTO_TCP)
     err |= optionhash_extract_int (options, PORTCFG_FREQ, 1, 0,
@@ -1713,6 +1724,21 @@ This setting is overridden by the command-line @samp{-m} option.  */)
                         max);
 }
 
+SCM_DEFINE
+(guile_access_coserver_threads,
+ "serveez-coserver-threads", 0, 1, 0,
+ (SCM count),
+ doc: /***********
+Return the number of threads running the coservers (an integer),
+zero meaning they run as processes of their own.  Optional arg
+@var{count} means set it to that number, instead.  This setting is
+overridden by the command-line @samp{-T} option.  */)
+{
+  return parm_accessor (s_guile_access_coserver_threads,
+                        SVZ_RUNPARM_COSERVER_THREADS,
+                        count);
+}
+
 #if ENABLE_CONTROL_PROTO
 extern char *control_protocol_password;
 #else
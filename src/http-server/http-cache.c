@@ -25,12 +25,16 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/stat.h>
 #if HAVE_UNISTD_H
 # include <unistd.h>
 #endif
 #if HAVE_FLOSS_H
 # include <floss.h>
 #endif
+#if HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include "networking-headers.h"
 
 #ifdef __MINGW32__
@@ -42,24 +46,54 @@
 # include <sys/socket.h>
 #endif
 
+/* Without symbolic links, there is no need to tell them apart.  */
+#ifndef S_ISLNK
+# define lstat stat
+# define S_ISLNK(mode) 0
+#endif
+
 #include "libserveez.h"
 #include "misc-macros.h"
 #include "http-proto.h"
 #include "http-core.h"
 #include "http-cache.h"
+#include "http-watch.h"
 #include "unused.h"
 
 svz_hash_t *http_cache = NULL;               /* actual cache entry hash */
 size_t http_cache_entries = 0;               /* amount of cache entries */
+size_t http_cache_bytes = 0;                 /* size of all cache entries */
+size_t http_cache_limit = 0;                 /* maximum of the above */
 http_cache_entry_t *http_cache_first = NULL; /* most recent entry */
 http_cache_entry_t *http_cache_last = NULL;  /* least recent entry */
 
 /*
- * This will initialize the http cache entries.
+ * The entries not in use by any cache reader or writer, which can be
+ * dropped, beginning with the least recently used.  Entries being read
+ * and entries dropped from the cache already are not in this list.
+ */
+static http_cache_entry_t *http_cache_unused_first = NULL;
+static http_cache_entry_t *http_cache_unused_last = NULL;
+
+/* Is the cache entry CACHE in the above list?  */
+#define http_cache_unused_p(cache) \
+  ((cache)->ready && !(cache)->usage && !(cache)->orphan)
+
+/* Counting the uses of all cache entries.  */
+static unsigned long http_cache_clock = 0;
+
+static void http_cache_orphan (http_cache_entry_t *cache);
+static void http_cache_destroy_entry (http_cache_entry_t *cache);
+
+/*
+ * This will initialize the http cache entries.  The size of all cached
+ * files is limited to BYTES in addition to their number.
  */
 void
-http_alloc_cache (size_t entries)
+http_alloc_cache (size_t entries, size_t bytes)
 {
+  if (bytes > http_cache_limit)
+    http_cache_limit = bytes;
   if (entries > http_cache_entries || http_cache == NULL)
     {
       if (http_cache)
@@ -73,7 +107,8 @@ http_alloc_cache (size_t entries)
 }
 
 /*
- * Free all the cache entries.
+ * Free all the cache entries.  Entries still in use are dropped from
+ * the cache, and freed as soon as they are released.
  */
 void
 http_free_cache (void)
@@ -87,9 +122,7 @@ http_free_cache (void)
       next = cache->next;
       total += cache->size;
       files++;
-      svz_free (cache->buffer);
-      svz_free (cache->file);
-      svz_free (cache);
+      http_drop_cache (cache);
     }
 
   svz_hash_destroy (http_cache);
@@ -112,8 +145,8 @@ cache_consistency_internal (UNUSED void *k, void *v,
 
   /* Cache entry must be completely unused if not ready.  */
   if (!ent->ready)
-    assert (!ent->size
-            && !ent->buffer
+    assert (!ent->buffer
+            && !ent->usage
             && !ent->hits);
   /* Otherwise, a cache entry must contain something.  */
   else
@@ -129,7 +162,8 @@ cache_consistency_internal (UNUSED void *k, void *v,
 static void
 http_cache_consistency (void)
 {
-  svz_hash_foreach (cache_consistency_internal, http_cache, NULL);
+  if (http_cache)
+    svz_hash_foreach (cache_consistency_internal, http_cache, NULL);
 }
 #else /* not ENABLE_DEBUG */
 # define http_cache_consistency()
@@ -153,18 +187,45 @@ http_cache_print (void)
 #endif  /* ENABLE_CACHE_PRINT */
 
 /*
- * Returns the urgency value of the given http cache entry CACHE.
+ * Returns the urgency value of the given http cache entry CACHE, that is
+ * how often other entries have been looked up since it was used last.
  */
 int
 http_cache_urgency (http_cache_entry_t *cache)
 {
-  int n;
-  http_cache_entry_t *entry;
+  return (int) (http_cache_clock - cache->stamp);
+}
 
-  for (n = 0, entry = http_cache_first; entry; entry = entry->next, n++)
-    if (entry == cache)
-      return n;
-  return -1;
+/*
+ * Put the cache entry CACHE which is not in use any longer in front of
+ * the list of unused entries.
+ */
+static void
+http_cache_unused (http_cache_entry_t *cache)
+{
+  cache->more = NULL;
+  if ((cache->less = http_cache_unused_first) == NULL)
+    http_cache_unused_last = cache;
+  else
+    http_cache_unused_first->more = cache;
+  http_cache_unused_first = cache;
+}
+
+/*
+ * Remove the cache entry CACHE from the list of unused entries.
+ */
+static void
+http_cache_used (http_cache_entry_t *cache)
+{
+  if (cache->more)
+    cache->more->less = cache->less;
+  else
+    http_cache_unused_first = cache->less;
+  if (cache->less)
+    cache->less->more = cache->more;
+  else
+    http_cache_unused_last = cache->more;
+  cache->less = cache->more = NULL;
 }
 
 /*
@@ -206,6 +267,7 @@ http_check_cache (char *file, http_cache_t *cache)
     {
       /* set this entry to the most recent, ready or not  */
       http_urgent_cache (cachefile);
+      cachefile->stamp = ++http_cache_clock;
       http_cache_consistency ();
 
       /* is this entry fully read by the cache reader?  */
@@ -233,13 +295,13 @@ http_cache_create_entry (void)
 }
 
 /*
- * Destroy an existing http cache entry and remove it from the cache hash.
+ * Drop an existing http cache entry from the cache hash and the lists of
+ * entries, without freeing it.  It is an orphan afterwards, which nobody
+ * can find any longer.
  */
 static void
-http_cache_destroy_entry (http_cache_entry_t *cache)
+http_cache_orphan (http_cache_entry_t *cache)
 {
-  http_cache_consistency ();
-
   /* Delete cache entry from hash.  */
   if (svz_hash_delete (http_cache, cache->file) != cache)
     svz_log (SVZ_LOG_FATAL, "cache: inconsistent http hash\n");
@@ -253,9 +315,48 @@ http_cache_destroy_entry (http_cache_entry_t *cache)
     cache->next->prev = cache->prev;
   else
     http_cache_last = cache->prev;
+  cache->next = cache->prev = NULL;
+
+  if (http_cache_unused_p (cache))
+    http_cache_used (cache);
+  http_unwatch_cache (cache);
+  cache->orphan = 1;
+}
+
+/*
+ * Destroy an existing http cache entry and remove it from the cache hash.
+ */
+static void
+http_cache_destroy_entry (http_cache_entry_t *cache)
+{
+  int n;
+
+  http_cache_consistency ();
+
+  if (!cache->orphan)
+    http_cache_orphan (cache);
+  http_cache_bytes -= cache->size;
+  if (cache->gzip)
+    {
+      http_cache_bytes -= cache->gzip_size;
+      svz_free (cache->gzip);
+    }
+  for (n = 0; n < 2; n++)
+    if (cache->header[n].fields)
+      {
+        svz_free (cache->header[n].fields);
+        svz_free (cache->header[n].type);
+      }
 
   if (cache->ready)
-    svz_free (cache->buffer);
+    {
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+      if (cache->mapped)
+        munmap (cache->buffer, cache->size);
+      else
+#endif
+        svz_free (cache->buffer);
+    }
   svz_free (cache->file);
   svz_free (cache);
 }
@@ -295,57 +396,77 @@ http_cache_disconnect (svz_socket_t *sock)
 }
 
 /*
- * Find a free slot in the http file cache entries.  If necessary
- * delete the least recent.  Return zero if there was a free slot.
+ * Delete the least recent entries which are not currently in use by the
+ * cache writer or reader until there are less than ENTRIES entries and
+ * another SIZE bytes fit into the cache.  Return zero on success.
  */
-int
-http_init_cache (char *file, http_cache_t *cache)
+static int
+http_cache_room (size_t entries, size_t size)
 {
-  http_cache_entry_t *entry, *slot = NULL;
-
-  /*
-   * If there are still empty cache entries then create a
-   * new cache entry.
-   */
-  if (svz_hash_size (http_cache) < http_cache_entries)
+  if (size > http_cache_limit)
+    return -1;
+  while (svz_hash_size (http_cache) >= entries
+         || http_cache_bytes + size > http_cache_limit)
     {
-      slot = http_cache_create_entry ();
+      /* not a "reinitialable" cache entry found */
+      if (http_cache_unused_last == NULL)
+        return -1;
+      http_cache_destroy_entry (http_cache_unused_last);
     }
+  return 0;
+}
 
-  /*
-   * Otherwise find the least recent which is not currently in
-   * use by the cache writer or reader.
-   */
-  else
-    {
-      for (entry = http_cache_last; entry; entry = entry->prev)
-        if (!entry->usage && entry->ready)
-          {
-            slot = entry;
-            break;
-          }
-
-      /* not a "reinitialable" cache entry found */
-      if (!slot)
-        {
-          http_cache_reset (cache);
-          http_cache_consistency ();
-          return -1;
-        }
+/*
+ * Find a free slot in the http file cache entries for a file of SIZE
+ * bytes last modified at DATE.  If necessary delete the least recent.
+ * Return zero if there was a free slot.
+ */
+int
+http_init_cache (char *file, http_cache_t *cache, size_t size, time_t date)
+{
+  http_cache_entry_t *slot;
+  struct stat buf;
 
-      /* is currently used, so free the entry previously */
-      http_cache_destroy_entry (slot);
-      slot = http_cache_create_entry ();
+  if (http_cache_room (http_cache_entries, size) != 0)
+    {
+      http_cache_reset (cache);
+      http_cache_consistency ();
+      return -1;
     }
 
+  slot = http_cache_create_entry ();
   svz_hash_put (http_cache, file, slot);
   slot->file = svz_strdup (file);
+  slot->size = size;
+  slot->date = date;
+  slot->stamp = ++http_cache_clock;
+  slot->checked = time (NULL);
+  http_cache_bytes += size;
   if ((slot->next = http_cache_first) == NULL)
     http_cache_last = slot;
   else
     http_cache_first->prev = slot;
   http_cache_first = slot;
 
+  /*
+   * watch the file first, then make sure it is still the one the caller
+   * has looked at, so that no change goes unnoticed; a symbolic link or
+   * a file with other hard links may change without any event for its
+   * directory, so it is looked at again when requested instead
+   */
+  http_watch_cache (slot);
+  if (lstat (file, &buf) == -1
+      || (S_ISREG (buf.st_mode)
+          && ((size_t) buf.st_size != size || buf.st_mtime != date)))
+    {
+      http_cache_destroy_entry (slot);
+      http_cache_reset (cache);
+      http_cache_consistency ();
+      return -1;
+    }
+  if (S_ISLNK (buf.st_mode) || buf.st_nlink > 1)
+    http_unwatch_cache (slot);
+
   /*
    * initialize the cache entry for the cache file reader: cachebuffer
    * is not allocated yet and current cache length is zero
@@ -357,73 +478,316 @@ http_init_cache (char *file, http_cache_t *cache)
   return 0;
 }
 
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+
 /*
- * Refresh a certain cache entry for reusing it afterwards.  So we do not
- * destroy the entry, but the actual cache content.
+ * Map the file FD into memory as the content of the new cache entry of
+ * CACHE, which is ready afterwards.  The memory is the file system's
+ * cache, shared by all processes mapping the file, so no copy of the
+ * file is made at all.  Return zero on success, -1 if the file must be
+ * read into the cache entry instead.
+ *
+ * Beware: if the file is truncated while mapped, touching the pages
+ * beyond its new end raises SIGBUS.  That is why the ‘cache-mmap’
+ * option is off by default.
+ */
+int
+http_map_cache (http_cache_t *cache, int fd)
+{
+  http_cache_entry_t *entry = cache->entry;
+  void *buffer;
+
+  buffer = mmap (NULL, entry->size, PROT_READ, MAP_SHARED, fd, 0);
+  if (buffer == MAP_FAILED)
+    {
+      svz_log_sys_error ("cache: mmap");
+      return -1;
+    }
+
+  entry->buffer = buffer;
+  entry->mapped = 1;
+  entry->ready = 42;
+  http_cache_unused (entry);
+  cache->buffer = entry->buffer;
+  cache->size = entry->size;
+  return 0;
+}
+
+#else /* not (HAVE_MMAP && HAVE_SYS_MMAN_H) */
+
+int
+http_map_cache (UNUSED http_cache_t *cache, UNUSED int fd)
+{
+  return -1;
+}
+
+#endif /* not (HAVE_MMAP && HAVE_SYS_MMAN_H) */
+
+/*
+ * Lock the ready cache entry CACHE while sending it.  It cannot be
+ * deleted until released via ‘http_release_cache’.
  */
 void
-http_refresh_cache (http_cache_t *cache)
+http_use_cache (http_cache_entry_t *cache)
 {
-  svz_free_and_zero (cache->entry->buffer);
-  cache->entry->ready = 0;
-  cache->entry->hits = 0;
-  cache->entry->usage = 0;
-  cache->size = 0;
-  cache->buffer = NULL;
+  if (http_cache_unused_p (cache))
+    http_cache_used (cache);
+  cache->usage++;
 }
 
 /*
- * Send a complete cache entry to a http connection.
+ * Unlock the cache entry CACHE.  If nobody uses it any longer it can be
+ * deleted, and it is at once if it has been dropped from the cache.
  */
-int
-http_cache_write (svz_socket_t *sock)
+void
+http_release_cache (http_cache_entry_t *cache)
 {
-  int num_written;
-  int do_write;
-  http_socket_t *http;
-  http_cache_t *cache;
+  if (--cache->usage > 0)
+    return;
+  if (cache->orphan)
+    http_cache_destroy_entry (cache);
+  else
+    http_cache_unused (cache);
+}
 
-  /* get additional cache and http structures */
-  http = sock->data;
-  cache = http->cache;
-  assert (cache->entry);
+/*
+ * Drop the cache entry CACHE, e.g. because the file has changed on disk.
+ * If it is still in use, it is freed as soon as it is released.
+ */
+void
+http_drop_cache (http_cache_entry_t *cache)
+{
+  if (cache->usage || !cache->ready)
+    http_cache_orphan (cache);
+  else
+    http_cache_destroy_entry (cache);
+}
+
+/*
+ * Drop the cache entry of CACHE, and forget about it.
+ */
+void
+http_expire_cache (http_cache_t *cache)
+{
+  http_drop_cache (cache->entry);
+  http_cache_reset (cache);
+}
+
+/*
+ * Return the ready cache entry for FILE if it can be sent without
+ * looking at the file on disk, or NULL.  That is if the file is being
+ * watched for changes, or has been looked at within the last
+ * CACHE_RECHECK seconds otherwise.
+ */
+http_cache_entry_t *
+http_cache_fresh (char *file)
+{
+  http_cache_entry_t *cache;
+
+  if ((cache = svz_hash_get (http_cache, file)) == NULL || !cache->ready)
+    return NULL;
+  if (cache->watch || time (NULL) - cache->checked < CACHE_RECHECK)
+    return cache;
+  return NULL;
+}
+
+/*
+ * Return the entity header fields for sending the ready cache entry
+ * CACHE, its gzip encoded content if ZIPPED, with the content type TYPE,
+ * the content coding ENCODING (a static string, or NULL) and the "Vary"
+ * field if VARY.  Store their length in LEN.  They are built once, and
+ * again only if sent differently.
+ */
+char *
+http_cache_header (http_cache_entry_t *cache, int zipped, char *type,
+                   const char *encoding, int vary, int *len)
+{
+  http_cache_header_t *header = &cache->header[zipped ? 1 : 0];
+  char date[64];
+  int size;
+
+  if (header->fields == NULL || header->encoding != encoding
+      || header->vary != vary || strcmp (header->type, type))
+    {
+      if (header->fields)
+        {
+          svz_free (header->fields);
+          svz_free (header->type);
+        }
+      strcpy (date, http_asc_date (cache->date));
+      size = strlen (type) + strlen (date) + 160
+        + (encoding ? strlen (encoding) : 0);
+      header->fields = svz_malloc (size);
+      header->len = snprintf (header->fields, size,
+                              "Content-Type: %s\r\n"
+                              "%s%s%s"
+                              "%s"
+                              "Content-Length: %d\r\n"
+                              "Last-Modified: %s\r\n"
+                              "Accept-Ranges: bytes\r\n",
+                              type,
+                              encoding ? "Content-Encoding: " : "",
+                              encoding ? encoding : "",
+                              encoding ? "\r\n" : "",
+                              vary ? "Vary: Accept-Encoding\r\n" : "",
+                              zipped ? cache->gzip_size : cache->size,
+                              date);
+      header->type = svz_strdup (type);
+      header->encoding = encoding;
+      header->vary = vary;
+    }
+
+  *len = header->len;
+  return header->fields;
+}
+
+/*
+ * Compute the CRC-32 of the N bytes at P, as in the gzip trailer.
+ */
+static unsigned long
+http_crc32 (const unsigned char *p, size_t n)
+{
+  static unsigned long table[256];
+  unsigned long c;
+  int i, k;
+
+  if (table[1] == 0)
+    for (i = 0; i < 256; i++)
+      {
+        for (c = i, k = 0; k < 8; k++)
+          c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+        table[i] = c;
+      }
+
+  for (c = 0xffffffffUL; n > 0; n--, p++)
+    c = table[(c ^ *p) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffUL;
+}
 
-  do_write = cache->size;
-  if (do_write > (SVZ_SOCK_MAX_WRITE << 5))
-    do_write = (SVZ_SOCK_MAX_WRITE << 5);
-  num_written = send (sock->sock_desc, cache->buffer, do_write, 0);
+/*
+ * Store the 32 bit value X at P, least significant byte first.
+ */
+static void
+http_put32 (char *p, unsigned long x)
+{
+  p[0] = (char) (x & 0xff);
+  p[1] = (char) ((x >> 8) & 0xff);
+  p[2] = (char) ((x >> 16) & 0xff);
+  p[3] = (char) ((x >> 24) & 0xff);
+}
 
-  if (num_written > 0)
+/*
+ * Compress the content of the ready cache entry CACHE with the zlib
+ * codec and keep it as a gzip stream (RFC 1952) along with the entry.
+ * That is the zlib stream (RFC 1950) with another header and trailer.
+ * Return zero on success.
+ */
+static int
+http_cache_compress (http_cache_entry_t *cache)
+{
+  svz_codec_t *codec;
+  svz_codec_data_t data;
+  char *gzip;
+  int size, ret = SVZ_CODEC_ERROR;
+
+  if ((codec = svz_codec_get ("zlib", SVZ_CODEC_ENCODER)) == NULL)
+    return -1;
+
+  /* The output buffer is large enough for any input, so that the codec
+     never moves the rest of the input, which may be read only.  */
+  memset (&data, 0, sizeof (data));
+  data.codec = codec;
+  data.flag = SVZ_CODEC_INIT;
+  data.in_buffer = cache->buffer;
+  data.in_fill = data.in_size = cache->size;
+  data.out_size = cache->size + cache->size / 8 + cache->size / 64 + 64;
+  data.out_buffer = svz_malloc (data.out_size);
+  if (codec->init (&data) != SVZ_CODEC_ERROR)
     {
-      sock->last_send = time (NULL);
-      cache->buffer += num_written;
-      cache->size -= num_written;
-      http->length += num_written;
+      data.flag = SVZ_CODEC_FINISH;
+      ret = codec->code (&data);
     }
-  else if (num_written < 0)
+  codec->finalize (&data);
+
+  /* Not worth it unless it saves a little at least.  */
+  size = data.out_fill - 6 + 18;
+  if (ret != SVZ_CODEC_FINISHED || size >= cache->size - cache->size / 16)
     {
-      svz_log_net_error ("cache: send");
-      if (svz_wait_if_unavailable (sock, 1))
-        num_written = 0;
+      svz_free (data.out_buffer);
+      return -1;
     }
 
-  /*
-   * Check if the http cache has (success)fully been sent.
-   * If yes then return non-zero in order to shutdown the
-   * socket SOCK.
-   */
-  if (cache->size <= 0)
+  /* Magic, deflate, no flags, no time, no extra flags, unix.  */
+  gzip = svz_malloc (size);
+  memcpy (gzip, "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+  memcpy (gzip + 10, data.out_buffer + 2, data.out_fill - 6);
+  http_put32 (gzip + size - 8,
+              http_crc32 ((unsigned char *) cache->buffer, cache->size));
+  http_put32 (gzip + size - 4, (unsigned long) cache->size);
+  svz_free (data.out_buffer);
+
+  cache->gzip = gzip;
+  cache->gzip_size = size;
+  http_cache_bytes += size;
+  return 0;
+}
+
+/*
+ * Return the cache entry for FILE with a gzip encoded variant of its
+ * content, if the file has SIZE bytes and has been modified at DATE,
+ * or NULL.  The content is compressed once when the entry is looked up
+ * like this first, and kept within the cache from then on.
+ */
+http_cache_entry_t *
+http_gzip_cache (char *file, int size, time_t date)
+{
+  http_cache_entry_t *cache;
+
+  if ((cache = svz_hash_get (http_cache, file)) == NULL || !cache->ready
+      || cache->size != size || cache->date != date || cache->gzip_size < 0)
+    return NULL;
+
+  /* The entry must not go while making room for the variant.  */
+  if (cache->gzip == NULL)
     {
-#if ENABLE_DEBUG
-      svz_log (SVZ_LOG_DEBUG, "cache: file successfully sent\n");
-#endif
-      num_written = http_keep_alive (sock);
+      http_use_cache (cache);
+      if (http_cache_compress (cache) != 0)
+        cache->gzip_size = -1;
+      else if (http_cache_room (svz_hash_size (http_cache) + 1, 0) != 0)
+        {
+          http_cache_bytes -= cache->gzip_size;
+          svz_free_and_zero (cache->gzip);
+          cache->gzip_size = 0;
+        }
+      http_release_cache (cache);
+      if (cache->gzip == NULL)
+        return NULL;
     }
 
-  /*
-   * Return a non-zero value if an error occurred.
-   */
-  return (num_written < 0) ? -1 : 0;
+  http_urgent_cache (cache);
+  cache->stamp = ++http_cache_clock;
+  return cache;
+}
+
+/*
+ * The cache reader has finished the cache entry of CACHE.
+ */
+static void
+http_cache_ready (http_cache_t *cache)
+{
+  http_cache_entry_t *entry = cache->entry;
+
+  /* the file size may have changed since it has been reserved */
+  http_cache_bytes = http_cache_bytes - entry->size + cache->size;
+  entry->size = cache->size;
+  entry->buffer = cache->buffer;
+  entry->ready = 42;
+  http_cache_reset (cache);
+
+  if (entry->orphan)
+    http_cache_destroy_entry (entry);
+  else
+    http_cache_unused (entry);
 }
 
 /*
@@ -442,13 +806,15 @@ http_cache_read (svz_socket_t *sock)
   http = sock->data;
   cache = http->cache;
 
-  do_read = sock->send_buffer_size - sock->send_buffer_fill;
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_OUTBUF);
+  do_read = svz_sock_compact_send (sock);
 
   /*
-   * This means the send buffer is currently full, we have to
-   * wait until some data has been send via the socket.
+   * This means the send buffer is currently full, or there are
+   * responses queued behind it, we have to wait until some data
+   * has been send via the socket.
    */
-  if (do_read <= 0)
+  if (do_read <= 0 || sock->send_chain)
     {
       return 0;
     }
@@ -478,11 +844,9 @@ http_cache_read (svz_socket_t *sock)
 #endif
 
       /* release the actual cache entry previously reserved */
-      if (cache->size > 0)
-        {
-          svz_free (cache->buffer);
-          http_cache_reset (cache);
-        }
+      http_cache_destroy_entry (cache->entry);
+      svz_free (cache->buffer);
+      http_cache_reset (cache);
       return -1;
     }
 
@@ -506,10 +870,7 @@ http_cache_read (svz_socket_t *sock)
   /* Bogus file.  File size from ‘stat’ was not true.  */
   if (num_read == 0 && http->filelength != 0)
     {
-      cache->entry->size = cache->size;
-      cache->entry->buffer = cache->buffer;
-      cache->entry->ready = 42;
-      http_cache_reset (cache);
+      http_cache_ready (cache);
       return -1;
     }
 
@@ -522,10 +883,7 @@ http_cache_read (svz_socket_t *sock)
 #endif
 
       /* fill in the actual cache entry */
-      cache->entry->size = cache->size;
-      cache->entry->buffer = cache->buffer;
-      cache->entry->ready = 42;
-      http_cache_reset (cache);
+      http_cache_ready (cache);
 
       /* set flags and reassign default reader */
       sock->read_socket = svz_tcp_read_socket;
@@ -25,8 +25,24 @@
  * Some #defines.  These are just default values for configurable
  * variables.
  */
-#define MAX_CACHE          64       /* cache file entries */
-#define MAX_CACHE_SIZE     1024*200 /* maximum cache file size */
+#define MAX_CACHE          64           /* cache file entries */
+#define MAX_CACHE_SIZE     1024*200     /* maximum cache file size */
+#define MAX_CACHE_BYTES    1024*1024*16 /* maximum size of all files */
+#define CACHE_RECHECK      1            /* seconds between checks of files */
+
+/*
+ * The entity header fields of a cached file, built when it is sent with
+ * a content type, encoding and "Vary" field for the first time.
+ */
+typedef struct
+{
+  char *fields;             /* the header fields */
+  int len;                  /* their length */
+  char *type;               /* the content type ... */
+  const char *encoding;     /* ... content coding ... */
+  int vary;                 /* ... and "Vary" field they include */
+}
+http_cache_header_t;
 
 /*
  * This structure contains the info for a cached file.
@@ -36,6 +52,8 @@ struct http_cache_entry
 {
   http_cache_entry_t *next; /* next in list */
   http_cache_entry_t *prev; /* previous in list */
+  http_cache_entry_t *less; /* next unused entry, less recent */
+  http_cache_entry_t *more; /* previous unused entry, more recent */
   char *buffer;             /* pointer to cache buffer */
   int size;                 /* cache buffer size (size of file) */
   char *file;               /* actual filename */
@@ -43,6 +61,14 @@ struct http_cache_entry
   int usage;                /* how often this is currently used */
   int hits;                 /* cache hits */
   int ready;                /* this flag indicates if the entry is ok */
+  int mapped;               /* the buffer is the file mapped into memory */
+  int orphan;               /* dropped from the cache, but still in use */
+  unsigned long stamp;      /* value of the cache clock when last used */
+  time_t checked;           /* when the file has been looked at last */
+  char *gzip;               /* the gzip encoded content, if any */
+  int gzip_size;            /* its size, or -1 if not worth it */
+  struct http_watch *watch; /* watch on its directory, if any */
+  http_cache_header_t header[2]; /* header fields, for content and gzip */
 };
 
 /*
@@ -62,19 +88,29 @@ http_cache_t;
  */
 extern svz_hash_t *http_cache;
 extern size_t http_cache_entries;
+extern size_t http_cache_bytes;
+extern size_t http_cache_limit;
 extern http_cache_entry_t *http_cache_first;
 extern http_cache_entry_t *http_cache_last;
 
 /*
  * Basic http cache functions.
  */
-void http_alloc_cache (size_t entries);
+void http_alloc_cache (size_t entries, size_t bytes);
 void http_free_cache (void);
-void http_refresh_cache (http_cache_t *cache);
+void http_drop_cache (http_cache_entry_t *cache);
+void http_expire_cache (http_cache_t *cache);
+http_cache_entry_t *http_cache_fresh (char *file);
+http_cache_entry_t *http_gzip_cache (char *file, int size, time_t date);
 int http_cache_urgency (http_cache_entry_t *cache);
-int http_init_cache (char *file, http_cache_t *cache);
+char *http_cache_header (http_cache_entry_t *cache, int zipped, char *type,
+                         const char *encoding, int vary, int *len);
+int http_init_cache (char *file, http_cache_t *cache, size_t size,
+                     time_t date);
+int http_map_cache (http_cache_t *cache, int fd);
 int http_check_cache (char *file, http_cache_t *cache);
-int http_cache_write (svz_socket_t *sock);
+void http_use_cache (http_cache_entry_t *cache);
+void http_release_cache (http_cache_entry_t *cache);
 int http_cache_read (svz_socket_t *sock);
 int http_cache_disconnect (svz_socket_t *sock);
 
@@ -157,7 +157,7 @@ http_cgi_died (svz_socket_t *sock)
 #endif /* __MINGW32__ */
     }
 
-  sock->idle_counter = 1;
+  svz_sock_idle_arm (sock, 1000);
   return 0;
 }
 
@@ -174,9 +174,11 @@ http_cgi_read (svz_socket_t *sock)
   int num_read;
   http_socket_t *http = sock->data;
 
-  /* read as much space is left in the buffer */
-  do_read = sock->send_buffer_size - sock->send_buffer_fill;
-  if (do_read <= 0)
+  /* read as much space is left in the buffer, but not before the
+     responses queued behind it have been sent */
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_OUTBUF);
+  do_read = svz_sock_compact_send (sock);
+  if (do_read <= 0 || sock->send_chain)
     {
       return 0;
     }
@@ -293,13 +295,7 @@ http_cgi_write (svz_socket_t *sock)
        * Shuffle the data in the output buffer around, so that
        * new data can get stuffed into it.
        */
-      if (sock->recv_buffer_fill > num_written)
-        {
-          memmove (sock->recv_buffer,
-                   sock->recv_buffer + num_written,
-                   sock->recv_buffer_fill - num_written);
-        }
-      sock->recv_buffer_fill -= num_written;
+      svz_sock_reduce_recv (sock, num_written);
       http->contentlength -= num_written;
     }
 
@@ -401,20 +397,20 @@ cgi_create_envp (svz_socket_t *sock,  /* socket for this request */
   http = sock->data;
 
   /* convert some http request properties into environment variables */
-  if (http->property)
-    for (c = 0; env_var[c].property; c++)
-      {
-        char *prop = env_var[c].property;
-        size_t plen = strlen (prop);
-
-        for (n = 0; http->property[n]; n += 2)
-          if (!strncasecmp (http->property[n], prop, plen))
-            {
-              svz_envblock_add (env, "%s=%s",
-                                env_var[c].env, http->property[n + 1]);
-              break;
-            }
-      }
+  for (c = 0; env_var[c].property; c++)
+    {
+      char *prop = env_var[c].property;
+      int plen = strlen (prop);
+
+      for (n = 0; n < (unsigned) http->fields; n++)
+        if (http->field[n].nlen == plen
+            && !strncasecmp (http->head + http->field[n].name, prop, plen))
+          {
+            svz_envblock_add (env, "%s=%s", env_var[c].env,
+                              http->head + http->field[n].value);
+            break;
+          }
+    }
 
   /*
    * set up some more environment variables which might be
@@ -1044,7 +1040,7 @@ http_post_response (svz_socket_t *sock, char *request,
     }
 
   /* get the content length from the header information */
-  if ((length = http_find_property (http, "Content-length")) == NULL)
+  if ((length = http->known.content_length) == NULL)
     {
       svz_sock_printf (sock, HTTP_BAD_REQUEST "\r\n");
       http_error_response (sock, 411);
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
@@ -286,8 +287,8 @@ http_log (svz_socket_t *sock)
 
   if (cfg->log && http->request)
     {
-      referrer = http_find_property (http, "Referer");
-      agent = http_find_property (http, "User-Agent");
+      referrer = http->known.referrer;
+      agent = http->known.agent;
 
       /* access logging format given?  */
       if (cfg->logformat && *cfg->logformat)
@@ -379,6 +380,14 @@ http_log (svz_socket_t *sock)
     }
 }
 
+/*
+ * The header fields sent with each response, rebuilt once a second by
+ * ‘http_update_date’, and the time of their "Date" field.
+ */
+static char http_common[128];
+static int http_common_len = 0;
+static time_t http_common_date = 0;
+
 /*
  * Reset the current http header structure.
  */
@@ -387,6 +396,7 @@ http_reset_header (void)
 {
   http_header.code = 0;
   http_header.field[0] = '\0';
+  http_header.len = 0;
   http_header.response = NULL;
 }
 
@@ -397,14 +407,47 @@ void
 http_add_header (const char *fmt, ...)
 {
   va_list args;
-  int len = strlen (http_header.field);
-  char *p = http_header.field + len;
+  int len = http_header.len, n;
 
-  if (len >= HTTP_HEADER_SIZE)
+  if (len >= HTTP_HEADER_SIZE - 1)
     return;
   va_start (args, fmt);
-  vsnprintf (p, HTTP_HEADER_SIZE - len, fmt, args);
+  n = vsnprintf (http_header.field + len, HTTP_HEADER_SIZE - len, fmt, args);
   va_end (args);
+  if (n > 0)
+    http_header.len += (n < HTTP_HEADER_SIZE - len)
+      ? n : HTTP_HEADER_SIZE - len - 1;
+}
+
+/*
+ * Add the response header fields FIELD of length LEN, which are built
+ * already, to the current header.
+ */
+void
+http_put_header (const char *field, int len)
+{
+  if (len > HTTP_HEADER_SIZE - 1 - http_header.len)
+    len = HTTP_HEADER_SIZE - 1 - http_header.len;
+  memcpy (http_header.field + http_header.len, field, len);
+  http_header.len += len;
+  http_header.field[http_header.len] = '\0';
+}
+
+/*
+ * Rebuild the header fields sent with each response for the time T,
+ * unless done already.  This is called by the server timer once a
+ * second, so that sending a header needs no formatting.
+ */
+void
+http_update_date (time_t t)
+{
+  if (t == http_common_date && http_common_len)
+    return;
+  http_common_date = t;
+  http_common_len = snprintf (http_common, sizeof (http_common),
+                              "Date: %s\r\n"
+                              "Server: %s\r\n",
+                              http_asc_date (t), SERVER_STRING);
 }
 
 /*
@@ -415,19 +458,21 @@ http_send_header (svz_socket_t *sock)
 {
   int ret = 0;
 
+  if (http_common_len == 0)
+    http_update_date (time (NULL));
+
   /* send first part of header including response field and static texts */
-  ret = svz_sock_printf (sock,
-                         "%s"
-                         "Date: %s\r\n"
-                         "Server: %s\r\n",
-                         http_header.response,
-                         http_asc_date (time (NULL)),
-                         SERVER_STRING);
+  ret = svz_sock_write (sock, http_header.response,
+                        strlen (http_header.response));
+  if (ret)
+    return ret;
+  ret = svz_sock_write (sock, http_common, http_common_len);
   if (ret)
     return ret;
 
   /* send header fields and trailing line break */
-  ret = svz_sock_printf (sock, "%s\r\n", http_header.field);
+  http_put_header ("\r\n", 2);
+  ret = svz_sock_write (sock, http_header.field, http_header.len);
   if (ret)
     return ret;
 
@@ -628,6 +673,9 @@ http_error_response (svz_socket_t *sock, int response)
     }
   http->response = response;
 
+  /* the message ends with the connection */
+  sock->userflags &= ~HTTP_FLAG_KEEP;
+
   /* Send some standard error message.  */
   return svz_sock_printf (sock,
                           "<html><body bgcolor=white text=black><br>"
@@ -658,7 +706,7 @@ http_keep_alive (svz_socket_t *sock)
       sock->read_socket = svz_tcp_read_socket;
       sock->check_request = http_check_request;
       sock->write_socket = http_default_write;
-      sock->send_buffer_fill = 0;
+      svz_sock_release_buffers (sock);
       sock->idle_func = http_idle;
 #if ENABLE_DEBUG
       svz_log (SVZ_LOG_DEBUG, "http: keeping connection alive\n");
@@ -678,22 +726,51 @@ http_check_keepalive (svz_socket_t *sock)
   http_socket_t *http = sock->data;
   http_config_t *cfg = sock->cfg;
 
+  static const char closing[] = "Connection: close\r\n";
+  static char field[96];
+  static int len = 0, timeout, max;
+
   if ((sock->userflags & HTTP_FLAG_KEEP) && http->keepalive > 0)
     {
-      sock->idle_counter = cfg->timeout;
-      http_add_header ("Connection: Keep-Alive\r\n");
-      http_add_header ("Keep-Alive: timeout=%d, max=%d\r\n",
-                       sock->idle_counter, cfg->keepalive);
+      svz_sock_idle_arm (sock, cfg->timeout * 1000L);
+
+      /* build the fields only when the values differ from last time */
+      if (len == 0 || timeout != cfg->timeout || max != cfg->keepalive)
+        {
+          timeout = cfg->timeout;
+          max = cfg->keepalive;
+          len = snprintf (field, sizeof (field),
+                          "Connection: Keep-Alive\r\n"
+                          "Keep-Alive: timeout=%d, max=%d\r\n",
+                          timeout, max);
+        }
+      http_put_header (field, len);
       http->keepalive--;
     }
   /* tell HTTP/1.1 clients that the connection is closed after delivery */
   else
     {
       sock->userflags &= ~HTTP_FLAG_KEEP;
-      http_add_header ("Connection: close\r\n");
+      http_put_header (closing, sizeof (closing) - 1);
     }
 }
 
+/*
+ * Check if the connection in SOCK could be a Keep-Alive connection.
+ * HTTP/1.1 connections are unless the client says otherwise.
+ */
+void
+http_check_connection (svz_socket_t *sock)
+{
+  http_socket_t *http = sock->data;
+  char *p = http->known.connection;
+
+  if ((p && http_token_p (p, "Keep-Alive"))
+      || (!http->simple && http->minor >= 1
+          && !(p && http_token_p (p, "close"))))
+    sock->userflags |= HTTP_FLAG_KEEP;
+}
+
 /*
  * Create a date format used within the Common Log Format.  That is as
  * follows: [DD/MMM/YYYY:HH:MM:SS +ZZZZ]
@@ -797,90 +874,281 @@ http_parse_date (char *date)
 }
 
 /*
- * Parse part of the receive buffer for HTTP request properties
- * and store it in the socket structure SOCK.  Return the amount of
- * properties found in the request.
+ * The known header fields, and where they go in the ‘http_known_t’.
  */
-int
-http_parse_property (svz_socket_t *sock, char *request, char *end)
+#define KNOWN(name, member) \
+  { name, sizeof (name) - 1, offsetof (http_known_t, member) }
+
+static struct
 {
-  int properties, n;
-  char *p;
-  http_socket_t *http;
+  char *name;    /* field name */
+  int len;       /* its length */
+  size_t offset; /* offset of the member */
+}
+http_known_field[] =
+{
+  KNOWN ("Host", host),
+  KNOWN ("Range", range),
+  KNOWN ("Request-Range", range),
+  KNOWN ("Connection", connection),
+  KNOWN ("If-Modified-Since", modified_since),
+  KNOWN ("Accept-Encoding", accept_encoding),
+  KNOWN ("Content-Length", content_length),
+  KNOWN ("Referer", referrer),
+  KNOWN ("User-Agent", agent),
+  { NULL, 0, 0 }
+};
+
+#undef KNOWN
 
-  /* get the http socket structure */
-  http = sock->data;
+/*
+ * Return the index of the known header field with the name of LEN bytes
+ * at NAME, or -1 if it is not a known one.
+ */
+static int
+http_find_known (char *name, int len)
+{
+  int n;
 
-  /* reserve data space for the http properties */
-  http->property = svz_malloc (MAX_HTTP_PROPERTIES * 2 * sizeof (char *));
-  properties = 0;
-  n = 0;
+  for (n = 0; http_known_field[n].name; n++)
+    if (http_known_field[n].len == len
+        && !strncasecmp (http_known_field[n].name, name, len))
+      return n;
+  return -1;
+}
 
-  /* find out properties if necessary */
-  while (!EOL1_P (request) && properties < MAX_HTTP_PROPERTIES - 1)
+/*
+ * Parse the HTTP request head at the beginning of the receive buffer of
+ * socket SOCK, as far as it has been received.  The parser keeps its
+ * state within the http socket structure and goes on where it stopped
+ * when called again.  The request line and the header fields are kept
+ * as offsets into the receive buffer.  Return the length of the request
+ * head if it is complete, zero if not, or -1 if it is malformed.
+ */
+int
+http_parse_request (svz_socket_t *sock)
+{
+  http_socket_t *http = sock->data;
+  char *buf = sock->recv_buffer;
+  http_field_t *field;
+  int n, c;
+
+  for (n = http->scan; n < sock->recv_buffer_fill; n++)
     {
-      /* get property entity identifier */
-      p = request;
-      while (*p != ':' && p < end)
-        p++;
-      if (p == end)
-        break;
-      http->property[n] = svz_malloc (p - request + 1);
-      strncpy (http->property[n], request, p - request);
-      http->property[n][p - request] = 0;
-      n++;
-      request = p + 2;
-
-      /* get property entity body */
-      while (!EOL1_P (p) && p < end)
-        p++;
-      if (p == end || p <= request)
-        break;
-      http->property[n] = svz_malloc (p - request + 1);
-      strncpy (http->property[n], request, p - request);
-      http->property[n][p - request] = 0;
-      n++;
-      properties++;
-      request = p + 2;
-
-#if 0
-      printf ("http header: {%s} = {%s}\n",
-              http->property[n - 2], http->property[n - 1]);
-#endif
+      c = buf[n];
+      switch (http->state)
+        {
+          /* skip empty lines in front of the request */
+        case HTTP_PARSE_START:
+          if (c == '\r' || c == '\n')
+            break;
+          http->method = n;
+          http->simple = 0;
+          http->fields = 0;
+          http->state = HTTP_PARSE_METHOD;
+          break;
+
+        case HTTP_PARSE_METHOD:
+          if (c == ' ')
+            {
+              http->methodlen = n - http->method;
+              http->state = HTTP_PARSE_SLASH;
+            }
+          else if (c == '\r' || c == '\n')
+            return -1;
+          break;
+
+        case HTTP_PARSE_SLASH:
+          if (c != '/')
+            return -1;
+          http->uri = n;
+          http->state = HTTP_PARSE_URI;
+          break;
+
+          /* a request line without version is a HTTP/0.9 simple GET,
+             which has got no header fields */
+        case HTTP_PARSE_URI:
+          if (c == ' ')
+            {
+              http->urilen = n - http->uri;
+              http->version = n + 1;
+              http->state = HTTP_PARSE_VERSION;
+            }
+          else if (c == '\r' || c == '\n')
+            {
+              if (http->methodlen != 3
+                  || memcmp (buf + http->method, "GET", 3))
+                return -1;
+              http->urilen = n - http->uri;
+              http->simple = 1;
+              http->minor = 9;
+              http->state = HTTP_PARSE_HEAD_LF;
+              if (c == '\n')
+                goto done;
+            }
+          break;
+
+          /* only HTTP/1.0 and HTTP/1.1 are accepted */
+        case HTTP_PARSE_VERSION:
+          if (c == '\r' || c == '\n')
+            {
+              if (n - http->version != 8
+                  || memcmp (buf + http->version, "HTTP/", 5)
+                  || buf[http->version + 5] - '0' != HTTP_MAJOR_VERSION
+                  || buf[http->version + 6] != '.'
+                  || buf[http->version + 7] < '0'
+                  || buf[http->version + 7] > '1')
+                return -1;
+              http->minor = buf[http->version + 7] - '0';
+              http->state = (c == '\r') ? HTTP_PARSE_LINE_LF
+                : HTTP_PARSE_FIELD;
+            }
+          else if (n - http->version >= 8)
+            return -1;
+          break;
+
+        case HTTP_PARSE_LINE_LF:
+        case HTTP_PARSE_FIELD_LF:
+          if (c != '\n')
+            return -1;
+          http->state = HTTP_PARSE_FIELD;
+          break;
+
+          /* an empty line ends the request head */
+        case HTTP_PARSE_FIELD:
+          if (c == '\r')
+            http->state = HTTP_PARSE_HEAD_LF;
+          else if (c == '\n')
+            goto done;
+          else if (c == ' ' || c == '\t' || c == ':')
+            http->state = HTTP_PARSE_SKIP;
+          else
+            {
+              field = &http->field[http->fields];
+              field->name = n;
+              http->state = HTTP_PARSE_NAME;
+            }
+          break;
+
+          /* a field name is what comes before the colon */
+        case HTTP_PARSE_NAME:
+          if (c == ':')
+            {
+              field = &http->field[http->fields];
+              field->nlen = n - field->name;
+              field->value = n + 1;
+              http->state = HTTP_PARSE_SPACE;
+            }
+          else if (c == '\r' || c == '\n')
+            http->state = (c == '\r') ? HTTP_PARSE_FIELD_LF
+              : HTTP_PARSE_FIELD;
+          break;
+
+        case HTTP_PARSE_SPACE:
+          field = &http->field[http->fields];
+          if (c == ' ' || c == '\t')
+            {
+              field->value = n + 1;
+              break;
+            }
+          http->state = HTTP_PARSE_VALUE;
+          /* fallthrough */
+
+          /* the field is complete at the end of its line, but it is
+             kept only if there is room for it */
+        case HTTP_PARSE_VALUE:
+          if (c == '\r' || c == '\n')
+            {
+              field = &http->field[http->fields];
+              field->vlen = n - field->value;
+              while (field->vlen > 0
+                     && (buf[field->value + field->vlen - 1] == ' '
+                         || buf[field->value + field->vlen - 1] == '\t'))
+                field->vlen--;
+              field->known = http_find_known (buf + field->name,
+                                              field->nlen);
+              if (http->fields < MAX_HTTP_PROPERTIES - 1)
+                http->fields++;
+              http->state = (c == '\r') ? HTTP_PARSE_FIELD_LF
+                : HTTP_PARSE_FIELD;
+            }
+          break;
+
+          /* folded or otherwise malformed header lines are dropped */
+        case HTTP_PARSE_SKIP:
+          if (c == '\r' || c == '\n')
+            http->state = (c == '\r') ? HTTP_PARSE_FIELD_LF
+              : HTTP_PARSE_FIELD;
+          break;
+
+        case HTTP_PARSE_HEAD_LF:
+          if (c != '\n')
+            return -1;
+          goto done;
+        }
     }
 
-  request += 2;
-  http->property[n] = NULL;
+  /* come back when there is more */
+  http->scan = n;
+  return 0;
 
-  return properties;
+ done:
+  http->scan = 0;
+  http->state = HTTP_PARSE_START;
+  return n + 1;
 }
 
 /*
- * Find a given property entity in the HTTP request properties.
- * Return a NULL pointer if not found.
+ * Keep the request head of LEN bytes at the beginning of the receive
+ * buffer of socket SOCK, as parsed by ‘http_parse_request’, within the
+ * http socket structure, since the receive buffer is going to be used
+ * for the next request.  The buffer is reused for all requests on the
+ * connection.  Then set up the known header fields and the request
+ * string for logging, which has got the URI converted.
  */
-char *
-http_find_property (http_socket_t *http, char *key)
+void
+http_copy_request (svz_socket_t *sock, int len)
 {
-  int n;
-  size_t len;
-
-  /* check if there are any properties */
-  if (http->property == NULL)
-    return NULL;
+  http_socket_t *http = sock->data;
+  http_field_t *field;
+  char *head, *uri;
+  int n, size;
 
-  /* search through all the http properties */
-  n = 0;
-  len = strlen (key);
-  while (http->property[n])
+  /* room for the head and the request string behind it */
+  size = len + http->methodlen + http->urilen + 16;
+  if (size > http->headsize)
     {
-      if (!strncasecmp (http->property[n], key, len))
+      http->head = svz_realloc (http->head, size);
+      http->headsize = size;
+    }
+  head = http->head;
+  memcpy (head, sock->recv_buffer, len);
+
+  /* terminate all the strings */
+  head[http->method + http->methodlen] = '\0';
+  head[http->uri + http->urilen] = '\0';
+  memset (&http->known, 0, sizeof (http_known_t));
+  for (n = 0; n < http->fields; n++)
+    {
+      field = &http->field[n];
+      head[field->name + field->nlen] = '\0';
+      head[field->value + field->vlen] = '\0';
+      if (field->known != -1)
         {
-          return http->property[n + 1];
+          char **known = (char **) ((char *) &http->known
+                                    + http_known_field[field->known].offset);
+          if (*known == NULL)
+            *known = head + field->value;
         }
-      n += 2;
     }
-  return NULL;
+
+  /* convert URI if necessary */
+  uri = head + http->uri;
+  http_process_uri (uri);
+
+  http->request = head + len;
+  sprintf (http->request, "%s %s HTTP/%d.%d", head + http->method, uri,
+           http->simple ? 0 : HTTP_MAJOR_VERSION, http->minor);
 }
 
 #define ASC_TO_HEX(c)                             \
@@ -1024,6 +1292,83 @@ http_find_content_type (svz_socket_t *sock, char *file)
   return cfg->default_type;
 }
 
+/*
+ * Return non-zero if the client of the http connection HTTP accepts the
+ * content coding CODING according to the "Accept-Encoding" property of
+ * its request, i.e. if it lists CODING or "*" with a non-zero quality
+ * value.  The coding named explicitly overrides the asterisk.
+ */
+int
+http_accept_encoding (http_socket_t *http, const char *coding)
+{
+  char *p, *end, *q;
+  size_t len, n = strlen (coding);
+  int any = 0, found = -1, ok;
+
+  if ((p = http->known.accept_encoding) == NULL)
+    return 0;
+
+  while (*p)
+    {
+      while (*p == ' ' || *p == '\t' || *p == ',')
+        p++;
+      end = p;
+      while (*end && *end != ',' && *end != ';'
+             && *end != ' ' && *end != '\t')
+        end++;
+      len = end - p;
+
+      /* a quality value of zero means "not acceptable" */
+      ok = 1;
+      for (q = end; *q && *q != ','; q++)
+        if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=')
+          ok = (strtod (q + 2, NULL) > 0);
+
+      if (len == n && !strncasecmp (p, coding, n))
+        found = ok;
+      else if (len == 1 && *p == '*')
+        any = ok;
+      p = q;
+    }
+  return found != -1 ? found : any;
+}
+
+/*
+ * Return non-zero if the comma separated list LIST, e.g. the value of a
+ * "Connection" header field, contains TOKEN in any case.
+ */
+int
+http_token_p (const char *list, const char *token)
+{
+  size_t n = strlen (token);
+
+  while (*list)
+    {
+      while (*list == ' ' || *list == '\t' || *list == ',')
+        list++;
+      if (!strncasecmp (list, token, n)
+          && (list[n] == '\0' || list[n] == ',' || list[n] == ' '
+              || list[n] == '\t' || list[n] == ';'))
+        return 1;
+      while (*list && *list != ',')
+        list++;
+    }
+  return 0;
+}
+
+/*
+ * Return non-zero if content of the given content TYPE is worth being
+ * compressed, i.e. if it is some kind of text.
+ */
+int
+http_compressible_type (const char *type)
+{
+  return (!strncasecmp (type, "text/", 5)
+          || strstr (type, "javascript") != NULL
+          || strstr (type, "json") != NULL
+          || strstr (type, "xml") != NULL);
+}
+
 /*
  * This routine converts a relative file/path name into an
  * absolute file/path name.  The given argument will be reallocated
@@ -29,6 +29,7 @@
 #define HTTP_REQUESTS       8          /* number of known request types */
 #define HTTP_TIMEOUT        15         /* default timeout value */
 #define HTTP_MAXKEEPALIVE   10         /* number of requests per connection */
+#define HTTP_PIPELINE       8          /* responses queued at once */
 #define HTTP_HEADER_SIZE    (1 * 1024) /* maximum header size */
 
 #define STANDARD_EOL  "\r\n\r\n"
@@ -50,6 +51,7 @@ typedef struct
   char *response;               /* text representation of response */
   int code;                     /* response code */
   char field[HTTP_HEADER_SIZE]; /* holds header fields */
+  int len;                      /* their length */
 }
 http_header_t;
 
@@ -65,6 +67,52 @@ typedef struct
 }
 http_range_t;
 
+/*
+ * A header field of a request, given as offsets and lengths of its name
+ * and value within the request head.
+ */
+typedef struct
+{
+  int name;     /* offset of the field name */
+  int nlen;     /* its length */
+  int value;    /* offset of the field value */
+  int vlen;     /* its length */
+  int known;    /* index of the field if it is a known one, or -1 */
+}
+http_field_t;
+
+/*
+ * The header fields of a request the server looks at itself.  They point
+ * into the copy of the request head, and are NULL if missing.
+ */
+typedef struct
+{
+  char *host;            /* "Host" */
+  char *range;           /* "Range" or "Request-Range" */
+  char *connection;      /* "Connection" */
+  char *modified_since;  /* "If-Modified-Since" */
+  char *accept_encoding; /* "Accept-Encoding" */
+  char *content_length;  /* "Content-Length" */
+  char *referrer;        /* "Referer" */
+  char *agent;           /* "User-Agent" */
+}
+http_known_t;
+
+/* States of the request parser.  */
+#define HTTP_PARSE_START    0 /* before the request line */
+#define HTTP_PARSE_METHOD   1 /* within the request method */
+#define HTTP_PARSE_SLASH    2 /* at the beginning of the URI */
+#define HTTP_PARSE_URI      3 /* within the URI */
+#define HTTP_PARSE_VERSION  4 /* within the HTTP version */
+#define HTTP_PARSE_LINE_LF  5 /* at the end of the request line */
+#define HTTP_PARSE_FIELD    6 /* at the beginning of a header line */
+#define HTTP_PARSE_NAME     7 /* within a field name */
+#define HTTP_PARSE_SPACE    8 /* in front of a field value */
+#define HTTP_PARSE_VALUE    9 /* within a field value */
+#define HTTP_PARSE_FIELD_LF 10 /* at the end of a header line */
+#define HTTP_PARSE_HEAD_LF  11 /* at the end of the request head */
+#define HTTP_PARSE_SKIP     12 /* within a malformed header line */
+
 /*
  * This structure is used to process a http connection.  It will be stored
  * within the original socket structure (sock->data).
@@ -74,7 +122,23 @@ typedef struct http_socket http_socket_t;
 struct http_socket
 {
   http_cache_t *cache;   /* a http file cache structure */
-  char **property;       /* property list of a http request */
+  struct http_fd *desc;  /* the file kept open, if sent from there */
+  int state;             /* request parser state */
+  int scan;              /* receive buffer bytes parsed so far */
+  int method;            /* offset of the request method */
+  int methodlen;         /* its length */
+  int uri;               /* offset of the request URI */
+  int urilen;            /* its length */
+  int version;           /* offset of the HTTP version */
+  int minor;             /* minor HTTP version */
+  int simple;            /* HTTP/0.9 simple request */
+  http_field_t field[MAX_HTTP_PROPERTIES]; /* header fields */
+  int fields;            /* number of header fields */
+  http_known_t known;    /* known header fields */
+  char *head;            /* copy of the request head */
+  int headsize;          /* its buffer size */
+  int pipelined;         /* responses queued since all output was sent */
+  int busy;              /* handling requests */
   size_t contentlength;     /* the content length for the cgi pipe */
   int filelength;        /* content length for the http file */
   int keepalive;         /* how many requests left for a connection */
@@ -118,6 +182,7 @@ struct http_socket
 #define HTTP_FLAG_KEEP     0x0040 /* keep alive connection */
 #define HTTP_FLAG_SENDFILE 0x0080 /* use sendfile for HTTP requests */
 #define HTTP_FLAG_PARTIAL  0x0100 /* partial content requested */
+#define HTTP_FLAG_DIRLIST  0x0200 /* waiting for a directory listing */
 
 /* all of the additional http flags */
 #define HTTP_FLAG (HTTP_FLAG_DONE      | \
@@ -126,17 +191,22 @@ struct http_socket
                    HTTP_FLAG_CACHE     | \
                    HTTP_FLAG_KEEP      | \
                    HTTP_FLAG_SENDFILE  | \
-                   HTTP_FLAG_PARTIAL)
+                   HTTP_FLAG_PARTIAL   | \
+                   HTTP_FLAG_DIRLIST)
 
 /* exported http core functions */
 int http_keep_alive (svz_socket_t *sock);
 void http_check_keepalive (svz_socket_t *sock);
+void http_check_connection (svz_socket_t *sock);
 
 int http_read_types (http_config_t *cfg);
 char *http_find_content_type (svz_socket_t *sock, char *file);
+int http_accept_encoding (http_socket_t *http, const char *coding);
+int http_token_p (const char *list, const char *token);
+int http_compressible_type (const char *type);
 
-int http_parse_property (svz_socket_t *sock, char *request, char *end);
-char *http_find_property (http_socket_t *sock, char *key);
+int http_parse_request (svz_socket_t *sock);
+void http_copy_request (svz_socket_t *sock, int len);
 
 int http_check_range (http_range_t *range, off_t filesize);
 int http_get_range (char *line, http_range_t *range);
@@ -150,11 +220,13 @@ void http_log (svz_socket_t *sock);
 time_t http_parse_date (char *date);
 char *http_asc_date (time_t t);
 char *http_clf_date (time_t t);
+void http_update_date (time_t t);
 
 void http_set_header (char *response);
 int http_send_header (svz_socket_t *sock);
 void http_reset_header (void);
 void http_add_header (const char *fmt, ...);
+void http_put_header (const char *field, int len);
 
 #ifdef __MINGW32__
 void http_start_netapi (void);
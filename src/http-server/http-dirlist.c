@@ -56,6 +56,7 @@
 # include <unistd.h>
 #endif
 
+#include "o-binary.h"
 #include "networking-headers.h"
 #ifdef __MINGW32__
 # include <windows.h>
@@ -82,8 +83,29 @@
 extern int alphasort (const struct dirent **, const struct dirent **);
 #endif
 
-/* Size of last buffer allocated.  */
-int http_dirlist_size = 0;
+/*
+ * Directory listings are built by a coserver into files of their own in
+ * a private temporary directory, and sent from there via sendfile(2).
+ * A listing is sent again as long as its directory has not changed, and
+ * is rebuilt at the latest after DIRLIST_RECHECK seconds, since the
+ * files in the directory may have.  The connections requesting a
+ * listing while it is built wait for it.
+ */
+
+static char *dirlist_dir = NULL;         /* the temporary directory */
+static int dirlist_type = -1;            /* the coserver type */
+static svz_hash_t *dirlist_cache = NULL; /* the listings by key */
+static http_listing_t *dirlist_first = NULL; /* least recent listing */
+static http_listing_t *dirlist_last = NULL;  /* most recent listing */
+
+/* A connection waiting for a listing.  */
+typedef struct
+{
+  int id;               /* the connection's id ... */
+  int version;          /* ... and version */
+  int flags;            /* the flags of its request */
+}
+dirlist_wait_t;
 
 /*
  * Convert a given filename to an appropriate http request URI.
@@ -119,22 +141,15 @@ http_create_uri (char *file)
 }
 
 /*
- * Return a buffer to a http directory listing referring to DIRNAME
- * and being part of the document root DOCROOT.  Do not to forget to
- * ‘svz_free’ the return buffer.  Return NULL on errors.
+ * Write the listing of the directory DIRNAME with the title TITLE to the
+ * stream F.  Return zero on success, non-zero otherwise.
  */
-char *
-http_dirlist (char *dirname, char *docroot, char *userdir)
+static int
+http_dirlist_write (FILE *f, char *dirname, char *title)
 {
-  char *dirdata = NULL;
-  int datasize = 0;
-  char *relpath = NULL;
-  int i = 0;
   struct stat buf;
   char filename[DIRLIST_SPACE_NAME];
-  char entrystr[DIRLIST_SPACE_ENTRY];
   char *timestr = NULL;
-  char postamble[DIRLIST_SPACE_POST];
   int files = 0;
 #if HAVE_SORTED_LIST
   struct dirent **dir;
@@ -147,19 +162,6 @@ http_dirlist (char *dirname, char *docroot, char *userdir)
   HANDLE dir;
 #endif
 
-  /* Initialize data fields */
-  memset (filename, 0, DIRLIST_SPACE_NAME);
-  memset (entrystr, 0, DIRLIST_SPACE_ENTRY);
-  memset (postamble, 0, DIRLIST_SPACE_POST);
-
-  /* Remove trailing slash of dirname */
-  if (strlen (dirname) != 1 &&
-      (dirname[strlen (dirname) - 1] == '/' ||
-       dirname[strlen (dirname) - 1] == '\\'))
-    {
-      dirname[strlen (dirname) - 1] = 0;
-    }
-
   /* Open the directory */
 #if HAVE_SORTED_LIST
   if ((files = scandir (dirname, &dir, 0, alphasort)) == -1)
@@ -176,43 +178,18 @@ http_dirlist (char *dirname, char *docroot, char *userdir)
   if ((dir = opendir (dirname)) == NULL)
 #endif
     {
-      return NULL;
+      return -1;
     }
 
-  dirdata = svz_malloc (DIRLIST_SPACE);
-  datasize = DIRLIST_SPACE;
-
-  /* Calculate relative path */
-  if (!userdir)
-    {
-      i = 0;
-      while (dirname[i] == docroot[i] && docroot[i] != 0)
-        i++;
-      relpath = &dirname[i];
-      if (!strcmp (relpath, "/"))
-        {
-          relpath++;
-          dirname++;
-        }
-    }
-  else
-    relpath = userdir + 1;
-
   /* Output preamble */
-  while (-1 == snprintf (dirdata, datasize,
-                         "%sContent-Type: text/html\r\n\r\n"
-                         "<html><head>\n"
-                         "<title>Directory listing of %s%s</title></head>"
-                         "\n<body bgcolor=white text=black link=blue>\n"
-                         "<h1>Directory listing of %s%s</h1>\n"
-                         "<hr noshade>\n"
-                         "<pre>\n",
-                         HTTP_OK, relpath, userdir ? "" : "/",
-                         relpath, userdir ? "" : "/"))
-    {
-      dirdata = svz_realloc (dirdata, datasize + DIRLIST_SPACE_GROW);
-      datasize += DIRLIST_SPACE_GROW;
-    }
+  fprintf (f,
+           "<html><head>\n"
+           "<title>Directory listing of %s</title></head>"
+           "\n<body bgcolor=white text=black link=blue>\n"
+           "<h1>Directory listing of %s</h1>\n"
+           "<hr noshade>\n"
+           "<pre>\n",
+           title, title);
 
   /* Iterate directory */
 #if HAVE_SORTED_LIST
@@ -231,9 +208,8 @@ http_dirlist (char *dirname, char *docroot, char *userdir)
       if (-1 == stat (filename, &buf))
         {
           /* Something is wrong with this file...  */
-          snprintf (entrystr, DIRLIST_SPACE_ENTRY - 1,
-                    "<font color=red>%s -- %s</font>\n",
-                    FILENAME, svz_sys_strerror ());
+          fprintf (f, "<font color=red>%s -- %s</font>\n",
+                   FILENAME, svz_sys_strerror ());
         }
       else
         {
@@ -254,57 +230,41 @@ http_dirlist (char *dirname, char *docroot, char *userdir)
           if (S_ISDIR (buf.st_mode))
             {
               /* This is a directory...  */
-              snprintf (entrystr, DIRLIST_SPACE_ENTRY - 1,
-                        "<img border=0 src=internal-gopher-menu> "
-                        "<a href=\"%s/\">%-40s</a> "
-                        "&lt;directory&gt; "
-                        "%s\n",
-                        http_create_uri (FILENAME), FILENAME, timestr);
+              fprintf (f,
+                       "<img border=0 src=internal-gopher-menu> "
+                       "<a href=\"%s/\">%-40s</a> "
+                       "&lt;directory&gt; "
+                       "%s\n",
+                       http_create_uri (FILENAME), FILENAME, timestr);
             }
           else
             {
               /* Let's treat this as a normal file */
-              snprintf (entrystr, DIRLIST_SPACE_ENTRY - 1,
-                        "<img border=0 src=internal-gopher-text> "
-                        "<a href=\"%s\">%-40s</a> "
-                        "<b>%11d</b> "
-                        "%s\n",
-                        http_create_uri (FILENAME),
-                        FILENAME, (int) buf.st_size, timestr);
+              fprintf (f,
+                       "<img border=0 src=internal-gopher-text> "
+                       "<a href=\"%s\">%-40s</a> "
+                       "<b>%11d</b> "
+                       "%s\n",
+                       http_create_uri (FILENAME),
+                       FILENAME, (int) buf.st_size, timestr);
             }
         }
 
       /* increase file counter unless this list is sorted */
 #if !HAVE_SORTED_LIST
       files++;
+#else
+      free (dir[n]);
 #endif
-
-      /* Append this entry's data to output buffer */
-      while (datasize - strlen (dirdata) < strlen (entrystr) + 1)
-        {
-          dirdata = svz_realloc (dirdata, datasize + DIRLIST_SPACE_GROW);
-          datasize += DIRLIST_SPACE_GROW;
-        }
-      strcat (dirdata, entrystr);
     }
 #ifdef __MINGW32__
   while (FindNextFile (dir, &de));
 #endif
 
   /* Output postamble */
-  snprintf (postamble, DIRLIST_SPACE_POST - 1,
-            "\n</pre><hr noshade>\n"
-            "%d entries\n</body>\n</html>", files);
-
-  if (datasize - strlen (dirdata) < strlen (postamble) + 1)
-    {
-      dirdata = svz_realloc (dirdata, datasize + strlen (postamble) + 1);
-      datasize += strlen (postamble) + 1;
-    }
-  strcat (dirdata, postamble);
-
-  /* Remember buffer size for caller */
-  http_dirlist_size = datasize;
+  fprintf (f,
+           "\n</pre><hr noshade>\n"
+           "%d entries\n</body>\n</html>", files);
 
   /* Close the directory */
 #if HAVE_SORTED_LIST
@@ -313,5 +273,422 @@ http_dirlist (char *dirname, char *docroot, char *userdir)
   closedir (dir);
 #endif
 
-  return dirdata;
+  return ferror (f);
+}
+
+/*
+ * Split the KEY of a listing into the directory name, returned, and the
+ * title, stored in TITLE.  The key is modified.
+ */
+static char *
+dirlist_split (char *key, char **title)
+{
+  char *dirname;
+  long len = strtol (key, &dirname, 10);
+
+  dirname++;
+  *title = dirname + len;
+  memmove (dirname - 1, dirname, len);
+  dirname[len - 1] = '\0';
+  return dirname - 1;
+}
+
+/*
+ * The routine of the coserver building directory listings: write the
+ * listing of the REQUEST, a listing key, to a new file in the directory
+ * DIR.  Return "SIZE:FILE", or NULL on errors.
+ */
+static char *
+dirlist_build (char *request, void *dir)
+{
+  static char result[DIRLIST_SPACE_NAME + 32];
+  char file[DIRLIST_SPACE_NAME];
+  char *dirname, *title;
+  FILE *f;
+  int fd, failed;
+  long size;
+
+  dirname = dirlist_split (request, &title);
+  snprintf (file, sizeof (file), "%s/XXXXXX", (char *) dir);
+  if ((fd = mkstemp (file)) == -1)
+    return NULL;
+  if ((f = fdopen (fd, "w")) == NULL)
+    {
+      close (fd);
+      unlink (file);
+      return NULL;
+    }
+
+  failed = http_dirlist_write (f, dirname, title);
+  size = ftell (f);
+  if (fclose (f) != 0 || failed || size < 0)
+    {
+      unlink (file);
+      return NULL;
+    }
+
+  snprintf (result, sizeof (result), "%ld:%s", size, file);
+  return result;
+}
+
+/*
+ * Send the listing of SIZE bytes in the file FD to the connection SOCK
+ * which has made a request with FLAGS.
+ */
+static void
+dirlist_send (svz_socket_t *sock, int fd, off_t size, int flags)
+{
+  http_socket_t *http = sock->data;
+
+  http->response = 200;
+  if (!(flags & HTTP_FLAG_SIMPLE))
+    {
+      http_reset_header ();
+      http_set_header (HTTP_OK);
+      http_add_header ("Content-Type: text/html\r\n");
+      http_add_header ("Content-Length: %ld\r\n", (long) size);
+      http_check_keepalive (sock);
+      http_send_header (sock);
+    }
+
+  /* just the header for a HEAD request */
+  if (flags & HTTP_FLAG_NOFILE)
+    {
+      svz_close (fd);
+      sock->userflags |= HTTP_FLAG_DONE;
+      return;
+    }
+
+  sock->file_desc = fd;
+  http->filelength = size;
+  http->fileoffset = 0;
+  http_stream_file (sock);
+}
+
+/*
+ * Tell the connection SOCK that the directory listing cannot be sent.
+ */
+static void
+dirlist_error (svz_socket_t *sock)
+{
+  svz_sock_printf (sock, HTTP_FILE_NOT_FOUND "\r\n");
+  http_error_response (sock, 404);
+  sock->userflags |= HTTP_FLAG_DONE;
+}
+
+/*
+ * Forget the listing LISTING, and delete its file.
+ */
+static void
+dirlist_drop (http_listing_t *listing)
+{
+  svz_hash_delete (dirlist_cache, listing->key);
+  if (listing->prev)
+    listing->prev->next = listing->next;
+  else
+    dirlist_first = listing->next;
+  if (listing->next)
+    listing->next->prev = listing->prev;
+  else
+    dirlist_last = listing->prev;
+
+  if (listing->file)
+    {
+      unlink (listing->file);
+      svz_free (listing->file);
+    }
+  svz_array_destroy (listing->waiting);
+  svz_free (listing->key);
+  svz_free (listing);
+}
+
+/*
+ * The RESULT of the coserver building the listing with the key KEY.
+ * Send it to the connections waiting for it.
+ */
+static int
+dirlist_done (char *result, void *key)
+{
+  http_listing_t *listing = svz_hash_get (dirlist_cache, key);
+  svz_array_t *waiting;
+  dirlist_wait_t *w;
+  svz_socket_t *sock;
+  char *file = NULL;
+  long size = 0;
+  size_t n;
+  int fd;
+
+  svz_free (key);
+  if (result)
+    {
+      size = strtol (result, &file, 10);
+      file++;
+    }
+
+  /* nobody is waiting for it any longer */
+  if (listing == NULL || listing->file)
+    {
+      if (file)
+        unlink (file);
+      return 0;
+    }
+
+  waiting = listing->waiting;
+  listing->waiting = NULL;
+  if (file)
+    {
+      listing->file = svz_strdup (file);
+      listing->size = size;
+      listing->made = time (NULL);
+    }
+  else
+    {
+      svz_log (SVZ_LOG_ERROR, "http: dirlist failed: %s\n", listing->key);
+      dirlist_drop (listing);
+    }
+
+  svz_array_foreach (waiting, w, n)
+    {
+      if ((sock = svz_sock_find (w->id, w->version)) == NULL
+          || !(sock->userflags & HTTP_FLAG_DIRLIST))
+        continue;
+      sock->userflags &= ~HTTP_FLAG_DIRLIST;
+      if (file && (fd = svz_open (file, O_RDONLY | O_BINARY, 0)) != -1)
+        dirlist_send (sock, fd, size, w->flags);
+      else
+        dirlist_error (sock);
+    }
+  svz_array_destroy (waiting);
+  return 0;
+}
+
+/*
+ * Build the listing with the key KEY at once into an anonymous file, and
+ * send it to the connection SOCK which has made a request with FLAGS.
+ * Return zero on success.
+ */
+static int
+dirlist_now (svz_socket_t *sock, char *key, int flags)
+{
+  char *dirname, *title;
+  FILE *f;
+  long size;
+  int fd;
+
+  if ((f = tmpfile ()) == NULL)
+    return -1;
+  dirname = dirlist_split (key, &title);
+  if (http_dirlist_write (f, dirname, title) || fflush (f)
+      || (size = ftell (f)) < 0 || (fd = dup (fileno (f))) == -1)
+    {
+      fclose (f);
+      return -1;
+    }
+  fclose (f);
+  lseek (fd, 0, SEEK_SET);
+  dirlist_send (sock, fd, size, flags);
+  return 0;
+}
+
+/*
+ * Respond to the connection SOCK, which has made a request with FLAGS,
+ * with the listing of the directory DIRNAME in the document root
+ * DOCROOT, or in the user directory USERDIR.  The trailing slash of
+ * DIRNAME is removed (not if it is '/' though).  The listing is sent
+ * from the cache, or the connection waits for it to be built.  Return
+ * zero on success, non-zero if there is no such directory.
+ */
+int
+http_dirlist (svz_socket_t *sock, char *dirname, char *docroot,
+              char *userdir, int flags)
+{
+  http_listing_t *listing;
+  dirlist_wait_t *w;
+  struct stat buf;
+  char *relpath, *key, *result;
+  time_t now = time (NULL);
+  int i, fd;
+
+  /* Remove trailing slash of dirname */
+  if (strlen (dirname) != 1 &&
+      (dirname[strlen (dirname) - 1] == '/' ||
+       dirname[strlen (dirname) - 1] == '\\'))
+    {
+      dirname[strlen (dirname) - 1] = 0;
+    }
+
+  /* Calculate relative path */
+  if (!userdir)
+    {
+      i = 0;
+      while (dirname[i] == docroot[i] && docroot[i] != 0)
+        i++;
+      relpath = &dirname[i];
+      if (!strcmp (relpath, "/"))
+        relpath++;
+    }
+  else
+    relpath = userdir + 1;
+
+  if (stat (dirname, &buf) == -1)
+    return -1;
+  if (!S_ISDIR (buf.st_mode))
+    {
+      errno = ENOTDIR;
+      return -1;
+    }
+  http_check_connection (sock);
+
+  /* the key of the listing: the directory name and the title */
+  key = svz_malloc (strlen (dirname) + strlen (relpath) + 24);
+  sprintf (key, "%d:%s%s%s", (int) strlen (dirname), dirname,
+           relpath, userdir ? "" : "/");
+  if (dirlist_cache == NULL)
+    {
+      i = dirlist_now (sock, key, flags);
+      svz_free (key);
+      return i;
+    }
+
+  /* send a listing built before unless the directory has changed */
+  if ((listing = svz_hash_get (dirlist_cache, key)) != NULL
+      && listing->file)
+    {
+      if (listing->mtime == buf.st_mtime
+          && now - listing->made < DIRLIST_RECHECK
+          && (fd = svz_open (listing->file, O_RDONLY | O_BINARY, 0)) != -1)
+        {
+          dirlist_send (sock, fd, listing->size, flags);
+          svz_free (key);
+          return 0;
+        }
+      dirlist_drop (listing);
+      listing = NULL;
+    }
+
+  /* wait for the listing */
+  w = svz_malloc (sizeof (dirlist_wait_t));
+  w->id = sock->id;
+  w->version = sock->version;
+  w->flags = flags;
+  sock->userflags |= HTTP_FLAG_DIRLIST;
+  if (listing)
+    {
+      svz_array_add (listing->waiting, w);
+      svz_free (key);
+      return 0;
+    }
+
+  /* make room for a new one, not dropping those being built */
+  if (svz_hash_size (dirlist_cache) >= DIRLIST_CACHE)
+    for (listing = dirlist_first; listing; listing = listing->next)
+      if (listing->file)
+        {
+          dirlist_drop (listing);
+          break;
+        }
+
+  listing = svz_calloc (sizeof (http_listing_t));
+  listing->key = key;
+  listing->mtime = buf.st_mtime;
+  listing->waiting = svz_array_create (1, svz_free);
+  svz_array_add (listing->waiting, w);
+  svz_hash_put (dirlist_cache, key, listing);
+  if ((listing->prev = dirlist_last) != NULL)
+    dirlist_last->next = listing;
+  else
+    dirlist_first = listing;
+  dirlist_last = listing;
+
+  /* let the coserver build it, or do so right here */
+  key = svz_strdup (listing->key);
+  if (svz_coserver_invoke (dirlist_type, key, dirlist_done, key))
+    {
+      relpath = svz_strdup (key);
+      result = dirlist_build (relpath, dirlist_dir);
+      svz_free (relpath);
+      dirlist_done (result, key);
+    }
+  return 0;
+}
+
+/*
+ * Create the temporary directory for the directory listings, and
+ * register the coserver building them, unless done before.  Return
+ * zero on success; otherwise the listings are built at once in the
+ * server loop and not cached.
+ */
+int
+http_dirlist_init (void)
+{
+#if HAVE_MKDTEMP
+  const char *tmp = getenv ("TMPDIR");
+  char *dir;
+
+  if (dirlist_cache != NULL)
+    return 0;
+  if (tmp == NULL || *tmp == '\0')
+    tmp = "/tmp";
+  dir = svz_malloc (strlen (tmp) + 32);
+  sprintf (dir, "%s/serveez-dirlist.XXXXXX", tmp);
+  if (mkdtemp (dir) == NULL)
+    {
+      svz_log_sys_error ("http: mkdtemp (%s)", dir);
+      svz_free (dir);
+      return -1;
+    }
+
+  /* the listings are built by a coserver process, since building them
+     is not reentrant */
+  dirlist_type = svz_coserver_register ("dirlist", dirlist_build,
+                                        dir, 1, SVZ_COSERVER_PROCESS);
+  if (dirlist_type == -1)
+    {
+      rmdir (dir);
+      svz_free (dir);
+      return -1;
+    }
+  dirlist_dir = dir;
+  dirlist_cache = svz_hash_create (DIRLIST_CACHE, NULL);
+  return 0;
+#else /* !HAVE_MKDTEMP */
+  return -1;
+#endif /* !HAVE_MKDTEMP */
+}
+
+/*
+ * Delete the directory listings, and their temporary directory.
+ */
+void
+http_dirlist_finalize (void)
+{
+#if HAVE_MKDTEMP
+  char file[DIRLIST_SPACE_NAME];
+  struct dirent *de;
+  DIR *dir;
+
+  while (dirlist_first)
+    dirlist_drop (dirlist_first);
+  svz_hash_destroy (dirlist_cache);
+  dirlist_cache = NULL;
+  if (dirlist_dir == NULL)
+    return;
+
+  /* the listings not delivered by the coserver are left over */
+  if ((dir = opendir (dirlist_dir)) != NULL)
+    {
+      while ((de = readdir (dir)) != NULL)
+        if (de->d_name[0] != '.')
+          {
+            snprintf (file, sizeof (file), "%s/%s", dirlist_dir, de->d_name);
+            unlink (file);
+          }
+      closedir (dir);
+    }
+  if (rmdir (dirlist_dir) == -1)
+    svz_log_sys_error ("http: rmdir (%s)", dirlist_dir);
+  svz_free (dirlist_dir);
+  dirlist_dir = NULL;
+  dirlist_type = -1;
+#endif /* HAVE_MKDTEMP */
 }
@@ -22,28 +22,33 @@
 #define __HTTP_DIRlIST_H__
 
 /*
- * Create a directory listing of the directory given as dirname.  If the
- * name contains a trailing slash it is removed (not if it is '/' though).
- * docroot is a document root.  The output suppresses this part of
- * the directory name.
- * The return value is a string containing a directory listing in some
- * hard coded way.  The global variable http_dirlist_size is set
- * to the actual size of this buffer (for debugging/memory counting).
- * If NULL is returned, something was wrong with the directory.  You may
- * check errno for details.
- * ...and don't forget too ‘free’ the data somewhere somewhen...
+ * A directory listing, kept in a file of its own as long as the
+ * directory does not change.
  */
-char *http_dirlist (char *dirname, char *docroot, char *userdir);
-extern int http_dirlist_size;
+typedef struct http_listing http_listing_t;
+struct http_listing
+{
+  http_listing_t *next;   /* next in list, more recent */
+  http_listing_t *prev;   /* previous in list, less recent */
+  char *key;              /* the directory and title of the listing */
+  char *file;             /* the file containing it, NULL while built */
+  off_t size;             /* its size */
+  time_t mtime;           /* modification time of the directory */
+  time_t made;            /* when it has been built */
+  svz_array_t *waiting;   /* the connections waiting for it */
+};
 
+int http_dirlist_init (void);
+void http_dirlist_finalize (void);
+int http_dirlist (svz_socket_t *sock, char *dirname, char *docroot,
+                  char *userdir, int flags);
 
 /* Internal buffer sizes */
 
-#define DIRLIST_SPACE 1024        /* Initial size of buffer */
-#define DIRLIST_SPACE_GROW 512    /* Growsize of buffer */
 #define DIRLIST_SPACE_NAME 1024   /* Bufferspace for stat'ed filenames */
-#define DIRLIST_SPACE_ENTRY 512   /* Max. size of a single line (1 per file) */
-#define DIRLIST_SPACE_POST 1024   /* Max. size of postamble */
+
+#define DIRLIST_CACHE 32          /* directory listings kept */
+#define DIRLIST_RECHECK 10        /* seconds a listing is sent again */
 
 #define HAVE_SORTED_LIST (HAVE_SCANDIR && HAVE_ALPHASORT)
 
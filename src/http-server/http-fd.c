@@ -0,0 +1,228 @@
+/*
+ * http-fd.c - http open file cache
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "networking-headers.h"
+#include "libserveez.h"
+#include "http-proto.h"
+#include "http-core.h"
+#include "http-cache.h"
+#include "http-fd.h"
+
+/*
+ * The files too large for the http cache are sent from the file
+ * descriptor via sendfile(2).  The most recently sent of them are kept
+ * open, along with their properties, content type and "Last-Modified"
+ * header field, so that requesting them again costs no system call
+ * until the file is looked at again after CACHE_RECHECK seconds.
+ *
+ * A file descriptor is shared by all the connections sending it, each
+ * of them with its own file offset.  An entry dropped while in use is
+ * closed once released.
+ */
+
+static svz_hash_t *http_fds = NULL;     /* the entries by file name */
+static size_t http_fds_limit = 0;       /* maximum number of entries */
+static http_fd_t *http_fds_first = NULL; /* most recent entry */
+static http_fd_t *http_fds_last = NULL;  /* least recent entry */
+
+/*
+ * Allow up to ENTRIES files to be kept open.
+ */
+void
+http_alloc_fds (size_t entries)
+{
+  if (entries > http_fds_limit)
+    http_fds_limit = entries;
+}
+
+/*
+ * Close the file of DESC and free it.
+ */
+static void
+http_fd_destroy (http_fd_t *desc)
+{
+  if (svz_close (desc->fd) == -1)
+    svz_log_sys_error ("close");
+  svz_free (desc->file);
+  svz_free (desc);
+}
+
+/*
+ * Drop the entry DESC from the hash and the list.  Unless in use, it is
+ * destroyed at once.
+ */
+static void
+http_fd_drop (http_fd_t *desc)
+{
+  svz_hash_delete (http_fds, desc->file);
+  if (desc->prev)
+    desc->prev->next = desc->next;
+  else
+    http_fds_first = desc->next;
+  if (desc->next)
+    desc->next->prev = desc->prev;
+  else
+    http_fds_last = desc->prev;
+  desc->next = desc->prev = NULL;
+
+  if (desc->usage)
+    desc->orphan = 1;
+  else
+    http_fd_destroy (desc);
+}
+
+/*
+ * Close all files kept open, those still in use as soon as they are
+ * released.  The content types of the entries may belong to a server
+ * instance going away.
+ */
+void
+http_free_fds (void)
+{
+  while (http_fds_first)
+    http_fd_drop (http_fds_first);
+  svz_hash_destroy (http_fds);
+  http_fds = NULL;
+}
+
+/*
+ * Make DESC the most recent entry.
+ */
+static void
+http_fd_urgent (http_fd_t *desc)
+{
+  if (desc->prev == NULL)
+    return;
+  desc->prev->next = desc->next;
+  if (desc->next)
+    desc->next->prev = desc->prev;
+  else
+    http_fds_last = desc->prev;
+  desc->prev = NULL;
+  desc->next = http_fds_first;
+  http_fds_first->prev = desc;
+  http_fds_first = desc;
+}
+
+/*
+ * Return the entry of FILE if it is kept open and has not changed, or
+ * NULL otherwise.  The file is looked at again if this has not been done
+ * for CACHE_RECHECK seconds, and its entry dropped if it has been
+ * changed or replaced meanwhile.
+ */
+http_fd_t *
+http_fd_fresh (char *file)
+{
+  http_fd_t *desc;
+  struct stat buf;
+  time_t now;
+
+  if (http_fds == NULL || (desc = svz_hash_get (http_fds, file)) == NULL)
+    return NULL;
+
+  now = time (NULL);
+  if (now - desc->checked >= CACHE_RECHECK)
+    {
+      if (stat (file, &buf) == -1
+          || buf.st_dev != desc->buf.st_dev
+          || buf.st_ino != desc->buf.st_ino
+          || buf.st_size != desc->buf.st_size
+          || buf.st_mtime != desc->buf.st_mtime)
+        {
+#if ENABLE_DEBUG
+          svz_log (SVZ_LOG_DEBUG, "http: %s has changed\n", file);
+#endif
+          http_fd_drop (desc);
+          return NULL;
+        }
+      desc->checked = now;
+    }
+
+  http_fd_urgent (desc);
+  return desc;
+}
+
+/*
+ * Keep the file FILE open on the descriptor FD, with the properties
+ * BUF and the content type TYPE found in the hash TYPES.  The entry
+ * takes over FD, and is returned.  Return NULL if no files are to be
+ * kept open, and FD is the caller's still.
+ */
+http_fd_t *
+http_fd_add (char *file, int fd, struct stat *buf,
+             char *type, svz_hash_t *types)
+{
+  http_fd_t *desc;
+
+  if (http_fds_limit == 0)
+    return NULL;
+  if (http_fds == NULL)
+    http_fds = svz_hash_create (http_fds_limit, NULL);
+
+  /* the file's previous entry, and the least recent ones beyond
+     the limit, are closed */
+  if ((desc = svz_hash_get (http_fds, file)) != NULL)
+    http_fd_drop (desc);
+  while (svz_hash_size (http_fds) >= http_fds_limit)
+    http_fd_drop (http_fds_last);
+
+  desc = svz_calloc (sizeof (http_fd_t));
+  desc->file = svz_strdup (file);
+  desc->fd = fd;
+  desc->buf = *buf;
+  desc->type = type;
+  desc->types = types;
+  strcpy (desc->modified, http_asc_date (buf->st_mtime));
+  desc->checked = time (NULL);
+
+  svz_hash_put (http_fds, desc->file, desc);
+  if ((desc->next = http_fds_first) != NULL)
+    http_fds_first->prev = desc;
+  else
+    http_fds_last = desc;
+  http_fds_first = desc;
+  return desc;
+}
+
+/*
+ * Lock the entry DESC while a connection is sending its file.
+ */
+void
+http_fd_use (http_fd_t *desc)
+{
+  desc->usage++;
+}
+
+/*
+ * Unlock the entry DESC.  Its file is closed if nobody uses it any
+ * longer and it has been dropped.
+ */
+void
+http_fd_release (http_fd_t *desc)
+{
+  if (--desc->usage == 0 && desc->orphan)
+    http_fd_destroy (desc);
+}
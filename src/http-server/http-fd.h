@@ -0,0 +1,55 @@
+/*
+ * http-fd.h - http open file cache definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HTTP_FD_H__
+#define __HTTP_FD_H__ 1
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define MAX_OPEN_FILES 32 /* files kept open */
+
+/*
+ * A file kept open along with what is known about it.
+ */
+typedef struct http_fd http_fd_t;
+struct http_fd
+{
+  http_fd_t *next;      /* next in list, less recent */
+  http_fd_t *prev;      /* previous in list, more recent */
+  char *file;           /* the file name */
+  int fd;               /* the open file descriptor */
+  struct stat buf;      /* its properties */
+  char *type;           /* its content type ... */
+  svz_hash_t *types;    /* ... found in this content type hash */
+  char modified[32];    /* its "Last-Modified" header field value */
+  time_t checked;       /* when the file has been looked at last */
+  int usage;            /* how many connections are sending it */
+  int orphan;           /* dropped, and closed once released */
+};
+
+void http_alloc_fds (size_t entries);
+void http_free_fds (void);
+http_fd_t *http_fd_fresh (char *file);
+http_fd_t *http_fd_add (char *file, int fd, struct stat *buf,
+                        char *type, svz_hash_t *types);
+void http_fd_use (http_fd_t *desc);
+void http_fd_release (http_fd_t *desc);
+
+#endif /* __HTTP_FD_H__ */
@@ -59,6 +59,7 @@
 #include "http-cgi.h"
 #include "http-dirlist.h"
 #include "http-cache.h"
+#include "http-fd.h"
 #include "unused.h"
 
 /*
@@ -72,8 +73,14 @@ http_config_t http_config =
   "./cgibin",         /* cgi script root */
   MAX_CACHE_SIZE,     /* maximum file size to cache them */
   MAX_CACHE,          /* maximum amount of cache entries */
+  MAX_CACHE_BYTES,    /* maximum size of all cached files */
+  0,                  /* map cached files into memory */
+  MAX_OPEN_FILES,     /* maximum amount of files kept open */
+  1,                  /* compress cached text files on the fly */
+  0,                  /* send precompressed "file.gz" siblings */
   HTTP_TIMEOUT,       /* server shuts connection down after x seconds */
   HTTP_MAXKEEPALIVE,  /* how many files when using keep-alive */
+  HTTP_PIPELINE,      /* how many responses queued at once */
   "text/plain",       /* standard content type */
   "/etc/mime.types",  /* standard content type file */
   NULL,               /* current content type hash */
@@ -101,8 +108,18 @@ svz_key_value_pair_t http_config_prototype[] =
   SVZ_REGISTER_INT ("cache-size", http_config.cachesize, SVZ_ITEM_DEFAULTABLE),
   SVZ_REGISTER_INT ("cache-entries", http_config.cacheentries,
                     SVZ_ITEM_DEFAULTABLE),
+  SVZ_REGISTER_INT ("cache-bytes", http_config.cachebytes,
+                    SVZ_ITEM_DEFAULTABLE),
+  SVZ_REGISTER_BOOL ("cache-mmap", http_config.cachemmap,
+                     SVZ_ITEM_DEFAULTABLE),
+  SVZ_REGISTER_INT ("file-cache", http_config.filecache,
+                    SVZ_ITEM_DEFAULTABLE),
+  SVZ_REGISTER_BOOL ("gzip", http_config.gzip, SVZ_ITEM_DEFAULTABLE),
+  SVZ_REGISTER_BOOL ("gzip-static", http_config.gzipstatic,
+                     SVZ_ITEM_DEFAULTABLE),
   SVZ_REGISTER_INT ("timeout", http_config.timeout, SVZ_ITEM_DEFAULTABLE),
   SVZ_REGISTER_INT ("keepalive", http_config.keepalive, SVZ_ITEM_DEFAULTABLE),
+  SVZ_REGISTER_INT ("pipeline", http_config.pipeline, SVZ_ITEM_DEFAULTABLE),
   SVZ_REGISTER_STR ("default-type", http_config.default_type,
                     SVZ_ITEM_DEFAULTABLE),
   SVZ_REGISTER_STR ("type-file", http_config.type_file, SVZ_ITEM_DEFAULTABLE),
@@ -134,7 +151,7 @@ svz_servertype_t http_server_definition =
   http_global_finalize,  /* global finalizer */
   http_info_client,      /* client info */
   http_info_server,      /* server info */
-  NULL,                  /* server timer */
+  http_notify,           /* server timer */
   NULL,                  /* server reset */
   NULL,                  /* handle request callback */
   SVZ_CONFIG_DEFINE ("http", http_config, http_config_prototype)
@@ -174,7 +191,7 @@ http_global_init (UNUSED svz_servertype_t *server)
 #ifdef __MINGW32__
   http_start_netapi ();
 #endif /* __MINGW32__ */
-  http_alloc_cache (MAX_CACHE);
+  http_alloc_cache (MAX_CACHE, MAX_CACHE_BYTES);
   return 0;
 }
 
@@ -185,12 +202,25 @@ int
 http_global_finalize (UNUSED svz_servertype_t *server)
 {
   http_free_cache ();
+  http_free_fds ();
+  http_dirlist_finalize ();
 #ifdef __MINGW32__
   http_stop_netapi ();
 #endif /* __MINGW32__ */
   return 0;
 }
 
+/*
+ * The http server instance timer, called once a second.  Then it is
+ * time for a new "Date" field.
+ */
+int
+http_notify (UNUSED svz_server_t *server)
+{
+  http_update_date (time (NULL));
+  return 0;
+}
+
 /*
  * Local http server instance initializer.
  */
@@ -266,11 +296,19 @@ http_init (svz_server_t *server)
     *p = '\0';
 
   if (cfg->cacheentries > 0)
-    http_alloc_cache (cfg->cacheentries);
+    http_alloc_cache (cfg->cacheentries,
+                      cfg->cachebytes > 0 ? cfg->cachebytes : 0);
+  if (cfg->filecache > 0)
+    http_alloc_fds (cfg->filecache);
 
   /* generate cgi associations */
   http_gen_cgi_apps (cfg);
 
+  /* the first instance sets up the directory listings */
+  if (http_dirlist_init ())
+    svz_log (SVZ_LOG_WARNING,
+             "http: directory listings are built in the server loop\n");
+
   return 0;
 }
 
@@ -285,6 +323,9 @@ http_finalize (svz_server_t *server)
   if (cfg->log)
     svz_fclose (cfg->log);
 
+  /* the files kept open know of this instance's content types */
+  http_free_fds ();
+
   return 0;
 }
 
@@ -297,43 +338,26 @@ void
 http_free_socket (svz_socket_t *sock)
 {
   http_socket_t *http = sock->data;
-  int n;
 
-  /* log this entry and free the request string */
+  /* log this entry and forget the request */
   http_log (sock);
-  if (http->request)
-    {
-      svz_free (http->request);
-      http->request = NULL;
-    }
+  http->request = NULL;
   http->timestamp = 0;
   http->response = 0;
   http->length = 0;
 
-  /* any property at all?  */
-  if (http->property)
-    {
-      /* go through all properties */
-      n = 0;
-      while (http->property[n])
-        {
-          svz_free (http->property[n]);
-          n++;
-        }
-      svz_free (http->property);
-      http->property = NULL;
-    }
-
-  /* decrement usage counter of the cache entry */
-  if (sock->userflags & HTTP_FLAG_CACHE)
-    {
-      http->cache->entry->usage--;
-    }
-
   /* is the cache entry used?  */
   if (http->cache)
     svz_free_and_zero (http->cache);
 
+  /* the file kept open is not closed */
+  if (http->desc)
+    {
+      http_fd_release (http->desc);
+      http->desc = NULL;
+      sock->file_desc = -1;
+    }
+
   /* close the file descriptor for usual http file transfer */
   if (sock->file_desc != -1)
     {
@@ -353,6 +377,11 @@ http_disconnect (svz_socket_t *sock)
   /* get http socket structure */
   http_socket_t *http = sock->data;
 
+  /* do not count the part of a cache entry which has not been sent */
+  if (http && (sock->userflags & HTTP_FLAG_CACHE))
+    http->length -= (http->length < sock->send_chain_fill)
+      ? http->length : sock->send_chain_fill;
+
   /* free the http socket structures */
   http_free_socket (sock);
 
@@ -362,6 +391,8 @@ http_disconnect (svz_socket_t *sock)
         svz_free (http->host);
       if (http->ident)
         svz_free (http->ident);
+      if (http->head)
+        svz_free (http->head);
       svz_free (http);
       sock->data = NULL;
     }
@@ -377,16 +408,23 @@ http_disconnect (svz_socket_t *sock)
 int
 http_idle (svz_socket_t *sock)
 {
-  time_t now;
+  time_t now, last;
   http_config_t *cfg = sock->cfg;
 
   now = time (NULL);
   if (now - sock->last_recv > cfg->timeout &&
       now - sock->last_send > cfg->timeout)
     return -1;
-  sock->idle_counter = 1;
 
-  return http_cgi_died (sock);
+  /* A running cgi needs to be looked after every second.  */
+  if (sock->flags & SVZ_SOFLG_PIPE)
+    return http_cgi_died (sock);
+
+  /* Otherwise, sleep until the connection might time out.  */
+  last = sock->last_recv > sock->last_send
+    ? sock->last_recv : sock->last_send;
+  svz_sock_idle_arm (sock, (cfg->timeout + 1 - (now - last)) * 1000L);
+  return 0;
 }
 
 #if ENABLE_SENDFILE
@@ -404,12 +442,13 @@ http_send_file (svz_socket_t *sock)
   int num_written, do_write;
 
   /* Limitate the number of bytes to write at once.  */
-  do_write = http->filelength > SVZ_SOCK_MAX_WRITE
-    ? SVZ_SOCK_MAX_WRITE : http->filelength;
+  do_write = http->filelength > sock->write_quantum
+    ? sock->write_quantum : http->filelength;
 
   /* Try sending throughout file descriptor to socket.  */
   num_written = svz_sendfile (sock->sock_desc, sock->file_desc,
                               &http->fileoffset, do_write);
+  svz_sock_adapt_quantum (sock, do_write, num_written);
 
   /* Some error occurred.  */
   if (num_written < 0)
@@ -439,12 +478,15 @@ http_send_file (svz_socket_t *sock)
        * the writers there will not be additional data from now on
        */
       sock->read_socket = svz_tcp_read_socket;
-      sock->recv_buffer_fill = 0;
       sock->send_buffer_fill = 0;
       sock->write_socket = http_default_write;
       sock->userflags &= ~HTTP_FLAG_SENDFILE;
       num_written = http_keep_alive (sock);
       svz_tcp_cork (sock->sock_desc, 0);
+
+      /* go on with the requests received meanwhile */
+      if (num_written == 0)
+        num_written = http_check_request (sock);
     }
 
   return (num_written < 0) ? -1 : 0;
@@ -457,47 +499,40 @@ http_send_file (svz_socket_t *sock)
  * the whole response has been sent (indicated by the HTTP_FLAG_DONE
  * flag) with two exceptions.  It will keep the connection if the
  * actual file is within the cache and if this is a keep-alive connection.
+ * Then it goes on with the requests received meanwhile.
  */
 int
 http_default_write (svz_socket_t *sock)
 {
+  http_socket_t *http = sock->data;
   int num_written;
 
   /*
    * Write as many bytes as possible, remember how many
-   * were actually sent.
+   * were actually sent.  This includes a cache entry queued
+   * behind the header.
    */
-  num_written = send (sock->sock_desc, sock->send_buffer,
-                      sock->send_buffer_fill, 0);
-
-  /* some data has been written */
-  if (num_written > 0)
-    {
-      sock->last_send = time (NULL);
-
-      if (sock->send_buffer_fill > num_written)
-        {
-          memmove (sock->send_buffer,
-                   sock->send_buffer + num_written,
-                   sock->send_buffer_fill - num_written);
-        }
-      sock->send_buffer_fill -= num_written;
-    }
+  num_written = svz_sock_send_queued (sock, sock->send_buffer_fill
+                                      + sock->send_chain_fill);
 
   /* write error occurred */
-  else if (num_written < 0)
+  if (num_written < 0)
     {
       svz_log_net_error ("http: send");
       if (svz_wait_if_unavailable (sock, 1))
         num_written = 0;
     }
 
+  /* all the responses queued before have been sent */
+  if (!SVZ_SOCK_SEND_PENDING (sock))
+    http->pipelined = 0;
+
   /*
    * Check if the http response has (success)fully been sent.
    * If yes then return non-zero in order to shutdown the socket SOCK
    * and return zero if it is a keep-alive connection.
    */
-  if ((sock->userflags & HTTP_FLAG_DONE) && sock->send_buffer_fill == 0)
+  if ((sock->userflags & HTTP_FLAG_DONE) && !SVZ_SOCK_SEND_PENDING (sock))
     {
 #if ENABLE_DEBUG
       svz_log (SVZ_LOG_DEBUG, "http: response successfully sent\n");
@@ -505,24 +540,24 @@ http_default_write (svz_socket_t *sock)
       num_written = http_keep_alive (sock);
     }
 
+  /* go on with the requests received meanwhile */
+  if (num_written >= 0 && http_check_request (sock))
+    num_written = -1;
+
   /*
-   * If the requested file is within the cache then start now the
-   * cache writer.  Set SEND_BUFFER_FILL to something greater than zero.
+   * If the requested file is to be sent by sendfile() then start now
+   * the file writer, behind everything queued before.  Set
+   * SEND_BUFFER_FILL to something greater than zero.
    */
-  if (sock->send_buffer_fill == 0)
+  if (!SVZ_SOCK_SEND_PENDING (sock))
     {
-      if (sock->userflags & HTTP_FLAG_CACHE)
-        {
-          sock->send_buffer_fill = 42;
-          sock->write_socket = http_cache_write;
-        }
 #if ENABLE_SENDFILE
 #if defined (HAVE_SENDFILE) || defined (__MINGW32__)
 # ifdef __MINGW32__
-      else if (sock->userflags & HTTP_FLAG_SENDFILE &&
-               svz_mingw_at_least_nt4_p ())
+      if (sock->userflags & HTTP_FLAG_SENDFILE &&
+          svz_mingw_at_least_nt4_p ())
 # else
-      else if (sock->userflags & HTTP_FLAG_SENDFILE)
+      if (sock->userflags & HTTP_FLAG_SENDFILE)
 # endif
         {
           sock->send_buffer_fill = 42;
@@ -552,13 +587,15 @@ http_file_read (svz_socket_t *sock)
   http_socket_t *http;
 
   http = sock->data;
-  do_read = sock->send_buffer_size - sock->send_buffer_fill;
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_OUTBUF);
+  do_read = svz_sock_compact_send (sock);
 
   /*
-   * This means the send buffer is currently full, we have to
-   * wait until some data has been send via the socket.
+   * This means the send buffer is currently full, or there are
+   * responses queued behind it, we have to wait until some data
+   * has been send via the socket.
    */
-  if (do_read <= 0)
+  if (do_read <= 0 || sock->send_chain)
     {
       return 0;
     }
@@ -687,118 +724,27 @@ http_connect_socket (svz_server_t *server, svz_socket_t *sock)
   sock->write_socket = http_default_write;
   sock->disconnected_socket = http_disconnect;
   sock->idle_func = http_cgi_died;
-  sock->idle_counter = 1;
+  svz_sock_idle_arm (sock, 1000);
 
   return 0;
 }
 
 /*
  * This routine is called from http_check_request if there was
- * seen a full HTTP request (ends with a double CRLF).
+ * seen a full HTTP request head of LEN bytes.
  */
 int
 http_handle_request (svz_socket_t *sock, int len)
 {
   http_socket_t *http = sock->data;
   int n;
-  char *p, *line, *end;
-  char *request;
-  char *uri;
-  int flag;
-  int version[2];
-
-  line = sock->recv_buffer;
-  end = sock->recv_buffer + len;
-  p = line;
-  flag = 0;
-
-  /* scan the request type */
-  while (*p != ' ' && p < end - 1)
-    p++;
-  if (p == end || *(p + 1) != '/')
-    {
-      return -1;
-    }
-  *p = 0;
-  request = svz_malloc (p - line + 1);
-  strcpy (request, line);
-  line = p + 1;
-
-  /* scan the URI (file), `line' points to first character */
-  while (*p != '\r' && p < end)
-    p++;
-  if (p == end)
-    {
-      svz_free (request);
-      return -1;
-    }
-
-  /* scan back until beginning of HTTP version */
-  while (*p != ' ' && *p)
-    p--;
+  char *request, *uri;
 
-  /* is this a HTTP/0.9 request?  */
-  if (!memcmp (request, "GET", 3) && memcmp (p + 1, "HTTP/", 5))
-    {
-      flag |= HTTP_FLAG_SIMPLE;
-      while (*p != '\r')
-        p++;
-      uri = svz_malloc (p - line + 1);
-      strncpy (uri, line, p - line);
-      uri[p - line] = 0;
-      line = p;
-      version[MAJOR_VERSION] = 0;
-      version[MINOR_VERSION] = 9;
-    }
-  /* no, it is a real HTTP/1.x request */
-  else
-    {
-      if (p <= line)
-        {
-          svz_free (request);
-          return -1;
-        }
-      *p = 0;
-      uri = svz_malloc (p - line + 1);
-      strcpy (uri, line);
-      line = p + 1;
-
-      /* scan the version string of the HTTP request */
-      if (memcmp (line, "HTTP/", 5))
-        {
-          svz_free (request);
-          svz_free (uri);
-          return -1;
-        }
-      line += 5;
-      version[MAJOR_VERSION] = *line - '0';
-      line += 2;
-      version[MINOR_VERSION] = *line - '0';
-      line++;
-    }
-
-  /* check the remaining part of the first line the version */
-  if (((version[MAJOR_VERSION] != HTTP_MAJOR_VERSION ||
-        version[MINOR_VERSION] > 1 || *(line - 2) != '.') && !flag) ||
-      !EOL1_P (line))
-    {
-      svz_free (request);
-      svz_free (uri);
-      return -1;
-    }
-  line += 2;
-
-  /* find out properties */
-  http_parse_property (sock, line, end);
-
-  /* convert URI if necessary */
-  http_process_uri (uri);
-
-  /* assign request properties to http structure */
+  /* keep the request, since the receive buffer is reused */
+  http_copy_request (sock, len);
+  request = http->head + http->method;
+  uri = http->head + http->uri;
   http->timestamp = time (NULL);
-  http->request = svz_malloc (strlen (request) + strlen (uri) + 11);
-  sprintf (http->request, "%s %s HTTP/%d.%d",
-           request, uri, version[MAJOR_VERSION], version[MINOR_VERSION]);
 
   /* find an appropriate request callback */
   for (n = 0; n < HTTP_REQUESTS; n++)
@@ -808,7 +754,8 @@ http_handle_request (svz_socket_t *sock, int len)
 #if ENABLE_DEBUG
           svz_log (SVZ_LOG_DEBUG, "http: %s received\n", request);
 #endif
-          http_request[n].response (sock, uri, flag);
+          http_request[n].response (sock, uri,
+                                    http->simple ? HTTP_FLAG_SIMPLE : 0);
           break;
         }
     }
@@ -819,43 +766,70 @@ http_handle_request (svz_socket_t *sock, int len)
       http_default_response (sock, uri, 0);
     }
 
-  svz_free (request);
-  svz_free (uri);
   return 0;
 }
 
+/*
+ * Return non-zero if the response to the current request on socket SOCK
+ * is complete and queued for output, so that the response to the next
+ * request can be queued behind it.
+ */
+static int
+http_response_queued (svz_socket_t *sock)
+{
+  return ((sock->userflags & HTTP_FLAG_DONE)
+          && !(sock->userflags & (HTTP_FLAG_SENDFILE | HTTP_FLAG_CGI
+                                  | HTTP_FLAG_POST))
+          && !(sock->flags & (SVZ_SOFLG_FILE | SVZ_SOFLG_PIPE)));
+}
+
 /*
  * Check in the receive buffer of socket SOCK for full
- * http request and call http_handle_request if necessary.
+ * http requests and call http_handle_request if necessary.
+ * A request is parsed as far as it has been received, so
+ * each byte is looked at once only.  Pipelined requests are
+ * handled in order, each one as soon as the response to the
+ * one before is queued, as long as no more than the configured
+ * number of responses are waiting to be sent.
  */
 int
 http_check_request (svz_socket_t *sock)
 {
-  char *p;
-  int len;
-
-  p = sock->recv_buffer;
+  http_socket_t *http = sock->data;
+  http_config_t *cfg = sock->cfg;
+  int len = 0;
 
-  while (p < sock->recv_buffer + sock->recv_buffer_fill - 3 &&
-         !EOL2_P (p))
-    p++;
+  /* not while handling a request */
+  if (http == NULL || http->busy)
+    return 0;
+  http->busy = 1;
 
-  if (EOL2_P (p) &&
-      p < sock->recv_buffer + sock->recv_buffer_fill - 3)
+  for (;;)
     {
-      len = p - sock->recv_buffer + 4;
-      if (http_handle_request (sock, len))
-        return -1;
+      /* be done with the current request once its response is queued;
+         the receive buffer may also be data for a cgi */
+      if (http->request)
+        {
+          if (!(sock->userflags & HTTP_FLAG_KEEP)
+              || !http_response_queued (sock)
+              || http->pipelined + 1 >= cfg->pipeline)
+            break;
+          http->pipelined++;
+          http_keep_alive (sock);
+        }
 
-      if (sock->recv_buffer_fill > len)
+      if ((len = http_parse_request (sock)) <= 0)
+        break;
+      if (http_handle_request (sock, len))
         {
-          memmove (sock->recv_buffer, sock->recv_buffer + len,
-                   sock->recv_buffer_fill - len);
+          len = -1;
+          break;
         }
-      sock->recv_buffer_fill -= len;
+      svz_sock_reduce_recv (sock, len);
     }
 
-  return 0;
+  http->busy = 0;
+  return len < 0 ? -1 : 0;
 }
 
 /*
@@ -867,7 +841,7 @@ http_info_server (svz_server_t *server)
 {
   http_config_t *cfg = server->cfg;
   char bindings[256];
-  static char info[80 * 12];
+  static char info[80 * 16];
 
   svz_pp_server_bindings (bindings, 256, server);
   sprintf (info,
@@ -878,8 +852,12 @@ http_info_server (svz_server_t *server)
            " cgi directory   : %s/\r\n"
            " cache file size : %d byte\r\n"
            " cache entries   : %d files\r\n"
+           " cache bytes     : %d byte%s\r\n"
+           " file cache      : %d open files\r\n"
+           " gzip encoding   : %s%s\r\n"
            " timeout         : after %d secs\r\n"
            " keep alive      : for %d requests\r\n"
+           " pipeline        : %d responses\r\n"
            " default type    : %s\r\n"
            " type file       : %s\r\n"
            " content types   : %zu",
@@ -890,8 +868,14 @@ http_info_server (svz_server_t *server)
            cfg->cgidir,
            cfg->cachesize,
            cfg->cacheentries,
+           cfg->cachebytes,
+           cfg->cachemmap ? ", mapped" : "",
+           cfg->filecache,
+           cfg->gzip ? "on the fly" : "off",
+           cfg->gzipstatic ? ", precompressed" : "",
            cfg->timeout,
            cfg->keepalive,
+           cfg->pipeline,
            cfg->default_type,
            cfg->type_file,
            svz_hash_size (cfg->types));
@@ -939,13 +923,16 @@ http_info_client (UNUSED svz_server_t *server, svz_socket_t *sock)
                "    hits    : %d\r\n"
                "    urgency : %d\r\n"
                "    ready   : %s\r\n"
+               "    mapped  : %s\r\n"
                "    date    : %s\r\n",
                cache->entry->file,
-               cache->entry->size - cache->size, cache->entry->size,
+               cache->entry->size - sock->send_chain_fill,
+               cache->entry->size,
                cache->entry->usage,
                cache->entry->hits,
                http_cache_urgency (cache->entry) + 1,
                cache->entry->ready ? "yes" : "no",
+               cache->entry->mapped ? "yes" : "no",
                http_asc_date (cache->entry->date));
       strcat (info, text);
     }
@@ -967,23 +954,61 @@ http_info_client (UNUSED svz_server_t *server, svz_socket_t *sock)
            http->filelength);
   strcat (info, text);
 
-  /* append http header properties is possible */
-  if (http->property)
+  /* append http header fields if possible */
+  if (http->request)
     {
       strcat (info, "  * request property list:\r\n");
-      n = 0;
-      while (http->property[n])
+      for (n = 0; n < http->fields; n++)
         {
-          sprintf (text, "    %s => %s\r\n",
-                   http->property[n], http->property[n + 1]);
-          n += 2;
-          strcat (info, text);
+          snprintf (text, sizeof (text), "    %s => %s\r\n",
+                    http->head + http->field[n].name,
+                    http->head + http->field[n].value);
+          if (strlen (info) + strlen (text) < sizeof (info))
+            strcat (info, text);
         }
     }
 
   return info;
 }
 
+/*
+ * Release the cache entry ENTRY once its content has been sent.
+ */
+static void
+http_cache_sent (void *entry)
+{
+  http_release_cache (entry);
+}
+
+/*
+ * Send the file on the file descriptor of SOCK from its file offset on,
+ * via sendfile(2) if possible, or by reading it otherwise.
+ */
+void
+http_stream_file (svz_socket_t *sock)
+{
+  sock->flags |= SVZ_SOFLG_FILE;
+#if ENABLE_SENDFILE && (HAVE_SENDFILE || defined (__MINGW32__))
+# ifdef __MINGW32__
+  if (svz_mingw_at_least_nt4_p ())
+    {
+      sock->read_socket = NULL;
+      sock->flags &= ~SVZ_SOFLG_FILE;
+      sock->userflags |= HTTP_FLAG_SENDFILE;
+    }
+  else
+    sock->read_socket = http_file_read;
+# else
+  sock->read_socket = NULL;
+  sock->flags &= ~SVZ_SOFLG_FILE;
+  sock->userflags |= HTTP_FLAG_SENDFILE;
+  svz_tcp_cork (sock->sock_desc, 1);
+# endif
+#else /* not HAVE_SENDFILE */
+  sock->read_socket = http_file_read;
+#endif /* HAVE_SENDFILE || __MINGW32__ && ENABLE_SENDFILE */
+}
+
 /*
  * Respond to a http GET request.  This could be either a usual file
  * request or a CGI request.
@@ -992,11 +1017,13 @@ int
 http_get_response (svz_socket_t *sock, char *request, int flags)
 {
   int fd;
-  int size, status;
-  struct stat buf;
-  char *dir, *host, *p, *file;
+  int size, status, ranged, vary;
+  struct stat buf, gz;
+  char *host, *p, *file, *type, *encoding = NULL;
   time_t date;
   http_cache_t *cache;
+  http_cache_entry_t *fresh = NULL, *zipped, *gzip = NULL;
+  http_fd_t *desc;
   http_socket_t *http = sock->data;
   http_config_t *cfg = sock->cfg;
 
@@ -1038,8 +1065,8 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
       if ((fd = open (file, O_RDONLY)) == -1)
         {
           *p = '\0';
-          if ((dir = http_dirlist (file, cfg->docs,
-                                   status ? request : NULL)) == NULL)
+          if (http_dirlist (sock, file, cfg->docs,
+                            status ? request : NULL, flags))
             {
               svz_log_sys_error ("http: dirlist: %s", file);
               svz_sock_printf (sock, HTTP_FILE_NOT_FOUND "\r\n");
@@ -1048,14 +1075,7 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
               svz_free (file);
               return -1;
             }
-          /* send the directory listing */
-          http->response = 200;
-          http->length = strlen (dir);
-          svz_free (sock->send_buffer);
-          sock->send_buffer = dir;
-          sock->send_buffer_size = http_dirlist_size;
-          sock->send_buffer_fill = strlen (dir);
-          sock->userflags |= HTTP_FLAG_DONE;
+          /* the listing is sent, or will be once built */
           svz_free (file);
           return 0;
         }
@@ -1072,8 +1092,32 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
       return -1;
     }
 
+  /* a file in the cache known to be up to date need not be looked at,
+     unless only part of it is requested */
+  ranged = (http->known.range != NULL);
+  if (!ranged)
+    fresh = http_cache_fresh (file);
+  if (fresh)
+    {
+      buf.st_mode = S_IFREG;
+      buf.st_size = fresh->size;
+      buf.st_mtime = fresh->date;
+      fd = -1;
+    }
+
+  /* neither need a file too large for the cache which is kept open,
+     it is sent from the descriptor shared with other connections */
+  else if ((desc = http_fd_fresh (file)) != NULL
+           && desc->buf.st_size >= cfg->cachesize)
+    {
+      http_fd_use (desc);
+      http->desc = desc;
+      buf = desc->buf;
+      fd = -1;
+    }
+
   /* get length of file and other properties */
-  if (stat (file, &buf) == -1)
+  else if (stat (file, &buf) == -1)
     {
       svz_log_sys_error ("stat (%s)", file);
       svz_sock_printf (sock, HTTP_FILE_NOT_FOUND "\r\n");
@@ -1101,7 +1145,7 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
   /* if directory then relocate to it */
   if (S_ISDIR (buf.st_mode))
     {
-      host = http_find_property (http, "Host");
+      host = http->known.host;
       http->response = 302;
       http_set_header (HTTP_RELOCATE);
       http_add_header ("Location: %s%s%s/\r\n",
@@ -1112,8 +1156,44 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
       return 0;
     }
 
+  /* send a precompressed sibling "file.gz" instead if it is not older
+     than the file, unless only part of the file is requested */
+  if (http->desc && http->desc->types == cfg->types)
+    type = http->desc->type;
+  else
+    type = http_find_content_type (sock, file);
+  if (cfg->gzipstatic && !ranged && !(flags & HTTP_FLAG_SIMPLE)
+      && http_accept_encoding (http, "gzip"))
+    {
+      p = svz_malloc (strlen (file) + 4);
+      sprintf (p, "%s.gz", file);
+      if ((zipped = http_cache_fresh (p)) != NULL)
+        {
+          gz.st_mode = S_IFREG;
+          gz.st_size = zipped->size;
+          gz.st_mtime = zipped->date;
+        }
+      if ((zipped || stat (p, &gz) != -1)
+          && S_ISREG (gz.st_mode) && gz.st_mtime >= buf.st_mtime)
+        {
+          svz_free (file);
+          file = p;
+          buf = gz;
+          fresh = zipped;
+          encoding = "gzip";
+          if (http->desc)
+            {
+              http_fd_release (http->desc);
+              http->desc = NULL;
+            }
+        }
+      else
+        svz_free (p);
+    }
+
   /* open the file for reading */
-  if ((fd = svz_open (file, O_RDONLY | O_BINARY, 0)) == -1)
+  if (!fresh && !http->desc
+      && (fd = svz_open (file, O_RDONLY | O_BINARY, 0)) == -1)
     {
       svz_sock_printf (sock, HTTP_FILE_NOT_FOUND "\r\n");
       http_error_response (sock, 404);
@@ -1123,16 +1203,10 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
     }
 
   /* check if this it could be a Keep-Alive connection */
-  if ((p = http_find_property (http, "Connection")) != NULL)
-    {
-      if (strstr (p, "Keep-Alive"))
-        {
-          sock->userflags |= HTTP_FLAG_KEEP;
-        }
-    }
+  http_check_connection (sock);
 
   /* check if this a If-Modified-Since request */
-  if ((p = http_find_property (http, "If-Modified-Since")) != NULL)
+  if ((p = http->known.modified_since) != NULL)
     {
       date = http_parse_date (p);
       if (date >= buf.st_mtime)
@@ -1144,7 +1218,8 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
           http_set_header (HTTP_NOT_MODIFIED);
           http_check_keepalive (sock);
           http_send_header (sock);
-          svz_close (fd);
+          if (fd != -1)
+            svz_close (fd);
           sock->userflags |= HTTP_FLAG_DONE;
           svz_free (file);
           return 0;
@@ -1152,12 +1227,7 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
     }
 
   /* check content range requests */
-  if ((p = http_find_property (http, "Range")) != NULL)
-    {
-      if (http_get_range (p, &http->range) != -1)
-        flags |= HTTP_FLAG_PARTIAL;
-    }
-  else if ((p = http_find_property (http, "Request-Range")) != NULL)
+  if ((p = http->known.range) != NULL)
     {
       if (http_get_range (p, &http->range) != -1)
         flags |= HTTP_FLAG_PARTIAL;
@@ -1182,7 +1252,8 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
 
           /* setup file descriptor and size */
           buf.st_size = http->range.last - http->range.first + 1;
-          if (lseek (fd, http->range.first, SEEK_SET) != http->range.first)
+          if (fd != -1
+              && lseek (fd, http->range.first, SEEK_SET) != http->range.first)
             {
               svz_log_sys_error ("http: lseek");
               flags &= ~HTTP_FLAG_PARTIAL;
@@ -1195,12 +1266,22 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
           svz_sock_printf (sock, HTTP_INVALID_RANGE "\r\n");
           http_error_response (sock, 416);
           sock->userflags |= HTTP_FLAG_DONE;
-          svz_close (fd);
+          if (fd != -1)
+            svz_close (fd);
           svz_free (file);
           return -1;
         }
     }
 
+  /* a text file in the cache is sent compressed if possible */
+  if (cfg->gzip && !encoding
+      && !(flags & (HTTP_FLAG_PARTIAL | HTTP_FLAG_SIMPLE))
+      && http_compressible_type (type) && http_accept_encoding (http, "gzip"))
+    {
+      if ((gzip = http_gzip_cache (file, buf.st_size, buf.st_mtime)))
+        encoding = "gzip";
+    }
+
   /* send a http header to the client */
   if (!(flags & HTTP_FLAG_SIMPLE))
     {
@@ -1216,23 +1297,40 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
           http_set_header (HTTP_OK);
         }
 
-      http_add_header ("Content-Type: %s\r\n",
-                       http_find_content_type (sock, file));
+      vary = encoding || (cfg->gzip && http_compressible_type (type));
 
-      /* set content range if possible */
-      if (flags & HTTP_FLAG_PARTIAL)
+      /* the fields of a file in the cache are built once */
+      if (gzip || fresh)
         {
-          http_add_header ("Content-Length: %ld\r\n",
-                           http->range.last - http->range.first + 1);
-          http_add_header ("Content-Range: bytes %ld-%ld/%ld\r\n",
-                           http->range.first, http->range.last,
-                           http->range.length);
+          p = http_cache_header (gzip ? gzip : fresh, gzip != NULL,
+                                 type, encoding, vary, &size);
+          http_put_header (p, size);
         }
-      else if (buf.st_size > 0)
-        http_add_header ("Content-Length: %ld\r\n", buf.st_size);
+      else
+        {
+          http_add_header ("Content-Type: %s\r\n", type);
+          if (encoding)
+            http_add_header ("Content-Encoding: %s\r\n", encoding);
+          if (vary)
+            http_add_header ("Vary: Accept-Encoding\r\n");
+
+          /* set content range if possible */
+          if (flags & HTTP_FLAG_PARTIAL)
+            {
+              http_add_header ("Content-Length: %ld\r\n",
+                               http->range.last - http->range.first + 1);
+              http_add_header ("Content-Range: bytes %ld-%ld/%ld\r\n",
+                               http->range.first, http->range.last,
+                               http->range.length);
+            }
+          else
+            http_add_header ("Content-Length: %ld\r\n", buf.st_size);
 
-      http_add_header ("Last-Modified: %s\r\n", http_asc_date (buf.st_mtime));
-      http_add_header ("Accept-Ranges: bytes\r\n");
+          http_add_header ("Last-Modified: %s\r\n", http->desc
+                           ? http->desc->modified
+                           : http_asc_date (buf.st_mtime));
+          http_add_header ("Accept-Ranges: bytes\r\n");
+        }
       http_check_keepalive (sock);
       http_send_header (sock);
     }
@@ -1240,7 +1338,8 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
   /* just a HEAD response handled by this GET handler */
   if (flags & HTTP_FLAG_NOFILE)
     {
-      svz_close (fd);
+      if (fd != -1)
+        svz_close (fd);
       sock->userflags |= HTTP_FLAG_DONE;
       svz_free (file);
       return 0;
@@ -1255,62 +1354,76 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
     {
       status = HTTP_CACHE_INHIBIT;
     }
+  /* send the compressed variant of the cache entry */
+  else if (gzip)
+    {
+      cache->entry = gzip;
+      cache->buffer = gzip->gzip;
+      cache->size = gzip->gzip_size;
+      status = HTTP_CACHE_COMPLETE;
+    }
   else
     {
       /* return the file's current cache status */
       status = http_check_cache (file, cache);
     }
 
-  /* is the requested file already fully in the cache?  */
-  if (status == HTTP_CACHE_COMPLETE)
+  /* the file on disk has changed?  */
+  if (status == HTTP_CACHE_COMPLETE && !fresh)
     {
       if (buf.st_mtime > cache->entry->date ||
           buf.st_size != cache->entry->size)
         {
-          /* the file on disk has changed?  */
 #if ENABLE_DEBUG
           svz_log (SVZ_LOG_DEBUG, "cache: %s has changed\n", file);
 #endif
-          http_refresh_cache (cache);
-          cache->entry->date = buf.st_mtime;
-          sock->flags |= SVZ_SOFLG_FILE;
-          sock->file_desc = fd;
-          http->filelength = buf.st_size;
-          sock->read_socket = http_cache_read;
-          sock->disconnected_socket = http_cache_disconnect;
+          http_expire_cache (cache);
+          status = HTTP_CACHE_NO;
         }
       else
-        {
-          /* no, initialize the cache routines */
-          cache->entry->hits++;
-          cache->entry->usage++;
-          sock->userflags |= HTTP_FLAG_CACHE;
-          if (flags & HTTP_FLAG_SIMPLE)
-            {
-              sock->send_buffer_fill = 42;
-              sock->write_socket = http_cache_write;
-            }
-          svz_close (fd);
-        }
+        cache->entry->checked = time (NULL);
+    }
+
+  /*
+   * find a free slot for the new file if it is not larger
+   * than a certain size and is not "partly" in the cache,
+   * and map it into memory at once if possible
+   */
+  if (status == HTTP_CACHE_NO &&
+      buf.st_size > 0 && buf.st_size < cfg->cachesize &&
+      http_init_cache (file, cache, buf.st_size, buf.st_mtime) != -1)
+    {
+      if (cfg->cachemmap && http_map_cache (cache, fd) != -1)
+        status = HTTP_CACHE_COMPLETE;
+    }
+
+  /* is the requested file already fully in the cache?  */
+  if (status == HTTP_CACHE_COMPLETE)
+    {
+      /* queue the cache entry behind the header without copying
+         it; the entry is locked until it has been sent */
+      cache->entry->hits++;
+      http_use_cache (cache->entry);
+      sock->userflags |= (HTTP_FLAG_CACHE | HTTP_FLAG_DONE);
+      http->length += cache->size;
+      svz_sock_write_chunk (sock, cache->buffer, cache->size,
+                            http_cache_sent, cache->entry);
+      if (fd != -1)
+        svz_close (fd);
     }
   /* the file is not in the cache structures yet */
   else
     {
-      sock->file_desc = fd;
+      sock->file_desc = http->desc ? http->desc->fd : fd;
       http->filelength = buf.st_size;
-      sock->flags |= SVZ_SOFLG_FILE;
+      http->fileoffset = (flags & HTTP_FLAG_PARTIAL) ? http->range.first : 0;
 
-      /*
-       * find a free slot for the new file if it is not larger
-       * than a certain size and is not "partly" in the cache
-       */
-      if (status == HTTP_CACHE_NO &&
-          buf.st_size > 0 && buf.st_size < cfg->cachesize &&
-          http_init_cache (file, cache) != -1)
+      /* read the file into the new cache entry */
+      if (cache->entry)
         {
+          sock->flags |= SVZ_SOFLG_FILE;
           sock->read_socket = http_cache_read;
           sock->disconnected_socket = http_cache_disconnect;
-          cache->entry->date = buf.st_mtime;
         }
       /*
        * either the file is not cacheable or it is currently
@@ -1318,25 +1431,15 @@ http_get_response (svz_socket_t *sock, char *request, int flags)
        */
       else
         {
-#if ENABLE_SENDFILE && (HAVE_SENDFILE || defined (__MINGW32__))
-# ifdef __MINGW32__
-          if (svz_mingw_at_least_nt4_p ())
-            {
-              sock->read_socket = NULL;
-              sock->flags &= ~SVZ_SOFLG_FILE;
-              sock->userflags |= HTTP_FLAG_SENDFILE;
-            }
-          else
-            sock->read_socket = http_file_read;
-# else
-          sock->read_socket = NULL;
-          sock->flags &= ~SVZ_SOFLG_FILE;
-          sock->userflags |= HTTP_FLAG_SENDFILE;
-          svz_tcp_cork (sock->sock_desc, 1);
-# endif
-#else /* not HAVE_SENDFILE */
-          sock->read_socket = http_file_read;
-#endif /* HAVE_SENDFILE || __MINGW32__ && ENABLE_SENDFILE */
+          http_stream_file (sock);
+
+          /* keep the whole file open for the next request */
+          if ((sock->userflags & HTTP_FLAG_SENDFILE) && !http->desc
+              && !(flags & HTTP_FLAG_PARTIAL)
+              && buf.st_size >= cfg->cachesize
+              && (http->desc = http_fd_add (file, fd, &buf, type,
+                                            cfg->types)) != NULL)
+            http_fd_use (http->desc);
         }
     }
 
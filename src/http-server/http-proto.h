@@ -34,8 +34,14 @@ typedef struct
   char *cgidir;         /* cgi directory where all cgi scripts are located */
   int cachesize;        /* maximum cache file size */
   int cacheentries;     /* maximum cache entries */
+  int cachebytes;       /* maximum size of all cache entries */
+  int cachemmap;        /* map cached files into memory */
+  int filecache;        /* maximum amount of files kept open */
+  int gzip;             /* compress cached text files on the fly */
+  int gzipstatic;       /* send precompressed "file.gz" siblings */
   int timeout;          /* timeout in seconds for keep-alive connections */
   int keepalive;        /* maximum amount of requests on a connection */
+  int pipeline;         /* maximum amount of responses queued at once */
   char *default_type;   /* the default content type */
   char *type_file;      /* content type file (e.g "/etc/mime.types") */
   svz_hash_t *types;    /* content type hash */
@@ -59,6 +65,7 @@ int http_init (svz_server_t *server);
 int http_finalize (svz_server_t *server);
 int http_global_init (svz_servertype_t *server);
 int http_global_finalize (svz_servertype_t *server);
+int http_notify (svz_server_t *server);
 
 /* basic protocol functions */
 int http_detect_proto (svz_server_t *server, svz_socket_t *sock);
@@ -72,6 +79,7 @@ int http_default_write (svz_socket_t *sock);
 int http_disconnect (svz_socket_t *sock);
 void http_free_socket (svz_socket_t *sock);
 int http_idle (svz_socket_t *sock);
+void http_stream_file (svz_socket_t *sock);
 
 /* http response functions including their flags */
 int http_get_response (svz_socket_t *sock, char *request, int flags);
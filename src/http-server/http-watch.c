@@ -0,0 +1,325 @@
+/*
+ * http-watch.c - http file cache invalidation
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+#include "networking-headers.h"
+#include "libserveez.h"
+#include "http-cache.h"
+#include "http-watch.h"
+#include "unused.h"
+
+/*
+ * The directories of the files in the http cache are watched via
+ * inotify(7), and the entries of files changing, moving or vanishing
+ * are dropped from the cache as soon as the server loop gets to know.
+ * A file which is not watched, because that is not possible on this
+ * system or for this directory, is looked at again when requested and
+ * its entry has not been checked for CACHE_RECHECK seconds.  So is a
+ * symbolic link or a file with several hard links, whose content may
+ * change via another name without any event for this directory.
+ */
+
+#if HAVE_SYS_INOTIFY_H && HAVE_INOTIFY_INIT1
+
+/* The events of a directory meaning a file within has changed.  */
+#define WATCH_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE \
+                      | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE \
+                      | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* The events meaning a directory is not watched any longer.  */
+#define WATCH_GONE (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_IGNORED)
+
+/* The inotify instance, and its socket structure in the server loop.
+   These are created when needed first, i.e. after forking the server
+   processes.  */
+static int ifd = -1;
+static svz_socket_t *watch_sock = NULL;
+
+/* The watches by directory name, and by watch descriptor.  */
+static svz_hash_t *watch_dirs = NULL;
+static svz_hash_t *watch_wds = NULL;
+
+/* Non-zero if inotify is not available.  */
+static int watch_failed = 0;
+
+static char *
+watch_key (int wd)
+{
+  static char key[32];
+
+  sprintf (key, "%d", wd);
+  return key;
+}
+
+/*
+ * Drop the entries of all files in the directory watched by WATCH from
+ * the cache, or all entries if WATCH is NULL.
+ */
+static void
+watch_drop (http_watch_t *watch)
+{
+  http_cache_entry_t *cache, *next;
+  int n = watch ? watch->entries : -1;
+
+  /* The watch is gone along with its last entry.  */
+  for (cache = http_cache_first; cache && n != 0; cache = next)
+    {
+      next = cache->next;
+      if (watch == NULL || cache->watch == watch)
+        {
+          http_drop_cache (cache);
+          n--;
+        }
+    }
+}
+
+/*
+ * Drop the entry of the file NAME in the directory of WATCH.
+ */
+static void
+watch_drop_file (http_watch_t *watch, const char *name)
+{
+  http_cache_entry_t *cache;
+  char *file;
+
+  file = svz_malloc (strlen (watch->dir) + strlen (name) + 2);
+  sprintf (file, "%s/%s", watch->dir, name);
+  if ((cache = svz_hash_get (http_cache, file)) != NULL)
+    {
+#if ENABLE_DEBUG
+      svz_log (SVZ_LOG_DEBUG, "cache: %s has changed\n", file);
+#endif
+      http_drop_cache (cache);
+    }
+  svz_free (file);
+}
+
+/*
+ * Read the pending events.  This is the @code{read_socket} callback of
+ * the inotify instance's socket structure.
+ */
+static int
+watch_read (UNUSED svz_socket_t *sock)
+{
+  char buf[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  struct inotify_event *event;
+  http_watch_t *watch;
+  ssize_t n;
+  char *p;
+
+  while ((n = read (ifd, buf, sizeof (buf))) > 0)
+    for (p = buf; p < buf + n; p += sizeof (*event) + event->len)
+      {
+        event = (struct inotify_event *) p;
+
+        /* Events have been lost, so nothing is known any longer.  */
+        if (event->mask & IN_Q_OVERFLOW)
+          {
+            svz_log (SVZ_LOG_WARNING, "cache: inotify queue overflow\n");
+            watch_drop (NULL);
+            continue;
+          }
+
+        /* The events of a directory not watched any longer are still
+           delivered after ‘inotify_rm_watch’.  */
+        if ((watch = svz_hash_get (watch_wds, watch_key (event->wd))) == NULL)
+          continue;
+        if (event->len > 0)
+          watch_drop_file (watch, event->name);
+        if (event->mask & WATCH_GONE
+            && (watch = svz_hash_get (watch_wds, watch_key (event->wd))))
+          watch_drop (watch);
+      }
+
+  if (n < 0 && errno != EAGAIN)
+    {
+      svz_log_sys_error ("cache: inotify");
+      return -1;
+    }
+  return 0;
+}
+
+static void
+watch_free (UNUSED void *k, void *v, UNUSED void *closure)
+{
+  http_watch_t *watch = v;
+
+  svz_free (watch->dir);
+  svz_free (watch);
+}
+
+/*
+ * The inotify instance is closed along with its socket structure.  Then
+ * the cache entries are checked by looking at their files again.
+ */
+static int
+watch_disconnected (UNUSED svz_socket_t *sock)
+{
+  http_cache_entry_t *cache;
+
+  for (cache = http_cache_first; cache; cache = cache->next)
+    if (cache->watch)
+      {
+        cache->watch = NULL;
+        cache->checked = 0;
+      }
+  svz_hash_foreach (watch_free, watch_wds, NULL);
+  svz_hash_destroy (watch_wds);
+  svz_hash_destroy (watch_dirs);
+  watch_wds = watch_dirs = NULL;
+  watch_sock = NULL;
+  ifd = -1;
+  return 0;
+}
+
+/*
+ * Create the inotify instance.  Return zero on success.
+ */
+static int
+watch_start (void)
+{
+  int fd;
+
+  if ((fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    {
+      svz_log_sys_error ("cache: inotify_init1");
+      return -1;
+    }
+
+  if ((watch_sock = svz_pipe_create (fd, fd)) == NULL)
+    {
+      close (fd);
+      return -1;
+    }
+
+  /* The descriptor is for reading only, and must be closed once.  */
+  svz_invalidate_handle (&watch_sock->pipe_desc[SVZ_WRITE]);
+  watch_sock->flags &= ~SVZ_SOFLG_SEND_PIPE;
+  watch_sock->flags |= SVZ_SOFLG_NOFLOOD;
+  watch_sock->read_socket = watch_read;
+  watch_sock->disconnected_socket = watch_disconnected;
+  svz_sock_enqueue (watch_sock);
+
+  ifd = fd;
+  watch_dirs = svz_hash_create (4, NULL);
+  watch_wds = svz_hash_create (4, NULL);
+  return 0;
+}
+
+/*
+ * Watch the directory of the file of the new cache entry CACHE.  Return
+ * zero on success, otherwise the file must be checked when requested.
+ */
+int
+http_watch_cache (http_cache_entry_t *cache)
+{
+  http_watch_t *watch;
+  char *dir, *p;
+  int wd;
+
+  if (watch_sock == NULL)
+    if (watch_failed || (watch_failed = watch_start ()) != 0)
+      return -1;
+
+  dir = svz_strdup (cache->file);
+  if ((p = strrchr (dir, '/')) == NULL || p == dir)
+    {
+      svz_free (dir);
+      return -1;
+    }
+  *p = '\0';
+
+  if ((watch = svz_hash_get (watch_dirs, dir)) == NULL)
+    {
+      if ((wd = inotify_add_watch (ifd, dir, WATCH_EVENTS)) == -1)
+        {
+          svz_log_sys_error ("cache: inotify_add_watch (%s)", dir);
+          svz_free (dir);
+          return -1;
+        }
+
+      /* The same directory by another name, e.g. via a symbolic link,
+         would get the events of the first name only.  */
+      if (svz_hash_get (watch_wds, watch_key (wd)) != NULL)
+        {
+          svz_free (dir);
+          return -1;
+        }
+
+      watch = svz_malloc (sizeof (http_watch_t));
+      watch->wd = wd;
+      watch->entries = 0;
+      watch->dir = dir;
+      svz_hash_put (watch_dirs, dir, watch);
+      svz_hash_put (watch_wds, watch_key (wd), watch);
+    }
+  else
+    svz_free (dir);
+
+  watch->entries++;
+  cache->watch = watch;
+  return 0;
+}
+
+/*
+ * The cache entry CACHE is going to be deleted, so do not watch its
+ * directory any longer unless there are other files within cached.
+ */
+void
+http_unwatch_cache (http_cache_entry_t *cache)
+{
+  http_watch_t *watch = cache->watch;
+
+  if (watch == NULL)
+    return;
+  cache->watch = NULL;
+  if (--watch->entries > 0)
+    return;
+
+  inotify_rm_watch (ifd, watch->wd);
+  svz_hash_delete (watch_dirs, watch->dir);
+  svz_hash_delete (watch_wds, watch_key (watch->wd));
+  watch_free (NULL, watch, NULL);
+}
+
+#else /* not (HAVE_SYS_INOTIFY_H && HAVE_INOTIFY_INIT1) */
+
+int
+http_watch_cache (UNUSED http_cache_entry_t *cache)
+{
+  return -1;
+}
+
+void
+http_unwatch_cache (UNUSED http_cache_entry_t *cache)
+{
+}
+
+#endif /* not (HAVE_SYS_INOTIFY_H && HAVE_INOTIFY_INIT1) */
@@ -0,0 +1,39 @@
+/*
+ * http-watch.h - http file cache invalidation definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HTTP_WATCH_H__
+#define __HTTP_WATCH_H__ 1
+
+#include "http-cache.h"
+
+/*
+ * A directory watched for changes of the cached files within.
+ */
+typedef struct http_watch http_watch_t;
+struct http_watch
+{
+  int wd;         /* watch descriptor */
+  int entries;    /* number of cache entries in the directory */
+  char *dir;      /* the directory name */
+};
+
+int http_watch_cache (http_cache_entry_t *cache);
+void http_unwatch_cache (http_cache_entry_t *cache);
+
+#endif /* __HTTP_WATCH_H__ */
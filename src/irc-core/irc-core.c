@@ -176,7 +176,7 @@ irc_connect_socket (UNUSED svz_server_t *server, svz_socket_t *sock)
   sock->check_request = irc_check_request;
   sock->disconnected_socket = irc_disconnect;
   sock->idle_func = irc_idle;
-  sock->idle_counter = 1;
+  svz_sock_idle_arm (sock, 1000);
   irc_start_auth (sock);
 
   return 0;
@@ -217,12 +217,7 @@ irc_check_request (svz_socket_t *sock)
     }
   while (p < sock->recv_buffer + sock->recv_buffer_fill && !retval);
 
-  if (request_len > 0 && request_len < sock->recv_buffer_fill)
-    {
-      memmove (sock->recv_buffer, packet,
-               sock->recv_buffer_fill - request_len);
-    }
-  sock->recv_buffer_fill -= request_len;
+  svz_sock_reduce_recv (sock, request_len);
 
   return retval;
 }
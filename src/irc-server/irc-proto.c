@@ -630,7 +630,7 @@ irc_idle (svz_socket_t *sock)
     {
       if (irc_register_client (sock, client, cfg))
         return -1;
-      sock->idle_counter = 1;
+      svz_sock_idle_arm (sock, 1000);
       return 0;
     }
 
@@ -652,7 +652,7 @@ irc_idle (svz_socket_t *sock)
       client->ping++;
     }
 
-  sock->idle_counter = IRC_PING_INTERVAL;
+  svz_sock_idle_arm (sock, IRC_PING_INTERVAL * 1000);
   return 0;
 }
 
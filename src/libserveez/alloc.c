@@ -30,6 +30,7 @@
 
 #include "libserveez/alloc.h"
 #include "libserveez/util.h"
+#include "libserveez/pool.h"
 
 #if DEBUG_MEMORY_LEAKS
 # include "libserveez/hash.h"
@@ -41,6 +42,13 @@
 static size_t allocated_bytes = 0;
 /* The number of memory blocks reserved by libserveez.  */
 static size_t allocated_blocks = 0;
+
+/* The coserver threads allocate memory, too.  */
+#if HAVE_COSERVER_THREADS
+# define COUNT(var, n)  __sync_add_and_fetch (&(var), (n))
+#else
+# define COUNT(var, n)  ((var) += (n))
+#endif
 #endif /* ENABLE_DEBUG */
 
 /* Default memory management functions.  */
@@ -175,9 +183,9 @@ svz_malloc (size_t size)
       block->caller = __builtin_return_address (0);
       heap_add (block);
 #endif /* DEBUG_MEMORY_LEAKS */
-      allocated_bytes += size;
+      COUNT (allocated_bytes, size);
 #endif /* ENABLE_HEAP_COUNT */
-      allocated_blocks++;
+      COUNT (allocated_blocks, 1);
       return ptr;
     }
 #else /* not ENABLE_DEBUG */
@@ -260,7 +268,7 @@ svz_realloc (void *ptr, size_t size)
           heap_add (block);
 #endif /* DEBUG_MEMORY_LEAKS */
 
-          allocated_bytes += size - old_size;
+          COUNT (allocated_bytes, size - old_size);
 #endif /* ENABLE_HEAP_COUNT */
 
           return ptr;
@@ -321,10 +329,10 @@ svz_free (void *ptr)
       size = *p;
       ptr = (void *) p;
       assert (size);
-      allocated_bytes -= size;
+      COUNT (allocated_bytes, -size);
 #endif /* ENABLE_HEAP_COUNT */
 
-      allocated_blocks--;
+      COUNT (allocated_blocks, -1);
 #endif /* ENABLE_DEBUG */
       svz_free_func (ptr);
     }
@@ -431,3 +439,16 @@ svz_get_curalloc (size_t *to)
   to[1] = allocated_blocks;
 #endif
 }
+
+/**
+ * Write values to @code{to[0]} and @code{to[1]} representing the
+ * number of bytes and blocks (socket structures and buffers) kept for
+ * reuse, respectively.  These are counted in any case, but included
+ * in the values written by @code{svz_get_curalloc} only if Serveez was
+ * configured with @samp{--enable-debug}.
+ */
+void
+svz_get_pooled (size_t *to)
+{
+  svz_pool_counters (to);
+}
@@ -60,6 +60,7 @@ SERVEEZ_API void svz_heap (void);
 /* end svzint */
 
 SERVEEZ_API void svz_get_curalloc (size_t *);
+SERVEEZ_API void svz_get_pooled (size_t *);
 
 __END_DECLS
 
@@ -64,6 +64,10 @@ svz_library_features (size_t *count)
 #ifdef ENABLE_IFLIST
     "interface-list",
 #endif
+#if defined ENABLE_EPOLL && defined HAVE_SYS_EPOLL_H \
+  && defined HAVE_EPOLL_CREATE1
+    "epoll",
+#endif
 #if defined ENABLE_POLL && defined HAVE_POLL
     "poll",
 #endif
@@ -152,7 +156,10 @@ svz__net_updn (int direction)
 #define UPDN(x)  SBO void svz__ ## x ## _updn (int direction)
 
 UPDN (log);
+UPDN (pool);
 UPDN (sock_table);
+UPDN (poller);
+UPDN (timer);
 UPDN (bindings);
 UPDN (signal);
 UPDN (interface);
@@ -176,11 +183,15 @@ svz_boot (char const *client)
   THE (boot) = time (NULL);
   SVZ_RUNPARM_X (MAX_SOCKETS, 100);
   SVZ_RUNPARM_X (VERBOSITY, SVZ_LOG_DEBUG);
+  SVZ_RUNPARM_X (COSERVER_THREADS, 0);
 
 #define UP(x)  svz__ ## x ## _updn (1)
 
   UP (log);
+  UP (pool);
   UP (sock_table);
+  UP (poller);
+  UP (timer);
   UP (bindings);
   UP (signal);
   UP (interface);
@@ -229,6 +240,8 @@ svz_runparm (int a, int b)
         {
         case SVZ_RUNPARM_VERBOSITY:   return log_verbosity;
         case SVZ_RUNPARM_MAX_SOCKETS: return THE (nclient_max);
+        case SVZ_RUNPARM_COSERVER_THREADS:
+          return THE (ncoserver_threads);
         default:                      return bad_runparm (b);
         }
 
@@ -240,6 +253,15 @@ svz_runparm (int a, int b)
       THE (nclient_max) = b;
       break;
 
+    case SVZ_RUNPARM_COSERVER_THREADS:
+#if !HAVE_COSERVER_THREADS
+      if (b > 0)
+        svz_log (SVZ_LOG_WARNING, "coserver threads not supported\n");
+      b = 0;
+#endif
+      THE (ncoserver_threads) = b < 0 ? 0 : b;
+      break;
+
     default:
       return bad_runparm (b);
     }
@@ -263,7 +285,10 @@ svz_halt (void)
   DN (interface);
   DN (signal);
   DN (bindings);
+  DN (timer);
+  DN (poller);
   DN (sock_table);
+  DN (pool);
   DN (log);
 
 #undef DN
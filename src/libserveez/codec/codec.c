@@ -226,7 +226,9 @@ svz_codec_ratio (svz_codec_t *codec, svz_codec_data_t *data)
 
 /* The following four (4) macros are receive buffer switcher used in order
    to apply the output buffer of the codec to the receive buffer of a socket
-   structure and to revert these changes.  */
+   structure and to revert these changes.  The receive buffer is compacted
+   before it is taken away from the socket structure, since only a buffer
+   starting at the beginning of its memory block can be swapped.  */
 
 #define svz_codec_set_recv_buffer(sock, data) \
   do {                                        \
@@ -237,6 +239,7 @@ svz_codec_ratio (svz_codec_t *codec, svz_codec_data_t *data)
 
 #define svz_codec_unset_recv_buffer(sock, data) \
   do {                                          \
+    svz_sock_compact_recv (sock);               \
     data->out_buffer = sock->recv_buffer;       \
     data->out_size = sock->recv_buffer_size;    \
     data->out_fill = sock->recv_buffer_fill;    \
@@ -244,6 +247,7 @@ svz_codec_ratio (svz_codec_t *codec, svz_codec_data_t *data)
 
 #define svz_codec_save_recv_buffer(sock, data) \
   do {                                         \
+    svz_sock_compact_recv (sock);              \
     data->in_buffer = sock->recv_buffer;       \
     data->in_fill = sock->recv_buffer_fill;    \
     data->in_size = sock->recv_buffer_size;    \
@@ -412,7 +416,8 @@ svz_codec_sock_receive (svz_socket_t *sock)
 }
 
 /* These are send buffer switcher used to apply the output buffer of a
-   sending codec to the send buffer of a socket structure and vice-versa.  */
+   sending codec to the send buffer of a socket structure and vice-versa.
+   Like above, the send buffer is compacted before it is swapped.  */
 
 #define svz_codec_set_send_buffer(sock, data) \
   do {                                        \
@@ -423,6 +428,7 @@ svz_codec_sock_receive (svz_socket_t *sock)
 
 #define svz_codec_unset_send_buffer(sock, data) \
   do {                                          \
+    svz_sock_compact_send (sock);               \
     data->out_buffer = sock->send_buffer;       \
     data->out_size = sock->send_buffer_size;    \
     data->out_fill = sock->send_buffer_fill;    \
@@ -430,6 +436,7 @@ svz_codec_sock_receive (svz_socket_t *sock)
 
 #define svz_codec_save_send_buffer(sock, data) \
   do {                                         \
+    svz_sock_compact_send (sock);              \
     data->in_buffer = sock->send_buffer;       \
     data->in_fill = sock->send_buffer_fill;    \
     data->in_size = sock->send_buffer_size;    \
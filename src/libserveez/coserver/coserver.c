@@ -44,24 +44,41 @@
 #include "libserveez/alloc.h"
 #include "libserveez/util.h"
 #include "libserveez/core.h"
+#include "libserveez/boot.h"
 #include "libserveez/hash.h"
 #include "libserveez/array.h"
 #include "libserveez/pipe-socket.h"
 #include "libserveez/server-core.h"
+#include "libserveez/pool.h"
 #include "libserveez/coserver/coserver.h"
 
 /* coserver-TODO: include header here */
 #include "dns.h"
 #include "reverse-dns.h"
 #include "ident.h"
+#include "resolver.h"
+#include "threads.h"
 
 #ifdef __MINGW32__
 /* define for the thread priority in Win32 */
 #define COSERVER_THREAD_PRIORITY THREAD_PRIORITY_IDLE
 #endif /* not __MINGW32__ */
 
-#define COSERVER_PACKET_BOUNDARY '\n' /* packet boundary */
-#define COSERVER_ID_BOUNDARY     ':'  /* id boundary */
+/*
+ * The header of each request and response going through the pipes: the
+ * callback id, and the number of bytes (not 0-terminated) following.  A
+ * response without any means there is no result.  Both ends belong to
+ * this very program, so the byte order does not matter.
+ */
+typedef struct
+{
+  unsigned int id;
+  unsigned int len;
+}
+frame_t;
+
+/* Bytes the coserver reads or writes at most at once.  */
+#define COSERVER_BATCH (16 * (sizeof (frame_t) + COSERVER_BUFSIZE))
 
 /*
  * This structure contains the type id and the callback
@@ -72,19 +89,33 @@ typedef struct
 {
   int type;                       /* coserver type id */
   char *name;                     /* name of the internal coserver */
-  char * (* callback) (char *);   /* coserver callback */
+  svz_coserver_func_t callback;   /* coserver callback */
   int instances;                  /* the amount of coserver instances */
   void (* init) (void);           /* coserver initialization routine */
   long last_start;                /* time stamp of the last instance ‘fork’ */
+  int ttl;                        /* seconds to cache a result ... */
+  int negative_ttl;               /* ... or the lack thereof */
+  void *data;                     /* passed to the callback */
+  int flags;                      /* SVZ_COSERVER_* flags */
 }
 svz_coservertype_t;
 
 /*
- * Both of these variables are for storing the given callbacks which get
- * called when the coservers delivered some result.
+ * The callbacks waiting for the coservers to deliver a result, indexed
+ * by the id of the request, and the socket id of the coserver asked.
+ * Unused slots are on the free stack.
  */
-static unsigned callback_id = 1;
-static svz_hash_t *callbacks = NULL;
+static svz_coserver_callback_t *slot = NULL;
+static int *owner = NULL;
+static unsigned int *freeslot = NULL;
+static unsigned int slots = 0;
+static unsigned int nfree = 0;
+
+/*
+ * Non-zero if the resolver answers the (reverse) DNS requests, so that
+ * there is no need for the respective coservers.
+ */
+static int native = 0;
 
 /*
  * Internal coserver instances.
@@ -96,19 +127,153 @@ static svz_array_t *coservers = NULL;
  */
 static svz_hash_t *friendly;
 
+/* Most results cached at once, for all types together.  */
+#define CACHE_SIZE 1024
+
+/* Seconds after which a pending request is not worth joining.  */
+#define CACHE_PATIENCE 60
+
+/*
+ * The result of a recent request, or a request still in flight as long
+ * as there are @code{waiters}.  Completed entries are kept in the LRU
+ * list until they expire or get pushed out.
+ */
+typedef struct entry entry_t;
+struct entry
+{
+  int type;                     /* coserver type */
+  char *request;                /* key in the cache of that type */
+  char *result;                 /* NULL for failed requests */
+  time_t expires;               /* time of expiry, or of impatience */
+  svz_array_t *waiters;         /* callbacks while in flight, or NULL */
+  entry_t *prev;                /* more recently used entry */
+  entry_t *next;                /* less recently used entry */
+};
+
+/*
+ * A cached result to be delivered by the next turn of the server loop.
+ */
+typedef struct hit hit_t;
+struct hit
+{
+  char *result;
+  svz_coserver_handle_result_t handle_result;
+  void *closure;
+  hit_t *next;
+};
+
+/* The entries by request, for each type.  */
+static svz_hash_t *cache[SVZ_MAX_COSERVER_TYPES];
+
+/* Completed entries, most recently used first.  */
+static entry_t *lru_head = NULL;
+static entry_t *lru_tail = NULL;
+static size_t cached = 0;
+
+static svz_coserver_cache_stats_t tally[SVZ_MAX_COSERVER_TYPES];
+
+/* Pending cache hits, and the socket whose timer delivers them.  */
+static hit_t *hits = NULL;
+static hit_t *last_hit = NULL;
+static svz_socket_t *carrier = NULL;
+
+static void spawn (int);
+
+static int cache_request (int, const char *,
+                          svz_coserver_handle_result_t, void *);
+
+/*
+ * Remember @var{handle_result} and @var{closure} until the result of a
+ * request to the coserver with socket id @var{asked} comes back.
+ * Return the id of the request.
+ */
+static unsigned int
+slot_get (int asked, svz_coserver_handle_result_t handle_result,
+          void *closure)
+{
+  unsigned int id, n;
+
+  if (nfree == 0)
+    {
+      n = slots ? 2 * slots : 16;
+      slot = svz_realloc (slot, n * sizeof (svz_coserver_callback_t));
+      owner = svz_realloc (owner, n * sizeof (int));
+      freeslot = svz_realloc (freeslot, n * sizeof (unsigned int));
+      while (slots < n)
+        {
+          slot[slots].handle_result = NULL;
+          freeslot[nfree++] = slots++;
+        }
+    }
+  id = freeslot[--nfree];
+  slot[id].handle_result = handle_result;
+  slot[id].closure = closure;
+  owner[id] = asked;
+  return id;
+}
+
+/*
+ * This static array contains the coserver structure for each type of
+ * internal coserver the core library provides.
+ */
+static svz_coservertype_t coservertypes[SVZ_MAX_COSERVER_TYPES] =
+{
+  { SVZ_COSERVER_REVERSE_DNS, "reverse dns",
+    reverse_dns_handle_request, 1, reverse_dns_init, 0, 300, 30 },
+
+  { SVZ_COSERVER_IDENT, "ident",
+    ident_handle_request, 1, NULL, 0, 0, 0 },
+
+  { SVZ_COSERVER_DNS, "dns",
+    dns_handle_request, 1, NULL, 0, 300, 30 }
+};
+
+/* The number of builtin types, which come with a cache.  */
+#define BUILTIN_TYPES  (SVZ_COSERVER_DNS + 1)
+
+/* The number of types, including those registered.  */
+static int ntypes = BUILTIN_TYPES;
+
+/*
+ * Return non-zero if the requests for coservers of type @var{type}
+ * go to the coserver threads.
+ */
+static int
+pooled (int type)
+{
+  return threads_running ()
+    && !(coservertypes[type].flags & SVZ_COSERVER_PROCESS);
+}
+
 /*
  * Invoke a @var{request} for one of the running internal coservers
  * with type @var{type}.  @var{handle_result} and @var{arg} specify what
- * should happen if the coserver delivers a result.
+ * should happen if the coserver delivers a result.  Return non-zero if
+ * there is no such coserver.
  */
-static void
-send_request (int type, const char *request,
-              svz_coserver_handle_result_t handle_result,
-              void *closure)
+static int
+dispatch (int type, const char *request,
+          svz_coserver_handle_result_t handle_result,
+          void *closure)
 {
   size_t n;
   svz_coserver_t *coserver, *current;
-  svz_coserver_callback_t *cb;
+  char buf[sizeof (frame_t) + COSERVER_BUFSIZE];
+  frame_t f;
+
+  if (native && resolver_query (type, request, handle_result, closure) == 0)
+    return 0;
+
+  if (pooled (type) && coservertypes[type].instances > 0)
+    return threads_submit (coservertypes[type].callback,
+                           coservertypes[type].data, request,
+                           handle_result, closure);
+
+  if (strlen (request) >= COSERVER_BUFSIZE)
+    {
+      svz_log (SVZ_LOG_ERROR, "coserver: request too long: %s\n", request);
+      return -1;
+    }
 
   /*
    * Go through all coservers and find out which coserver
@@ -128,31 +293,37 @@ send_request (int type, const char *request,
   /* found an appropriate coserver */
   if (coserver)
     {
-      /*
-       * Create new callback hash entry for this coserver request and
-       * put it into the global coserver callback hash.
-       */
-      cb = svz_malloc (sizeof (svz_coserver_callback_t));
-      cb->handle_result = handle_result;
-      cb->closure = closure;
-      svz_hash_put (callbacks,
-                    svz_itoa (callback_id), cb);
+      f.id = slot_get (coserver->sock->id, handle_result, closure);
+      f.len = strlen (request);
+      memcpy (buf, &f, sizeof (frame_t));
+      memcpy (buf + sizeof (frame_t), request, f.len);
 
       coserver->busy++;
 #ifdef __MINGW32__
       EnterCriticalSection (&coserver->sync);
 #endif /* __MINGW32__ */
-      if (svz_sock_printf (coserver->sock, "%u:%s\n",
-                           callback_id, request))
+      if (svz_sock_write (coserver->sock, buf, sizeof (frame_t) + f.len))
         {
           svz_sock_schedule_for_shutdown (coserver->sock);
         }
-      callback_id++;
 #ifdef __MINGW32__
       LeaveCriticalSection (&coserver->sync);
       coserver_activate (coserver->type);
 #endif /* __MINGW32__ */
+      return 0;
     }
+  return -1;
+}
+
+/*
+ * Like @code{dispatch}, but by way of the cache.
+ */
+static int
+send_request (int type, const char *request,
+              svz_coserver_handle_result_t handle_result,
+              void *closure)
+{
+  return cache_request (type, request, handle_result, closure);
 }
 
 svz_sock_iv_t *
@@ -220,24 +391,133 @@ svz_coserver_ident_invoke (svz_socket_t *sock,
   send_request (SVZ_COSERVER_IDENT, buffer, cb, closure);
 }
 
+/**
+ * Return the type of the coservers named @var{name}, or -1 if there is
+ * no such type.
+ */
+int
+svz_coserver_lookup (const char *name)
+{
+  int type;
+
+  for (type = 0; type < ntypes; type++)
+    if (!strcmp (coservertypes[type].name, name))
+      return type;
+  return -1;
+}
+
+/**
+ * Register a type of coserver named @var{name}, running the blocking
+ * routine @var{func} in @var{instances} processes (or in the coserver
+ * threads, if there are any).  @var{func} is passed each request along
+ * with @var{data}.  With @code{SVZ_COSERVER_PROCESS} in @var{flags}, the
+ * type never uses the coserver threads, e.g. if @var{func} is not
+ * reentrant.  Registering a @var{name} once more replaces its routine
+ * and restarts its coservers.  Return the type to pass to
+ * @code{svz_coserver_invoke}, or -1 on failure.
+ *
+ * If the coservers are running already, the new type is started right
+ * away.  Registered types are forgotten by @code{svz_updn_all_coservers}
+ * when finalizing.
+ */
+int
+svz_coserver_register (const char *name, svz_coserver_func_t func,
+                       void *data, int instances, int flags)
+{
+  svz_coservertype_t *coserver;
+  int type = svz_coserver_lookup (name);
+
+  if (type < 0)
+    {
+      if (ntypes == SVZ_MAX_COSERVER_TYPES)
+        {
+          svz_log (SVZ_LOG_ERROR, "coserver: too many types: %s\n", name);
+          return -1;
+        }
+      type = ntypes++;
+      coservertypes[type].type = type;
+      coservertypes[type].name = svz_strdup (name);
+    }
+  else if (type < BUILTIN_TYPES)
+    {
+      svz_log (SVZ_LOG_ERROR, "coserver: cannot replace %s\n", name);
+      return -1;
+    }
+  else if (friendly)
+    svz_coserver_destroy (type);
+
+  coserver = &coservertypes[type];
+  coserver->callback = func;
+  coserver->data = data;
+  coserver->instances = instances;
+  coserver->flags = flags;
+
+  if (friendly)
+    spawn (type);
+  return type;
+}
+
+/**
+ * Enqueue @var{request} for the coservers of type @var{type}, arranging
+ * for callback @var{cb} to be called with two args: the result (a
+ * string, or NULL if there is none) and the opaque data @var{closure}.
+ * Return non-zero if the request cannot be made; then @var{cb} is not
+ * called.
+ */
+int
+svz_coserver_invoke (int type, const char *request,
+                     svz_coserver_handle_result_t cb, void *closure)
+{
+  if (type < 0 || type >= ntypes)
+    return -1;
+  return send_request (type, request, cb, closure);
+}
+
 /*
- * This static array contains the coserver structure for each type of
- * internal coserver the core library provides.
+ * A request made on behalf of a socket.
  */
-static svz_coservertype_t coservertypes[] =
+typedef struct
 {
-  /* coserver-TODO:
-     place coserver callbacks and identification here */
+  svz_sock_iv_t iv;
+  svz_coserver_sock_result_t handle_result;
+  void *closure;
+}
+sock_request_t;
 
-  { SVZ_COSERVER_REVERSE_DNS, "reverse dns",
-    reverse_dns_handle_request, 1, reverse_dns_init, 0 },
+static int
+sock_result (char *result, void *arg)
+{
+  sock_request_t *r = arg;
+  int ret;
 
-  { SVZ_COSERVER_IDENT, "ident",
-    ident_handle_request, 1, NULL, 0},
+  ret = r->handle_result (svz_sock_find (r->iv.id, r->iv.version),
+                          result, r->closure);
+  svz_free (r);
+  return ret;
+}
 
-  { SVZ_COSERVER_DNS, "dns",
-    dns_handle_request, 1, NULL, 0 }
-};
+/**
+ * Like @code{svz_coserver_invoke}, but on behalf of @var{sock}.  The
+ * callback @var{cb} is passed that socket as first arg, or NULL if it
+ * has been shut down meanwhile.
+ */
+int
+svz_coserver_sock_invoke (int type, svz_socket_t *sock, const char *request,
+                          svz_coserver_sock_result_t cb, void *closure)
+{
+  sock_request_t *r = svz_malloc (sizeof (sock_request_t));
+
+  r->iv.id = sock->id;
+  r->iv.version = sock->version;
+  r->handle_result = cb;
+  r->closure = closure;
+  if (svz_coserver_invoke (type, request, sock_result, r))
+    {
+      svz_free (r);
+      return -1;
+    }
+  return 0;
+}
 
 /**
  * Call @var{func} for each coserver, passing additionally the second arg
@@ -259,48 +539,336 @@ svz_foreach_coserver (svz_coserver_do_t *func, void *closure)
   return 0;
 }
 
+static void
+cache_free (entry_t *e)
+{
+  svz_free (e->request);
+  svz_free (e->result);
+  svz_free (e);
+}
+
+/* Free a cache entry which may still be in flight.  */
+static void
+cache_discard (void *e)
+{
+  if (((entry_t *) e)->waiters)
+    svz_array_destroy (((entry_t *) e)->waiters);
+  cache_free (e);
+}
+
+/*
+ * Forget the cache entry @var{e}, and free it.
+ */
+static void
+cache_drop (entry_t *e)
+{
+  svz_hash_delete (cache[e->type], e->request);
+  if (e->waiters)
+    svz_array_destroy (e->waiters);
+  else
+    {
+      if (e->prev)
+        e->prev->next = e->next;
+      else
+        lru_head = e->next;
+      if (e->next)
+        e->next->prev = e->prev;
+      else
+        lru_tail = e->prev;
+      tally[e->type].entries--;
+      cached--;
+    }
+  cache_free (e);
+}
+
+/* Make the completed entry @var{e} the most recently used one.  */
+static void
+cache_push (entry_t *e)
+{
+  e->prev = NULL;
+  e->next = lru_head;
+  if (lru_head)
+    lru_head->prev = e;
+  else
+    lru_tail = e;
+  lru_head = e;
+}
+
+/*
+ * Run the callbacks of the cache hits so far.  This is the
+ * @code{idle_func} of the carrier socket.
+ */
+static int
+cache_deliver (UNUSED svz_socket_t *sock)
+{
+  hit_t *hit;
+
+  while ((hit = hits) != NULL)
+    {
+      if ((hits = hit->next) == NULL)
+        last_hit = NULL;
+      hit->handle_result (hit->result, hit->closure);
+      svz_free (hit->result);
+      svz_free (hit);
+    }
+  return 0;
+}
+
+static int
+carrier_forget (UNUSED svz_socket_t *sock)
+{
+  carrier = NULL;
+  cache_deliver (NULL);
+  return 0;
+}
+
+/*
+ * Create the socket which delivers the cache hits.  Return zero on
+ * success.  It is a pipe nobody writes to, merely for its timer.
+ */
+static int
+carrier_open (void)
+{
+  svz_t_handle desc[2];
+
+  if (svz_pipe_create_pair (desc) != 0)
+    return -1;
+  if ((carrier = svz_pipe_create (desc[SVZ_READ], desc[SVZ_WRITE])) == NULL)
+    {
+      svz_closehandle (desc[SVZ_READ]);
+      svz_closehandle (desc[SVZ_WRITE]);
+      return -1;
+    }
+  carrier->flags |= SVZ_SOFLG_RECV_PIPE | SVZ_SOFLG_NOFLOOD;
+  carrier->idle_func = cache_deliver;
+  carrier->disconnected_socket = carrier_forget;
+  svz_sock_enqueue (carrier);
+  return 0;
+}
+
+/*
+ * The result of a request sent on behalf of the cache entry @var{arg}:
+ * remember it as long as the type says, and pass it on to everybody
+ * waiting for it.
+ */
+static int
+cache_done (char *result, void *arg)
+{
+  entry_t *e = arg;
+  svz_coservertype_t *ctype = &coservertypes[e->type];
+  svz_array_t *waiters = e->waiters;
+  svz_coserver_callback_t *cb;
+  int ttl = result ? ctype->ttl : ctype->negative_ttl;
+  char *copy;
+  size_t n;
+
+  e->waiters = NULL;
+  if (ttl > 0)
+    {
+      e->result = result ? svz_strdup (result) : NULL;
+      e->expires = time (NULL) + ttl;
+      cache_push (e);
+      tally[e->type].entries++;
+      if (++cached > CACHE_SIZE)
+        cache_drop (lru_tail);
+    }
+  else
+    {
+      svz_hash_delete (cache[e->type], e->request);
+      cache_free (e);
+    }
+
+  /* Everybody gets a copy of their own to scribble on.  */
+  svz_array_foreach (waiters, cb, n)
+    {
+      copy = result ? svz_strdup (result) : NULL;
+      cb->handle_result (copy, cb->closure);
+      svz_free (copy);
+    }
+  svz_array_destroy (waiters);
+  return 0;
+}
+
 /*
- * This routine gets the coserver hash id from a given response and
- * cuts it from the given response buffer.
+ * The request sent on behalf of the cache entry @var{e} is lost with
+ * its coserver.  Tell everybody waiting for it, without remembering
+ * anything, so that the next request asks again.
  */
-static unsigned
-get_id (char *response)
+static void
+cache_fail (entry_t *e)
+{
+  svz_array_t *waiters = e->waiters;
+  svz_coserver_callback_t *cb;
+  size_t n;
+
+  e->waiters = NULL;
+  svz_hash_delete (cache[e->type], e->request);
+  cache_free (e);
+  svz_array_foreach (waiters, cb, n)
+    cb->handle_result (NULL, cb->closure);
+  svz_array_destroy (waiters);
+}
+
+/*
+ * Pass @var{handle_result} the result of @var{request} for a coserver
+ * of type @var{type}.  The result comes from the cache if possible, or
+ * from a pending request for the same thing.  Return non-zero if there
+ * is no coserver to ask.
+ */
+static int
+cache_request (int type, const char *request,
+               svz_coserver_handle_result_t handle_result,
+               void *closure)
 {
-  char *p = response;
-  unsigned id = 0;
+  svz_coserver_callback_t *cb;
+  entry_t *e;
+  hit_t *hit;
+
+  if (cache[type] == NULL || (carrier == NULL && carrier_open () != 0))
+    return dispatch (type, request, handle_result, closure);
 
-  while (*p >= '0' && *p <= '9')
+  e = svz_hash_get (cache[type], request);
+  if (e && e->waiters == NULL && e->expires <= time (NULL))
     {
-      id *= 10;
-      id += *p - '0';
-      p++;
+      cache_drop (e);
+      e = NULL;
     }
-  if (*p != COSERVER_ID_BOUNDARY)
+
+  if (e && e->waiters == NULL)
     {
-      svz_log (SVZ_LOG_WARNING,
-               "coserver: invalid protocol character (0x%02x)\n", *p);
+      tally[type].hits++;
+      if (e != lru_head)
+        {
+          e->prev->next = e->next;
+          if (e->next)
+            e->next->prev = e->prev;
+          else
+            lru_tail = e->prev;
+          cache_push (e);
+        }
+      hit = svz_malloc (sizeof (hit_t));
+      hit->result = e->result ? svz_strdup (e->result) : NULL;
+      hit->handle_result = handle_result;
+      hit->closure = closure;
+      hit->next = NULL;
+      if (last_hit)
+        last_hit->next = hit;
+      else
+        {
+          hits = hit;
+          svz_sock_idle_arm (carrier, 0);
+        }
+      last_hit = hit;
       return 0;
     }
-  p++;
 
-  while (*p != COSERVER_PACKET_BOUNDARY)
+  /* The coserver might be stuck on it.  Ask on its own.  */
+  if (e && e->expires <= time (NULL))
     {
-      *response++ = *p++;
+      tally[type].misses++;
+      return dispatch (type, request, handle_result, closure);
     }
-  *response = '\0';
-  return id;
+
+  cb = svz_malloc (sizeof (svz_coserver_callback_t));
+  cb->handle_result = handle_result;
+  cb->closure = closure;
+  if (e)
+    {
+      tally[type].joined++;
+      svz_array_add (e->waiters, cb);
+      return 0;
+    }
+
+  e = svz_calloc (sizeof (entry_t));
+  e->type = type;
+  e->request = svz_strdup (request);
+  e->expires = time (NULL) + CACHE_PATIENCE;
+  e->waiters = svz_array_create (1, svz_free);
+  svz_array_add (e->waiters, cb);
+  svz_hash_put (cache[type], request, e);
+  if (dispatch (type, request, cache_done, e))
+    {
+      cache_drop (e);
+      return -1;
+    }
+  tally[type].misses++;
+  return 0;
+}
+
+/**
+ * Write the statistics of the result cache for coservers of type
+ * @var{type} to @var{stats}.  Return zero on success, or non-zero
+ * if there is no such type, or no cache for it.
+ */
+int
+svz_coserver_cache_stats (int type, svz_coserver_cache_stats_t *stats)
+{
+  if (type < 0 || type >= ntypes || cache[type] == NULL)
+    return -1;
+  *stats = tally[type];
+  stats->name = coservertypes[type].name;
+  return 0;
 }
 
 /*
- * This function adds a given coserver hash id to the response.
+ * Create (if @var{direction} is non-zero) or destroy the cache.  Pending
+ * requests and hits are dropped without further ado, just like the
+ * callbacks of the coservers.
  */
 static void
-put_id (unsigned id, char *response)
+cache_updn (int direction)
 {
-  char buffer[COSERVER_BUFSIZE];
+  hit_t *hit;
+  int type;
+
+  for (type = 0; type < SVZ_MAX_COSERVER_TYPES; type++)
+    if (direction && type < BUILTIN_TYPES)
+      {
+        cache[type] = svz_hash_create (4, cache_discard);
+        memset (&tally[type], 0, sizeof (svz_coserver_cache_stats_t));
+      }
+    else if (!direction && cache[type])
+      {
+        svz_hash_destroy (cache[type]);
+        cache[type] = NULL;
+      }
+  lru_head = lru_tail = NULL;
+  cached = 0;
+
+  if (!direction)
+    {
+      if (carrier)
+        {
+          carrier->disconnected_socket = NULL;
+          svz_sock_shutdown (carrier);
+          carrier = NULL;
+        }
+      while ((hit = hits) != NULL)
+        {
+          hits = hit->next;
+          svz_free (hit->result);
+          svz_free (hit);
+        }
+      last_hit = NULL;
+    }
+}
 
-  snprintf (buffer, COSERVER_BUFSIZE, "%u:%s\n", id, response);
-  strcpy (response, buffer);
+/*
+ * Return the size of the frame at @var{p}, if the @var{fill} bytes there
+ * contain it completely, otherwise zero.  Store its header in @var{f}.
+ * Return -1 if the header is invalid.
+ */
+static int
+frame_size (const char *p, size_t fill, frame_t *f)
+{
+  if (fill < sizeof (frame_t))
+    return 0;
+  memcpy (f, p, sizeof (frame_t));
+  if (f->len >= COSERVER_BUFSIZE)
+    return -1;
+  if (fill - sizeof (frame_t) < f->len)
+    return 0;
+  return (int) (sizeof (frame_t) + f->len);
 }
 
 /*************************************************************************/
@@ -318,8 +886,8 @@ put_id (unsigned id, char *response)
  *
  * Unices:
  * ‘big_loop’ is a infinite loop in a separate process.  It reads
- * blocking from a receive pipe, processes the request and puts the
- * result to a sending pipe to the server.
+ * blocking from a receive pipe, processes the requests and puts the
+ * results to a sending pipe to the server, as many as it can at once.
  *
  * The coserver loop heavily differs in Win32 and Unices...
  */
@@ -342,30 +910,43 @@ put_id (unsigned id, char *response)
 # define COSERVER_RESULT()
 #endif
 
-/* Pre-Processing Macro.  */
-#define COSERVER_REQUEST()                                   \
-  COSERVER_REQUEST_INFO ();                                  \
-  /* Process the request here.  Might be blocking indeed!  */ \
-  if ((id = get_id (request)) != 0)                          \
-    {                                                        \
-      if ((result = coserver->callback (request)) == NULL)   \
-        {                                                    \
-          result = request;                                  \
-          *result = '\0';                                    \
-        }                                                    \
-      put_id (id, result);                                   \
-    }                                                        \
-
+/*
+ * Answer the request in the frame with header @var{f} and data
+ * @var{data}, writing the response frame to @var{out}.  Return its size.
+ */
+static size_t
+answer (svz_coserver_t *coserver, frame_t *f, const char *data, char *out)
+{
+  char request[COSERVER_BUFSIZE];
+  char *result;
+  frame_t r;
+
+  COSERVER_REQUEST_INFO ();
+  memcpy (request, data, f->len);
+  request[f->len] = '\0';
+
+  /* Process the request here.  Might be blocking indeed!  */
+  result = coserver->callback (request, coservertypes[coserver->type].data);
+  r.id = f->id;
+  r.len = result ? strlen (result) : 0;
+  if (r.len >= COSERVER_BUFSIZE)
+    r.len = COSERVER_BUFSIZE - 1;
+  memcpy (out, &r, sizeof (frame_t));
+  if (r.len)
+    memcpy (out + sizeof (frame_t), result, r.len);
+
+  COSERVER_RESULT ();
+  return sizeof (frame_t) + r.len;
+}
 
 #ifdef __MINGW32__
 static void
 big_loop (svz_coserver_t *coserver, svz_socket_t *sock)
 {
-  char *p;
+  char request[sizeof (frame_t) + COSERVER_BUFSIZE];
+  char result[sizeof (frame_t) + COSERVER_BUFSIZE];
   int len;
-  char request[COSERVER_BUFSIZE];
-  char *result = NULL;
-  unsigned id;
+  frame_t f;
 
   /* wait until the thread handle has been passed */
   while (svz_invalid_handle_p (coserver->thread));
@@ -374,39 +955,31 @@ big_loop (svz_coserver_t *coserver, svz_socket_t *sock)
   for (;;)
     {
       /* check if there is anything in the receive buffer */
-      while (sock->send_buffer_fill > 0)
+      for (;;)
         {
-          p = sock->send_buffer;
-          while (*p != COSERVER_PACKET_BOUNDARY &&
-                 p < sock->send_buffer + sock->send_buffer_fill)
-            p++;
-          len = p - sock->send_buffer + 1;
-
-          /* Copy the coserver request to static buffer.  */
-          assert (len <= COSERVER_BUFSIZE);
-          memcpy (request, sock->send_buffer, len);
-
-          /* Enter a synchronized section (exclusive access to all data).  */
+          /* Take the next request off the send buffer
+             (exclusive access to all data).  */
           EnterCriticalSection (&coserver->sync);
-          if (sock->send_buffer_fill > len)
+          len = frame_size (sock->send_buffer, sock->send_buffer_fill, &f);
+          if (len > 0)
             {
-              memmove (sock->send_buffer, p + 1,
-                       sock->send_buffer_fill - len);
+              memcpy (request, sock->send_buffer, len);
+              if (sock->send_buffer_fill > len)
+                memmove (sock->send_buffer, sock->send_buffer + len,
+                         sock->send_buffer_fill - len);
+              sock->send_buffer_fill -= len;
             }
-          sock->send_buffer_fill -= len;
           LeaveCriticalSection (&coserver->sync);
+          if (len <= 0)
+            break;
 
-          COSERVER_REQUEST ();
+          len = answer (coserver, &f, request + sizeof (frame_t), result);
 
-          if (id && result)
-            {
-              EnterCriticalSection (&coserver->sync);
-              memcpy (sock->recv_buffer + sock->recv_buffer_fill,
-                      result, strlen (result));
-              sock->recv_buffer_fill += strlen (result);
-              LeaveCriticalSection (&coserver->sync);
-              COSERVER_RESULT ();
-            }
+          EnterCriticalSection (&coserver->sync);
+          svz_sock_compact_recv (sock);
+          memcpy (sock->recv_buffer + sock->recv_buffer_fill, result, len);
+          sock->recv_buffer_fill += len;
+          LeaveCriticalSection (&coserver->sync);
         }
 
       /* suspend myself and wait for being resumed ...  */
@@ -419,43 +992,78 @@ big_loop (svz_coserver_t *coserver, svz_socket_t *sock)
 
 #else /* not __MINGW32__ */
 
-static void
-big_loop (svz_coserver_t *coserver, int in_pipe, int out_pipe)
+/*
+ * Write the @var{len} bytes at @var{buf} to @var{fd}.  Return zero on
+ * success.
+ */
+static int
+write_all (int fd, const char *buf, size_t len)
 {
-  FILE *in, *out;
-  char request[COSERVER_BUFSIZE];
-  char *result = NULL;
-  unsigned id;
+  ssize_t n;
 
-  if ((in = fdopen (in_pipe, "r")) == NULL)
+  while (len > 0)
     {
-      svz_log_sys_error ("coserver: fdopen (%d)", in_pipe);
-      return;
-    }
-  if ((out = fdopen (out_pipe, "w")) == NULL)
-    {
-      svz_log_sys_error ("coserver: fdopen (%d)", out_pipe);
-      return;
+      if ((n = write (fd, buf, len)) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          svz_log_sys_error ("coserver: write");
+          return -1;
+        }
+      buf += n;
+      len -= n;
     }
+  return 0;
+}
 
-  while (NULL != fgets (request, COSERVER_BUFSIZE, in))
-    {
+static void
+big_loop (svz_coserver_t *coserver, int in_pipe, int out_pipe)
+{
+  char in[COSERVER_BATCH], out[COSERVER_BATCH];
+  size_t fill = 0, done, sent;
+  ssize_t n;
+  int len;
+  frame_t f;
 
-      COSERVER_REQUEST ();
+  for (;;)
+    {
+      if ((n = read (in_pipe, in + fill, sizeof (in) - fill)) <= 0)
+        {
+          if (n < 0 && errno == EINTR)
+            continue;
+          /* error in reading pipe, or end of file */
+          if (n < 0)
+            svz_log_sys_error ("coserver: read");
+          break;
+        }
+      fill += n;
 
-      if (id && result)
+      /* Answer all the requests read so far, sending the results
+         in as few writes as possible.  */
+      done = sent = 0;
+      while ((len = frame_size (in + done, fill - done, &f)) > 0)
+        {
+          if (sent + sizeof (frame_t) + COSERVER_BUFSIZE > sizeof (out))
+            {
+              if (write_all (out_pipe, out, sent))
+                return;
+              sent = 0;
+            }
+          sent += answer (coserver, &f, in + done + sizeof (frame_t),
+                          out + sent);
+          done += len;
+        }
+      if (write_all (out_pipe, out, sent))
+        return;
+      if (len < 0)
         {
-          fprintf (out, "%s", result);
-          fflush (out);
-          COSERVER_RESULT ();
+          svz_log (SVZ_LOG_ERROR, "coserver: invalid request\n");
+          return;
         }
-    }
 
-  /* error in reading pipe */
-  if (fclose (in))
-    svz_log_sys_error ("fclose");
-  if (fclose (out))
-    svz_log_sys_error ("fclose");
+      memmove (in, in + done, fill - done);
+      fill -= done;
+    }
 }
 
 #endif /* not __MINGW32__ */
@@ -515,6 +1123,17 @@ coserver_activate (int type)
 
 #endif /* __MINGW32__ */
 
+/*
+ * Return non-zero if requests for coservers of type @var{type} are
+ * left to the resolver.
+ */
+static int
+native_type (int type)
+{
+  return native && (type == SVZ_COSERVER_DNS
+                    || type == SVZ_COSERVER_REVERSE_DNS);
+}
+
 /*
  * Return the number of currently running coservers with the type @var{type}.
  */
@@ -531,6 +1150,41 @@ count_type (int type)
   return count;
 }
 
+/*
+ * The request to be passed to @var{handle_result} along with
+ * @var{closure} will not be answered.  Pass NULL instead, or fail the
+ * cache entry waiting for it.
+ */
+static void
+lost (svz_coserver_handle_result_t handle_result, void *closure)
+{
+  if (handle_result == cache_done)
+    cache_fail (closure);
+  else
+    handle_result (NULL, closure);
+}
+
+/*
+ * The coserver with socket id @var{asked} is gone.  Pass NULL to the
+ * callbacks of all requests it has not answered yet, as if it failed
+ * each of them.
+ */
+static void
+slot_fail (int asked)
+{
+  svz_coserver_callback_t cb;
+  unsigned int id;
+
+  for (id = 0; id < slots; id++)
+    if (slot[id].handle_result != NULL && owner[id] == asked)
+      {
+        cb = slot[id];
+        slot[id].handle_result = NULL;
+        freeslot[nfree++] = id;
+        lost (cb.handle_result, cb.closure);
+      }
+}
+
 /*
  * Delete the n'th internal coserver from coserver array.
  */
@@ -580,6 +1234,7 @@ disconnect (svz_socket_t *sock)
 #endif /* HAVE_WAITPID */
           /* re-arrange the internal coserver array */
           delete_nth (n);
+          slot_fail (sock->id);
           break;
         }
     }
@@ -589,118 +1244,73 @@ disconnect (svz_socket_t *sock)
 
 /*
  * This routine has to be called for coservers requests.  It is the default
- * @code{check_request} routine for coservers detecting full responses as
- * lines (trailing '\n').
+ * @code{check_request} routine for coservers, passing each complete
+ * response frame in the receive buffer on to @code{handle_request}.
  */
 static int
 check_request (svz_socket_t *sock)
 {
-  char *packet = sock->recv_buffer;
-  char *p = packet;
-  int request_len;
-  int len = 0;
+  int len, done = 0;
+  frame_t f;
   svz_coserver_t *coserver = svz_hash_get (friendly, svz_itoa (sock->id));
 
   assert (coserver);
-  do
+  while ((len = frame_size (sock->recv_buffer + done,
+                            sock->recv_buffer_fill - done, &f)) > 0)
     {
-      /* find a line (trailing '\n') */
-      while (*p != COSERVER_PACKET_BOUNDARY &&
-             p < sock->recv_buffer + sock->recv_buffer_fill)
-        p++;
-
-      if (*p == COSERVER_PACKET_BOUNDARY &&
-          p < sock->recv_buffer + sock->recv_buffer_fill)
-        {
-          coserver->busy--;
-          p++;
-          request_len = p - packet;
-          len += request_len;
-          if (sock->handle_request)
-            sock->handle_request (sock, packet, request_len);
-          packet = p;
-        }
+      coserver->busy--;
+      if (sock->handle_request)
+        sock->handle_request (sock, sock->recv_buffer + done, len);
+      done += len;
     }
-  while (p < sock->recv_buffer + sock->recv_buffer_fill);
 
 #if ENABLE_DEBUG
   svz_log (SVZ_LOG_DEBUG, "%s: %d byte response\n",
-           coservertypes[coserver->type].name, len);
+           coservertypes[coserver->type].name, done);
 #endif
 
   /* remove data from receive buffer if necessary */
-  if (len > 0 && sock->recv_buffer_fill > len)
+  svz_sock_reduce_recv (sock, done);
+
+  if (len < 0)
     {
-      memmove (sock->recv_buffer, packet, sock->recv_buffer_fill - len);
+      svz_log (SVZ_LOG_WARNING, "coserver: invalid coserver response\n");
+      return -1;
     }
-  sock->recv_buffer_fill -= len;
-
   return 0;
 }
 
 /*
  * The standard coserver @code{handle_request} routine is called whenever
- * the standard @code{check_request} detected a full packet by any coserver.
+ * the standard @code{check_request} detected a full response frame of
+ * @var{len} bytes at @var{response} by any coserver.
  */
 static int
-handle_request (UNUSED svz_socket_t *sock, char *request, int len)
+handle_request (UNUSED svz_socket_t *sock, char *response, UNUSED int len)
 {
-  int ret;
-  unsigned id;
-  char *p, *end, *data;
-  svz_coserver_callback_t *cb;
-
-  /* Search for coserver hash id.  */
-  id = 0;
-  p = request;
-  end = p + len;
-  while (*p != COSERVER_ID_BOUNDARY && p < end)
-    {
-      if (*p < '0' || *p > '9')
-        {
-          svz_log (SVZ_LOG_WARNING,
-                   "coserver: invalid character in id (0x%02X)\n", *p);
-          return -1;
-        }
-      id *= 10;
-      id += *p - '0';
-      p++;
-    }
-  if (p == end)
-    {
-      svz_log (SVZ_LOG_WARNING, "coserver: invalid coserver response (no id)\n");
-      return -1;
-    }
-  data = ++p;
+  char data[COSERVER_BUFSIZE];
+  svz_coserver_callback_t cb;
+  frame_t f;
 
-  /* Search for packet end.  */
-  while (*p != COSERVER_PACKET_BOUNDARY && p < end)
-    p++;
-  if (p == end)
+  memcpy (&f, response, sizeof (frame_t));
+  if (f.id >= slots || slot[f.id].handle_result == NULL)
     {
-      svz_log (SVZ_LOG_WARNING,
-               "coserver: invalid coserver response (no data)\n");
+      svz_log (SVZ_LOG_ERROR, "coserver: invalid callback for id %u\n", f.id);
       return -1;
     }
-  *p = '\0';
 
-  /* Have a look at the coserver callback hash.  */
-  if (NULL == (cb = svz_hash_get (callbacks, svz_itoa (id))))
-    {
-      svz_log (SVZ_LOG_ERROR, "coserver: invalid callback for id %u\n", id);
-      return -1;
-    }
+  /* Free the slot before running the callback, which may want one.  */
+  cb = slot[f.id];
+  slot[f.id].handle_result = NULL;
+  freeslot[nfree++] = f.id;
 
   /*
-   * Run the callback inclusive its arg.  Second arg is either NULL for
-   * error detection or the actual result string.  Afterwards free the
-   * callback structure and delete it from the coserver callback hash.
+   * Run the callback inclusive its arg.  First arg is either NULL for
+   * error detection or the actual result string.
    */
-  ret = cb->handle_result (*data ? data : NULL, cb->closure);
-  svz_hash_delete (callbacks, svz_itoa (id));
-  svz_free (cb);
-
-  return ret;
+  memcpy (data, response + sizeof (frame_t), f.len);
+  data[f.len] = '\0';
+  return cb.handle_result (f.len ? data : NULL, cb.closure);
 }
 
 #ifndef __MINGW32__
@@ -759,7 +1369,7 @@ close_all (svz_socket_t *self)
       if (sock != self)
         {
           svz_sock_resize_buffers (sock, 0, 0);
-          svz_free (sock);
+          svz_pool_sock_free (sock);
         }
     }
   svz_file_closeall ();
@@ -800,13 +1410,14 @@ void
 svz_coserver_destroy (int type)
 {
   size_t n;
-  int count = 0;
+  int count = 0, asked;
   svz_coserver_t *coserver;
 
   svz_array_foreach (coservers, coserver, n)
     {
       if (coserver->type == type)
         {
+          asked = coserver->sock->id;
 #ifdef __MINGW32__
           /* stop the thread and close its handle */
           if (!TerminateThread (coserver->thread, 0))
@@ -827,6 +1438,7 @@ svz_coserver_destroy (int type)
 #endif /* HAVE_WAITPID */
 #endif /* not __MINGW32__ */
           delete_nth (n);
+          slot_fail (asked);
           n--;
           count++;
         }
@@ -889,6 +1501,8 @@ start (int type)
   if ((sock = svz_sock_alloc ()) == NULL)
     return NULL;
 
+  /* The thread fills in the receive buffer directly.  */
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_INBUF);
   InitializeCriticalSection (&coserver->sync);
   sock->write_socket = NULL;
   sock->read_socket = NULL;
@@ -1079,10 +1693,11 @@ svz_coserver_check (void)
 #endif /* __MINGW32__ */
 
   /* check the number of coserver instances of each coserver type */
-  for (n = 0; n < SVZ_MAX_COSERVER_TYPES; n++)
+  for (n = 0; n < (size_t) ntypes; n++)
     {
       ctype = &coservertypes[n];
-      if (count_type (ctype->type) < ctype->instances &&
+      if (!native_type (ctype->type) && !pooled (ctype->type) &&
+          count_type (ctype->type) < ctype->instances &&
           ((long) time (NULL)) - ctype->last_start >= 3)
         start (ctype->type);
     }
@@ -1126,6 +1741,30 @@ forget_sock (const svz_socket_t *sock)
   svz_hash_delete (friendly, svz_itoa (sock->id));
 }
 
+/*
+ * Start the coservers of type @var{type}: the threads, if desired and
+ * not running yet, or the processes.
+ */
+static void
+spawn (int type)
+{
+  svz_coservertype_t *coserver = &coservertypes[type];
+  int i;
+
+  if (native_type (type))
+    return;
+  if (coserver->init)
+    coserver->init ();
+
+  if (coserver->instances > 0
+      && !(coserver->flags & SVZ_COSERVER_PROCESS)
+      && !threads_running () && SVZ_RUNPARM (COSERVER_THREADS) > 0)
+    threads_start (SVZ_RUNPARM (COSERVER_THREADS), lost);
+
+  for (i = 0; i < coserver->instances && !pooled (type); i++)
+    start (type);
+}
+
 /*
  * Global coserver initialization.  Here you should start all the internal
  * coservers you want to use later.
@@ -1133,23 +1772,17 @@ forget_sock (const svz_socket_t *sock)
 static int
 init (void)
 {
-  int i, n;
-  svz_coservertype_t *coserver;
+  int n;
 
   friendly = svz_hash_create (1, NULL);
   svz_sock_prefree (1, forget_sock);
 
-  callbacks = svz_hash_create (4, svz_free);
-  callback_id = 1;
+  cache_updn (1);
 
-  for (n = 0; n < SVZ_MAX_COSERVER_TYPES; n++)
-    {
-      coserver = &coservertypes[n];
-      if (coserver->init)
-        coserver->init ();
-      for (i = 0; i < coserver->instances; i++)
-        start (coserver->type);
-    }
+  native = resolver_init () == 0;
+
+  for (n = 0; n < ntypes; n++)
+    spawn (n);
 
   return 0;
 }
@@ -1163,19 +1796,37 @@ finalize (void)
   int n;
   svz_coservertype_t *coserver;
 
-  for (n = 0; n < SVZ_MAX_COSERVER_TYPES; n++)
+  threads_stop ();
+  for (n = 0; n < ntypes; n++)
     {
       coserver = &coservertypes[n];
       svz_coserver_destroy (coserver->type);
     }
 
+  /* Forget the registered types.  */
+  while (ntypes > BUILTIN_TYPES)
+    {
+      coserver = &coservertypes[--ntypes];
+      svz_free (coserver->name);
+      memset (coserver, 0, sizeof (svz_coservertype_t));
+    }
+
 #if ENABLE_DEBUG
-  svz_log (SVZ_LOG_DEBUG, "coserver: %d callback(s) left\n",
-           svz_hash_size (callbacks));
+  svz_log (SVZ_LOG_DEBUG, "coserver: %u callback(s) left\n", slots - nfree);
 #endif
 
   /* Destroy all callbacks left so far.  */
-  svz_hash_destroy (callbacks);
+  svz_free (slot);
+  svz_free (owner);
+  svz_free (freeslot);
+  slot = NULL;
+  owner = NULL;
+  freeslot = NULL;
+  slots = nfree = 0;
+
+  resolver_finalize ();
+  native = 0;
+  cache_updn (0);
 
   svz_sock_prefree (0, forget_sock);
   svz_hash_destroy (friendly);
@@ -1194,8 +1845,10 @@ finalize (void)
 int
 svz_updn_all_coservers (int direction)
 {
+  int i;
+
   if (0 > direction)
-    for (int i = 0; i < SVZ_MAX_COSERVER_TYPES; i++)
+    for (i = 0; i < ntypes; i++)
       coservertypes[i].instances = 0;
 
   return (direction
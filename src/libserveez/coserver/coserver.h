@@ -28,6 +28,13 @@
 #include "libserveez/socket.h"
 /* end svzint */
 
+/*
+ * The blocking routine of a coserver: passed a request, and the data
+ * given at its registration, it returns the result (at most
+ * @code{COSERVER_BUFSIZE - 1} bytes), or NULL if there is none.
+ */
+typedef char * (* svz_coserver_func_t) (char *, void *);
+
 /*
  * Every invoked internal coserver has got such a structure.
  * It contains all the data it needs to run properly.
@@ -48,7 +55,7 @@ typedef struct
 
 #endif /* not __MINGW32__ */
 
-  char * (* callback) (char *); /* callback routine, blocking...  */
+  svz_coserver_func_t callback; /* callback routine, blocking...  */
   svz_socket_t *sock;           /* socket structure for this coserver */
   int type;                     /* coserver type id */
   int busy;                     /* is this thread currently busy?  */
@@ -86,18 +93,39 @@ typedef struct
 }
 svz_coserver_callback_t;
 
+/*
+ * Like @code{svz_coserver_handle_result_t}, but also passed the socket
+ * the request was made for, or NULL if it is gone meanwhile.
+ */
+typedef int (* svz_coserver_sock_result_t) (svz_socket_t *, char *, void *);
+
 /*
  * Types of internal servers you can start as threads or processes.
- * coserver-TODO:
- * add your coserver identification here and increase SVZ_MAX_COSERVER_TYPES
+ * Those registered by @code{svz_coserver_register} follow these.
  */
 #define SVZ_COSERVER_REVERSE_DNS 0 /* reverse DNS lookup ID */
 #define SVZ_COSERVER_IDENT       1 /* identification ID */
 #define SVZ_COSERVER_DNS         2 /* DNS lookup ID */
-#define SVZ_MAX_COSERVER_TYPES   3 /* number of different coservers */
+#define SVZ_MAX_COSERVER_TYPES   16 /* number of different coservers */
+
+/* Flags for @code{svz_coserver_register}.  */
+#define SVZ_COSERVER_PROCESS     1 /* never run in a coserver thread */
 
 typedef int (svz_coserver_do_t) (const svz_coserver_t *, void *);
 
+/*
+ * Statistics of the result cache of one type of coserver.
+ */
+typedef struct
+{
+  const char *name;             /* name of the coserver type */
+  unsigned long hits;           /* requests answered from the cache */
+  unsigned long joined;         /* requests sharing a pending lookup */
+  unsigned long misses;         /* requests passed on to the coserver */
+  unsigned long entries;        /* results currently cached */
+}
+svz_coserver_cache_stats_t;
+
 __BEGIN_DECLS
 
 SERVEEZ_API svz_sock_iv_t *svz_make_sock_iv (svz_socket_t *);
@@ -107,6 +135,15 @@ SERVEEZ_API int svz_updn_all_coservers (int);
 SERVEEZ_API void svz_coserver_destroy (int);
 SERVEEZ_API svz_coserver_t *svz_coserver_create (int);
 SERVEEZ_API const char *svz_coserver_type_name (const svz_coserver_t *);
+SERVEEZ_API int svz_coserver_cache_stats (int, svz_coserver_cache_stats_t *);
+SERVEEZ_API int svz_coserver_register (const char *, svz_coserver_func_t,
+                                       void *, int, int);
+SERVEEZ_API int svz_coserver_lookup (const char *);
+SERVEEZ_API int svz_coserver_invoke (int, const char *,
+                                     svz_coserver_handle_result_t, void *);
+SERVEEZ_API int svz_coserver_sock_invoke (int, svz_socket_t *, const char *,
+                                          svz_coserver_sock_result_t,
+                                          void *);
 
 /*
  * These are the three wrappers for our existing coservers.
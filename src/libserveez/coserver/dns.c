@@ -35,51 +35,80 @@
 #endif
 
 #include "cpp-tricks.h"
+#include "unused.h"
 
 #include "libserveez/util.h"
 #include "libserveez/core.h"
 #include "libserveez/coserver/coserver.h"
 #include "libserveez/coserver/dns.h"
 #include "libserveez/coserver/xerror.h"
+#include "libserveez/coserver/threads.h"
 
 /*
  * Proceed a single DNS lookup.
  */
 char *
-dns_handle_request (char *inbuf)
+dns_handle_request (char *inbuf, UNUSED void *data)
 {
+#if HAVE_GETADDRINFO
+  struct addrinfo hints, *res;
+  char addr[INET_ADDRSTRLEN];
+  int error;
+#else
   in_addr_t addr;
   struct hostent *host;
-  static char resolved[COSERVER_BUFSIZE];
+#endif
+  static SVZ_TLS char resolved[COSERVER_BUFSIZE + 1];
 
   if ((1 == sscanf (inbuf, PERCENT_N_S (COSERVER_BUFSIZE), resolved)))
     {
+#if HAVE_GETADDRINFO
+      /* find the host by its name, no lock needed */
+      memset (&hints, 0, sizeof (hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      if ((error = getaddrinfo (resolved, NULL, &hints, &res)) != 0)
+        {
+          svz_log (SVZ_LOG_ERROR, "dns: getaddrinfo: %s (%s)\n",
+                   xerror (error), resolved);
+          return NULL;
+        }
+
+      /* get the inet address in dotted decimal notation */
+      inet_ntop (AF_INET, &((struct sockaddr_in *) res->ai_addr)->sin_addr,
+                 addr, sizeof (addr));
+      freeaddrinfo (res);
+
+#if ENABLE_DEBUG
+      svz_log (SVZ_LOG_DEBUG, "dns: %s is %s\n", resolved, addr);
+#endif /* ENABLE_DEBUG */
+      sprintf (resolved, "%s", addr);
+      return resolved;
+#else /* not HAVE_GETADDRINFO */
       /* find the host by its name */
-      if ((host = gethostbyname (resolved)) == NULL)
+      threads_lock ();
+      if ((host = gethostbyname (resolved)) == NULL
+          || host->h_addrtype != AF_INET)
         {
+          threads_unlock ();
           svz_log (SVZ_LOG_ERROR, "dns: gethostbyname: %s (%s)\n",
-                   xerror (), resolved);
+                   xerror (0), resolved);
           return NULL;
         }
 
       /* get the inet address in network byte order */
-      if (host->h_addrtype == AF_INET)
-        {
-          memcpy (&addr, host->h_addr_list[0], host->h_length);
+      memcpy (&addr, host->h_addr_list[0], host->h_length);
 
 #if ENABLE_DEBUG
-          svz_log (SVZ_LOG_DEBUG, "dns: %s is %s\n",
-                   host->h_name, svz_inet_ntoa (addr));
+      svz_log (SVZ_LOG_DEBUG, "dns: %s is %s\n",
+               host->h_name, svz_inet_ntoa (addr));
 #endif /* ENABLE_DEBUG */
-          sprintf (resolved, "%s", svz_inet_ntoa (addr));
-          return resolved;
-        }
-    }
-  else
-    {
-      svz_log (SVZ_LOG_ERROR, "dns: protocol error\n");
-      return NULL;
+      sprintf (resolved, "%s", svz_inet_ntoa (addr));
+      threads_unlock ();
+      return resolved;
+#endif /* not HAVE_GETADDRINFO */
     }
 
+  svz_log (SVZ_LOG_ERROR, "dns: protocol error\n");
   return NULL;
 }
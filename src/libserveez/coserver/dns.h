@@ -25,7 +25,7 @@
 
 __BEGIN_DECLS
 
-SBO char *dns_handle_request (char *);
+SBO char *dns_handle_request (char *, void *);
 
 __END_DECLS
 
@@ -33,6 +33,7 @@
 # include <netdb.h>
 #endif
 
+#include "unused.h"
 #include "libserveez/core.h"
 #include "libserveez/socket.h"
 #include "libserveez/util.h"
@@ -48,13 +49,13 @@
  * gain the users name.
  */
 char *
-ident_handle_request (char *inbuf)
+ident_handle_request (char *inbuf, UNUSED void *data)
 {
   svz_t_socket sock;
   struct sockaddr_in server;
   in_addr_t addr;
   unsigned lport, rport;
-  static char ident_response[COSERVER_BUFSIZE];
+  static SVZ_TLS char ident_response[COSERVER_BUFSIZE];
   char *p_end;
   char user[64];
   char *p, *u;
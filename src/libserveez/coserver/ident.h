@@ -25,7 +25,7 @@
 
 __BEGIN_DECLS
 
-SBO char *ident_handle_request (char *);
+SBO char *ident_handle_request (char *, void *);
 
 __END_DECLS
 
@@ -0,0 +1,1244 @@
+/*
+ * resolver.c - asynchronous DNS resolver
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if HAVE_SYS_RANDOM_H
+# include <sys/random.h>
+#endif
+#include "networking-headers.h"
+#ifndef __MINGW32__
+# include <sys/types.h>
+# include <sys/socket.h>
+#endif
+#include "unused.h"
+#include "misc-macros.h"
+#include "libserveez/alloc.h"
+#include "libserveez/util.h"
+#include "libserveez/core.h"
+#include "libserveez/hash.h"
+#include "libserveez/array.h"
+#include "libserveez/socket.h"
+#include "libserveez/server-core.h"
+#include "libserveez/timer.h"
+#include "libserveez/coserver/coserver.h"
+#include "resolver.h"
+
+/*
+ * This is a stub resolver in the server loop, standing in for the
+ * (reverse) DNS coservers.  It asks the name servers listed in
+ * @file{/etc/resolv.conf} over a few UDP sockets and keeps any number
+ * of questions in flight.  Against spoofed answers, each question gets
+ * a random message id and goes out from a random one of the sockets,
+ * which are bound to random ports and replaced after a number of
+ * questions.  The idle timers of the sockets take care of
+ * retransmissions.  Names from @file{/etc/hosts} and numeric addresses
+ * are answered without asking.
+ *
+ * Like the DNS coserver, the resolver yields IPv4 addresses only.
+ */
+
+/* Where to find the name servers and the host table.  */
+#define RESOLV_CONF      "/etc/resolv.conf"
+#define RESOLV_CONF_ENV  "SERVEEZ_RESOLV_CONF"
+#define HOSTS_FILE       "/etc/hosts"
+
+#define MAX_SERVERS  8          /* name servers used at most */
+#define MAX_WORDS    16         /* words in a configuration line */
+#define DNS_PORT     53
+
+#define MAX_FLIGHT   256        /* questions in flight at most */
+#define ID_BUCKETS   64         /* hash buckets of their message ids */
+
+#define PORTS        4          /* sockets asking at once */
+#define PORT_USES    64         /* questions asked by one of them */
+#define PORT_TRIES   8          /* attempts at binding a random port */
+#define PORT_MIN     1024       /* lowest random port */
+
+#define PACKET_MAX   512        /* largest message over UDP (RFC 1035) */
+#define NAME_MAX_LEN 255        /* longest domain name */
+#define LABEL_MAX    63         /* longest label in a domain name */
+#define HEADER_SIZE  12
+#define RECV_MAX     64         /* messages handled per ‘receive’ */
+
+/* Resource record types and classes.  */
+#define TYPE_A     1
+#define TYPE_PTR   12
+#define CLASS_IN   1
+
+/* Response codes.  */
+#define RCODE_NOERROR   0
+#define RCODE_NXDOMAIN  3
+
+/* Big-endian 16-bit value at @var{p}.  */
+#define GET16(p)  (((p)[0] << 8) | (p)[1])
+
+typedef struct query query_t;
+typedef struct port port_t;
+
+/* A doubly linked list of questions.  */
+typedef struct
+{
+  query_t *head;
+  query_t *tail;
+}
+list_t;
+
+/*
+ * A single request, which may take several questions (for the names
+ * of the search list and for both address types) each of which may be
+ * sent several times.
+ */
+struct query
+{
+  int type;                     /* coserver type */
+  char *request;                /* host name or address */
+  char *result;                 /* answer, if known up front */
+  svz_coserver_handle_result_t handle_result;
+  void *closure;
+  int flying;                   /* non-zero if counted in ‘flying’ */
+  int listed;                   /* non-zero if listed by ‘id’ */
+  unsigned short id;            /* message id of the question */
+  query_t *chain;               /* next with the same hash of ‘id’ */
+  port_t *port;                 /* the socket which sent the question */
+  int qtype;                    /* type of the question */
+  char name[NAME_MAX_LEN + 1];  /* name in the question */
+  int step;                     /* candidate names tried so far */
+  int tries;                    /* transmissions of the question */
+  unsigned long expires;        /* time out (in milliseconds) */
+  list_t *list;                 /* the list the query is in */
+  query_t *prev;
+  query_t *next;
+};
+
+/*
+ * A socket asking questions from a port of its own.  It is retired
+ * after @code{PORT_USES} questions, and closed once they are answered
+ * or sent again from another one.
+ */
+struct port
+{
+  svz_socket_t *sock;           /* the socket, or NULL if gone */
+  int uses;                     /* questions sent so far */
+  int questions;                /* questions waiting for an answer */
+  int retired;                  /* non-zero if not to be used anymore */
+  list_t pending;               /* the waiting questions, by time out */
+  port_t *next;                 /* all the ports */
+};
+
+/* The sockets in use, and all of them including the retired ones.  */
+static port_t *port[PORTS];
+static port_t *ports = NULL;
+
+/* The configuration (see resolv.conf(5)).  */
+static struct sockaddr_in server[MAX_SERVERS];
+static int servers = 0;
+static svz_array_t *search = NULL;
+static int ndots;
+static int timeout;             /* per transmission, in milliseconds */
+static int attempts;            /* transmissions per name server */
+
+/* Host names by address and addresses by (lower-case) host name.  */
+static svz_hash_t *hosts = NULL;
+static svz_hash_t *addrs = NULL;
+
+/* Questions in flight by message id, and their number.  */
+static query_t *byid[ID_BUCKETS];
+static int flying;
+
+static list_t waiting;          /* for being in flight */
+static list_t ready;            /* answered up front */
+
+/* Random bytes not used yet, and the state of the fallback generator
+   for systems without a source of them.  */
+static unsigned char random_pool[256];
+static size_t random_left;
+static unsigned long seed;
+
+static void
+list_append (list_t *list, query_t *q)
+{
+  q->list = list;
+  q->next = NULL;
+  q->prev = list->tail;
+  if (list->tail)
+    list->tail->next = q;
+  else
+    list->head = q;
+  list->tail = q;
+}
+
+static void
+list_remove (query_t *q)
+{
+  list_t *list = q->list;
+
+  if (list == NULL)
+    return;
+  if (q->prev)
+    q->prev->next = q->next;
+  else
+    list->head = q->next;
+  if (q->next)
+    q->next->prev = q->prev;
+  else
+    list->tail = q->prev;
+  q->list = NULL;
+}
+
+/*
+ * Fill the pool of random bytes from the system, if possible.
+ */
+static void
+random_fill (void)
+{
+  unsigned char *p = random_pool;
+  ssize_t n = -1;
+  size_t i;
+
+#if HAVE_GETRANDOM
+  n = getrandom (p, sizeof (random_pool), 0);
+#else
+  int fd;
+
+  if ((fd = open ("/dev/urandom", O_RDONLY)) != -1)
+    {
+      n = read (fd, p, sizeof (random_pool));
+      close (fd);
+    }
+#endif
+
+  if (n != (ssize_t) sizeof (random_pool))
+    for (i = 0; i < sizeof (random_pool); i++)
+      {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        p[i] = (seed >> 16) & 0xff;
+      }
+  random_left = sizeof (random_pool);
+}
+
+/* Return a random number between 0 and 0xffff.  */
+static unsigned int
+random16 (void)
+{
+  unsigned char *p;
+
+  if (random_left < 2)
+    random_fill ();
+  random_left -= 2;
+  p = random_pool + random_left;
+  return (p[0] << 8) | p[1];
+}
+
+/*
+ * Split @var{line} into at most @var{max} whitespace separated words,
+ * dropping comments.  Return the number of words.
+ */
+static int
+split (char *line, char **word, int max)
+{
+  int n = 0;
+
+  while (n < max)
+    {
+      while (*line && isspace ((unsigned char) *line))
+        line++;
+      if (!*line || *line == '#' || *line == ';')
+        break;
+      word[n++] = line;
+      while (*line && !isspace ((unsigned char) *line))
+        line++;
+      if (*line)
+        *line++ = '\0';
+    }
+  return n;
+}
+
+/*
+ * Return non-zero if @var{name} is a valid domain name, possibly with
+ * a trailing dot.
+ */
+static int
+valid_name (const char *name)
+{
+  size_t len = strlen (name), n = 0;
+
+  if (len && name[len - 1] == '.')
+    len--;
+  if (len == 0 || len >= NAME_MAX_LEN)
+    return 0;
+  for (; len--; name++)
+    if (*name != '.')
+      {
+        if (++n > LABEL_MAX)
+          return 0;
+      }
+    else if (n == 0)
+      return 0;
+    else
+      n = 0;
+  return n > 0;
+}
+
+/*
+ * Add the name server at @var{addr}, which is an IPv4 address,
+ * optionally followed by a colon and a port number.
+ */
+static void
+add_server (char *addr)
+{
+  struct sockaddr_in *s;
+  char *port = strchr (addr, ':');
+
+  if (port && strchr (port + 1, ':'))
+    {
+      svz_log (SVZ_LOG_NOTICE, "resolver: ignoring name server %s\n", addr);
+      return;
+    }
+  if (servers == MAX_SERVERS)
+    return;
+
+  s = &server[servers];
+  memset (s, 0, sizeof (struct sockaddr_in));
+  s->sin_family = AF_INET;
+  s->sin_port = htons (DNS_PORT);
+  if (port)
+    {
+      *port++ = '\0';
+      s->sin_port = htons (atoi (port));
+    }
+  if (svz_pton (addr, &s->sin_addr) == -1)
+    {
+      svz_log (SVZ_LOG_ERROR, "resolver: invalid name server %s\n", addr);
+      return;
+    }
+  servers++;
+}
+
+/* Return the value of option @var{word}, limited to [1, @var{max}].  */
+static int
+option_value (const char *word, int max)
+{
+  int n = atoi (strchr (word, ':') + 1);
+
+  return n < 1 ? 1 : n > max ? max : n;
+}
+
+/*
+ * Read the resolver configuration from @var{file}.  Return -1 if it
+ * cannot be read.
+ */
+static int
+read_conf (const char *file)
+{
+  FILE *f;
+  char line[1024], *word[MAX_WORDS];
+  int i, n;
+
+  if ((f = fopen (file, "r")) == NULL)
+    return -1;
+
+  while (fgets (line, sizeof (line), f))
+    {
+      if ((n = split (line, word, MAX_WORDS)) < 2)
+        continue;
+      if (!strcmp (word[0], "nameserver"))
+        add_server (word[1]);
+      else if (!strcmp (word[0], "domain") || !strcmp (word[0], "search"))
+        {
+          /* The last of these wins.  */
+          svz_array_destroy (search);
+          search = svz_array_create (n - 1, svz_free);
+          for (i = 1; i < n; i++)
+            if (valid_name (word[i]))
+              svz_array_add (search, svz_strdup (word[i]));
+        }
+      else if (!strcmp (word[0], "options"))
+        for (i = 1; i < n; i++)
+          {
+            if (!strncmp (word[i], "ndots:", 6))
+              ndots = option_value (word[i], 15);
+            else if (!strncmp (word[i], "timeout:", 8))
+              timeout = 1000 * option_value (word[i], 30);
+            else if (!strncmp (word[i], "attempts:", 9))
+              attempts = option_value (word[i], 5);
+          }
+    }
+  fclose (f);
+  return 0;
+}
+
+/*
+ * Read the host table, if any.  IPv6 addresses are used for reverse
+ * lookups only.
+ */
+static void
+read_hosts (void)
+{
+  FILE *f;
+  char line[1024], *word[MAX_WORDS];
+  unsigned char bits[16];
+  int i, n;
+
+  if ((f = fopen (HOSTS_FILE, "r")) == NULL)
+    return;
+
+  hosts = svz_hash_create (4, svz_free);
+  addrs = svz_hash_create (4, svz_free);
+  while (fgets (line, sizeof (line), f))
+    {
+      if ((n = split (line, word, MAX_WORDS)) < 2)
+        continue;
+      if (svz_pton (word[0], bits) == -1
+#if IPV6_OK
+          && inet_pton (AF_INET6, word[0], bits) != 1
+#endif
+          )
+        continue;
+
+      if (!svz_hash_get (addrs, word[0]))
+        svz_hash_put (addrs, word[0], svz_strdup (word[1]));
+      if (strchr (word[0], ':'))
+        continue;
+      for (i = 1; i < n; i++)
+        if (!svz_hash_get (hosts, svz_tolower (word[i])))
+          svz_hash_put (hosts, word[i], svz_strdup (word[0]));
+    }
+  fclose (f);
+}
+
+/*
+ * Write the name to look up the address @var{addr} in the reverse
+ * mapping to @var{name}.  Return -1 if @var{addr} is not an address.
+ */
+static int
+ptr_name (const char *addr, char *name)
+{
+  unsigned char b[16];
+  int i;
+
+  if (svz_pton (addr, b) == 0)
+    {
+      sprintf (name, "%u.%u.%u.%u.in-addr.arpa", b[3], b[2], b[1], b[0]);
+      return 0;
+    }
+#if IPV6_OK
+  if (inet_pton (AF_INET6, addr, b) == 1)
+    {
+      for (i = 15; i >= 0; i--)
+        name += sprintf (name, "%x.%x.", b[i] & 0x0f, b[i] >> 4);
+      strcpy (name, "ip6.arpa");
+      return 0;
+    }
+#endif
+  return -1;
+}
+
+/*
+ * Set the name in the question of @var{q} to the next candidate built
+ * from the requested host name and the search list, in the order
+ * described in resolv.conf(5).  Return -1 if there is none left.
+ */
+static int
+next_name (query_t *q)
+{
+  const char *host = q->request;
+  size_t len = strlen (host), size;
+  int n = search ? (int) svz_array_size (search) : 0;
+  int dots = 0, k, i;
+  const char *p;
+
+  for (p = host; *p; p++)
+    if (*p == '.')
+      dots++;
+
+  for (;;)
+    {
+      k = q->step++;
+      /* Fully qualified names are never looked up in the search list.  */
+      if (host[len - 1] == '.')
+        i = k ? n : -1;
+      else if (dots >= ndots)
+        i = k - 1;
+      else
+        i = k < n ? k : k == n ? -1 : n;
+      if (i >= n)
+        return -1;
+
+      if (i < 0)
+        size = snprintf (q->name, sizeof (q->name), "%s", host);
+      else
+        size = snprintf (q->name, sizeof (q->name), "%s.%s", host,
+                         (char *) svz_array_get (search, i));
+      if (q->name[size - 1] == '.')
+        q->name[--size] = '\0';
+      if (size < NAME_MAX_LEN)
+        return 0;
+    }
+}
+
+/*
+ * Write the question of @var{q} to @var{buf} in wire format.  Return
+ * its length or -1 if the name is not valid.
+ */
+static int
+encode (query_t *q, unsigned char *buf)
+{
+  unsigned char *p = buf + HEADER_SIZE, *label;
+  const char *s = q->name;
+
+  memset (buf, 0, HEADER_SIZE);
+  buf[0] = q->id >> 8;
+  buf[1] = q->id & 0xff;
+  buf[2] = 0x01;                /* recursion desired */
+  buf[5] = 1;                   /* one question */
+
+  while (*s)
+    {
+      label = p++;
+      while (*s && *s != '.')
+        *p++ = *s++;
+      if (p - label - 1 < 1 || p - label - 1 > LABEL_MAX)
+        return -1;
+      *label = p - label - 1;
+      if (*s)
+        s++;
+    }
+  *p++ = 0;
+  *p++ = q->qtype >> 8;
+  *p++ = q->qtype & 0xff;
+  *p++ = 0;
+  *p++ = CLASS_IN;
+  return p - buf;
+}
+
+/*
+ * Read the (possibly compressed) domain name at offset @var{pos} in
+ * the message @var{buf} of @var{len} bytes into @var{name}, unless it
+ * is NULL.  Return the offset after the name or -1 if it is damaged.
+ */
+static int
+decode (const unsigned char *buf, int len, int pos, char *name)
+{
+  int end = -1, jumps = 0, n = 0, size;
+
+  for (;;)
+    {
+      if (pos >= len)
+        return -1;
+      size = buf[pos];
+      if ((size & 0xc0) == 0xc0)
+        {
+          /* A pointer to the rest of the name.  */
+          if (pos + 1 >= len || ++jumps > 64)
+            return -1;
+          if (end < 0)
+            end = pos + 2;
+          pos = ((size & 0x3f) << 8) | buf[pos + 1];
+          continue;
+        }
+      if (size & 0xc0)
+        return -1;
+      pos++;
+      if (size == 0)
+        break;
+      if (pos + size > len || n + size + 1 > NAME_MAX_LEN)
+        return -1;
+      if (name)
+        {
+          if (n)
+            name[n++] = '.';
+          memcpy (name + n, buf + pos, size);
+          n += size;
+        }
+      pos += size;
+    }
+  if (name)
+    name[n] = '\0';
+  return end < 0 ? pos : end;
+}
+
+static int receive (svz_socket_t *);
+static int expire (svz_socket_t *);
+static int forget (svz_socket_t *);
+
+/*
+ * Open a socket on a random port.  Return NULL on errors.
+ */
+static port_t *
+open_port (void)
+{
+  struct sockaddr_in addr;
+  svz_t_socket fd;
+  svz_socket_t *sock;
+  port_t *p;
+  int n;
+
+  if ((fd = svz_socket_create (SVZ_PROTO_UDP)) == (svz_t_socket) -1)
+    return NULL;
+
+  /* Leave it to the system if no random port is free.  */
+  memset (&addr, 0, sizeof (struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  for (n = 0; n < PORT_TRIES; n++)
+    {
+      addr.sin_port = htons (PORT_MIN + random16 () % (0x10000 - PORT_MIN));
+      if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == 0)
+        break;
+    }
+
+  if ((sock = svz_sock_alloc ()) == NULL)
+    {
+      svz_closesocket (fd);
+      return NULL;
+    }
+
+  svz_sock_unique_id (sock);
+  sock->sock_desc = fd;
+  sock->proto = SVZ_PROTO_UDP;
+  /* The socket is not connected to any of the name servers, but the
+     core should treat it like any other client socket.  */
+  sock->flags |= (SVZ_SOFLG_SOCK | SVZ_SOFLG_CONNECTED
+                  | SVZ_SOFLG_NOSHUTDOWN | SVZ_SOFLG_NOFLOOD
+                  | SVZ_SOFLG_COSERVER);
+  sock->read_socket = receive;
+  sock->check_request = NULL;
+  sock->idle_func = expire;
+  sock->disconnected_socket = forget;
+  svz_sock_enqueue (sock);
+  svz_sock_connections++;
+
+  p = svz_calloc (sizeof (port_t));
+  p->sock = sock;
+  p->next = ports;
+  ports = p;
+  sock->data = p;
+  return p;
+}
+
+/*
+ * Close the socket of @var{p}, if it is still there, and release
+ * @var{p}.  Its questions must have been taken care of.
+ */
+static void
+close_port (port_t *p)
+{
+  port_t **prev;
+  int i;
+
+  for (prev = &ports; *prev != p; prev = &(*prev)->next)
+    ;
+  *prev = p->next;
+  for (i = 0; i < PORTS; i++)
+    if (port[i] == p)
+      port[i] = NULL;
+
+  if (p->sock)
+    {
+      p->sock->data = NULL;
+      svz_sock_idle_cancel (p->sock);
+      svz_sock_schedule_for_shutdown (p->sock);
+    }
+  svz_free (p);
+}
+
+/*
+ * Arm the idle timer of the socket of @var{p} for the next thing to do.
+ */
+static void
+schedule (port_t *p)
+{
+  if (p->sock == NULL)
+    return;
+  if (ready.head || (p->retired && p->questions == 0))
+    svz_sock_idle_arm (p->sock, 0);
+  else if (p->pending.head)
+    svz_sock_idle_arm (p->sock, (long) (p->pending.head->expires
+                                        - svz_timer_msec ()));
+  else
+    svz_sock_idle_cancel (p->sock);
+}
+
+/*
+ * Return any socket in use, opening one if there is none.  Return NULL
+ * if that fails.
+ */
+static port_t *
+any_port (void)
+{
+  int i;
+
+  for (i = 0; i < PORTS; i++)
+    if (port[i])
+      return port[i];
+  return port[0] = open_port ();
+}
+
+/*
+ * Return a random socket to send the next question from, replacing
+ * it if it has sent enough questions already.  Return NULL if there
+ * is none.
+ */
+static port_t *
+choose_port (void)
+{
+  int i = random16 () % PORTS, n;
+  port_t *p = port[i];
+
+  if (p && p->uses >= PORT_USES)
+    {
+      p->retired = 1;
+      port[i] = NULL;
+      schedule (p);
+    }
+  if (port[i] == NULL)
+    port[i] = open_port ();
+
+  for (n = 0; n < PORTS; n++)
+    if ((p = port[(i + n) % PORTS]) != NULL)
+      return p;
+  return NULL;
+}
+
+/*
+ * Return where the question with the message id @var{id} is listed,
+ * or should be.
+ */
+static query_t **
+lookup (unsigned short id)
+{
+  query_t **q = &byid[id % ID_BUCKETS];
+
+  while (*q && (*q)->id != id)
+    q = &(*q)->chain;
+  return q;
+}
+
+/*
+ * Stop listing @var{q} by its message id.
+ */
+static void
+unlist (query_t *q)
+{
+  if (q->listed)
+    {
+      *lookup (q->id) = q->chain;
+      q->listed = 0;
+    }
+}
+
+/*
+ * Take @var{q} off its list, and the question of @var{q} back from
+ * the socket which sent it, if any.
+ */
+static void
+land (query_t *q)
+{
+  port_t *p = q->port;
+
+  list_remove (q);
+  if (p == NULL)
+    return;
+  q->port = NULL;
+  p->questions--;
+  if (p->retired && p->questions == 0)
+    schedule (p);
+}
+
+static void finish (query_t *, char *);
+
+/*
+ * (Re)send the question of @var{q}, to the next name server in turn.
+ */
+static void
+transmit (query_t *q)
+{
+  unsigned char buf[PACKET_MAX];
+  struct sockaddr_in *s = &server[q->tries % servers];
+  int len = encode (q, buf);
+  port_t *p;
+
+  land (q);
+  if ((p = choose_port ()) == NULL)
+    {
+      finish (q, NULL);
+      return;
+    }
+  q->port = p;
+  p->questions++;
+  p->uses++;
+  q->tries++;
+  q->expires = svz_timer_msec () + timeout;
+  list_append (&p->pending, q);
+  schedule (p);
+
+  if (sendto (p->sock->sock_desc, (void *) buf, len, 0,
+              (struct sockaddr *) s, sizeof (struct sockaddr_in)) < 0)
+    svz_log_net_error ("resolver: sendto");
+}
+
+/*
+ * Send the question of @var{q} again, unless it has been sent often
+ * enough already.
+ */
+static void
+retry (query_t *q)
+{
+  if (q->tries < attempts * servers)
+    transmit (q);
+  else
+    {
+      svz_log (SVZ_LOG_ERROR, "resolver: %s: no answer\n", q->request);
+      finish (q, NULL);
+    }
+}
+
+static void advance (query_t *);
+
+/*
+ * Send a new question for @var{q}, with a message id not in use.
+ */
+static void
+ask (query_t *q)
+{
+  unsigned char buf[PACKET_MAX];
+  query_t **slot;
+
+  unlist (q);
+  do
+    q->id = random16 ();
+  while (*(slot = lookup (q->id)) != NULL);
+  q->chain = NULL;
+  q->listed = 1;
+  *slot = q;
+
+  q->tries = 0;
+  if (encode (q, buf) < 0)
+    advance (q);
+  else
+    transmit (q);
+}
+
+static void admit (query_t *);
+
+/*
+ * Run the callback of @var{q} with @var{result} and release it.
+ */
+static void
+finish (query_t *q, char *result)
+{
+  query_t *next;
+
+  land (q);
+  unlist (q);
+  if (q->flying)
+    {
+      flying--;
+      if ((next = waiting.head) != NULL)
+        {
+          list_remove (next);
+          admit (next);
+        }
+    }
+
+#if ENABLE_DEBUG
+  svz_log (SVZ_LOG_DEBUG, "resolver: %s is %s\n",
+           q->request, result ? result : "unknown");
+#endif
+  q->handle_result (result, q->closure);
+  svz_free (q->result);
+  svz_free (q->request);
+  svz_free (q);
+}
+
+/*
+ * Give up on the name in the question of @var{q}: try the next one,
+ * if any.
+ */
+static void
+advance (query_t *q)
+{
+  if (q->type == SVZ_COSERVER_DNS && next_name (q) == 0)
+    {
+      q->qtype = TYPE_A;
+      ask (q);
+    }
+  else
+    finish (q, NULL);
+}
+
+/*
+ * Start asking for @var{q}, or let it wait if there are too many
+ * questions in flight.
+ */
+static void
+admit (query_t *q)
+{
+  if (flying == MAX_FLIGHT)
+    {
+      list_append (&waiting, q);
+      return;
+    }
+  flying++;
+  q->flying = 1;
+
+  if (q->type == SVZ_COSERVER_REVERSE_DNS)
+    {
+      q->qtype = TYPE_PTR;
+      ask (q);
+    }
+  else
+    advance (q);
+}
+
+/*
+ * Process the response @var{buf} of @var{len} bytes, received by the
+ * socket of @var{p}.
+ */
+static void
+handle_response (port_t *p, const unsigned char *buf, int len)
+{
+  char name[NAME_MAX_LEN + 1], result[NAME_MAX_LEN + 1];
+  int pos, count, type, size, rcode;
+  query_t *q;
+
+  if (len < HEADER_SIZE || !(buf[2] & 0x80))
+    return;
+  /* The answer must arrive where the question was sent from.  */
+  q = *lookup (GET16 (buf));
+  if (q == NULL || q->port != p || GET16 (buf + 4) != 1)
+    return;
+
+  /* The question must be ours.  */
+  if ((pos = decode (buf, len, HEADER_SIZE, name)) < 0 || pos + 4 > len
+      || strcasecmp (name, q->name) || GET16 (buf + pos) != q->qtype)
+    return;
+  pos += 4;
+
+  rcode = buf[3] & 0x0f;
+  if (rcode == RCODE_NXDOMAIN)
+    {
+      advance (q);
+      return;
+    }
+  if (rcode != RCODE_NOERROR)
+    {
+      /* Server failure or refusal: ask the next one.  */
+      if (q->tries < attempts * servers)
+        transmit (q);
+      else
+        finish (q, NULL);
+      return;
+    }
+
+  /* Take the first record of the type asked for, following any
+     aliases implicitly.  */
+  for (count = GET16 (buf + 6); count > 0; count--)
+    {
+      if ((pos = decode (buf, len, pos, NULL)) < 0 || pos + 10 > len)
+        break;
+      type = GET16 (buf + pos);
+      size = GET16 (buf + pos + 8);
+      pos += 10;
+      if (pos + size > len)
+        break;
+      if (type == q->qtype && GET16 (buf + pos - 8) == CLASS_IN)
+        {
+          if (type == TYPE_PTR)
+            {
+              if (decode (buf, len, pos, result) >= 0)
+                {
+                  finish (q, result);
+                  return;
+                }
+            }
+          else if (size == 4)
+            {
+              inet_ntop (AF_INET, buf + pos, result, sizeof (result));
+              finish (q, result);
+              return;
+            }
+        }
+      pos += size;
+    }
+
+  /* No such record.  */
+  advance (q);
+}
+
+/*
+ * The @code{read_socket} callback of the sockets.
+ */
+static int
+receive (svz_socket_t *s)
+{
+  unsigned char buf[PACKET_MAX];
+  struct sockaddr_in from;
+  socklen_t size;
+  port_t *p = s->data;
+  int n, i, len;
+
+  if (p == NULL)
+    return 0;
+
+  for (n = 0; n < RECV_MAX; n++)
+    {
+      size = sizeof (struct sockaddr_in);
+      len = recvfrom (s->sock_desc, (void *) buf, sizeof (buf), 0,
+                      (struct sockaddr *) &from, &size);
+      if (len < 0)
+        {
+          if (!svz_socket_unavailable_error_p ())
+            svz_log_net_error ("resolver: recvfrom");
+          break;
+        }
+      s->last_recv = time (NULL);
+
+      /* Only the name servers may answer.  */
+      for (i = 0; i < servers; i++)
+        if (server[i].sin_addr.s_addr == from.sin_addr.s_addr
+            && server[i].sin_port == from.sin_port)
+          {
+            handle_response (p, buf, len);
+            break;
+          }
+    }
+  schedule (p);
+  return 0;
+}
+
+/*
+ * The @code{idle_func} of the sockets: deliver the answers known up
+ * front and resend the questions which timed out.  Close a retired
+ * socket with no more questions.
+ */
+static int
+expire (svz_socket_t *s)
+{
+  unsigned long now = svz_timer_msec ();
+  port_t *p = s->data;
+  query_t *q;
+
+  while ((q = ready.head) != NULL)
+    finish (q, q->result);
+  if (p == NULL)
+    return 0;
+
+  if (p->retired && p->questions == 0)
+    {
+      close_port (p);
+      return 0;
+    }
+  while ((q = p->pending.head) != NULL && (long) (now - q->expires) >= 0)
+    retry (q);
+
+  schedule (p);
+  return 0;
+}
+
+/*
+ * The @code{disconnected_socket} callback of the sockets.  Send the
+ * questions of a socket which went away from the others, unless the
+ * server loop is being left.
+ */
+static int
+forget (svz_socket_t *s)
+{
+  port_t *p = s->data;
+  int i;
+
+  if (p == NULL)
+    return 0;
+  s->data = NULL;
+  p->sock = NULL;
+  p->retired = 1;
+  for (i = 0; i < PORTS; i++)
+    if (port[i] == p)
+      port[i] = NULL;
+  if (svz_shutting_down_p ())
+    return 0;
+
+  while (p->pending.head)
+    retry (p->pending.head);
+  close_port (p);
+
+  if (any_port () == NULL)
+    {
+      while (ready.head)
+        finish (ready.head, ready.head->result);
+      while (waiting.head)
+        finish (waiting.head, NULL);
+    }
+  return 0;
+}
+
+/*
+ * Ask for the address of the host name (@var{type} is
+ * @code{SVZ_COSERVER_DNS}) or the host name of the address
+ * (@code{SVZ_COSERVER_REVERSE_DNS}) @var{request}, and arrange for
+ * @var{handle_result} to be called with the answer and @var{closure}
+ * later.  The address is always an IPv4 address in dotted decimal
+ * notation.  Return -1 if the resolver cannot answer this kind of
+ * request.
+ */
+int
+resolver_query (int type, const char *request,
+                svz_coserver_handle_result_t handle_result, void *closure)
+{
+  unsigned char bits[16];
+  char *local, host[NAME_MAX_LEN + 1];
+  query_t *q, *query;
+  port_t *p;
+
+  if (servers == 0
+      || (type != SVZ_COSERVER_DNS && type != SVZ_COSERVER_REVERSE_DNS))
+    return -1;
+  if ((p = any_port ()) == NULL)
+    return -1;
+
+  q = query = svz_calloc (sizeof (query_t));
+  q->type = type;
+  q->request = svz_strdup (request);
+  q->handle_result = handle_result;
+  q->closure = closure;
+
+  /* Answer right away if possible, but call back later nevertheless.  */
+  if (type == SVZ_COSERVER_REVERSE_DNS)
+    {
+      if (addrs && (local = svz_hash_get (addrs, request)) != NULL)
+        q->result = svz_strdup (local);
+      else if (ptr_name (request, q->name) == 0)
+        q = NULL;
+    }
+  else
+    {
+      snprintf (host, sizeof (host), "%s", request);
+      if (*host && host[strlen (host) - 1] == '.')
+        host[strlen (host) - 1] = '\0';
+      if (hosts && (local = svz_hash_get (hosts, svz_tolower (host))))
+        q->result = svz_strdup (local);
+      else if (svz_pton (request, bits) == 0)
+        q->result = svz_strdup (inet_ntop (AF_INET, bits, host,
+                                           sizeof (host)));
+      else if (valid_name (request))
+        q = NULL;
+    }
+
+  if (q)
+    list_append (&ready, q);
+  else
+    admit (query);
+  schedule (p);
+  return 0;
+}
+
+static void
+free_list (list_t *list)
+{
+  query_t *q;
+
+  while ((q = list->head) != NULL)
+    {
+      list_remove (q);
+      svz_free (q->result);
+      svz_free (q->request);
+      svz_free (q);
+    }
+}
+
+/*
+ * Read the configuration.  Return -1 if there is none, in which case
+ * the resolver refuses to answer any request.
+ */
+int
+resolver_init (void)
+{
+  const char *file = getenv (RESOLV_CONF_ENV);
+  int n;
+
+  servers = 0;
+  ndots = 1;
+  timeout = 5000;
+  attempts = 2;
+  for (n = 0; n < ID_BUCKETS; n++)
+    byid[n] = NULL;
+  for (n = 0; n < PORTS; n++)
+    port[n] = NULL;
+  flying = 0;
+  seed = (unsigned long) time (NULL) ^ (unsigned long) SVZ_PTR2NUM (&n);
+  seed ^= (unsigned long) getpid () << 16;
+  if (seed == 0)
+    seed = 1;
+  random_left = 0;
+
+  if (file == NULL)
+    file = RESOLV_CONF;
+  if (read_conf (file) == -1)
+    {
+      svz_log (SVZ_LOG_NOTICE, "resolver: cannot read %s\n", file);
+      return -1;
+    }
+  /* Use the local name server by default.  */
+  if (servers == 0)
+    add_server ("127.0.0.1");
+  read_hosts ();
+
+  svz_log (SVZ_LOG_NOTICE, "resolver: using %d name server(s)\n", servers);
+  return 0;
+}
+
+/*
+ * Drop all requests without calling their callbacks, and close the
+ * sockets.
+ */
+void
+resolver_finalize (void)
+{
+  int n;
+
+  free_list (&ready);
+  free_list (&waiting);
+  while (ports)
+    {
+      free_list (&ports->pending);
+      close_port (ports);
+    }
+  for (n = 0; n < ID_BUCKETS; n++)
+    byid[n] = NULL;
+  flying = 0;
+  servers = 0;
+
+  svz_array_destroy (search);
+  search = NULL;
+  svz_hash_destroy (hosts);
+  hosts = NULL;
+  svz_hash_destroy (addrs);
+  addrs = NULL;
+}
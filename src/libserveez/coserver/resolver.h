@@ -0,0 +1,35 @@
+/*
+ * resolver.h - asynchronous DNS resolver definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RESOLVER_H__
+#define __RESOLVER_H__ 1
+
+#include "libserveez/defines.h"
+#include "libserveez/coserver/coserver.h"
+
+__BEGIN_DECLS
+
+SBO int resolver_init (void);
+SBO void resolver_finalize (void);
+SBO int resolver_query (int, const char *,
+                        svz_coserver_handle_result_t, void *);
+
+__END_DECLS
+
+#endif /* not __RESOLVER_H__ */
@@ -35,11 +35,13 @@
 #endif
 
 #include "cpp-tricks.h"
+#include "unused.h"
 
 #include "libserveez/util.h"
 #include "libserveez/coserver/coserver.h"
 #include "libserveez/coserver/reverse-dns.h"
 #include "libserveez/coserver/xerror.h"
+#include "libserveez/coserver/threads.h"
 
 #define MAX_CACHE_ENTRIES 1024 /* nslookup cache entries */
 
@@ -50,7 +52,7 @@ typedef struct
 {
   int entries;
   in_addr_t ip[MAX_CACHE_ENTRIES];
-  char resolved[COSERVER_BUFSIZE][MAX_CACHE_ENTRIES];
+  char resolved[MAX_CACHE_ENTRIES][COSERVER_BUFSIZE];
 }
 reverse_dns_cache_t;
 
@@ -67,16 +69,36 @@ reverse_dns_init (void)
 
 #define MAX_IP_STRING_LENGTH  15        /* www.xxx.yyy.zzz */
 
+/*
+ * Return the index of @var{addr} in the cache, or -1 if it is not there.
+ * The caller holds the lock.
+ */
+static int
+cache_find (in_addr_t addr)
+{
+  int n;
+
+  for (n = 0; n < cache.entries; n++)
+    if (cache.ip[n] == addr)
+      return n;
+  return -1;
+}
+
 /*
  * Proceed a reverse DNS lookup.
  */
 char *
-reverse_dns_handle_request (char *inbuf)
+reverse_dns_handle_request (char *inbuf, UNUSED void *data)
 {
   char ip[1 + MAX_IP_STRING_LENGTH];
   in_addr_t addr[2];
+#if HAVE_GETADDRINFO
+  struct sockaddr_in sa;
+  int error;
+#else
   struct hostent *host;
-  static char resolved[COSERVER_BUFSIZE];
+#endif
+  static SVZ_TLS char resolved[COSERVER_BUFSIZE];
   int n;
 
   if ((1 == sscanf (inbuf, PERCENT_N_S (MAX_IP_STRING_LENGTH), ip)))
@@ -87,37 +109,54 @@ reverse_dns_handle_request (char *inbuf)
       /*
        * look up the ip->host cache first
        */
-      for (n = 0; n < cache.entries; n++)
+      threads_lock ();
+      if ((n = cache_find (addr[0])) >= 0)
         {
-          if (cache.ip[n] == addr[0])
-            {
-              sprintf (resolved, "%s", cache.resolved[n]);
-              return resolved;
-            }
+          sprintf (resolved, "%s", cache.resolved[n]);
+          threads_unlock ();
+          return resolved;
         }
 
+#if HAVE_GETADDRINFO
+      /* ask without the lock, so that other lookups can go on */
+      threads_unlock ();
+      memset (&sa, 0, sizeof (sa));
+      sa.sin_family = AF_INET;
+      sa.sin_addr.s_addr = addr[0];
+      if ((error = getnameinfo ((struct sockaddr *) &sa, sizeof (sa),
+                                resolved, COSERVER_BUFSIZE, NULL, 0,
+                                NI_NAMEREQD)) != 0)
+        {
+          svz_log (SVZ_LOG_ERROR, "reverse dns: getnameinfo: %s (%s)\n",
+                   xerror (error), ip);
+          return NULL;
+        }
+      threads_lock ();
+#else /* not HAVE_GETADDRINFO */
       if ((host = gethostbyaddr ((char *) addr, sizeof (addr[0]), AF_INET))
           == NULL)
         {
+          threads_unlock ();
           svz_log (SVZ_LOG_ERROR, "reverse dns: gethostbyaddr: %s (%s)\n",
-                   xerror (), ip);
+                   xerror (0), ip);
           return NULL;
         }
-      else
+      snprintf (resolved, COSERVER_BUFSIZE, "%s", host->h_name);
+#endif /* not HAVE_GETADDRINFO */
+
+      /* somebody else might have been quicker meanwhile */
+      if (cache_find (addr[0]) < 0 && cache.entries < MAX_CACHE_ENTRIES)
         {
-          if (n < MAX_CACHE_ENTRIES)
-            {
-              strcpy (cache.resolved[n], host->h_name);
-              cache.ip[n] = addr[0];
-              cache.entries++;
-            }
+          n = cache.entries++;
+          snprintf (cache.resolved[n], COSERVER_BUFSIZE, "%s", resolved);
+          cache.ip[n] = addr[0];
+        }
+      threads_unlock ();
 
 #if ENABLE_DEBUG
-          svz_log (SVZ_LOG_DEBUG, "reverse dns: %s is %s\n", ip, host->h_name);
+      svz_log (SVZ_LOG_DEBUG, "reverse dns: %s is %s\n", ip, resolved);
 #endif /* ENABLE_DEBUG */
-          sprintf (resolved, "%s", host->h_name);
-          return resolved;
-        }
+      return resolved;
     }
   else
     {
@@ -26,7 +26,7 @@
 __BEGIN_DECLS
 
 SBO void reverse_dns_init (void);
-SBO char *reverse_dns_handle_request (char *);
+SBO char *reverse_dns_handle_request (char *, void *);
 
 __END_DECLS
 
@@ -0,0 +1,392 @@
+/*
+ * threads.c - coservers running as threads
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if HAVE_COSERVER_THREADS
+# include <pthread.h>
+#endif
+#include "networking-headers.h"
+#include "unused.h"
+#include "libserveez/alloc.h"
+#include "libserveez/util.h"
+#include "libserveez/socket.h"
+#include "libserveez/pipe-socket.h"
+#include "libserveez/server-core.h"
+#include "libserveez/coserver/coserver.h"
+#include "misc-macros.h"
+#include "threads.h"
+
+/*
+ * With the @code{SVZ_RUNPARM_COSERVER_THREADS} run parameter set, the
+ * coservers are a fixed number of threads of the server process instead
+ * of processes of their own, each of them serving requests of any type.
+ * There is no copying through pipes, and a thread costs a stack only.
+ *
+ * The requests wait in a list under a mutex, where idle threads sleep
+ * on a condition.  The results are pushed onto a lock-free stack; the
+ * push onto an empty one writes a byte to a pipe, waking up the server
+ * loop, which takes them all at once.
+ */
+
+#if HAVE_COSERVER_THREADS
+
+/* A request, and then its result.  */
+typedef struct job
+{
+  struct job *next;
+  svz_coserver_func_t callback;         /* the blocking routine ... */
+  void *arg;                            /* ... and its data */
+  svz_coserver_handle_result_t handle_result;
+  void *closure;
+  int failed;                           /* non-zero if there is no result */
+  char data[COSERVER_BUFSIZE];          /* the request, then the result */
+}
+job_t;
+
+/* The threads.  */
+static pthread_t *thread = NULL;
+static int nthreads = 0;
+
+/* The requests not taken yet, oldest first.  */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static job_t *head = NULL, *tail = NULL;
+static int stopping = 0;
+
+/* The results not delivered yet, newest first.  */
+static job_t *done = NULL;
+
+/* The pipe waking up the server loop, and its receiving end.  */
+static svz_t_handle wake[2];
+static svz_socket_t *sock = NULL;
+
+/* Serializing the calls of non-reentrant library routines.  */
+static pthread_mutex_t libc = PTHREAD_MUTEX_INITIALIZER;
+
+/* Failing the requests which are dropped.  */
+static threads_lost_t lost = NULL;
+
+/*
+ * Drop the jobs in the list @var{job}, telling whoever waits for each
+ * of them that there is no result.
+ */
+static void
+discard (job_t *job)
+{
+  job_t *next;
+
+  for (; job; job = next)
+    {
+      next = job->next;
+      lost (job->handle_result, job->closure);
+      svz_free (job);
+    }
+}
+
+/*
+ * The main routine of each thread: run the requests until stopped.
+ */
+static void *
+work (UNUSED void *arg)
+{
+  job_t *job, *top;
+  char *result;
+  size_t len;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&lock);
+      while (head == NULL && !stopping)
+        pthread_cond_wait (&wakeup, &lock);
+      if (stopping)
+        {
+          pthread_mutex_unlock (&lock);
+          break;
+        }
+      job = head;
+      if ((head = job->next) == NULL)
+        tail = NULL;
+      pthread_mutex_unlock (&lock);
+
+      /* The result may well live in the request buffer.  */
+      result = job->callback (job->data, job->arg);
+      job->failed = (result == NULL || *result == '\0');
+      if (!job->failed)
+        {
+          len = strlen (result);
+          if (len >= COSERVER_BUFSIZE)
+            len = COSERVER_BUFSIZE - 1;
+          memmove (job->data, result, len);
+          job->data[len] = '\0';
+        }
+
+      do
+        top = job->next = done;
+      while (!__sync_bool_compare_and_swap (&done, top, job));
+
+      if (top == NULL
+          && write ((int) wake[SVZ_WRITE], "", 1) < 0 && errno != EAGAIN)
+        svz_log_sys_error ("coserver: write");
+    }
+  return NULL;
+}
+
+/*
+ * Deliver the results.  This is the @code{read_socket} callback of the
+ * receiving end of the pipe.
+ */
+static int
+deliver (svz_socket_t *s)
+{
+  job_t *job, *next, *list = NULL;
+  char buf[64];
+
+  /* Drain the pipe first, so a result pushed meanwhile leaves a byte
+     in it and is not missed.  */
+  while (read ((int) s->pipe_desc[SVZ_READ], buf, sizeof (buf)) > 0)
+    ;
+
+  /* Take them all, in the order of completion.  */
+  for (job = __sync_lock_test_and_set (&done, NULL); job; job = next)
+    {
+      next = job->next;
+      job->next = list;
+      list = job;
+    }
+
+  for (job = list; job; job = next)
+    {
+      next = job->next;
+      job->handle_result (job->failed ? NULL : job->data, job->closure);
+      svz_free (job);
+    }
+  return 0;
+}
+
+/*
+ * The pipe is going to be closed, so the threads must be gone first.
+ */
+static int
+disconnected (UNUSED svz_socket_t *s)
+{
+  sock = NULL;
+  threads_stop ();
+  return 0;
+}
+
+/*
+ * Start @var{n} threads.  The requests dropped when they stop are
+ * passed to @var{fail}.  Return zero on success.
+ */
+int
+threads_start (int n, threads_lost_t fail)
+{
+  sigset_t all, old;
+  int i, err;
+
+  if (n < 1 || nthreads)
+    return -1;
+
+#if DEBUG_MEMORY_LEAKS
+  svz_log (SVZ_LOG_WARNING, "coserver threads disabled by heap debugging\n");
+  return -1;
+#endif
+
+  if (svz_pipe_create_pair (wake) != 0)
+    return -1;
+  if ((sock = svz_pipe_create (wake[SVZ_READ], wake[SVZ_WRITE])) == NULL)
+    {
+      svz_closehandle (wake[SVZ_READ]);
+      svz_closehandle (wake[SVZ_WRITE]);
+      return -1;
+    }
+  sock->flags |= SVZ_SOFLG_RECV_PIPE | SVZ_SOFLG_NOFLOOD;
+  sock->read_socket = deliver;
+  sock->disconnected_socket = disconnected;
+  svz_sock_enqueue (sock);
+
+  /* Signals are for the main thread only.  */
+  stopping = 0;
+  lost = fail;
+  thread = svz_malloc (n * sizeof (pthread_t));
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (i = 0; i < n; i++)
+    {
+      if ((err = pthread_create (&thread[nthreads], NULL, work, NULL)) != 0)
+        {
+          svz_log (SVZ_LOG_ERROR, "pthread_create: %s\n", strerror (err));
+          break;
+        }
+      nthreads++;
+    }
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  if (nthreads == 0)
+    {
+      threads_stop ();
+      return -1;
+    }
+  svz_log (SVZ_LOG_NOTICE, "running coservers in %d threads\n", nthreads);
+  return 0;
+}
+
+/*
+ * Stop the threads, failing the requests not served yet along with
+ * those whose results are not delivered yet.  This waits for requests
+ * being served, e.g. an ident lookup until it times out.
+ */
+void
+threads_stop (void)
+{
+  svz_socket_t *s = sock;
+  job_t *queued;
+  int i;
+
+  pthread_mutex_lock (&lock);
+  stopping = 1;
+  pthread_cond_broadcast (&wakeup);
+  pthread_mutex_unlock (&lock);
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join (thread[i], NULL);
+  svz_free_and_zero (thread);
+  nthreads = 0;
+
+  queued = head;
+  head = tail = NULL;
+  discard (queued);
+  discard (__sync_lock_test_and_set (&done, NULL));
+
+  if (s)
+    {
+      sock = NULL;
+      s->disconnected_socket = NULL;
+      svz_sock_shutdown (s);
+    }
+}
+
+/*
+ * Return non-zero if there are threads running.
+ */
+int
+threads_running (void)
+{
+  return nthreads > 0;
+}
+
+/*
+ * Hand @var{request} over to the threads, to be passed to
+ * @var{callback} along with @var{arg}.  Its result is passed to
+ * @var{handle_result} along with @var{closure} later on.  Return zero
+ * on success.
+ */
+int
+threads_submit (svz_coserver_func_t callback, void *arg, const char *request,
+                svz_coserver_handle_result_t handle_result, void *closure)
+{
+  job_t *job;
+  size_t len = strlen (request);
+
+  if (nthreads == 0 || len >= COSERVER_BUFSIZE)
+    return -1;
+
+  job = svz_malloc (sizeof (job_t));
+  job->next = NULL;
+  job->callback = callback;
+  job->arg = arg;
+  job->handle_result = handle_result;
+  job->closure = closure;
+  memcpy (job->data, request, len + 1);
+
+  pthread_mutex_lock (&lock);
+  if (tail)
+    tail->next = job;
+  else
+    head = job;
+  tail = job;
+  pthread_cond_signal (&wakeup);
+  pthread_mutex_unlock (&lock);
+  return 0;
+}
+
+/*
+ * Enter and leave the section where a coserver routine uses shared
+ * data, e.g. the reverse DNS cache, or calls library routines which are
+ * not reentrant, e.g. @code{gethostbyname} where @code{getaddrinfo} is
+ * not available.
+ */
+void
+threads_lock (void)
+{
+  pthread_mutex_lock (&libc);
+}
+
+void
+threads_unlock (void)
+{
+  pthread_mutex_unlock (&libc);
+}
+
+#else /* not HAVE_COSERVER_THREADS */
+
+int
+threads_start (UNUSED int n, UNUSED threads_lost_t fail)
+{
+  return -1;
+}
+
+void
+threads_stop (void)
+{
+}
+
+int
+threads_running (void)
+{
+  return 0;
+}
+
+int
+threads_submit (UNUSED svz_coserver_func_t callback, UNUSED void *arg,
+                UNUSED const char *request,
+                UNUSED svz_coserver_handle_result_t handle_result,
+                UNUSED void *closure)
+{
+  return -1;
+}
+
+void
+threads_lock (void)
+{
+}
+
+void
+threads_unlock (void)
+{
+}
+
+#endif /* not HAVE_COSERVER_THREADS */
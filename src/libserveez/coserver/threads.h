@@ -0,0 +1,41 @@
+/*
+ * threads.h - coserver threads definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __THREADS_H__
+#define __THREADS_H__ 1
+
+#include "libserveez/defines.h"
+#include "libserveez/coserver/coserver.h"
+
+/* What to do with a request which is dropped.  */
+typedef void (* threads_lost_t) (svz_coserver_handle_result_t, void *);
+
+__BEGIN_DECLS
+
+SBO int threads_start (int, threads_lost_t);
+SBO void threads_stop (void);
+SBO int threads_running (void);
+SBO int threads_submit (svz_coserver_func_t, void *, const char *,
+                        svz_coserver_handle_result_t, void *);
+SBO void threads_lock (void);
+SBO void threads_unlock (void);
+
+__END_DECLS
+
+#endif /* not __THREADS_H__ */
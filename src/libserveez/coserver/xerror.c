@@ -24,6 +24,7 @@
 #ifdef HAVE_NETDB_H
 # include <netdb.h>
 #endif
+#include "unused.h"
 #include "libserveez/util.h"
 
 #if !defined HAVE_DECL_H_ERRNO
@@ -40,13 +41,20 @@ extern char * hstrerror (int);
 #endif
 #endif
 
+/*
+ * Return a string describing the failure @var{error} of
+ * @code{getaddrinfo} or @code{getnameinfo}, or if these are not
+ * available, the last failure of @code{gethostbyname} or
+ * @code{gethostbyaddr}.
+ */
 const char *
-xerror (void)
+xerror (UNUSED int error)
 {
-#if defined __MINGW32__
+#if HAVE_GETADDRINFO
+  return gai_strerror (error);
+#elif defined __MINGW32__
   return svz_net_strerror (void);
 #else
-  /* FIXME: Use ‘gai_strerror’ (on switch to get{name,addr}info).  */
   return hstrerror (h_errno);
 #endif
 }
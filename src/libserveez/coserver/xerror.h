@@ -24,7 +24,7 @@
 
 __BEGIN_DECLS
 
-SBO const char *xerror (void);
+SBO const char *xerror (int);
 
 __END_DECLS
 
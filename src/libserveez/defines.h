@@ -93,6 +93,9 @@ typedef struct
 
   int nclient_max;
   /* Maxium number of clients allowed to connect.  */
+
+  int ncoserver_threads;
+  /* Number of threads serving coserver requests, 0 for processes.  */
 } svz_private_t;
 
 __BEGIN_DECLS
@@ -101,5 +104,13 @@ __END_DECLS
 
 #define THE(x)  svz_private->x
 
+/* Storage class of the static buffers each coserver thread keeps to
+   itself.  */
+#if HAVE_COSERVER_THREADS
+#define SVZ_TLS  __thread
+#else
+#define SVZ_TLS
+#endif
+
 /* end svzint */
 #endif /* !__DEFINES_H__ */
@@ -24,66 +24,164 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "libserveez/alloc.h"
 #include "libserveez/util.h"
 #include "libserveez/hash.h"
+#include "misc-macros.h"
 
 #if DEBUG_MEMORY_LEAKS
 # define svz_free(ptr) svz_free_func (ptr)
 # define svz_malloc(size) svz_malloc_func (size)
-# define svz_realloc(ptr, size) svz_realloc_func (ptr, size)
 #endif /* DEBUG_MEMORY_LEAKS */
 
+/*
+ * The hash table is a single array of entries, using open addressing
+ * with linear probing and ‘Robin Hood’ insertion: an entry being
+ * inserted takes the slot of any entry it passes which is closer to its
+ * own home slot, and the displaced entry moves on in its place.  This
+ * keeps the probe sequences short and evenly long, so that a lookup can
+ * stop as soon as it finds an entry closer to home than the key it looks
+ * for would be.  Deletion shifts the following entries back by one slot
+ * instead of leaving a tombstone.
+ *
+ * Keys of up to ‘HASH_INLINE’ bytes are stored within the entry itself,
+ * longer ones in a separately allocated copy.  Hence the key pointers
+ * passed to a @code{svz_hash_foreach} callback or returned by
+ * @code{svz_hash_contains} are valid only until the table is modified.
+ *
+ * Resizing is spread over many calls, so that none of them takes long.
+ * It starts by allocating the new table, which each subsequent put and
+ * delete clears a part of.  A table is prepared for growing once it is
+ * five eighths full, and for shrinking once it is a quarter full.  When
+ * the new table is clear, it replaces the old one, but the entries stay
+ * where they are: each put and delete moves a few of them over (scanning
+ * the old table from its start), and lookups search both tables until
+ * the old one is empty.  Lookups themselves do not move anything, so
+ * that they keep the keys in place and are safe to do concurrently.
+ * Since growing doubles the size of a table, and shrinking halves it,
+ * the migration is complete long before the new table fills up.
+ */
+
 /* some useful defines */
-#define HASH_SHRINK_LIMIT(hash) (hash->buckets >> 2)
-#define HASH_EXPAND_LIMIT(hash) ((hash->buckets >> 1) + (hash->buckets >> 2))
-#define HASH_BUCKET(code, hash) (code & (hash->buckets - 1))
+#define HASH_SHRINK_LIMIT(buckets) ((buckets) >> 2)
+#define HASH_EXPAND_LIMIT(buckets) (((buckets) >> 1) + ((buckets) >> 2))
+#define HASH_PREPARE_LIMIT(buckets) (((buckets) >> 1) + ((buckets) >> 3))
+#define HASH_BUCKET(code, buckets) ((code) & ((buckets) - 1))
 
 /* useful defines */
-#define SVZ_HASH_SHRINK   4
-#define SVZ_HASH_EXPAND   8
 #define SVZ_HASH_MIN_SIZE 4
 
+/* Maximum length of keys stored within an entry.  */
+#define HASH_INLINE 16
+
+/* Number of slots migrated by each put and delete while resizing.  */
+#define HASH_MIGRATE 16
+
+/* Number of slots of a new table cleared by each put and delete.  */
+#define HASH_CLEAR 64
+
 /*
  * This is the basic structure of a hash entry consisting of its
  * key, the actual value stored in the hash table and the hash code
- * of the key.
+ * of the key.  The @code{dist} member is the distance of the entry
+ * from its home slot plus one, or zero if the slot is empty.
  */
 struct svz_hash_entry
 {
   unsigned long code;
-  char *key;
   void *value;
+  unsigned int len;
+  unsigned int dist;
+  union
+  {
+    char *ptr;
+    char data[HASH_INLINE];
+  }
+  key;
 };
 
+#define ENTRY_KEY(entry) \
+  ((entry)->len > HASH_INLINE ? (entry)->key.ptr : (entry)->key.data)
+
+#define ROTL(x, b)  (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND()  do                                                  \
+    {                                                                   \
+      v0 += v1; v1 = ROTL (v1, 13); v1 ^= v0; v0 = ROTL (v0, 32);       \
+      v2 += v3; v3 = ROTL (v3, 16); v3 ^= v2;                           \
+      v0 += v3; v3 = ROTL (v3, 21); v3 ^= v0;                           \
+      v2 += v1; v1 = ROTL (v1, 17); v1 ^= v2; v2 = ROTL (v2, 32);       \
+    }                                                                   \
+  while (0)
+
 /*
- * The hash table consists of different hash buckets.  This contains the
- * bucket's size and the entry array.
+ * Return the SipHash-1-3 of the @var{len} bytes at @var{data}, using
+ * the 128 bit key @var{k}.
  */
-struct svz_hash_bucket
+static uint64_t
+siphash (const uint64_t k[2], const char *data, size_t len)
 {
-  int size;
-  svz_hash_entry_t *entry;
-};
+  const unsigned char *p = (const unsigned char *) data;
+  const unsigned char *end = p + (len & ~(size_t) 7);
+  uint64_t v0 = k[0] ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k[1] ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k[0] ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k[1] ^ 0x7465646279746573ULL;
+  uint64_t m, b = (uint64_t) len << 56;
+  int i;
+
+  for (; p != end; p += 8)
+    {
+      for (m = 0, i = 8; i--;)
+        m = (m << 8) | p[i];
+      v3 ^= m;
+      SIPROUND ();
+      v0 ^= m;
+    }
+  for (i = len & 7; i--;)
+    b |= (uint64_t) p[i] << (8 * i);
+  v3 ^= b;
+  SIPROUND ();
+  v0 ^= b;
+  v2 ^= 0xff;
+  SIPROUND ();
+  SIPROUND ();
+  SIPROUND ();
+  return v0 ^ v1 ^ v2 ^ v3;
+}
 
 /*
- * Calculate the hash code for a given string @var{key}.  This is the standard
- * callback for any newly created hash table.
+ * Scramble the bits of @var{x}.  Distinct arguments give distinct
+ * results.
  */
-static unsigned long
-hash_code (const char *key)
+static uint64_t
+mix (uint64_t x)
 {
-  unsigned long code = 0;
-  const char *p = key;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
 
+/*
+ * Calculate the hash code for a given @var{key} in the hash table
+ * @var{hash}.  Unless there is a custom @code{code} callback, this is
+ * the SipHash of the key's bytes with the table's own random key, so
+ * that similar keys are spread evenly and collisions are hard to
+ * provoke from outside.  Custom codes get scrambled as well, since only
+ * their lower bits select the home slot.
+ */
+static unsigned long
+hash_code (const svz_hash_t *hash, const char *key)
+{
   assert (key);
-  while (*p)
-    {
-      code = (code << 1) ^ *p;
-      p++;
-    }
-  return code;
+  if (hash->code == NULL)
+    return (unsigned long) siphash (hash->seed, key, hash->keylen (key));
+  return (unsigned long) mix (hash->code (key) ^ hash->seed[0]);
 }
 
 /*
@@ -142,43 +240,53 @@ hash_key_length (const char *key)
 static void
 display_analysis (svz_hash_t *hash)
 {
-  svz_hash_bucket_t *bucket;
-  int n, e, buckets, depth, entries;
+  svz_hash_entry_t *entry;
+  size_t n, entries, total;
+  unsigned int depth;
 
-  for (entries = 0, depth = 0, buckets = 0, n = 0; n < hash->buckets; n++)
+  for (entries = total = depth = 0, n = 0; n < hash->buckets; n++)
     {
-      bucket = &hash->table[n];
-      if (bucket->size > 0)
-        buckets++;
-      for (e = 0; e < bucket->size; e++)
-        {
-          entries++;
+      entry = &hash->table[n];
+      if (entry->dist == 0)
+        continue;
+      entries++;
+      total += entry->dist;
 #if 0
-          fprintf (stdout, "bucket %04d: entry %02d: code: %08lu "
-                   "value: %p key: %-20s\n",
-                   n + 1, e + 1, bucket->entry[e].code,
-                   bucket->entry[e].value, bucket->entry[e].key);
+      fprintf (stdout, "bucket %04zu: distance %02u: code: %08lu "
+               "value: %p\n",
+               n + 1, entry->dist, entry->code, entry->value);
 #endif /* 0 */
-          if (e > depth)
-            depth = e;
-        }
+      if (entry->dist > depth)
+        depth = entry->dist;
     }
 #if ENABLE_DEBUG
   svz_log (SVZ_LOG_DEBUG,
-           "%d/%d buckets (%d), %d entries (%d), depth: %d\n",
-           buckets, hash->buckets, hash->fill,
-           entries, hash->keys, depth + 1);
+           "%zu/%zu buckets, %zu entries, depth: %u (mean %.2f)\n",
+           entries, hash->buckets, hash->keys, depth,
+           entries ? (double) total / entries : 0.0);
 #endif /* ENABLE_DEBUG */
 }
 #endif  /* ENABLE_HASH_ANALYSE */
 
+/*
+ * Allocate an empty table of @var{size} slots for @var{hash}.
+ */
+static void
+alloc_table (svz_hash_t *hash, size_t size)
+{
+  hash->buckets = size;
+  hash->table = svz_malloc (sizeof (svz_hash_entry_t) * size);
+  memset (hash->table, 0, sizeof (svz_hash_entry_t) * size);
+}
+
 /**
  * Create a new hash table with an initial capacity @var{size}.  Return a
- * non-zero pointer to the newly created hash.  The size is calculated down
- * to a binary value.  The @var{destroy} callback specifies an
- * element destruction callback for use by @code{svz_hash_clear} and
- * @code{svz_hash_destroy} for each value.  If no such operation should be
- * performed the argument must be @code{NULL}.
+ * non-zero pointer to the newly created hash.  The table grows and
+ * shrinks as needed, so the capacity is merely a hint.  The @var{destroy}
+ * callback specifies an element destruction callback for use by
+ * @code{svz_hash_clear} and @code{svz_hash_destroy} for each value.  If
+ * no such operation should be performed the argument must be
+ * @code{NULL}.
  */
 svz_hash_t *
 svz_hash_create (size_t size, svz_free_func_t destroy)
@@ -186,29 +294,32 @@ svz_hash_create (size_t size, svz_free_func_t destroy)
   size_t n;
   svz_hash_t *hash;
 
-  /* set initial hash table size to a binary value */
-  for (n = size, size = 1; n != 1; n >>= 1)
-    size <<= 1;
-  if (size < SVZ_HASH_MIN_SIZE)
-    size = SVZ_HASH_MIN_SIZE;
+  /* use the smallest binary table size holding SIZE keys */
+  for (n = SVZ_HASH_MIN_SIZE; HASH_EXPAND_LIMIT (n) < size; n <<= 1)
+    ;
 
   /* allocate space for the hash itself */
   hash = svz_malloc (sizeof (svz_hash_t));
-  hash->buckets = size;
-  hash->fill = 0;
   hash->keys = 0;
-  hash->code = hash_code;
+  hash->shrink = 1;
+  hash->old = NULL;
+  hash->old_buckets = 0;
+  hash->old_keys = 0;
+  hash->migrated = 0;
+  hash->fresh = NULL;
+  hash->fresh_buckets = 0;
+  hash->cleared = 0;
+  hash->code = NULL;
   hash->equals = hash_equal;
   hash->keylen = hash_key_length;
   hash->destroy = destroy;
 
+  /* no two tables share the same key for the hash codes */
+  hash->seed[0] = mix ((uint64_t) time (NULL) ^ SVZ_PTR2NUM (hash));
+  hash->seed[1] = mix (hash->seed[0] ^ SVZ_PTR2NUM (&n));
+
   /* allocate space for the hash table and initialize it */
-  hash->table = svz_malloc (sizeof (svz_hash_bucket_t) * size);
-  for (n = 0; n < size; n++)
-    {
-      hash->table[n].size = 0;
-      hash->table[n].entry = NULL;
-    }
+  alloc_table (hash, n);
 
   return hash;
 }
@@ -221,13 +332,15 @@ svz_hash_create (size_t size, svz_free_func_t destroy)
  * the number of bytes in @var{data} representing the key.
  *
  * @var{code} takes @code{const char *data}
- * and returns @code{unsigned long}.
+ * and returns @code{unsigned long}.  The default hashes the
+ * @var{keylen} bytes of the key, so most tables need not set it.
  *
  * @var{equals} takes @code{const char *data1, const char *data2}
- * and returns @code{int}, which should be non-zero if equal.
+ * and returns @code{int}, which should be zero if equal.
  *
  * As a special case, a @code{NULL} value means don't set that function,
- * leaving it to its default value.
+ * leaving it to its default value.  This must be done before putting
+ * the first key into the table.
  */
 svz_hash_t *
 svz_hash_configure (svz_hash_t *hash,
@@ -241,6 +354,45 @@ svz_hash_configure (svz_hash_t *hash,
   return hash;
 }
 
+/**
+ * Set whether the hash table @var{hash} may shrink when deleting
+ * keys, which is the default.  If @var{shrink} is zero, the table
+ * keeps the size it grew to until it is destroyed, trading memory for
+ * not resizing it over and over if the number of keys goes up and down
+ * a lot.  Return @var{hash}.
+ */
+svz_hash_t *
+svz_hash_configure_shrink (svz_hash_t *hash, int shrink)
+{
+  hash->shrink = shrink;
+  return hash;
+}
+
+/*
+ * Release the key and, using the element destruction callback of
+ * @var{hash}, the value of each entry of @var{table} with @var{buckets}
+ * slots, and the table itself.
+ */
+static void
+free_table (svz_hash_t *hash, svz_hash_entry_t *table, size_t buckets)
+{
+  size_t n;
+  svz_hash_entry_t *entry;
+
+  for (n = 0; n < buckets; n++)
+    {
+      entry = &table[n];
+      if (entry->dist)
+        {
+          if (entry->len > HASH_INLINE)
+            svz_free (entry->key.ptr);
+          if (hash->destroy)
+            hash->destroy (entry->value);
+        }
+    }
+  svz_free (table);
+}
+
 /**
  * Destroy the existing hash table @var{hash}, @code{svz_free}ing
  * all keys within the hash, the hash table and the hash itself.
@@ -250,135 +402,206 @@ svz_hash_configure (svz_hash_t *hash,
 void
 svz_hash_destroy (svz_hash_t *hash)
 {
-  size_t n;
-  int e;
-  svz_hash_bucket_t *bucket;
-
   if (hash == NULL)
     return;
 
-  for (n = 0; n < hash->buckets; n++)
+  if (hash->old)
+    free_table (hash, hash->old, hash->old_buckets);
+  free_table (hash, hash->table, hash->buckets);
+  if (hash->fresh)
+    svz_free (hash->fresh);
+  svz_free (hash);
+}
+
+/*
+ * Put the entry @var{entry}, whose key is known not to be in @var{table}
+ * with @var{buckets} slots yet, into its place.  There must be a free
+ * slot.
+ */
+static void
+insert (svz_hash_entry_t *table, size_t buckets, svz_hash_entry_t *entry)
+{
+  size_t n = HASH_BUCKET (entry->code, buckets);
+  svz_hash_entry_t *slot, swap;
+
+  for (entry->dist = 1;; n = HASH_BUCKET (n + 1, buckets), entry->dist++)
     {
-      bucket = &hash->table[n];
-      if (bucket->size)
+      slot = &table[n];
+      if (slot->dist == 0)
+        {
+          *slot = *entry;
+          return;
+        }
+      /* rob the rich: the entry farther from home keeps the slot */
+      if (slot->dist < entry->dist)
         {
-          for (e = 0; e < bucket->size; e++)
-            {
-              svz_free (bucket->entry[e].key);
-              if (hash->destroy)
-                hash->destroy (bucket->entry[e].value);
-            }
-          svz_free (bucket->entry);
+          swap = *slot;
+          *slot = *entry;
+          *entry = swap;
         }
     }
-  svz_free (hash->table);
-  svz_free (hash);
 }
 
 /*
- * Rehash a given hash table @var{hash}.  Double (@var{type} is
- * @code{SVZ_HASH_EXPAND}) its size and expand the hash codes or half (@var{type}
- * is @code{SVZ_HASH_SHRINK}) its size and shrink the hash codes if these would
- * be placed somewhere else.
+ * Remove the entry @var{entry} from @var{table} with @var{buckets}
+ * slots, moving the following entries one slot closer to home.
  */
 static void
-rehash (svz_hash_t *hash, int type)
+unlink_entry (svz_hash_entry_t *table, size_t buckets,
+              svz_hash_entry_t *entry)
 {
-  size_t n;
-  int e;
-  svz_hash_bucket_t *bucket, *next_bucket;
+  svz_hash_entry_t *next;
 
-#if ENABLE_HASH_ANALYSE
-  display_analysis (hash);
-#endif
+  for (;;)
+    {
+      next = &table[HASH_BUCKET (entry - table + 1, buckets)];
+      if (next->dist <= 1)
+        break;
+      *entry = *next;
+      entry->dist--;
+      entry = next;
+    }
+  entry->dist = 0;
+}
 
-  if (type == SVZ_HASH_EXPAND)
+/*
+ * Return the entry of @var{key} with hash code @var{code} in @var{table}
+ * with @var{buckets} slots of the hash table @var{hash}, or @code{NULL}
+ * if there is no such key.
+ */
+static svz_hash_entry_t *
+probe (const svz_hash_t *hash, svz_hash_entry_t *table, size_t buckets,
+       const char *key, unsigned long code)
+{
+  size_t n = HASH_BUCKET (code, buckets);
+  svz_hash_entry_t *entry;
+  unsigned int dist;
+
+  for (dist = 1;; n = HASH_BUCKET (n + 1, buckets), dist++)
     {
-      /*
-       * Reallocate and initialize the hash table itself.
-       */
-      hash->buckets <<= 1;
-      hash->table = svz_realloc (hash->table,
-                                 sizeof (svz_hash_bucket_t) * hash->buckets);
-      for (n = hash->buckets >> 1; n < hash->buckets; n++)
-        {
-          hash->table[n].size = 0;
-          hash->table[n].entry = NULL;
-        }
+      entry = &table[n];
+      /* the key would have robbed this slot (or taken an empty one) */
+      if (entry->dist < dist)
+        return NULL;
+      if (entry->code == code && hash->equals (ENTRY_KEY (entry), key) == 0)
+        return entry;
+    }
+}
 
-      /*
-       * Go through all hash table entries and check if it is necessary
-       * to relocate them.
-       */
-      for (n = 0; n < (hash->buckets >> 1); n++)
-        {
-          bucket = &hash->table[n];
-          for (e = 0; e < bucket->size; e++)
-            {
-              if (n != HASH_BUCKET (bucket->entry[e].code, hash))
-                {
-                  /* copy this entry to the far entry */
-                  next_bucket =
-                    &hash->table[HASH_BUCKET (bucket->entry[e].code, hash)];
-                  next_bucket->entry = svz_realloc (next_bucket->entry,
-                                                    (next_bucket->size + 1) *
-                                                    sizeof (svz_hash_entry_t));
-                  next_bucket->entry[next_bucket->size] = bucket->entry[e];
-                  next_bucket->size++;
-                  if (next_bucket->size == 1)
-                    hash->fill++;
-
-                  /* delete this entry */
-                  bucket->size--;
-                  if (bucket->size == 0)
-                    {
-                      svz_free (bucket->entry);
-                      bucket->entry = NULL;
-                      hash->fill--;
-                    }
-                  else
-                    {
-                      bucket->entry[e] = bucket->entry[bucket->size];
-                      bucket->entry = svz_realloc (bucket->entry,
-                                                   bucket->size *
-                                                   sizeof (svz_hash_entry_t));
-                    }
-                  e--;
-                }
-            }
-        }
+/*
+ * Return the entry of @var{key} with hash code @var{code} in the hash
+ * table @var{hash}, or @code{NULL} if there is no such key.  Set
+ * @var{old} (if given) to whether it is in the table being migrated.
+ */
+static svz_hash_entry_t *
+lookup (const svz_hash_t *hash, const char *key, unsigned long code,
+        int *old)
+{
+  svz_hash_entry_t *entry;
+
+  if (old)
+    *old = 0;
+  entry = probe (hash, hash->table, hash->buckets, key, code);
+  if (entry == NULL && hash->old_keys)
+    {
+      if (old)
+        *old = 1;
+      entry = probe (hash, hash->old, hash->old_buckets, key, code);
     }
-  else if (type == SVZ_HASH_SHRINK && hash->buckets > SVZ_HASH_MIN_SIZE)
+  return entry;
+}
+
+/*
+ * Move the entries of at most @var{slots} slots of the table being
+ * migrated into the current table of @var{hash}.  Release the former
+ * once it is empty.  The slots before @code{hash->migrated} are always
+ * empty: removing an entry only moves the entries after it.
+ */
+static void
+migrate (svz_hash_t *hash, size_t slots)
+{
+  svz_hash_entry_t *entry, move;
+
+  for (; hash->old_keys && slots; slots--)
     {
-      hash->buckets >>= 1;
-      for (n = hash->buckets; n < hash->buckets << 1; n++)
+      entry = &hash->old[hash->migrated];
+      if (entry->dist == 0)
         {
-          bucket = &hash->table[n];
-          if (bucket->size)
-            {
-              for (e = 0; e < bucket->size; e++)
-                {
-                  next_bucket =
-                    &hash->table[HASH_BUCKET (bucket->entry[e].code, hash)];
-                  next_bucket->entry = svz_realloc (next_bucket->entry,
-                                                    (next_bucket->size + 1) *
-                                                    sizeof (svz_hash_entry_t));
-                  next_bucket->entry[next_bucket->size] = bucket->entry[e];
-                  next_bucket->size++;
-                  if (next_bucket->size == 1)
-                    hash->fill++;
-                }
-              svz_free (bucket->entry);
-            }
-          hash->fill--;
+          hash->migrated++;
+          continue;
         }
-      hash->table = svz_realloc (hash->table,
-                                 sizeof (svz_hash_bucket_t) * hash->buckets);
+      move = *entry;
+      unlink_entry (hash->old, hash->old_buckets, entry);
+      insert (hash->table, hash->buckets, &move);
+      hash->old_keys--;
+    }
+
+  if (hash->old && hash->old_keys == 0)
+    {
+      svz_free (hash->old);
+      hash->old = NULL;
+      hash->old_buckets = 0;
+      hash->migrated = 0;
     }
+}
+
+/*
+ * Start resizing the hash table @var{hash} to @var{size} slots.  The new
+ * table is not cleared right away: for large tables, that alone would
+ * take milliseconds.
+ */
+static void
+prepare (svz_hash_t *hash, size_t size)
+{
+  hash->fresh = svz_malloc (sizeof (svz_hash_entry_t) * size);
+  hash->fresh_buckets = size;
+  hash->cleared = 0;
+}
+
+/*
+ * Clear at most @var{slots} slots of the table being prepared for the
+ * hash table @var{hash}.  Once it is clear, make it the current table
+ * and start migrating the entries of the former one.
+ */
+static void
+advance (svz_hash_t *hash, size_t slots)
+{
+  size_t n = hash->fresh_buckets - hash->cleared;
+
+  if (n > slots)
+    n = slots;
+  memset (hash->fresh + hash->cleared, 0, sizeof (svz_hash_entry_t) * n);
+  hash->cleared += n;
+  if (hash->cleared < hash->fresh_buckets)
+    return;
 
 #if ENABLE_HASH_ANALYSE
   display_analysis (hash);
 #endif
+
+  /* Unlikely, but there is only room for one table being migrated.  */
+  migrate (hash, (size_t) -1);
+
+  hash->old = hash->table;
+  hash->old_buckets = hash->buckets;
+  hash->old_keys = hash->keys;
+  hash->migrated = 0;
+  hash->table = hash->fresh;
+  hash->buckets = hash->fresh_buckets;
+  hash->fresh = NULL;
+  hash->fresh_buckets = 0;
+}
+
+/*
+ * Do a bounded amount of pending resizing work for the hash
+ * table @var{hash}.
+ */
+static void
+step (svz_hash_t *hash)
+{
+  migrate (hash, HASH_MIGRATE);
+  if (hash->fresh)
+    advance (hash, HASH_CLEAR);
 }
 
 /**
@@ -389,50 +612,47 @@ rehash (svz_hash_t *hash, int type)
 void *
 svz_hash_put (svz_hash_t *hash, const char *key, void *value)
 {
-  unsigned long code = 0;
-  int e;
+  unsigned long code;
   void *old;
-  svz_hash_entry_t *entry;
-  svz_hash_bucket_t *bucket;
+  svz_hash_entry_t *entry, fresh;
 
-  code = hash->code (key);
+  code = hash_code (hash, key);
 
   /* Check if the key is already stored.  If so replace the value.  */
-  bucket = &hash->table[HASH_BUCKET (code, hash)];
-  for (e = 0; e < bucket->size; e++)
+  if ((entry = lookup (hash, key, code, NULL)) != NULL)
     {
-      if (bucket->entry[e].code == code &&
-          hash->equals (bucket->entry[e].key, key) == 0)
-        {
-          old = bucket->entry[e].value;
-          bucket->entry[e].value = value;
-          return old;
-        }
+      old = entry->value;
+      entry->value = value;
+      step (hash);
+      return old;
     }
 
-  /* Reallocate this bucket.  */
-  bucket = &hash->table[HASH_BUCKET (code, hash)];
-  bucket->entry = svz_realloc (bucket->entry,
-                               sizeof (svz_hash_entry_t) * (bucket->size + 1));
-
   /* Fill this entry.  */
-  entry = &bucket->entry[bucket->size];
-  entry->key = svz_malloc (hash->keylen (key));
-  memcpy (entry->key, key, hash->keylen (key));
-  entry->value = value;
-  entry->code = code;
-  bucket->size++;
-  hash->keys++;
-
-  /* 75% filled?  */
-  if (bucket->size == 1)
+  fresh.code = code;
+  fresh.value = value;
+  fresh.len = hash->keylen (key);
+  if (fresh.len > HASH_INLINE)
+    fresh.key.ptr = svz_malloc (fresh.len);
+  memcpy (ENTRY_KEY (&fresh), key, fresh.len);
+
+  /* Migrating may move KEY, if it was found in this very table.  */
+  step (hash);
+
+  /* Get ready to grow well before the table is 75% filled.  */
+  if (hash->fresh == NULL && hash->old == NULL
+      && hash->keys + 1 > HASH_PREPARE_LIMIT (hash->buckets))
+    prepare (hash, hash->buckets << 1);
+
+  /* 75% filled?  Normally, the new table is long ready by now.  */
+  while (hash->keys + 1 > HASH_EXPAND_LIMIT (hash->buckets))
     {
-      hash->fill++;
-      if (hash->fill > HASH_EXPAND_LIMIT (hash))
-        {
-          rehash (hash, SVZ_HASH_EXPAND);
-        }
+      if (hash->fresh == NULL)
+        prepare (hash, hash->buckets << 1);
+      advance (hash, (size_t) -1);
     }
+
+  insert (hash->table, hash->buckets, &fresh);
+  hash->keys++;
   return NULL;
 }
 
@@ -444,45 +664,31 @@ svz_hash_put (svz_hash_t *hash, const char *key, void *value)
 void *
 svz_hash_delete (svz_hash_t *hash, const char *key)
 {
-  int n;
-  unsigned long code;
-  svz_hash_bucket_t *bucket;
+  svz_hash_entry_t *entry;
   void *value;
+  int old;
 
-  code = hash->code (key);
-  bucket = &hash->table[HASH_BUCKET (code, hash)];
+  if ((entry = lookup (hash, key, hash_code (hash, key), &old)) == NULL)
+    return NULL;
 
-  for (n = 0; n < bucket->size; n++)
+  value = entry->value;
+  if (entry->len > HASH_INLINE)
+    svz_free (entry->key.ptr);
+  if (old)
     {
-      if (bucket->entry[n].code == code &&
-          hash->equals (bucket->entry[n].key, key) == 0)
-        {
-          value = bucket->entry[n].value;
-          bucket->size--;
-          svz_free (bucket->entry[n].key);
-          if (bucket->size)
-            {
-              bucket->entry[n] = bucket->entry[bucket->size];
-              bucket->entry = svz_realloc (bucket->entry,
-                                           sizeof (svz_hash_entry_t) *
-                                           bucket->size);
-            }
-          else
-            {
-              svz_free (bucket->entry);
-              bucket->entry = NULL;
-              hash->fill--;
-              if (hash->fill < HASH_SHRINK_LIMIT (hash))
-                {
-                  rehash (hash, SVZ_HASH_SHRINK);
-                }
-            }
-          hash->keys--;
-          return value;
-        }
+      unlink_entry (hash->old, hash->old_buckets, entry);
+      hash->old_keys--;
     }
-
-  return NULL;
+  else
+    unlink_entry (hash->table, hash->buckets, entry);
+  hash->keys--;
+
+  step (hash);
+  if (hash->shrink && hash->fresh == NULL && hash->old == NULL
+      && hash->keys < HASH_SHRINK_LIMIT (hash->buckets)
+      && hash->buckets > SVZ_HASH_MIN_SIZE)
+    prepare (hash, hash->buckets >> 1);
+  return value;
 }
 
 /**
@@ -492,23 +698,10 @@ svz_hash_delete (svz_hash_t *hash, const char *key)
 void *
 svz_hash_get (const svz_hash_t *hash, const char *key)
 {
-  int n;
-  unsigned long code;
-  svz_hash_bucket_t *bucket;
-
-  code = hash->code (key);
-  bucket = &hash->table[HASH_BUCKET (code, hash)];
-
-  for (n = 0; n < bucket->size; n++)
-    {
-      if (bucket->entry[n].code == code &&
-          hash->equals (bucket->entry[n].key, key) == 0)
-        {
-          return bucket->entry[n].value;
-        }
-    }
+  svz_hash_entry_t *entry;
 
-  return NULL;
+  entry = lookup (hash, key, hash_code (hash, key), NULL);
+  return entry ? entry->value : NULL;
 }
 
 /**
@@ -521,46 +714,41 @@ svz_hash_get (const svz_hash_t *hash, const char *key)
 int
 svz_hash_exists (const svz_hash_t *hash, char *key)
 {
-  int n;
-  unsigned long code;
-  svz_hash_bucket_t *bucket;
+  return lookup (hash, key, hash_code (hash, key), NULL) ? -1 : 0;
+}
 
-  code = hash->code (key);
-  bucket = &hash->table[HASH_BUCKET (code, hash)];
+/*
+ * Call @var{func} with the key, the value and @var{closure} for each
+ * entry of @var{table} with @var{buckets} slots.
+ */
+static void
+foreach_entry (svz_hash_do_t *func, svz_hash_entry_t *table,
+               size_t buckets, void *closure)
+{
+  size_t n;
+
+  for (n = 0; n < buckets; n++)
+    {
+      svz_hash_entry_t *entry = &table[n];
 
-  for (n = 0; n < bucket->size; n++)
-    if (bucket->entry[n].code == code &&
-        hash->equals (bucket->entry[n].key, key) == 0)
-      return -1;
-  return 0;
+      if (entry->dist)
+        func (ENTRY_KEY (entry), entry->value, closure);
+    }
 }
 
 /**
  * Iterate @var{func} over each key/value pair in @var{hash}.
  * @var{func} is called with three @code{void *} args: the key,
  * the value and the opaque (to @code{svz_hash_foreach}) @var{closure}.
+ * The key is valid only until @var{hash} is modified; @var{func}
+ * must not modify it.
  */
 void
 svz_hash_foreach (svz_hash_do_t *func, svz_hash_t *hash, void *closure)
 {
-  size_t i, n;
-  int e;
-
-  for (i = 0, n = 0;
-       i < hash->keys && n < hash->buckets;
-       n++)
-    {
-      svz_hash_bucket_t *bucket = &hash->table[n];
-
-      for (e = 0;
-           e < bucket->size;
-           e++, i++)
-        {
-          svz_hash_entry_t *entry = &bucket->entry[e];
-
-          func (entry->key, entry->value, closure);
-        }
-    }
+  foreach_entry (func, hash->table, hash->buckets, closure);
+  if (hash->old)
+    foreach_entry (func, hash->old, hash->old_buckets, closure);
 }
 
 /**
@@ -575,25 +763,37 @@ svz_hash_size (const svz_hash_t *hash)
   return hash->keys;
 }
 
-/**
- * Return the key associated with @var{value} in the hash table
- * @var{hash}, or @code{NULL} if there is no such value.
+/*
+ * Return the key associated with @var{value} in @var{table} with
+ * @var{buckets} slots, or @code{NULL} if there is no such value.
  */
-char *
-svz_hash_contains (const svz_hash_t *hash, void *value)
+static char *
+find_value (svz_hash_entry_t *table, size_t buckets, void *value)
 {
-  svz_hash_bucket_t *bucket;
+  svz_hash_entry_t *entry;
   size_t n;
-  int e;
 
-  for (n = 0; n < hash->buckets; n++)
+  for (n = 0; n < buckets; n++)
     {
-      bucket = &hash->table[n];
-      for (e = 0; e < bucket->size; e++)
-        {
-          if (bucket->entry[e].value == value)
-            return bucket->entry[e].key;
-        }
+      entry = &table[n];
+      if (entry->dist && entry->value == value)
+        return ENTRY_KEY (entry);
     }
   return NULL;
 }
+
+/**
+ * Return the key associated with @var{value} in the hash table
+ * @var{hash}, or @code{NULL} if there is no such value.  The key
+ * is valid only until @var{hash} is modified, except that it may
+ * be passed to @code{svz_hash_delete}.
+ */
+char *
+svz_hash_contains (const svz_hash_t *hash, void *value)
+{
+  char *key = find_value (hash->table, hash->buckets, value);
+
+  if (key == NULL && hash->old)
+    key = find_value (hash->old, hash->old_buckets, value);
+  return key;
+}
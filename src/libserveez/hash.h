@@ -26,7 +26,6 @@
 /* end svzint */
 
 typedef struct svz_hash_entry svz_hash_entry_t;
-typedef struct svz_hash_bucket svz_hash_bucket_t;
 typedef struct svz_hash svz_hash_t;
 /* begin svzint */
 /*
@@ -35,14 +34,23 @@ typedef struct svz_hash svz_hash_t;
  */
 struct svz_hash
 {
-  size_t buckets;                  /* number of buckets in the table */
-  size_t fill;                     /* number of filled buckets */
+  size_t buckets;                  /* number of slots in the table */
   size_t keys;                     /* number of stored keys */
+  int shrink;                      /* whether to shrink when sparse */
+  svz_hash_entry_t *old;           /* table being migrated, or NULL */
+  size_t old_buckets;              /* number of slots in that table */
+  size_t old_keys;                 /* number of keys left in it */
+  size_t migrated;                 /* slots before this one are empty */
+  svz_hash_entry_t *fresh;         /* table being prepared, or NULL */
+  size_t fresh_buckets;            /* number of slots in that table */
+  size_t cleared;                  /* slots before this one are clear */
+  uint64_t seed[2];                /* key of the default hash function */
   int (* equals) (const char *, const char *); /* key string equality callback */
-  unsigned long (* code) (const char *); /* hash code calculation callback */
+  unsigned long (* code) (const char *); /* hash code calculation callback,
+                                            NULL for the default */
   size_t (* keylen) (const char *);      /* how to get the hash key length */
   svz_free_func_t destroy;         /* element destruction callback */
-  svz_hash_bucket_t *table;        /* hash table */
+  svz_hash_entry_t *table;         /* hash table */
 };
 /* end svzint */
 
@@ -59,6 +67,7 @@ svz_hash_configure (svz_hash_t *hash,
                     size_t (* keylen) (const char *),
                     unsigned long (* code) (const char *),
                     int (* equals) (const char *, const char *));
+SERVEEZ_API svz_hash_t *svz_hash_configure_shrink (svz_hash_t *, int);
 SERVEEZ_API void svz_hash_destroy (svz_hash_t *);
 SERVEEZ_API void *svz_hash_delete (svz_hash_t *, const char *);
 SERVEEZ_API void *svz_hash_put (svz_hash_t *, const char *, void *);
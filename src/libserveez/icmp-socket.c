@@ -476,7 +476,10 @@ read_socket (svz_socket_t *sock)
       if (trunc >= 0)
         {
           num_read -= trunc;
-          if (num_read > sock->recv_buffer_size - sock->recv_buffer_fill)
+          svz_sock_alloc_buffers (sock, SVZ_SOFLG_INBUF);
+          if (num_read > sock->recv_buffer_size - sock->recv_buffer_head
+              - sock->recv_buffer_fill
+              && num_read > svz_sock_compact_recv (sock))
             {
               svz_log (SVZ_LOG_ERROR,
                        "receive buffer overflow on icmp socket %d\n",
@@ -585,13 +588,7 @@ svz_icmp_write_socket (svz_socket_t *sock)
   else
     {
       sock->last_send = time (NULL);
-      if ((unsigned) sock->send_buffer_fill > do_write)
-        {
-          memmove (sock->send_buffer,
-                   sock->send_buffer + do_write,
-                   sock->send_buffer_fill - do_write);
-        }
-      sock->send_buffer_fill -= do_write;
+      svz_sock_reduce_send (sock, do_write);
     }
 
 #if ENABLE_DEBUG
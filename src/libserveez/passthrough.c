@@ -200,6 +200,7 @@ disconnect_passthrough (svz_socket_t *sock)
   sock->recv_buffer = sock->send_buffer = NULL;
   sock->recv_buffer_fill = sock->recv_buffer_size = 0;
   sock->send_buffer_fill = sock->send_buffer_size = 0;
+  sock->recv_buffer_head = sock->send_buffer_head = 0;
   return 0;
 }
 
@@ -219,15 +220,19 @@ send_switch_buffers (svz_socket_t *sock, int set)
 
   if (set)
     {
+      svz_sock_alloc_buffers (xsock, SVZ_SOFLG_INBUF);
       sock->send_buffer = xsock->recv_buffer;
       sock->send_buffer_fill = xsock->recv_buffer_fill;
       sock->send_buffer_size = xsock->recv_buffer_size;
+      sock->send_buffer_head = xsock->recv_buffer_head;
     }
   else
     {
       xsock->recv_buffer = sock->send_buffer;
       xsock->recv_buffer_fill = sock->send_buffer_fill;
       xsock->recv_buffer_size = sock->send_buffer_size;
+      xsock->recv_buffer_head = sock->send_buffer_head;
+      svz_sock_touch (xsock);
     }
   return 0;
 }
@@ -284,15 +289,19 @@ recv_switch_buffers (svz_socket_t *sock, int set)
 
   if (set)
     {
+      svz_sock_alloc_buffers (xsock, SVZ_SOFLG_OUTBUF);
       sock->recv_buffer = xsock->send_buffer;
       sock->recv_buffer_fill = xsock->send_buffer_fill;
       sock->recv_buffer_size = xsock->send_buffer_size;
+      sock->recv_buffer_head = xsock->send_buffer_head;
     }
   else
     {
       xsock->send_buffer = sock->recv_buffer;
       xsock->send_buffer_fill = sock->recv_buffer_fill;
       xsock->send_buffer_size = sock->recv_buffer_size;
+      xsock->send_buffer_head = sock->recv_buffer_head;
+      svz_sock_touch (xsock);
     }
   return 0;
 }
@@ -313,7 +322,11 @@ recv_socket (svz_socket_t *sock)
     return -1;
 
   /* return here if there is nothing to do */
-  if ((do_read = sock->recv_buffer_size - sock->recv_buffer_fill) <= 0)
+  if (sock->recv_buffer_head + sock->recv_buffer_fill
+      >= sock->recv_buffer_size)
+    svz_sock_compact_recv (sock);
+  if ((do_read = sock->recv_buffer_size - sock->recv_buffer_head
+       - sock->recv_buffer_fill) <= 0)
     return 0;
 
   if ((num_read = recv (sock->sock_desc,
@@ -398,7 +411,11 @@ recv_pipe (svz_socket_t *sock)
     return -1;
 
   /* return here if there is nothing to do */
-  if ((do_read = sock->recv_buffer_size - sock->recv_buffer_fill) <= 0)
+  if (sock->recv_buffer_head + sock->recv_buffer_fill
+      >= sock->recv_buffer_size)
+    svz_sock_compact_recv (sock);
+  if ((do_read = sock->recv_buffer_size - sock->recv_buffer_head
+       - sock->recv_buffer_fill) <= 0)
     return 0;
 
 #ifndef __MINGW32__
@@ -551,7 +568,7 @@ mind_children (svz_socket_t *sock)
 
 #endif /* __MINGW32__ */
 
-  sock->idle_counter = 1;
+  svz_sock_idle_arm (sock, 1000);
   return 0;
 }
 
@@ -618,10 +635,7 @@ shuffle (svz_process_t *proc)
     }
 
   /* release receive and send buffers of the new socket structure */
-  svz_free_and_zero (xsock->recv_buffer);
-  xsock->recv_buffer_fill = xsock->recv_buffer_size = 0;
-  svz_free_and_zero (xsock->send_buffer);
-  xsock->send_buffer_fill = xsock->send_buffer_size = 0;
+  svz_sock_resize_buffers (xsock, 0, 0);
 
   /* let both socket structures refer to each other */
   svz_sock_setreferrer (proc->sock, xsock);
@@ -669,7 +683,7 @@ shuffle (svz_process_t *proc)
   /* setup child checking callback */
   xsock->pid = (svz_t_handle) pid;
   xsock->idle_func = mind_children;
-  xsock->idle_counter = 1;
+  svz_sock_idle_arm (xsock, 1000);
 #if ENABLE_DEBUG
   svz_log (SVZ_LOG_DEBUG, "process `%s' got pid %d\n", proc->bin, pid);
 #endif
@@ -422,9 +422,17 @@ svz_pipe_read_socket (svz_socket_t *sock)
 {
   int num_read, do_read;
 
+  /* Allocate the buffer on first use, or make room by moving the
+     data to the beginning of the buffer.  */
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_INBUF);
+  if (sock->recv_buffer_head + sock->recv_buffer_fill
+      >= sock->recv_buffer_size)
+    svz_sock_compact_recv (sock);
+
   /* Read as much space is left in the receive buffer and return
    * zero if there is no more space.  */
-  do_read = sock->recv_buffer_size - sock->recv_buffer_fill;
+  do_read = sock->recv_buffer_size - sock->recv_buffer_head
+    - sock->recv_buffer_fill;
   if (do_read <= 0)
     {
       svz_log (SVZ_LOG_ERROR, "receive buffer overflow on pipe %d\n",
@@ -617,13 +625,7 @@ svz_pipe_write_socket (svz_socket_t *sock)
   if (num_written > 0)
     {
       sock->last_send = time (NULL);
-      if (sock->send_buffer_fill > num_written)
-        {
-          memmove (sock->send_buffer,
-                   sock->send_buffer + num_written,
-                   sock->send_buffer_fill - num_written);
-        }
-      sock->send_buffer_fill -= num_written;
+      svz_sock_reduce_send (sock, num_written);
     }
 
   return (num_written < 0) ? -1 : 0;
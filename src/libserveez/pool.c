@@ -0,0 +1,301 @@
+/*
+ * pool.c - socket structure and buffer pools
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stddef.h>
+#include <string.h>
+#include "libserveez/alloc.h"
+#include "libserveez/socket.h"
+#include "libserveez/pool.h"
+
+/*
+ * Socket structures are carved out of slabs of SLAB_SOCKS structures
+ * each.  Slabs with free structures are kept in a list, so allocating
+ * and freeing is O(1).  Completely unused slabs are given back to the
+ * heap except for one, which absorbs the connection churn.
+ *
+ * Socket buffers with a size of a power of two between BUFFER_MIN
+ * and BUFFER_MAX bytes are recycled through a free list per size
+ * class, holding up to POOL_BYTES bytes each.  The buffers are still
+ * ordinary blocks of heap memory, so it is safe to pass them to
+ * @code{svz_free} or to replace them with other blocks.
+ */
+
+#define SLAB_SOCKS   32
+
+#define BUFFER_SHIFT 9
+#define BUFFER_MIN   (1 << BUFFER_SHIFT)
+#define NCLASSES     8
+#define BUFFER_MAX   (BUFFER_MIN << (NCLASSES - 1))
+#define POOL_BYTES   (512 * 1024)
+
+typedef struct slab slab_t;
+
+/* A socket structure within a slab.  */
+typedef struct obj
+{
+  slab_t *slab;                 /* the slab containing this object */
+  union
+  {
+    struct obj *next;           /* next free object within the slab */
+    svz_socket_t sock;
+  }
+  u;
+}
+obj_t;
+
+struct slab
+{
+  slab_t *prev, *next;          /* links within the list of slabs */
+  obj_t *free;                  /* first free object (or NULL) */
+  int used;                     /* number of objects in use */
+  obj_t obj[SLAB_SOCKS];
+};
+
+/* Slabs with at least one free object.  */
+static slab_t *slabs = NULL;
+static int nempty = 0;          /* number of completely free slabs */
+static size_t nfree_socks = 0;  /* number of free objects overall */
+
+/* Free buffers of each size class, linked through their first bytes.  */
+static char *buffers[NCLASSES];
+static size_t nbuffers[NCLASSES];
+
+static void
+link_slab (slab_t *slab)
+{
+  slab->prev = NULL;
+  slab->next = slabs;
+  if (slabs)
+    slabs->prev = slab;
+  slabs = slab;
+}
+
+static void
+unlink_slab (slab_t *slab)
+{
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    slabs = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+}
+
+static slab_t *
+new_slab (void)
+{
+  slab_t *slab = svz_malloc (sizeof (slab_t));
+  int n;
+
+  slab->free = NULL;
+  for (n = SLAB_SOCKS - 1; n >= 0; n--)
+    {
+      slab->obj[n].slab = slab;
+      slab->obj[n].u.next = slab->free;
+      slab->free = &slab->obj[n];
+    }
+  slab->used = 0;
+  link_slab (slab);
+  nempty++;
+  nfree_socks += SLAB_SOCKS;
+  return slab;
+}
+
+/*
+ * Return a cleared socket structure.
+ */
+svz_socket_t *
+svz_pool_sock_alloc (void)
+{
+  slab_t *slab = slabs ? slabs : new_slab ();
+  obj_t *obj = slab->free;
+
+  slab->free = obj->u.next;
+  if (slab->used++ == 0)
+    nempty--;
+  if (slab->free == NULL)
+    unlink_slab (slab);
+  nfree_socks--;
+
+  memset (&obj->u.sock, 0, sizeof (svz_socket_t));
+  return &obj->u.sock;
+}
+
+/*
+ * Give back the socket structure @var{sock}, previously returned by
+ * @code{svz_pool_sock_alloc}.
+ */
+void
+svz_pool_sock_free (svz_socket_t *sock)
+{
+  obj_t *obj = (obj_t *) ((char *) sock - offsetof (obj_t, u));
+  slab_t *slab = obj->slab;
+
+  if (slab->free == NULL)
+    link_slab (slab);
+  obj->u.next = slab->free;
+  slab->free = obj;
+  nfree_socks++;
+
+  if (--slab->used == 0)
+    {
+      if (nempty > 0)
+        {
+          unlink_slab (slab);
+          svz_free (slab);
+          nfree_socks -= SLAB_SOCKS;
+        }
+      else
+        nempty++;
+    }
+}
+
+/* Return the size class of buffers of @var{size} bytes, or -1.  */
+static int
+size_class (int size)
+{
+  int n;
+
+  if (size < BUFFER_MIN || size > BUFFER_MAX || (size & (size - 1)))
+    return -1;
+  for (n = 0; (BUFFER_MIN << n) != size; n++)
+    ;
+  return n;
+}
+
+/*
+ * Return a buffer of @var{size} bytes.
+ */
+char *
+svz_pool_buffer_alloc (int size)
+{
+  int n = size_class (size);
+  char *buf;
+
+  if (n < 0 || (buf = buffers[n]) == NULL)
+    return svz_malloc (size);
+
+  memcpy (&buffers[n], buf, sizeof (char *));
+  nbuffers[n]--;
+  return buf;
+}
+
+/*
+ * Give back the buffer @var{buf} of @var{size} bytes.  It must have
+ * been allocated by @code{svz_malloc} or @code{svz_realloc}.
+ */
+void
+svz_pool_buffer_free (char *buf, int size)
+{
+  int n = size_class (size);
+
+  if (buf == NULL)
+    return;
+  if (n < 0 || (nbuffers[n] + 1) * size > POOL_BYTES)
+    {
+      svz_free (buf);
+      return;
+    }
+
+  memcpy (buf, &buffers[n], sizeof (char *));
+  buffers[n] = buf;
+  nbuffers[n]++;
+}
+
+/*
+ * Resize the buffer @var{buf} of @var{size} bytes to @var{new_size}
+ * bytes, keeping the first @var{fill} bytes of data.  Return the new
+ * buffer, or @code{NULL} if @var{new_size} is zero.
+ */
+char *
+svz_pool_buffer_resize (char *buf, int size, int fill, int new_size)
+{
+  char *dst;
+
+  if (new_size == 0)
+    {
+      svz_pool_buffer_free (buf, size);
+      return NULL;
+    }
+  if (buf == NULL)
+    return svz_pool_buffer_alloc (new_size);
+  if (size_class (size) < 0 && size_class (new_size) < 0)
+    return svz_realloc (buf, new_size);
+
+  dst = svz_pool_buffer_alloc (new_size);
+  if (fill > new_size)
+    fill = new_size;
+  if (fill > 0)
+    memcpy (dst, buf, fill);
+  svz_pool_buffer_free (buf, size);
+  return dst;
+}
+
+/*
+ * Write the number of bytes and blocks of memory kept in the pools
+ * for later use to @code{to[0]} and @code{to[1]}, respectively.
+ */
+void
+svz_pool_counters (size_t *to)
+{
+  int n;
+
+  to[0] = nfree_socks * sizeof (obj_t);
+  to[1] = nfree_socks;
+  for (n = 0; n < NCLASSES; n++)
+    {
+      to[0] += nbuffers[n] * (BUFFER_MIN << n);
+      to[1] += nbuffers[n];
+    }
+}
+
+void
+svz__pool_updn (int direction)
+{
+  slab_t *slab, *next;
+  char *buf;
+  int n;
+
+  if (direction)
+    return;
+
+  for (n = 0; n < NCLASSES; n++)
+    {
+      while ((buf = buffers[n]) != NULL)
+        {
+          memcpy (&buffers[n], buf, sizeof (char *));
+          svz_free (buf);
+        }
+      nbuffers[n] = 0;
+    }
+
+  /* Slabs still in use are left alone.  */
+  for (slab = slabs; slab; slab = next)
+    {
+      next = slab->next;
+      if (slab->used == 0)
+        {
+          unlink_slab (slab);
+          svz_free (slab);
+          nfree_socks -= SLAB_SOCKS;
+        }
+    }
+  nempty = 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * pool.h - socket structure and buffer pools
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __POOL_H__
+#define __POOL_H__ 1
+
+/* begin svzint */
+#include "libserveez/defines.h"
+#include "libserveez/socket.h"
+/* end svzint */
+
+__BEGIN_DECLS
+SBO svz_socket_t *svz_pool_sock_alloc (void);
+SBO void svz_pool_sock_free (svz_socket_t *);
+SBO char *svz_pool_buffer_alloc (int);
+SBO void svz_pool_buffer_free (char *, int);
+SBO char *svz_pool_buffer_resize (char *, int, int, int);
+SBO void svz_pool_counters (size_t *);
+__END_DECLS
+
+#endif /* not __POOL_H__ */
@@ -500,7 +500,7 @@ svz_portcfg_free (svz_portcfg_t *port)
     }
   if (port->accepted)
     {
-      svz_hash_destroy (port->accepted);
+      svz_ratelimit_destroy (port->accepted);
       port->accepted = NULL;
     }
 
@@ -803,6 +803,13 @@ svz_portcfg_prepare (svz_portcfg_t *port)
       else if (port->proto & (SVZ_PROTO_ICMP | SVZ_PROTO_RAW))
         port->recv_buffer_size = ICMP_BUF_SIZE;
     }
+  /* Check the bounds of the write quantum.  */
+  if (port->write_quantum_min <= 0)
+    port->write_quantum_min = SVZ_SOCK_MAX_WRITE;
+  if (port->write_quantum_max <= 0)
+    port->write_quantum_max = SVZ_SOCK_MAX_QUANTUM;
+  if (port->write_quantum_max < port->write_quantum_min)
+    port->write_quantum_max = port->write_quantum_min;
   /* Check the connection frequency.  */
   if (port->connect_freq <= 0)
     {
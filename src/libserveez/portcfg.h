@@ -25,6 +25,7 @@
 #include "libserveez/defines.h"
 #include "libserveez/array.h"
 #include "libserveez/hash.h"
+#include "libserveez/ratelimit.h"
 #include "libserveez/pipe-socket.h"
 /* end svzint */
 
@@ -118,11 +119,15 @@ typedef struct svz_portcfg
   int send_buffer_size;
   int recv_buffer_size;
 
+  /* bounds of the number of bytes written at once */
+  int write_quantum_min;
+  int write_quantum_max;
+
   /* allowed number of connects per second (hammer protection) */
   int connect_freq;
 
   /* remembers connect frequency for each ip */
-  svz_hash_t *accepted;
+  svz_ratelimit_t *accepted;
 
   /* denied and allowed access list (ip based) */
   svz_array_t *deny;
@@ -0,0 +1,242 @@
+/*
+ * ratelimit.c - event rate limiting
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "libserveez/alloc.h"
+#include "libserveez/ratelimit.h"
+#include "misc-macros.h"
+
+/* Number of key bytes taken into account.  */
+#define KEY_MAX  16
+
+/* No entry (end of a list).  */
+#define NIL  ((unsigned int) -1)
+
+/* Most entries released by ‘age’ at once.  */
+#define AGE_MAX  4
+
+/*
+ * The token bucket of a key.  The bucket holds up to @code{limit}
+ * tokens, each worth @code{period} units, and gets @code{limit} units
+ * refilled per second, so that there are at most @code{limit} events
+ * in any @code{period} seconds (on average).
+ */
+typedef struct
+{
+  unsigned long units;          /* number of units in the bucket */
+  time_t stamp;                 /* time of the last refill */
+  unsigned int chain;           /* next entry in the same hash bucket */
+  unsigned int prev;            /* neighbours in the LRU list ... */
+  unsigned int next;            /* ... or the free list */
+  unsigned char len;            /* key length */
+  unsigned char key[KEY_MAX];
+}
+entry_t;
+
+struct svz_ratelimit
+{
+  unsigned int limit;           /* events allowed ... */
+  unsigned int period;          /* ... per this many seconds */
+  unsigned int mask;            /* number of entries minus one */
+  unsigned int head;            /* most recently used entry */
+  unsigned int tail;            /* least recently used entry */
+  unsigned int free;            /* unused entries */
+  unsigned long seed;           /* perturbs the hash codes */
+  unsigned int *bucket;         /* first entry by hash code */
+  entry_t *entry;
+};
+
+/**
+ * Create a table counting events per key.  At most @var{limit} events
+ * within @var{period} seconds are allowed for each key.  The table
+ * remembers at least @var{size} keys (rounded up to the next power of
+ * two); once it is full, the least recently used key is forgotten.
+ */
+svz_ratelimit_t *
+svz_ratelimit_create (size_t size, unsigned int limit, unsigned int period)
+{
+  svz_ratelimit_t *rl = svz_malloc (sizeof (svz_ratelimit_t));
+  unsigned int n, i;
+
+  for (n = 1; n < size; n <<= 1)
+    ;
+  rl->limit = limit;
+  rl->period = period ? period : 1;
+  rl->mask = n - 1;
+  rl->head = rl->tail = NIL;
+  rl->seed = (unsigned long) time (NULL) ^ (unsigned long) SVZ_PTR2NUM (rl);
+  rl->bucket = svz_malloc (n * sizeof (unsigned int));
+  rl->entry = svz_malloc (n * sizeof (entry_t));
+  for (i = 0; i < n; i++)
+    {
+      rl->bucket[i] = NIL;
+      rl->entry[i].next = i + 1 < n ? i + 1 : NIL;
+    }
+  rl->free = 0;
+  return rl;
+}
+
+/**
+ * Destroy the table @var{rl}.
+ */
+void
+svz_ratelimit_destroy (svz_ratelimit_t *rl)
+{
+  if (rl)
+    {
+      svz_free (rl->bucket);
+      svz_free (rl->entry);
+      svz_free (rl);
+    }
+}
+
+static unsigned long
+hash_code (svz_ratelimit_t *rl, const unsigned char *key, size_t len)
+{
+  unsigned long code = rl->seed;
+
+  while (len--)
+    code = (code ^ *key++) * 16777619UL;
+  return code ^ (code >> 15);
+}
+
+static void
+lru_unlink (svz_ratelimit_t *rl, unsigned int i)
+{
+  entry_t *e = &rl->entry[i];
+
+  if (e->prev != NIL)
+    rl->entry[e->prev].next = e->next;
+  else
+    rl->head = e->next;
+  if (e->next != NIL)
+    rl->entry[e->next].prev = e->prev;
+  else
+    rl->tail = e->prev;
+}
+
+static void
+lru_push (svz_ratelimit_t *rl, unsigned int i)
+{
+  entry_t *e = &rl->entry[i];
+
+  e->prev = NIL;
+  e->next = rl->head;
+  if (rl->head != NIL)
+    rl->entry[rl->head].prev = i;
+  else
+    rl->tail = i;
+  rl->head = i;
+}
+
+/*
+ * Forget the key of entry @var{i} and put the entry on the free list.
+ */
+static void
+release (svz_ratelimit_t *rl, unsigned int i)
+{
+  entry_t *e = &rl->entry[i];
+  unsigned int *p = &rl->bucket[hash_code (rl, e->key, e->len) & rl->mask];
+
+  while (*p != i)
+    p = &rl->entry[*p].chain;
+  *p = e->chain;
+  lru_unlink (rl, i);
+  e->next = rl->free;
+  rl->free = i;
+}
+
+/*
+ * Release the least recently used entries whose buckets must have been
+ * refilled completely by @var{now}: they are as good as new.
+ */
+static void
+age (svz_ratelimit_t *rl, time_t now)
+{
+  int n;
+
+  for (n = 0; n < AGE_MAX && rl->tail != NIL; n++)
+    {
+      if (now - rl->entry[rl->tail].stamp < (time_t) rl->period)
+        break;
+      release (rl, rl->tail);
+    }
+}
+
+/**
+ * Count an event for the key @var{key} (@var{len} bytes, of which only
+ * the first 16 are significant) in table @var{rl}.  Return zero if the
+ * event is within the limit, otherwise non-zero.  Events exceeding the
+ * limit are not counted.
+ */
+int
+svz_ratelimit_hit (svz_ratelimit_t *rl, const void *key, size_t len)
+{
+  unsigned long full = (unsigned long) rl->limit * rl->period;
+  time_t now = time (NULL);
+  unsigned int i, *b;
+  entry_t *e;
+
+  if (len > KEY_MAX)
+    len = KEY_MAX;
+  age (rl, now);
+
+  b = &rl->bucket[hash_code (rl, key, len) & rl->mask];
+  for (i = *b; i != NIL; i = rl->entry[i].chain)
+    if (rl->entry[i].len == len && !memcmp (rl->entry[i].key, key, len))
+      break;
+
+  if (i != NIL)
+    {
+      e = &rl->entry[i];
+      lru_unlink (rl, i);
+      if (now > e->stamp)
+        {
+          e->units += (unsigned long) (now - e->stamp) * rl->limit;
+          if (e->units > full)
+            e->units = full;
+          e->stamp = now;
+        }
+    }
+  else
+    {
+      /* Table full?  Forget the least recently used key.  */
+      if (rl->free == NIL)
+        release (rl, rl->tail);
+      i = rl->free;
+      e = &rl->entry[i];
+      rl->free = e->next;
+      e->len = len;
+      memcpy (e->key, key, len);
+      e->units = full;
+      e->stamp = now;
+      e->chain = *b;
+      *b = i;
+    }
+  lru_push (rl, i);
+
+  if (e->units < rl->period)
+    return -1;
+  e->units -= rl->period;
+  return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * ratelimit.h - event rate limiting interface
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__ 1
+
+/* begin svzint */
+#include "libserveez/defines.h"
+/* end svzint */
+
+typedef struct svz_ratelimit svz_ratelimit_t;
+
+__BEGIN_DECLS
+
+SERVEEZ_API svz_ratelimit_t *svz_ratelimit_create (size_t, unsigned int,
+                                                   unsigned int);
+SERVEEZ_API void svz_ratelimit_destroy (svz_ratelimit_t *);
+SERVEEZ_API int svz_ratelimit_hit (svz_ratelimit_t *, const void *, size_t);
+
+__END_DECLS
+
+#endif /* not __RATELIMIT_H__ */
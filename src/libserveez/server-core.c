@@ -75,6 +75,7 @@
 #include "libserveez/coserver/coserver.h"
 #include "libserveez/server.h"
 #include "libserveez/server-core.h"
+#include "libserveez/timer.h"
 #include "misc-macros.h"
 
 /*
@@ -496,6 +497,11 @@ svz_sock_enqueue (svz_socket_t *sock)
   last_socket = sock;
   sock->flags |= SVZ_SOFLG_ENQUEUED;
   socktab[sock->id] = sock;
+  svz_sock_touch (sock);
+
+  /* Schedule the idle callback the old-fashioned way.  */
+  if (sock->idle_func && sock->idle_counter > 0 && !svz_timer_armed_p (sock))
+    svz_sock_idle_arm (sock, sock->idle_counter * 1000L);
 
   return 0;
 }
@@ -536,6 +542,8 @@ dequeue (svz_socket_t *sock)
     }
 
   /* really dequeue socket */
+  svz_sock_unwatch (sock);
+  svz_sock_idle_cancel (sock);
   if (sock->next)
     sock->next->prev = sock->prev;
   else
@@ -834,42 +842,14 @@ notify_internal (svz_server_t *server, UNUSED void *closure)
 
 /*
  * This routine gets called once a second and is supposed to perform any
- * task that has to get scheduled periodically.  It checks all sockets'
- * timers and calls their timer functions when necessary.
+ * task that has to get scheduled periodically.  The sockets' idle
+ * timers are handled separately by ‘svz_timer_run’.
  */
 int
 svz_periodic_tasks (void)
 {
-  svz_socket_t *sock;
-
   svz_notify += 1;
 
-  sock = svz_sock_root;
-  while (sock)
-    {
-#if ENABLE_FLOOD_PROTECTION
-      if (sock->flood_points > 0)
-        {
-          sock->flood_points--;
-        }
-#endif /* ENABLE_FLOOD_PROTECTION */
-
-      if (sock->idle_func && sock->idle_counter > 0)
-        {
-          if (--sock->idle_counter <= 0)
-            {
-              if (sock->idle_func (sock))
-                {
-                  svz_log (SVZ_LOG_ERROR,
-                           "idle function for socket id %d "
-                           "returned error\n", sock->id);
-                  svz_sock_schedule_for_shutdown (sock);
-                }
-            }
-        }
-      sock = sock->next;
-    }
-
   /* check regularly for internal coserver responses and keep coservers
      alive */
   svz_coserver_check ();
@@ -1039,6 +1019,9 @@ svz_loop_one (void)
    */
   svz_check_sockets ();
 
+  /* Run the idle callbacks of sockets whose timers expired.  */
+  svz_timer_run ();
+
   /* Check if a child died.  Checks all socket structures.  */
   check_children ();
 
@@ -1149,6 +1132,30 @@ svz_loop (void)
   svz_loop_post ();
 }
 
+/* These are defined in server-loop.c and below, respectively.  */
+SBO void svz__poller_updn (int direction);
+SBO void svz__signal_updn (int direction);
+
+/**
+ * Make the server loop state inherited from the parent usable in a
+ * child process created by @code{fork}, e.g., after binding servers to
+ * ports.  Call this function in the child before @code{svz_loop_pre}.
+ */
+void
+svz_loop_forked (void)
+{
+  svz_socket_t *sock;
+
+  /* The ‘epoll’ instance is shared with the parent: get our own.  */
+  svz__poller_updn (0);
+  svz__poller_updn (1);
+  svz_sock_foreach (sock)
+    svz_sock_touch (sock);
+
+  /* Take back the signals the parent may have claimed for itself.  */
+  svz__signal_updn (1);
+}
+
 
 void
 svz__sock_table_updn (int direction)
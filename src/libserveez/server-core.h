@@ -59,11 +59,15 @@ SBO int svz_sock_shutdown (svz_socket_t *);
 SBO int svz_sock_check_access (svz_socket_t *, svz_socket_t *);
 SBO void svz_sock_check_bogus (void);
 SBO int svz_periodic_tasks (void);
+SBO void svz_sock_unwatch (svz_socket_t *);
 
 SERVEEZ_API int svz_foreach_socket (svz_socket_do_t *, void *);
 SERVEEZ_API svz_socket_t *svz_sock_find (int, int);
 SERVEEZ_API int svz_sock_schedule_for_shutdown (svz_socket_t *);
 SERVEEZ_API int svz_sock_enqueue (svz_socket_t *);
+SERVEEZ_API void svz_sock_touch (svz_socket_t *);
+SERVEEZ_API void svz_sock_idle_arm (svz_socket_t *, long);
+SERVEEZ_API void svz_sock_idle_cancel (svz_socket_t *);
 SERVEEZ_API void svz_sock_setparent (svz_socket_t *, svz_socket_t *);
 SERVEEZ_API svz_socket_t *svz_sock_getparent (svz_socket_t *);
 SERVEEZ_API void svz_sock_setreferrer (svz_socket_t *, svz_socket_t *);
@@ -75,6 +79,7 @@ SERVEEZ_API void svz_loop_pre (void);
 SERVEEZ_API void svz_loop_post (void);
 SERVEEZ_API void svz_loop (void);
 SERVEEZ_API void svz_loop_one (void);
+SERVEEZ_API void svz_loop_forked (void);
 
 __END_DECLS
 
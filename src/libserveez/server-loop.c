@@ -47,18 +47,31 @@
 #if HAVE_SYS_POLL_H
 # include <sys/poll.h>
 #endif
+#if HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 #if HAVE_STRINGS_H
 # include <strings.h>
 #endif
 
 #include "networking-headers.h"
+#include "unused.h"
 #include "libserveez/alloc.h"
 #include "libserveez/util.h"
 #include "libserveez/socket.h"
 #include "libserveez/pipe-socket.h"
 #include "libserveez/server-core.h"
+#include "libserveez/timer.h"
+#include "misc-macros.h"
 
 #define USE_POLL  (HAVE_POLL && ENABLE_POLL)
+#define USE_EPOLL  (HAVE_SYS_EPOLL_H && HAVE_EPOLL_CREATE1 && ENABLE_EPOLL)
+
+#if USE_EPOLL
+#define SVZ_UNUSED_IF_NOT_EPOLL
+#else
+#define SVZ_UNUSED_IF_NOT_EPOLL  UNUSED
+#endif
 
 #define SOCK_FILE_FUNCTIONALITY(sock) do {                 \
   /* If socket is a file descriptor, then read it here.  */\
@@ -127,6 +140,7 @@ check_sockets_select (void)
   fd_set write_fds;             /* ditto */
   fd_set except_fds;            /* ditto */
   struct timeval wait;          /* used for timeout in ‘select’ */
+  int timeout;                  /* ditto, in milliseconds */
   svz_socket_t *sock;
 
   /*
@@ -205,7 +219,7 @@ check_sockets_select (void)
               FD_SET (sock->sock_desc, &read_fds);
 
           /* Put a socket into WRITE if necessary and possible.  */
-          if (!sock->unavailable && (sock->send_buffer_fill > 0 ||
+          if (!sock->unavailable && (SVZ_SOCK_SEND_PENDING (sock) ||
                                      sock->flags & SVZ_SOFLG_CONNECTING))
             {
               FD_SET (sock->sock_desc, &write_fds);
@@ -218,10 +232,12 @@ check_sockets_select (void)
   /*
    * Adjust timeout value, so we won't wait longer than we want.
    */
-  wait.tv_sec = svz_notify - time (NULL);
-  if (wait.tv_sec < 0)
-    wait.tv_sec = 0;
-  wait.tv_usec = 0;
+  timeout = (svz_notify - time (NULL)) * 1000;
+  if (timeout < 0)
+    timeout = 0;
+  timeout = svz_timer_timeout (timeout);
+  wait.tv_sec = timeout / 1000;
+  wait.tv_usec = (timeout % 1000) * 1000;
 
   if ((nfds = select (nfds, &read_fds, &write_fds, &except_fds, &wait)) <= 0)
     {
@@ -232,7 +248,7 @@ check_sockets_select (void)
             svz_sock_check_bogus ();
           return -1;
         }
-      else
+      else if (time (NULL) >= svz_notify)
         {
           /*
            * ‘select’ timed out, so we can do some administrative stuff.
@@ -504,7 +520,7 @@ check_sockets_poll (void)
                   polled = 1;
                 }
             }
-          if (!sock->unavailable && (sock->send_buffer_fill > 0 ||
+          if (!sock->unavailable && (SVZ_SOCK_SEND_PENDING (sock) ||
                                      sock->flags & SVZ_SOFLG_CONNECTING))
             {
               FD_POLL_OUT (fd, sock);
@@ -518,6 +534,7 @@ check_sockets_poll (void)
   timeout = (svz_notify - time (NULL)) * 1000;
   if (timeout < 0)
     timeout = 0;
+  timeout = svz_timer_timeout (timeout);
 
   /* now ‘poll’ everything */
   if ((polled = poll (ufds, nfds, timeout)) <= 0)
@@ -529,7 +546,7 @@ check_sockets_poll (void)
             svz_sock_check_bogus ();
           return -1;
         }
-      else
+      else if (time (NULL) >= svz_notify)
         {
           svz_periodic_tasks ();
         }
@@ -638,6 +655,519 @@ check_sockets_poll (void)
 
 #endif  /* USE_POLL */
 
+#if USE_EPOLL
+
+/*
+ * The ‘epoll’ loop does not walk the whole socket list on each
+ * iteration.  Instead, each socket structure's interest in reading and
+ * writing is kept registered with the kernel and only re-evaluated when
+ * the socket has been "touched" (see ‘svz_sock_touch’).  Sockets which
+ * need attention on every iteration anyway (files, triggers, listening
+ * pipes and lingering connections) are kept on the ‘busy’ list.
+ */
+
+/* Roles a registered file descriptor plays for its socket structure.  */
+#define ROLE_SOCK  0x1                  /* the socket descriptor */
+#define ROLE_RECV  0x2                  /* the receiving pipe */
+#define ROLE_SEND  0x4                  /* the sending pipe */
+#define ROLE_BITS  3
+
+/* Number of descriptor slots per socket structure.  */
+#define NSLOTS  3
+
+/* Maximum number of events to fetch at once.  */
+#define MAX_EVENTS  256
+
+/* Registration state of a single socket structure, indexed by its id.  */
+typedef struct
+{
+  int touched;                  /* currently on the ‘touched’ list */
+  int fd[NSLOTS];               /* registered descriptors (or -1) */
+  uint32_t events[NSLOTS];      /* their event masks */
+  int roles[NSLOTS];            /* their roles */
+}
+watch_t;
+
+static int poller = -1;         /* the ‘epoll’ instance */
+static watch_t *watch = NULL;   /* registration state by socket id */
+static int nwatch = 0;
+static int *owner = NULL;       /* socket id by file descriptor (or -1) */
+static int nowner = 0;
+static int *touched = NULL;     /* ids of sockets to re-evaluate */
+static int ntouched = 0;
+static int *busy = NULL;        /* ids of sockets needing every loop */
+static int nbusy = 0;
+static int maxlist = 0;         /* allocated length of both lists */
+
+/*
+ * Return the registration state of the socket structure with the
+ * given @var{id}, growing the table if necessary.
+ */
+static watch_t *
+watch_get (int id)
+{
+  int n, i;
+
+  if (id >= nwatch)
+    {
+      n = id + 1;
+      watch = svz_realloc (watch, n * sizeof (watch_t));
+      for (; nwatch < n; nwatch++)
+        {
+          watch[nwatch].touched = 0;
+          for (i = 0; i < NSLOTS; i++)
+            watch[nwatch].fd[i] = -1;
+        }
+    }
+  return &watch[id];
+}
+
+/*
+ * Append the socket id @var{id} to the list @var{list} of length
+ * @var{n}.  Both lists are grown in lockstep.
+ */
+static void
+list_append (int **list, int *n, int id)
+{
+  if (*n >= maxlist)
+    {
+      maxlist = maxlist ? maxlist * 2 : 64;
+      touched = svz_realloc (touched, maxlist * sizeof (int));
+      busy = svz_realloc (busy, maxlist * sizeof (int));
+    }
+  (*list)[(*n)++] = id;
+}
+
+/*
+ * Drop the registration of file descriptor @var{fd} if it is still
+ * owned by the socket structure with the given @var{id}.
+ */
+static void
+unregister (int fd, int id)
+{
+  struct epoll_event ev;
+
+  if (fd >= nowner || owner[fd] != id)
+    return;
+  /* The descriptor may already be closed; this is no error.  */
+  epoll_ctl (poller, EPOLL_CTL_DEL, fd, &ev);
+  owner[fd] = -1;
+}
+
+/*
+ * Register (or modify) file descriptor @var{fd} for the events
+ * @var{events} on behalf of socket structure @var{sock}.  If the
+ * descriptor is still listed as owned by another socket structure, that
+ * one must have closed it without telling us.  Return non-zero on errors.
+ */
+static int
+reregister (svz_socket_t *sock, int fd, uint32_t events, int roles)
+{
+  struct epoll_event ev;
+  int op, i, prev;
+
+  if (fd >= nowner)
+    {
+      owner = svz_realloc (owner, (fd + 1) * sizeof (int));
+      for (; nowner <= fd; nowner++)
+        owner[nowner] = -1;
+    }
+
+  if ((prev = owner[fd]) != -1 && prev != sock->id && prev < nwatch)
+    for (i = 0; i < NSLOTS; i++)
+      if (watch[prev].fd[i] == fd)
+        watch[prev].fd[i] = -1;
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = events;
+  ev.data.u64 = ((uint64_t) (uint32_t) sock->version << 32)
+    | ((uint32_t) sock->id << ROLE_BITS) | roles;
+
+  op = prev == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  if (epoll_ctl (poller, op, fd, &ev) < 0)
+    {
+      /* The kernel knows better than our bookkeeping.  */
+      if (errno == EEXIST)
+        op = EPOLL_CTL_MOD;
+      else if (errno == ENOENT)
+        op = EPOLL_CTL_ADD;
+      else
+        op = -1;
+      if (op == -1 || epoll_ctl (poller, op, fd, &ev) < 0)
+        {
+          svz_log_sys_error ("epoll_ctl");
+          owner[fd] = -1;
+          return -1;
+        }
+    }
+  owner[fd] = sock->id;
+  return 0;
+}
+
+/*
+ * Return non-zero if the socket structure @var{sock} needs to be
+ * looked at on each iteration of the server loop.
+ */
+static int
+busy_p (svz_socket_t *sock)
+{
+  if (sock->flags & SVZ_SOFLG_KILLED)
+    return 0;
+  if ((sock->flags & SVZ_SOFLG_FILE) && sock->read_socket)
+    return 1;
+  if (sock->trigger_cond)
+    return 1;
+  if ((sock->flags & SVZ_SOFLG_PIPE) && (sock->flags & SVZ_SOFLG_LISTENING)
+      && !(sock->flags & SVZ_SOFLG_INITED))
+    return 1;
+  if ((sock->flags & SVZ_SOFLG_SOCK) && sock->unavailable)
+    return 1;
+  return 0;
+}
+
+/*
+ * Bring the kernel's view of what @var{sock} waits for in line with its
+ * current state.  The conditions are the same as in the ‘poll’ loop.
+ */
+static void
+sync_interest (svz_socket_t *sock)
+{
+  watch_t *w = watch_get (sock->id);
+  int fd[NSLOTS] = { -1, -1, -1 };
+  uint32_t events[NSLOTS] = { 0, 0, 0 };
+  int roles[NSLOTS] = { ROLE_SOCK, ROLE_RECV, ROLE_SEND };
+  int i, j;
+
+  if (!(sock->flags & SVZ_SOFLG_KILLED))
+    {
+      if ((sock->flags & SVZ_SOFLG_PIPE)
+          && !(sock->flags & SVZ_SOFLG_LISTENING))
+        {
+          if ((sock->flags & SVZ_SOFLG_RECV_PIPE) && SOCK_READABLE (sock))
+            {
+              fd[1] = (int) sock->pipe_desc[SVZ_READ];
+              events[1] = EPOLLIN;
+            }
+          if ((sock->flags & SVZ_SOFLG_SEND_PIPE)
+              && sock->send_buffer_fill > 0)
+            {
+              fd[2] = (int) sock->pipe_desc[SVZ_WRITE];
+              events[2] = EPOLLOUT;
+            }
+        }
+
+      if (sock->flags & SVZ_SOFLG_SOCK)
+        {
+          if (!(sock->flags & SVZ_SOFLG_CONNECTING) && SOCK_READABLE (sock))
+            events[0] |= EPOLLIN | EPOLLPRI;
+          if (!sock->unavailable && (SVZ_SOCK_SEND_PENDING (sock) ||
+                                     sock->flags & SVZ_SOFLG_CONNECTING))
+            events[0] |= EPOLLOUT;
+          if (events[0])
+            fd[0] = (int) sock->sock_desc;
+        }
+    }
+
+  /* The kernel allows a descriptor only once per ‘epoll’ instance.  */
+  for (i = 1; i < NSLOTS; i++)
+    for (j = 0; j < i; j++)
+      if (fd[i] != -1 && fd[i] == fd[j])
+        {
+          events[j] |= events[i];
+          roles[j] |= roles[i];
+          fd[i] = -1;
+        }
+
+  for (i = 0; i < NSLOTS; i++)
+    if (w->fd[i] != -1 && w->fd[i] != fd[i])
+      {
+        unregister (w->fd[i], sock->id);
+        w->fd[i] = -1;
+      }
+
+  for (i = 0; i < NSLOTS; i++)
+    if (fd[i] != -1
+        && (w->fd[i] != fd[i]
+            || w->events[i] != events[i]
+            || w->roles[i] != roles[i]
+            || owner[fd[i]] != sock->id))
+      {
+        if (reregister (sock, fd[i], events[i], roles[i]))
+          continue;
+        w->fd[i] = fd[i];
+        w->events[i] = events[i];
+        w->roles[i] = roles[i];
+      }
+}
+
+/*
+ * Handle the @var{events} reported for the descriptor playing
+ * @var{roles} for the socket structure @var{sock}.  The order of the
+ * callbacks is the same as in the ‘poll’ loop.
+ */
+static void
+dispatch (svz_socket_t *sock, uint32_t events, int roles)
+{
+  /* urgent data (out-of-band) on the socket?  */
+  if ((roles & ROLE_SOCK) && (events & EPOLLPRI))
+    if (sock->read_socket_oob)
+      if (sock->read_socket_oob (sock))
+        {
+          svz_sock_schedule_for_shutdown (sock);
+          return;
+        }
+
+  /* file descriptor ready for reading?  */
+  if ((roles & (ROLE_SOCK | ROLE_RECV)) && (events & EPOLLIN))
+    {
+      if (sock->read_socket)
+        if (sock->read_socket (sock))
+          {
+            svz_sock_schedule_for_shutdown (sock);
+            return;
+          }
+    }
+
+  /* file descriptor ready for writing */
+  if ((roles & (ROLE_SOCK | ROLE_SEND)) && (events & EPOLLOUT))
+    {
+      /* socket connected?  */
+      if ((roles & ROLE_SOCK) && (sock->flags & SVZ_SOFLG_CONNECTING))
+        {
+          if (sock->connected_socket)
+            if (sock->connected_socket (sock))
+              {
+                svz_sock_schedule_for_shutdown (sock);
+                return;
+              }
+        }
+      /* ready for writing */
+      else
+        {
+          if (sock->write_socket)
+            if (sock->write_socket (sock))
+              {
+                svz_sock_schedule_for_shutdown (sock);
+                return;
+              }
+        }
+    }
+
+  /* file descriptor caused some error */
+  if (events & (EPOLLERR | EPOLLHUP))
+    {
+      if (roles & ROLE_SOCK)
+        {
+          if (sock->flags & SVZ_SOFLG_CONNECTING)
+            {
+              svz_log (SVZ_LOG_ERROR, "exception connecting socket %d\n",
+                       sock->sock_desc);
+            }
+          else
+            {
+              svz_log (SVZ_LOG_ERROR, "exception on socket %d\n",
+                       sock->sock_desc);
+            }
+          error_info (sock);
+          svz_sock_schedule_for_shutdown (sock);
+        }
+      if (roles & ROLE_RECV)
+        {
+          svz_log (SVZ_LOG_ERROR, "exception on receiving pipe %d \n",
+                   sock->pipe_desc[SVZ_READ]);
+          svz_sock_schedule_for_shutdown (sock);
+        }
+      if (roles & ROLE_SEND)
+        {
+          svz_log (SVZ_LOG_ERROR, "exception on sending pipe %d \n",
+                   sock->pipe_desc[SVZ_WRITE]);
+          svz_sock_schedule_for_shutdown (sock);
+        }
+    }
+}
+
+/*
+ * Same routine as the above ‘check_sockets_poll’ routine, but using
+ * Linux' ‘epoll’ interface.  The cost of an iteration depends on the
+ * number of active sockets rather than on the number of all sockets.
+ */
+static int
+check_sockets_epoll (void)
+{
+  static struct epoll_event events[MAX_EVENTS];
+  svz_socket_t *sock;
+  watch_t *w;
+  int timeout, n, i, id, roles, version;
+
+  /* run the every-loop functionality of the busy sockets */
+  n = nbusy;
+  nbusy = 0;
+  for (i = 0; i < n; i++)
+    {
+      if ((sock = svz_sock_find (busy[i], -1)) == NULL)
+        continue;
+      if (sock->flags & SVZ_SOFLG_KILLED)
+        continue;
+
+      /* process files */
+      SOCK_FILE_FUNCTIONALITY (sock);
+
+      /* issue the trigger funcionality */
+      SOCK_TRIGGER_FUNCTIONALITY (sock);
+
+      /* handle listening pipe */
+      if ((sock->flags & SVZ_SOFLG_PIPE)
+          && (sock->flags & SVZ_SOFLG_LISTENING)
+          && !(sock->flags & SVZ_SOFLG_INITED))
+        if (sock->read_socket)
+          if (sock->read_socket (sock))
+            svz_sock_schedule_for_shutdown (sock);
+
+      /* process lingering connection counter */
+      if ((sock->flags & SVZ_SOFLG_SOCK) && sock->unavailable)
+        {
+          if (time (NULL) >= sock->unavailable)
+            sock->unavailable = 0;
+        }
+
+      svz_sock_touch (sock);
+    }
+
+  /* re-evaluate the touched sockets */
+  for (i = 0; i < ntouched; i++)
+    {
+      id = touched[i];
+      if (id >= nwatch || !(w = &watch[id])->touched)
+        continue;
+      w->touched = 0;
+      if ((sock = svz_sock_find (id, -1)) == NULL)
+        continue;
+      sync_interest (sock);
+      if (busy_p (sock))
+        list_append (&busy, &nbusy, id);
+    }
+  ntouched = 0;
+
+  /* calculate timeout value */
+  timeout = (svz_notify - time (NULL)) * 1000;
+  if (timeout < 0)
+    timeout = 0;
+  timeout = svz_timer_timeout (timeout);
+
+  /* now wait for anything to happen */
+  if ((n = epoll_wait (poller, events, MAX_EVENTS, timeout)) <= 0)
+    {
+      if (n < 0)
+        {
+          svz_log_sys_error ("epoll_wait");
+          return -1;
+        }
+      else if (time (NULL) >= svz_notify)
+        {
+          svz_periodic_tasks ();
+        }
+    }
+
+  /* go through all reported events */
+  for (i = 0; i < n; i++)
+    {
+      roles = (int) (events[i].data.u64 & ((1 << ROLE_BITS) - 1));
+      id = (int) ((uint32_t) events[i].data.u64 >> ROLE_BITS);
+      version = (int) (uint32_t) (events[i].data.u64 >> 32);
+
+      /* skip stale registrations and killed connections */
+      if ((sock = svz_sock_find (id, -1)) == NULL
+          || sock->version != version
+          || sock->flags & SVZ_SOFLG_KILLED)
+        continue;
+
+      dispatch (sock, events[i].events, roles);
+      svz_sock_touch (sock);
+    }
+
+  /* handle regular tasks ...  */
+  if (time (NULL) > svz_notify)
+    {
+      svz_periodic_tasks ();
+    }
+
+  return 0;
+}
+
+#endif  /* USE_EPOLL */
+
+/**
+ * Notify the server loop that the state of @var{sock} which decides
+ * whether it waits for reading or writing (send and receive buffer fill,
+ * the @code{SVZ_SOFLG_FILE} flag, the trigger callback, etc.) may have
+ * changed.  This is done implicitly for the socket a callback runs for
+ * and by functions like @code{svz_sock_write}, so you need it only when
+ * modifying other socket structures' buffers or callbacks directly.
+ */
+void
+svz_sock_touch (SVZ_UNUSED_IF_NOT_EPOLL svz_socket_t *sock)
+{
+#if USE_EPOLL
+  watch_t *w;
+
+  if (poller == -1 || !(sock->flags & SVZ_SOFLG_ENQUEUED))
+    return;
+  w = watch_get (sock->id);
+  if (w->touched)
+    return;
+  w->touched = 1;
+  list_append (&touched, &ntouched, sock->id);
+#endif
+}
+
+/*
+ * Forget about @var{sock}.  This is called when it is dequeued,
+ * before its descriptors are closed.
+ */
+void
+svz_sock_unwatch (SVZ_UNUSED_IF_NOT_EPOLL svz_socket_t *sock)
+{
+#if USE_EPOLL
+  watch_t *w;
+  int i;
+
+  if (poller == -1 || sock->id >= nwatch)
+    return;
+  w = &watch[sock->id];
+  for (i = 0; i < NSLOTS; i++)
+    if (w->fd[i] != -1)
+      {
+        unregister (w->fd[i], sock->id);
+        w->fd[i] = -1;
+      }
+  w->touched = 0;
+#endif
+}
+
+void
+svz__poller_updn (SVZ_UNUSED_IF_NOT_EPOLL int direction)
+{
+#if USE_EPOLL
+  if (direction)
+    {
+      /* If this fails, we fall back to the other loop.  */
+      if ((poller = epoll_create1 (EPOLL_CLOEXEC)) == -1)
+        svz_log_sys_error ("epoll_create1");
+    }
+  else
+    {
+      if (poller != -1)
+        close (poller);
+      poller = -1;
+      svz_free_and_zero (watch);
+      svz_free_and_zero (owner);
+      svz_free_and_zero (touched);
+      svz_free_and_zero (busy);
+      nwatch = nowner = ntouched = nbusy = maxlist = 0;
+    }
+#endif
+}
+
 #ifdef __MINGW32__
 
 /*
@@ -651,6 +1181,7 @@ check_sockets_mingw (void)
   fd_set write_fds;             /* ditto */
   fd_set except_fds;            /* ditto */
   struct timeval wait;          /* used for timeout in ‘select’ */
+  int timeout;                  /* ditto, in milliseconds */
   svz_socket_t *sock;
 
   /*
@@ -717,7 +1248,7 @@ check_sockets_mingw (void)
               FD_SET (sock->sock_desc, &read_fds);
 
           /* Put a socket into WRITE if necessary and possible.  */
-          if (!sock->unavailable && (sock->send_buffer_fill > 0 ||
+          if (!sock->unavailable && (SVZ_SOCK_SEND_PENDING (sock) ||
                                      sock->flags & SVZ_SOFLG_CONNECTING))
             {
               FD_SET (sock->sock_desc, &write_fds);
@@ -730,10 +1261,12 @@ check_sockets_mingw (void)
   /*
    * Adjust timeout value, so we won't wait longer than we want.
    */
-  wait.tv_sec = svz_notify - time (NULL);
-  if (wait.tv_sec < 0)
-    wait.tv_sec = 0;
-  wait.tv_usec = 0;
+  timeout = (svz_notify - time (NULL)) * 1000;
+  if (timeout < 0)
+    timeout = 0;
+  timeout = svz_timer_timeout (timeout);
+  wait.tv_sec = timeout / 1000;
+  wait.tv_usec = (timeout % 1000) * 1000;
 
   /* Just sleep a bit if there is no file descriptor to be ‘select’ed.  */
   if (nfds < 2)
@@ -750,7 +1283,7 @@ check_sockets_mingw (void)
             svz_sock_check_bogus ();
           return -1;
         }
-      else
+      else if (time (NULL) >= svz_notify)
         {
           /*
            * ‘select’ timed out, so we can do some administrative stuff.
@@ -875,6 +1408,10 @@ check_sockets_mingw (void)
 int
 svz_check_sockets (void)
 {
+#if USE_EPOLL
+  if (poller != -1)
+    return check_sockets_epoll ();
+#endif
 #if USE_POLL
   return check_sockets_poll ();
 #elif defined (__MINGW32__)
@@ -53,6 +53,7 @@
 #include "libserveez/server-core.h"
 #include "libserveez/server.h"
 #include "libserveez/binding.h"
+#include "libserveez/ratelimit.h"
 #include "libserveez/portcfg.h"
 #include "libserveez/server-socket.h"
 #include "misc-macros.h"
@@ -66,8 +67,9 @@ static int
 idle_protect (svz_socket_t *sock)
 {
   svz_portcfg_t *port = svz_sock_portcfg (sock);
+  long idle = time (NULL) - sock->last_recv;
 
-  if (time (NULL) - sock->last_recv > port->detection_wait)
+  if (idle > port->detection_wait)
     {
 #if ENABLE_DEBUG
       svz_log (SVZ_LOG_DEBUG, "socket id %d detection failed\n", sock->id);
@@ -75,14 +77,13 @@ idle_protect (svz_socket_t *sock)
       return -1;
     }
 
-  sock->idle_counter = 1;
+  /* Check again when the detection wait would be exceeded.  */
+  svz_sock_idle_arm (sock, (port->detection_wait + 1 - idle) * 1000);
   return 0;
 }
 
-/* This is 1 if ‘time_t’ cannot be cast into a ‘void *’.  If that's the
-   case, ‘check_frequency’ stores pointers to ‘svz_malloc’d
-   values in the array (arranging to ‘svz_free’ them when done).  */
-#define TIME_T_TOO_FAT  (SIZEOF_VOID_P < sizeof (time_t))
+/* Number of clients whose connect frequency is remembered per port.  */
+#define FREQUENCY_SLOTS  1024
 
 /*
  * This routine checks the connection frequency of the socket structure
@@ -94,53 +95,26 @@ static int
 check_frequency (svz_socket_t *parent, svz_socket_t *child)
 {
   svz_portcfg_t *port = parent->port;
+  unsigned char bits[16];
   char ip[64];
-  time_t *t, *s = TIME_T_TOO_FAT ? svz_malloc (sizeof (time_t)) : NULL;
-  time_t current;
-  size_t n;
-  int nr, ret = 0;
-  svz_array_t *accepted = NULL;
 
-  SVZ_PP_ADDR (ip, child->remote_addr);
+  if (svz_address_to (bits, child->remote_addr) < 0)
+    return 0;
 
-  /* Check connect frequency.  */
-  if (port->accepted)
-    accepted = svz_hash_get (port->accepted, ip);
-  else
-    port->accepted = svz_hash_create (4, (svz_free_func_t) svz_array_destroy);
-  current = time (s);
+  /* Allow for ‘connect_freq’ per second, averaged over four seconds.  */
+  if (!port->accepted)
+    port->accepted = svz_ratelimit_create (FREQUENCY_SLOTS,
+                                           4 * (port->connect_freq + 1), 4);
 
-  if (accepted != NULL)
-    {
-      /* Delete older entries and count valid entries.  */
-      nr = 0;
-      svz_array_foreach (accepted, t, n)
-        {
-          if ((TIME_T_TOO_FAT ? *t : (time_t) SVZ_PTR2NUM (t)) < current - 4)
-            {
-              svz_array_del (accepted, n);
-              n--;
-            }
-          else
-            nr++;
-        }
-      /* Check the connection frequency.  */
-      if ((nr /= 4) > port->connect_freq)
-        {
-          svz_log (SVZ_LOG_NOTICE, "connect frequency reached: %s: %d/%d\n",
-                   ip, nr, port->connect_freq);
-          ret = -1;
-        }
-    }
-  /* Not yet connected.  */
-  else
+  if (svz_ratelimit_hit (port->accepted, bits,
+                         svz_address_family (child->remote_addr) == AF_INET
+                         ? 4 : sizeof bits))
     {
-      accepted = svz_array_create (1, TIME_T_TOO_FAT ? svz_free : NULL);
+      svz_log (SVZ_LOG_NOTICE, "connect frequency reached: %s: %d\n",
+               SVZ_PP_ADDR (ip, child->remote_addr), port->connect_freq);
+      return -1;
     }
-
-  svz_array_add (accepted, TIME_T_TOO_FAT ? s : SVZ_NUM2PTR (current));
-  svz_hash_put (port->accepted, ip, accepted);
-  return ret;
+  return 0;
 }
 
 /*
@@ -212,10 +186,13 @@ tcp_accept (svz_socket_t *server_sock)
       svz_sock_bindings_set (sock, server_sock);
       sock->check_request = server_sock->check_request;
       sock->idle_func = idle_protect;
-      sock->idle_counter = 1;
+      svz_sock_idle_arm (sock, 1000);
 
       svz_sock_resize_buffers (sock, port->send_buffer_size,
                                port->recv_buffer_size);
+      sock->write_quantum = port->write_quantum_min;
+      sock->write_quantum_min = port->write_quantum_min;
+      sock->write_quantum_max = port->write_quantum_max;
       svz_sock_enqueue (sock);
       svz_sock_setparent (sock, server_sock);
       sock->proto = server_sock->proto;
@@ -404,7 +381,7 @@ pipe_accept (svz_socket_t *server_sock)
   sock->check_request = server_sock->check_request;
   sock->disconnected_socket = server_sock->disconnected_socket;
   sock->idle_func = idle_protect;
-  sock->idle_counter = 1;
+  svz_sock_idle_arm (sock, 1000);
   svz_sock_resize_buffers (sock, port->send_buffer_size,
                            port->recv_buffer_size);
   svz_sock_enqueue (sock);
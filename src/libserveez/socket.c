@@ -40,6 +40,18 @@
 # include <sys/time.h>
 #endif
 
+#if HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
+
+#if HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+
+#if HAVE_LINUX_SOCKIOS_H
+# include <linux/sockios.h>
+#endif
+
 #ifndef __MINGW32__
 # include <sys/types.h>
 # include <sys/socket.h>
@@ -50,6 +62,7 @@
 #include "libserveez/alloc.h"
 #include "libserveez/util.h"
 #include "libserveez/socket.h"
+#include "libserveez/pool.h"
 #include "libserveez/core.h"
 #include "libserveez/pipe-socket.h"
 #include "libserveez/tcp-socket.h"
@@ -111,6 +124,8 @@ svz_sock_prefree (int addsub, svz_sock_prefree_fn fn)
             svz_array_del (prefree, i);
             i--;
           }
+      if (svz_array_size (prefree) == 0)
+        prefree = svz_array_destroy_zero (prefree);
     }
 }
 
@@ -127,6 +142,14 @@ svz_sock_flood_protect (svz_socket_t *sock, int num_read)
 #ifdef ENABLE_FLOOD_PROTECTION
   if (!(sock->flags & SVZ_SOFLG_NOFLOOD))
     {
+      long now = time (NULL);
+
+      /* The points drain at a rate of one per second.  */
+      sock->flood_points -= now - sock->flood_time;
+      if (sock->flood_points < 0)
+        sock->flood_points = 0;
+      sock->flood_time = now;
+
       /*
        * Since the default flood limit is 100 a reader can produce
        * 5000 bytes per second before it gets kicked.
@@ -196,6 +219,7 @@ svz_sock_detect_proto (svz_socket_t *sock)
         {
           svz_array_destroy (bindings);
           sock->idle_func = NULL;
+          svz_sock_idle_cancel (sock);
           svz_sock_bindings_set (sock, NULL);
           sock->cfg = server->cfg;
           sock->port = binding->port;
@@ -382,20 +406,17 @@ svz_sock_check_request (svz_socket_t *sock)
 /*
  * Allocate a structure of type @code{svz_socket_t} and initialize its data
  * fields.  Assign some of the default callbacks for TCP connections.
+ * The send and receive buffers are allocated on first use.
  */
 svz_socket_t *
 svz_sock_alloc (void)
 {
   svz_socket_t *sock;
-  char *in;
-  char *out;
 
-  sock = svz_calloc (sizeof (svz_socket_t));
-  in = svz_malloc (RECV_BUF_SIZE);
-  out = svz_malloc (SEND_BUF_SIZE);
+  sock = svz_pool_sock_alloc ();
 
   sock->proto = SVZ_SOFLG_INIT;
-  sock->flags = SVZ_SOFLG_INIT | SVZ_SOFLG_INBUF | SVZ_SOFLG_OUTBUF;
+  sock->flags = SVZ_SOFLG_INIT;
   sock->userflags = SVZ_SOFLG_INIT;
   sock->file_desc = -1;
   sock->sock_desc = (svz_t_socket) -1;
@@ -409,17 +430,20 @@ svz_sock_alloc (void)
   sock->check_request = svz_sock_detect_proto;
   sock->disconnected_socket = maybe_log_disconnect;
 
-  sock->recv_buffer = in;
   sock->recv_buffer_size = RECV_BUF_SIZE;
-  sock->send_buffer = out;
   sock->send_buffer_size = SEND_BUF_SIZE;
   sock->last_send = time (NULL);
   sock->last_recv = time (NULL);
 
 #if ENABLE_FLOOD_PROTECTION
   sock->flood_limit = 100;
+  sock->flood_time = sock->last_recv;
 #endif /* ENABLE_FLOOD_PROTECTION */
 
+  sock->write_quantum = SVZ_SOCK_MAX_WRITE;
+  sock->write_quantum_min = SVZ_SOCK_MAX_WRITE;
+  sock->write_quantum_max = SVZ_SOCK_MAX_QUANTUM;
+
   return sock;
 }
 
@@ -428,7 +452,8 @@ svz_sock_alloc (void)
  * @var{send_buf_size} is the new size for the send buffer,
  * @var{recv_buf_size} for the receive buffer.  Note that data may be lost
  * when the buffers shrink.  For a new buffer size of 0 the buffer is
- * freed and the pointer set to NULL.
+ * freed and the pointer set to NULL.  Buffers which are not allocated
+ * yet are allocated with the new size on first use.
  */
 int
 svz_sock_resize_buffers (svz_socket_t *sock,
@@ -436,23 +461,23 @@ svz_sock_resize_buffers (svz_socket_t *sock,
 {
   char *send, *recv;
 
-  if (send_buf_size == 0)
-    {
-      svz_free (sock->send_buffer);
-      send = NULL;
-    }
-  else if (sock->send_buffer_size != send_buf_size)
-    send = svz_realloc (sock->send_buffer, send_buf_size);
+  svz_sock_compact_send (sock);
+  svz_sock_compact_recv (sock);
+  if (sock->send_buffer == NULL)
+    send = NULL;
+  else if (sock->send_buffer_size != send_buf_size || send_buf_size == 0)
+    send = svz_pool_buffer_resize (sock->send_buffer,
+                                   sock->send_buffer_size,
+                                   sock->send_buffer_fill, send_buf_size);
   else
     send = sock->send_buffer;
 
-  if (recv_buf_size == 0)
-    {
-      svz_free (sock->recv_buffer);
-      recv = NULL;
-    }
-  else if (sock->recv_buffer_size != recv_buf_size)
-    recv = svz_realloc (sock->recv_buffer, recv_buf_size);
+  if (sock->recv_buffer == NULL)
+    recv = NULL;
+  else if (sock->recv_buffer_size != recv_buf_size || recv_buf_size == 0)
+    recv = svz_pool_buffer_resize (sock->recv_buffer,
+                                   sock->recv_buffer_size,
+                                   sock->recv_buffer_fill, recv_buf_size);
   else
     recv = sock->recv_buffer;
 
@@ -460,10 +485,166 @@ svz_sock_resize_buffers (svz_socket_t *sock,
   sock->recv_buffer = recv;
   sock->send_buffer_size = send_buf_size;
   sock->recv_buffer_size = recv_buf_size;
+  if (send == NULL)
+    sock->flags &= ~SVZ_SOFLG_OUTBUF;
+  if (recv == NULL)
+    sock->flags &= ~SVZ_SOFLG_INBUF;
+  svz_sock_touch (sock);
 
   return 0;
 }
 
+/**
+ * Allocate the buffers of the socket @var{sock} given by @var{flags},
+ * that is @code{SVZ_SOFLG_INBUF} for the receive buffer and
+ * @code{SVZ_SOFLG_OUTBUF} for the send buffer, unless they are allocated
+ * already.  The buffers of a socket are allocated on first use and may
+ * be released by @code{svz_sock_release_buffers} when they are empty, so
+ * call this before accessing them other than by @code{svz_sock_write}
+ * or from within the @code{check_request} callback.
+ */
+void
+svz_sock_alloc_buffers (svz_socket_t *sock, int flags)
+{
+  if ((flags & SVZ_SOFLG_INBUF) && sock->recv_buffer == NULL
+      && sock->recv_buffer_size > 0)
+    {
+      sock->recv_buffer = svz_pool_buffer_alloc (sock->recv_buffer_size);
+      sock->recv_buffer_head = 0;
+      sock->flags |= SVZ_SOFLG_INBUF;
+    }
+  if ((flags & SVZ_SOFLG_OUTBUF) && sock->send_buffer == NULL
+      && sock->send_buffer_size > 0)
+    {
+      sock->send_buffer = svz_pool_buffer_alloc (sock->send_buffer_size);
+      sock->send_buffer_head = 0;
+      sock->flags |= SVZ_SOFLG_OUTBUF;
+    }
+}
+
+/* Give back the buffer at @var{buffer} of @var{size} bytes.  */
+static void
+release_buffer (char **buffer, int size, int *head)
+{
+  svz_pool_buffer_free (*buffer - *head, size);
+  *buffer = NULL;
+  *head = 0;
+}
+
+/**
+ * Give back the empty send and receive buffers of the socket @var{sock}
+ * to the buffer pool, so idle connections do not hold on to them.  They
+ * are allocated again by @code{svz_sock_alloc_buffers}.  Buffers in use
+ * by a codec are kept.
+ */
+void
+svz_sock_release_buffers (svz_socket_t *sock)
+{
+  if (sock->recv_buffer && sock->recv_buffer_fill <= 0
+      && sock->recv_codec == NULL)
+    {
+      release_buffer (&sock->recv_buffer, sock->recv_buffer_size,
+                      &sock->recv_buffer_head);
+      sock->recv_buffer_fill = 0;
+      sock->flags &= ~SVZ_SOFLG_INBUF;
+    }
+  if (sock->send_buffer && sock->send_buffer_fill <= 0
+      && sock->send_codec == NULL)
+    {
+      release_buffer (&sock->send_buffer, sock->send_buffer_size,
+                      &sock->send_buffer_head);
+      sock->send_buffer_fill = 0;
+      sock->flags &= ~SVZ_SOFLG_OUTBUF;
+    }
+}
+
+/* Maximum number of pieces ‘svz_sock_send_queued’ passes to the kernel.  */
+#define SEND_IOV_MAX 16
+
+/*
+ * Append the chunk @var{chunk} to the output chain of @var{sock}.
+ */
+static void
+append_chunk (svz_socket_t *sock, svz_sock_chunk_t *chunk)
+{
+  chunk->next = NULL;
+  if (sock->send_chain_last)
+    sock->send_chain_last->next = chunk;
+  else
+    sock->send_chain = chunk;
+  sock->send_chain_last = chunk;
+  sock->send_chain_fill += chunk->len;
+  if (chunk->copied)
+    sock->send_chain_copied += chunk->len;
+  svz_sock_touch (sock);
+}
+
+/*
+ * Remove @var{len} bytes from the front of the output chain of
+ * @var{sock}, releasing the chunks which are done with.
+ */
+static void
+release_chain (svz_socket_t *sock, int len)
+{
+  svz_sock_chunk_t *chunk;
+
+  sock->send_chain_fill -= len;
+  while ((chunk = sock->send_chain) != NULL)
+    {
+      if (len < chunk->len)
+        {
+          chunk->data += len;
+          chunk->len -= len;
+          if (chunk->copied)
+            sock->send_chain_copied -= len;
+          return;
+        }
+      len -= chunk->len;
+      if (chunk->copied)
+        sock->send_chain_copied -= chunk->len;
+      sock->send_chain = chunk->next;
+      if (sock->send_chain == NULL)
+        sock->send_chain_last = NULL;
+      if (chunk->release)
+        chunk->release (chunk->arg);
+      svz_free (chunk);
+    }
+}
+
+/*
+ * Copy @var{len} bytes at @var{buf} to a new chunk at the end of the
+ * output chain of @var{sock}.  This is what @code{svz_sock_write} does
+ * while there are chunks queued.  Only the copies count against the
+ * maximum buffer size, the chunks queued without copying do not.
+ */
+static int
+write_chain (svz_socket_t *sock, char *buf, int len)
+{
+  svz_sock_chunk_t *chunk;
+
+  if (len <= 0)
+    return 0;
+
+  if (sock->send_chain_copied + len > MAX_BUF_SIZE)
+    {
+      svz_log (SVZ_LOG_ERROR, "send queue overflow on socket %d (id %d)\n",
+               sock->sock_desc, sock->id);
+      if (sock->kicked_socket)
+        sock->kicked_socket (sock, 1);
+      return -1;
+    }
+
+  chunk = svz_malloc (sizeof (svz_sock_chunk_t) + len);
+  chunk->data = (char *) (chunk + 1);
+  memcpy (chunk->data, buf, len);
+  chunk->len = len;
+  chunk->release = NULL;
+  chunk->arg = NULL;
+  chunk->copied = 1;
+  append_chunk (sock, chunk);
+  return 0;
+}
+
 /*
  * Free the socket structure @var{sock}.  Return a non-zero value on error.
  */
@@ -484,9 +665,12 @@ svz_sock_free (svz_socket_t *sock)
   if (sock->local_addr)
     svz_free (sock->local_addr);
   if (sock->recv_buffer)
-    svz_free (sock->recv_buffer);
+    svz_pool_buffer_free (sock->recv_buffer - sock->recv_buffer_head,
+                          sock->recv_buffer_size);
   if (sock->send_buffer)
-    svz_free (sock->send_buffer);
+    svz_pool_buffer_free (sock->send_buffer - sock->send_buffer_head,
+                          sock->send_buffer_size);
+  release_chain (sock, sock->send_chain_fill);
   if (sock->recv_pipe)
     svz_free (sock->recv_pipe);
   if (sock->send_pipe)
@@ -499,7 +683,7 @@ svz_sock_free (svz_socket_t *sock)
     svz_free (sock->overlap[SVZ_WRITE]);
 #endif /* __MINGW32__ */
 
-  svz_free (sock);
+  svz_pool_sock_free (sock);
 
   return 0;
 }
@@ -616,6 +800,10 @@ svz_sock_write (svz_socket_t *sock, char *buf, int len)
   if (sock->flags & SVZ_SOFLG_KILLED)
     return 0;
 
+  /* Keep the order of the output.  */
+  if (sock->send_chain != NULL)
+    return write_chain (sock, buf, len);
+
   while (len > 0)
     {
       /* Try to flush the queue of this socket.  */
@@ -640,6 +828,14 @@ svz_sock_write (svz_socket_t *sock, char *buf, int len)
             sock->flags |= SVZ_SOFLG_FINAL_WRITE;
         }
 
+      /* Flushing may have released the (empty) buffer.  */
+      svz_sock_alloc_buffers (sock, SVZ_SOFLG_OUTBUF);
+
+      /* Make room by moving the data to the beginning of the buffer.  */
+      if (sock->send_buffer_head + sock->send_buffer_fill
+          >= sock->send_buffer_size)
+        svz_sock_compact_send (sock);
+
       if (sock->send_buffer_fill >= sock->send_buffer_size)
         {
           /* Queue is full, unlucky socket or pipe ...  */
@@ -660,7 +856,9 @@ svz_sock_write (svz_socket_t *sock, char *buf, int len)
         }
 
       /* Now move as much of BUF into the send queue.  */
-      if (sock->send_buffer_fill + len < sock->send_buffer_size)
+      space = sock->send_buffer_size - sock->send_buffer_head
+        - sock->send_buffer_fill;
+      if (len < space)
         {
           memcpy (sock->send_buffer + sock->send_buffer_fill, buf, len);
           sock->send_buffer_fill += len;
@@ -668,7 +866,6 @@ svz_sock_write (svz_socket_t *sock, char *buf, int len)
         }
       else
         {
-          space = sock->send_buffer_size - sock->send_buffer_fill;
           memcpy (sock->send_buffer + sock->send_buffer_fill, buf, space);
           sock->send_buffer_fill += space;
           len -= space;
@@ -676,9 +873,180 @@ svz_sock_write (svz_socket_t *sock, char *buf, int len)
         }
     }
 
+  /* The send buffer is not empty anymore.  */
+  svz_sock_touch (sock);
   return 0;
 }
 
+/**
+ * Queue @var{len} bytes at @var{buf} for output on the socket @var{sock}
+ * without copying them.  They are sent after all the data written
+ * before, and data written afterwards follows them.  When the data has
+ * been sent, or when @var{sock} is freed before, @var{release} (unless
+ * it is @code{NULL}) is called with @var{arg}; until then the memory at
+ * @var{buf} must stay valid.  This needs the default @code{write_socket}
+ * callback of TCP sockets, or any other callback using
+ * @code{svz_sock_send_queued}.  For other kinds of sockets the data is
+ * copied as with @code{svz_sock_write}.  Return a non-zero value on error.
+ */
+int
+svz_sock_write_chunk (svz_socket_t *sock, char *buf, int len,
+                      svz_sock_release_fn *release, void *arg)
+{
+  svz_sock_chunk_t *chunk;
+  int ret = 0;
+
+  /* Data to be encoded must pass through the send buffer.  The same
+     goes for anything but TCP connections.  */
+  if (sock->flags & SVZ_SOFLG_KILLED || len <= 0 || sock->send_codec
+      || !(sock->proto & SVZ_PROTO_TCP))
+    {
+      if (len > 0 && !(sock->flags & SVZ_SOFLG_KILLED))
+        ret = svz_sock_write (sock, buf, len);
+      if (release)
+        release (arg);
+      return ret;
+    }
+
+  chunk = svz_malloc (sizeof (svz_sock_chunk_t));
+  chunk->data = buf;
+  chunk->len = len;
+  chunk->release = release;
+  chunk->arg = arg;
+  chunk->copied = 0;
+  append_chunk (sock, chunk);
+  return 0;
+}
+
+/**
+ * Send the output queued on the socket @var{sock}, that is the contents
+ * of its send buffer followed by the chunks queued with
+ * @code{svz_sock_write_chunk}, but at most @var{max} bytes.  All the
+ * pieces are passed to the kernel in a single @code{writev} call where
+ * available.  Return the number of bytes sent, which are removed from
+ * the queue, or -1 on errors.
+ */
+int
+svz_sock_send_queued (svz_socket_t *sock, int max)
+{
+  svz_sock_chunk_t *chunk;
+  int num_written, left, n;
+
+#if HAVE_WRITEV && HAVE_SYS_UIO_H
+  struct iovec iov[SEND_IOV_MAX];
+
+  n = 0;
+  left = max;
+  if (sock->send_buffer_fill > 0 && left > 0)
+    {
+      iov[n].iov_base = sock->send_buffer;
+      iov[n].iov_len = sock->send_buffer_fill < left
+        ? sock->send_buffer_fill : left;
+      left -= iov[n++].iov_len;
+    }
+  for (chunk = sock->send_chain; chunk && n < SEND_IOV_MAX && left > 0;
+       chunk = chunk->next)
+    {
+      iov[n].iov_base = chunk->data;
+      iov[n].iov_len = chunk->len < left ? chunk->len : left;
+      left -= iov[n++].iov_len;
+    }
+  if (n == 0)
+    return 0;
+  num_written = writev (sock->sock_desc, iov, n);
+#else /* not (HAVE_WRITEV && HAVE_SYS_UIO_H) */
+  char *data;
+
+  /* Send one piece at a time.  */
+  if (sock->send_buffer_fill > 0)
+    {
+      data = sock->send_buffer;
+      left = sock->send_buffer_fill;
+    }
+  else if ((chunk = sock->send_chain) != NULL)
+    {
+      data = chunk->data;
+      left = chunk->len;
+    }
+  else
+    return 0;
+  num_written = send (sock->sock_desc, data, left < max ? left : max, 0);
+#endif /* not (HAVE_WRITEV && HAVE_SYS_UIO_H) */
+
+  if (num_written <= 0)
+    return num_written;
+
+  sock->last_send = time (NULL);
+  n = num_written < sock->send_buffer_fill
+    ? num_written : sock->send_buffer_fill;
+  if (n > 0)
+    svz_sock_reduce_send (sock, n);
+  if (num_written > n)
+    release_chain (sock, num_written - n);
+  return num_written;
+}
+
+
+/*
+ * Return the number of bytes which can be queued in the kernel's send
+ * buffer of the socket @var{sock} without blocking, or -1 if unknown.
+ */
+static int
+send_space (svz_socket_t *sock)
+{
+#if defined (SO_SNDBUF) && (defined (SIOCOUTQ) || defined (FIONWRITE))
+  int size, queued;
+  socklen_t len = sizeof (size);
+
+  if (!(sock->flags & SVZ_SOFLG_SOCK)
+      || getsockopt (sock->sock_desc, SOL_SOCKET, SO_SNDBUF,
+                     (void *) &size, &len) < 0)
+    return -1;
+# ifdef SIOCOUTQ
+  if (ioctl (sock->sock_desc, SIOCOUTQ, &queued) < 0)
+# else
+  if (ioctl (sock->sock_desc, FIONWRITE, &queued) < 0)
+# endif
+    return -1;
+  return size > queued ? size - queued : 0;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * Adjust the write quantum of the socket @var{sock}, that is the number
+ * of bytes written at once (@code{sock->write_quantum}), after trying to
+ * write @var{tried} bytes of which @var{written} were actually taken.
+ * The quantum is doubled whenever a full quantum has been sent, unless
+ * the kernel reports less free space in its send buffer, and halved when
+ * the network does not take all of it, so that a slow connection does
+ * not hold up the others.  It stays within the bounds
+ * @code{sock->write_quantum_min} and @code{sock->write_quantum_max}.
+ */
+void
+svz_sock_adapt_quantum (svz_socket_t *sock, int tried, int written)
+{
+  int quantum = sock->write_quantum;
+  int space;
+
+  if (written < tried)
+    {
+      quantum /= 2;
+      if (quantum < sock->write_quantum_min)
+        quantum = sock->write_quantum_min;
+    }
+  else if (written >= quantum && quantum < sock->write_quantum_max)
+    {
+      quantum *= 2;
+      if (quantum > sock->write_quantum_max)
+        quantum = sock->write_quantum_max;
+      if ((space = send_space (sock)) >= 0 && quantum > space)
+        quantum = space > sock->write_quantum ? space : sock->write_quantum;
+    }
+  sock->write_quantum = quantum;
+}
+
 /**
  * Print a formatted string on the socket @var{sock}.  @var{fmt} is the
  * @code{printf}-style format string, which describes how to format the
@@ -721,6 +1089,50 @@ svz_wait_if_unavailable (svz_socket_t *sock, unsigned int relax)
   return 0;
 }
 
+/*
+ * The send and receive buffers of a socket structure are windows into
+ * the memory blocks allocated for them: @code{*buffer} points @code{*head}
+ * bytes into its block, while @code{*size} remains the size of the whole
+ * block.  Removing data from the front of a buffer thus only needs to
+ * advance the window.  This routine moves the @var{fill} bytes of data
+ * back to the very beginning of the block, which makes all the free space
+ * available at the end of the buffer again.
+ */
+static void
+compact (char **buffer, int *head, int fill)
+{
+  char *base;
+
+  if (*head == 0)
+    return;
+
+  base = *buffer - *head;
+  if (fill > 0)
+    memmove (base, *buffer, fill);
+  *buffer = base;
+  *head = 0;
+}
+
+/*
+ * Remove @var{len} bytes from the front of a buffer as described above.
+ * The remaining data is moved only when it is no larger than the data
+ * removed since it was moved last, so each byte of data gets moved at
+ * most once on average.
+ */
+static void
+consume (char **buffer, int *head, int *fill, int len)
+{
+  *fill -= len;
+  if (*fill > 0 && len > 0)
+    {
+      *buffer += len;
+      *head += len;
+      if (*head < *fill)
+        return;
+    }
+  compact (buffer, head, *fill);
+}
+
 /**
  * Shorten the receive buffer of @var{sock} by @var{len} bytes.
  */
@@ -728,10 +1140,10 @@ void
 svz_sock_reduce_recv (svz_socket_t *sock, int len)
 {
   /* FIXME: What about the ‘0 > len’ case?  */
-  if (len && sock->recv_buffer_fill > len)
-    memmove (sock->recv_buffer, sock->recv_buffer + len,
-             sock->recv_buffer_fill - len);
-  sock->recv_buffer_fill -= len;
+  consume (&sock->recv_buffer, &sock->recv_buffer_head,
+           &sock->recv_buffer_fill, len);
+  if (sock->flags & SVZ_SOFLG_NOOVERFLOW)
+    svz_sock_touch (sock);
 }
 
 /**
@@ -741,8 +1153,39 @@ void
 svz_sock_reduce_send (svz_socket_t *sock, int len)
 {
   /* FIXME: What about the ‘0 > len’ case?  */
-  if (len && sock->send_buffer_fill > len)
-    memmove (sock->send_buffer, sock->send_buffer + len,
-             sock->send_buffer_fill - len);
-  sock->send_buffer_fill -= len;
+  consume (&sock->send_buffer, &sock->send_buffer_head,
+           &sock->send_buffer_fill, len);
+  if (sock->send_buffer_fill == 0)
+    svz_sock_touch (sock);
+}
+
+/**
+ * Move the data in the receive buffer of @var{sock} to the beginning of
+ * the memory allocated for it.  Data removed with
+ * @code{svz_sock_reduce_recv} is not necessarily moved immediately, so
+ * the free space at the end of the buffer can be less than
+ * @code{recv_buffer_size} minus @code{recv_buffer_fill}.  Use this
+ * before writing to the end of the buffer directly, or before replacing
+ * @code{recv_buffer}.  Return the size of the free space, which is then
+ * @code{recv_buffer_size} minus @code{recv_buffer_fill}.
+ */
+int
+svz_sock_compact_recv (svz_socket_t *sock)
+{
+  compact (&sock->recv_buffer, &sock->recv_buffer_head,
+           sock->recv_buffer_fill);
+  return sock->recv_buffer_size - sock->recv_buffer_fill;
+}
+
+/**
+ * Move the data in the send buffer of @var{sock} to the beginning of the
+ * memory allocated for it.  This is the counterpart of
+ * @code{svz_sock_compact_recv} for the send buffer.
+ */
+int
+svz_sock_compact_send (svz_socket_t *sock)
+{
+  compact (&sock->send_buffer, &sock->send_buffer_head,
+           sock->send_buffer_fill);
+  return sock->send_buffer_size - sock->send_buffer_fill;
 }
@@ -27,8 +27,10 @@
 #include "libserveez/address.h"
 /* end svzint */
 
-/* Do not write more than this many bytes to a socket at once.  */
+/* Default bounds of the number of bytes written to a socket at once
+   (see ‘svz_sock_adapt_quantum’).  */
 #define SVZ_SOCK_MAX_WRITE    1024
+#define SVZ_SOCK_MAX_QUANTUM  (1024 * 256)
 
 /* begin svzint */
 #define RECV_BUF_SIZE  (1024 * 8)         /* Normal receive buffer size.  */
@@ -37,8 +39,8 @@
 /* end svzint */
 
 #define SVZ_SOFLG_INIT        0x00000000 /* Value for initializing.  */
-#define SVZ_SOFLG_INBUF       0x00000001 /* Outbuf is allocated.  */
-#define SVZ_SOFLG_OUTBUF      0x00000002 /* Inbuf is allocated.  */
+#define SVZ_SOFLG_INBUF       0x00000001 /* Inbuf is allocated.  */
+#define SVZ_SOFLG_OUTBUF      0x00000002 /* Outbuf is allocated.  */
 #define SVZ_SOFLG_CONNECTED   0x00000004 /* Socket is connected.  */
 #define SVZ_SOFLG_LISTENING   0x00000008 /* Socket is listening.  */
 #define SVZ_SOFLG_KILLED      0x00000010 /* Socket will be shut down soon.  */
@@ -70,6 +72,27 @@
 /* end svzint */
 typedef struct svz_socket svz_socket_t;
 
+/* Data queued for output behind the send buffer (see
+   ‘svz_sock_write_chunk’).  */
+typedef struct svz_sock_chunk svz_sock_chunk_t;
+typedef void (svz_sock_release_fn) (void *);
+
+/* begin svzint */
+struct svz_sock_chunk
+{
+  svz_sock_chunk_t *next;       /* Next chunk in chain.  */
+  char *data;                   /* Data not sent yet.  */
+  int len;                      /* Length of DATA.  */
+  svz_sock_release_fn *release; /* Called when done with DATA, or NULL.  */
+  void *arg;                    /* Argument for RELEASE.  */
+  int copied;                   /* Non-zero if DATA is a copy.  */
+};
+/* end svzint */
+
+/* Non-zero if there is output queued on the socket @var{sock}.  */
+#define SVZ_SOCK_SEND_PENDING(sock) \
+  ((sock)->send_buffer_fill > 0 || (sock)->send_chain != NULL)
+
 struct svz_socket
 {
   svz_socket_t *next;           /* Next socket in chain.  */
@@ -114,6 +137,17 @@ struct svz_socket
   int recv_buffer_size;         /* Size of RECV_BUFFER.  */
   int send_buffer_fill;         /* Valid bytes in SEND_BUFFER.  */
   int recv_buffer_fill;         /* Valid bytes in RECV_BUFFER.  */
+  int send_buffer_head;         /* Offset of SEND_BUFFER in its block
+                                   of SEND_BUFFER_SIZE bytes.  */
+  int recv_buffer_head;         /* Offset of RECV_BUFFER in its block
+                                   of RECV_BUFFER_SIZE bytes.  */
+  svz_sock_chunk_t *send_chain; /* Output queued behind SEND_BUFFER.  */
+  svz_sock_chunk_t *send_chain_last; /* Last chunk of SEND_CHAIN.  */
+  int send_chain_fill;          /* Bytes in SEND_CHAIN.  */
+  int send_chain_copied;        /* Bytes in SEND_CHAIN which are copies.  */
+  int write_quantum;            /* Bytes to write at once.  */
+  int write_quantum_min;        /* Lower bound of WRITE_QUANTUM.  */
+  int write_quantum_max;        /* Upper bound of WRITE_QUANTUM.  */
 
   uint16_t sequence;            /* Currently received sequence.  */
   uint16_t send_seq;            /* Send stream sequence number.  */
@@ -197,15 +231,15 @@ struct svz_socket
   int (* trigger_cond) (svz_socket_t *sock);
 
   /*
-   * IDLE_FUNC gets called from the periodic task scheduler.  Whenever
-   * IDLE_COUNTER (see below) is non-zero, it is decremented and
-   * IDLE_FUNC gets called when it drops to zero.  IDLE_FUNC can reset
-   * IDLE_COUNTER to some value and thus can re-schedule itself for a
-   * later task.
+   * IDLE_FUNC gets called when the idle timer of the socket expires
+   * (see ‘svz_sock_idle_arm’).  IDLE_FUNC can re-arm the timer and
+   * thus can re-schedule itself for a later task.  For compatibility,
+   * setting IDLE_COUNTER (see below) to some number of seconds before
+   * the socket is enqueued or from within IDLE_FUNC does the same.
    */
   int (* idle_func) (svz_socket_t * sock);
 
-  int idle_counter;             /* Counter for calls to IDLE_FUNC.  */
+  int idle_counter;             /* Seconds the idle timer was armed for.  */
 
   long last_send;               /* Timestamp of last send to socket.  */
   long last_recv;               /* Timestamp of last receive from socket */
@@ -213,6 +247,7 @@ struct svz_socket
   /* Note: These two are used only if flood protection is enabled.  */
   int flood_points;             /* Accumulated flood points.  */
   int flood_limit;              /* Limit of the above before kicking.  */
+  long flood_time;              /* Time the points were last updated.  */
 
   /* Out-of-band data for TCP protocol.  This byte is used for both,
      receiving and sending.  */
@@ -253,12 +288,20 @@ typedef void (svz_sock_prefree_fn) (const svz_socket_t *);
 SERVEEZ_API void svz_sock_prefree (int addsub, svz_sock_prefree_fn fn);
 SERVEEZ_API int svz_sock_nconnections (void);
 SERVEEZ_API int svz_sock_write (svz_socket_t *, char *, int);
+SERVEEZ_API int svz_sock_write_chunk (svz_socket_t *, char *, int,
+                                      svz_sock_release_fn *, void *);
+SERVEEZ_API int svz_sock_send_queued (svz_socket_t *, int);
+SERVEEZ_API void svz_sock_adapt_quantum (svz_socket_t *, int, int);
 SERVEEZ_API int svz_sock_printf (svz_socket_t *, const char *, ...);
 SERVEEZ_API int svz_sock_resize_buffers (svz_socket_t *, int, int);
+SERVEEZ_API void svz_sock_alloc_buffers (svz_socket_t *, int);
+SERVEEZ_API void svz_sock_release_buffers (svz_socket_t *);
 SERVEEZ_API int svz_sock_check_request (svz_socket_t *);
 SERVEEZ_API int svz_wait_if_unavailable (svz_socket_t *, unsigned int);
 SERVEEZ_API void svz_sock_reduce_recv (svz_socket_t *, int);
 SERVEEZ_API void svz_sock_reduce_send (svz_socket_t *, int);
+SERVEEZ_API int svz_sock_compact_recv (svz_socket_t *);
+SERVEEZ_API int svz_sock_compact_send (svz_socket_t *);
 
 __END_DECLS
 
@@ -62,34 +62,20 @@
 int
 svz_tcp_write_socket (svz_socket_t *sock)
 {
-  int num_written;
-  int do_write;
-  svz_t_socket desc;
-
-  desc = sock->sock_desc;
+  int num_written, do_write;
 
   /*
-   * Write as many bytes as possible, remember how many were actually
-   * sent.  Limit the maximum sent bytes to ‘SVZ_SOCK_MAX_WRITE’.
+   * Write as many bytes as possible, including the queued chunks.
+   * Limit the maximum sent bytes to the socket's write quantum.
    */
-  do_write = sock->send_buffer_fill;
-  if (do_write > SVZ_SOCK_MAX_WRITE)
-    do_write = SVZ_SOCK_MAX_WRITE;
-  num_written = send (desc, sock->send_buffer, do_write, 0);
-
-  /* Some data has been written.  */
-  if (num_written > 0)
-    {
-      sock->last_send = time (NULL);
+  do_write = sock->send_buffer_fill + sock->send_chain_fill;
+  if (do_write > sock->write_quantum)
+    do_write = sock->write_quantum;
+  num_written = svz_sock_send_queued (sock, do_write);
+  svz_sock_adapt_quantum (sock, do_write, num_written);
 
-      /*
-       * Shuffle the data in the output buffer around, so that
-       * new data can get stuffed into it.
-       */
-      svz_sock_reduce_send (sock, num_written);
-    }
   /* Error occurred while sending.  */
-  else if (num_written < 0)
+  if (num_written < 0)
     {
       svz_log_net_error ("tcp: send");
       if (svz_wait_if_unavailable (sock, 1))
@@ -97,8 +83,11 @@ svz_tcp_write_socket (svz_socket_t *sock)
     }
 
   /* If final write flag is set, then schedule for shutdown.  */
-  if (sock->flags & SVZ_SOFLG_FINAL_WRITE && sock->send_buffer_fill == 0)
+  if (sock->flags & SVZ_SOFLG_FINAL_WRITE && !SVZ_SOCK_SEND_PENDING (sock))
     num_written = -1;
+  /* Otherwise do not keep the buffers if everything has been sent.  */
+  else if (num_written > 0)
+    svz_sock_release_buffers (sock);
 
   /* Return a non-zero value if an error occurred.  */
   return (num_written < 0) ? -1 : 0;
@@ -121,10 +110,18 @@ svz_tcp_read_socket (svz_socket_t *sock)
 
   desc = sock->sock_desc;
 
+  /* Allocate the buffer on first use, or make room by moving the
+     data to the beginning of the buffer.  */
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_INBUF);
+  if (sock->recv_buffer_head + sock->recv_buffer_fill
+      >= sock->recv_buffer_size)
+    svz_sock_compact_recv (sock);
+
   /*
    * Calculate how many bytes fit into the receive buffer.
    */
-  do_read = sock->recv_buffer_size - sock->recv_buffer_fill;
+  do_read = sock->recv_buffer_size - sock->recv_buffer_head
+    - sock->recv_buffer_fill;
 
   /*
    * Check if enough space is left in the buffer, kick the socket
@@ -187,6 +184,8 @@ svz_tcp_read_socket (svz_socket_t *sock)
       return -1;
     }
 
+  /* Do not keep the buffers if all the data has been processed.  */
+  svz_sock_release_buffers (sock);
   return 0;
 }
 
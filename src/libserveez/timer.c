@@ -0,0 +1,378 @@
+/*
+ * timer.c - socket timer wheel
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <time.h>
+#if HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
+#include "libserveez/alloc.h"
+#include "libserveez/util.h"
+#include "libserveez/socket.h"
+#include "libserveez/server-core.h"
+#include "libserveez/timer.h"
+#include "misc-macros.h"
+
+/*
+ * A hierarchical timing wheel (in the style of the classic BSD and
+ * Linux kernel timers) for the per-socket idle timers.  Each socket id
+ * has at most one timer.  The root wheel has one bucket per tick; each
+ * of the upper wheels has one bucket per revolution of the wheel below.
+ * When the root wheel wraps around, the next bucket of the first upper
+ * wheel is "cascaded", i.e. its timers are redistributed downwards,
+ * and so forth.  Thus arming, re-arming and cancelling is O(1) and
+ * the cost of a tick is proportional to the number of expiring timers.
+ */
+
+/* Resolution of the wheel in milliseconds.  */
+#define TICK_MSEC  10
+
+#define ROOT_BITS   8
+#define LEVEL_BITS  6
+#define ROOT_SIZE   (1 << ROOT_BITS)
+#define LEVEL_SIZE  (1 << LEVEL_BITS)
+#define ROOT_MASK   (ROOT_SIZE - 1)
+#define LEVEL_MASK  (LEVEL_SIZE - 1)
+#define NLEVELS     4
+
+/* Bucket index of the first bucket of upper wheel @var{n} (from 0).  */
+#define LEVEL(n)  (ROOT_SIZE + (n) * LEVEL_SIZE)
+
+/* Index into upper wheel @var{n} for the tick @var{t}.  */
+#define INDEX(t, n)  (((t) >> (ROOT_BITS + (n) * LEVEL_BITS)) & LEVEL_MASK)
+
+/* The extra bucket holding the timers being expired.  */
+#define WORK     LEVEL (NLEVELS)
+#define NBUCKETS (WORK + 1)
+
+/* Largest distance (in ticks) a timer can be put in the future.  */
+#define MAX_TICKS  ((1UL << (ROOT_BITS + NLEVELS * LEVEL_BITS)) - 1)
+
+/* A timer, indexed by socket id.  */
+typedef struct
+{
+  int next, prev;               /* links within the bucket (or -1) */
+  int bucket;                   /* the bucket, or -1 if not armed */
+  int version;                  /* version of the socket */
+  unsigned long expires;        /* tick of expiry */
+}
+node_t;
+
+static node_t *node = NULL;
+static int nnodes = 0;
+static int bucket[NBUCKETS];    /* first node of each bucket (or -1) */
+static int nroot = 0;           /* number of timers in the root wheel */
+static int narmed = 0;          /* number of timers overall */
+static unsigned long jiffies;   /* the next tick to be processed */
+
+/*
+ * Return the current time in milliseconds.  This need not be related
+ * to the wall clock, but should be monotonic if possible.
+ */
+static unsigned long
+now_msec (void)
+{
+#if HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+#endif
+#if HAVE_DECL_GETTIMEOFDAY
+  {
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000UL + tv.tv_usec / 1000;
+  }
+#else
+  return time (NULL) * 1000UL;
+#endif
+}
+
+/*
+ * Return the current time in milliseconds, on the clock of the timers.
+ */
+unsigned long
+svz_timer_msec (void)
+{
+  return now_msec ();
+}
+
+static node_t *
+node_get (int id)
+{
+  if (id >= nnodes)
+    {
+      node = svz_realloc (node, (id + 1) * sizeof (node_t));
+      for (; nnodes <= id; nnodes++)
+        node[nnodes].bucket = -1;
+    }
+  return &node[id];
+}
+
+static void
+unlink_node (int id)
+{
+  node_t *n = &node[id];
+
+  if (n->prev != -1)
+    node[n->prev].next = n->next;
+  else
+    bucket[n->bucket] = n->next;
+  if (n->next != -1)
+    node[n->next].prev = n->prev;
+  if (n->bucket < ROOT_SIZE)
+    nroot--;
+  n->bucket = -1;
+}
+
+static void
+link_node (int id, int b)
+{
+  node_t *n = &node[id];
+
+  n->bucket = b;
+  n->prev = -1;
+  n->next = bucket[b];
+  if (n->next != -1)
+    node[n->next].prev = id;
+  bucket[b] = id;
+  if (b < ROOT_SIZE)
+    nroot++;
+}
+
+/*
+ * Put the timer of socket id @var{id} into the bucket matching its
+ * expiry tick.
+ */
+static void
+place (int id)
+{
+  node_t *n = &node[id];
+  unsigned long e = n->expires;
+  unsigned long delta = e - jiffies;
+  int b;
+
+  if ((long) delta < 0)
+    b = jiffies & ROOT_MASK;
+  else if (delta < (1UL << ROOT_BITS))
+    b = e & ROOT_MASK;
+  else if (delta < (1UL << (ROOT_BITS + LEVEL_BITS)))
+    b = LEVEL (0) + INDEX (e, 0);
+  else if (delta < (1UL << (ROOT_BITS + 2 * LEVEL_BITS)))
+    b = LEVEL (1) + INDEX (e, 1);
+  else if (delta < (1UL << (ROOT_BITS + 3 * LEVEL_BITS)))
+    b = LEVEL (2) + INDEX (e, 2);
+  else
+    {
+      if (delta > MAX_TICKS)
+        n->expires = e = jiffies + MAX_TICKS;
+      b = LEVEL (3) + INDEX (e, 3);
+    }
+  link_node (id, b);
+}
+
+/*
+ * Redistribute the timers in bucket @var{index} of the upper wheel
+ * @var{level}.  Return @var{index}.
+ */
+static int
+cascade (int level, int index)
+{
+  int b = LEVEL (level) + index;
+  int id;
+
+  while ((id = bucket[b]) != -1)
+    {
+      unlink_node (id);
+      place (id);
+    }
+  return index;
+}
+
+/*
+ * Run the idle callback of the socket structure with id @var{id} and
+ * version @var{version}, whose timer just expired.
+ */
+static void
+expire (int id, int version)
+{
+  svz_socket_t *sock;
+
+  if ((sock = svz_sock_find (id, -1)) == NULL
+      || sock->version != version
+      || sock->flags & SVZ_SOFLG_KILLED)
+    return;
+
+  sock->idle_counter = 0;
+  if (sock->idle_func == NULL)
+    return;
+
+  if (sock->idle_func (sock))
+    {
+      svz_log (SVZ_LOG_ERROR,
+               "idle function for socket id %d returned error\n", sock->id);
+      svz_sock_schedule_for_shutdown (sock);
+    }
+  /* Callbacks setting IDLE_COUNTER themselves re-schedule in seconds.  */
+  else if (sock->idle_counter > 0 && !svz_timer_armed_p (sock))
+    svz_sock_idle_arm (sock, sock->idle_counter * 1000L);
+  svz_sock_touch (sock);
+}
+
+/*
+ * Process all ticks up to now, calling the idle callbacks of the
+ * sockets whose timers expired.
+ */
+void
+svz_timer_run (void)
+{
+  unsigned long now = now_msec () / TICK_MSEC;
+  int index, id;
+
+  /* Nothing to do?  Then do not bother going through the ticks.  */
+  if (narmed == 0)
+    {
+      jiffies = now + 1;
+      return;
+    }
+
+  while ((long) (now - jiffies) >= 0)
+    {
+      index = jiffies & ROOT_MASK;
+      if (!index
+          && !cascade (0, INDEX (jiffies, 0))
+          && !cascade (1, INDEX (jiffies, 1))
+          && !cascade (2, INDEX (jiffies, 2)))
+        cascade (3, INDEX (jiffies, 3));
+      jiffies++;
+
+      /* Move the whole bucket aside, so the callbacks can (re-)arm
+         and cancel timers as they please.  */
+      while ((id = bucket[index]) != -1)
+        {
+          unlink_node (id);
+          link_node (id, WORK);
+        }
+      while ((id = bucket[WORK]) != -1)
+        {
+          unlink_node (id);
+          narmed--;
+          expire (id, node[id].version);
+        }
+    }
+}
+
+/*
+ * Return the number of milliseconds the server loop may wait at most
+ * for network events, given that it would wait @var{msec} milliseconds
+ * otherwise.
+ */
+int
+svz_timer_timeout (int msec)
+{
+  unsigned long now, t;
+  int i, wait;
+
+  if (nroot == 0)
+    return msec;
+
+  /* Find the next non-empty bucket of the root wheel.  Timers in the
+     upper wheels are at least one revolution away.  */
+  for (i = 0; i < ROOT_SIZE; i++)
+    if (bucket[(jiffies + i) & ROOT_MASK] != -1)
+      break;
+
+  now = now_msec ();
+  t = (jiffies + i) * TICK_MSEC;
+  wait = (long) (t - now) < 0 ? 0 : (int) (t - now);
+  return wait < msec ? wait : msec;
+}
+
+/*
+ * Return non-zero if the idle timer of @var{sock} is currently armed.
+ */
+int
+svz_timer_armed_p (svz_socket_t *sock)
+{
+  return (sock->id >= 0 && sock->id < nnodes
+          && node[sock->id].bucket != -1
+          && node[sock->id].version == sock->version);
+}
+
+/**
+ * Arm the idle timer of socket @var{sock}, so that its @code{idle_func}
+ * is called in @var{msec} milliseconds.  If the timer is already armed,
+ * it is re-armed.  This replaces setting @code{idle_counter} directly,
+ * which is checked only after @code{idle_func} returns and when
+ * @var{sock} is enqueued.
+ */
+void
+svz_sock_idle_arm (svz_socket_t *sock, long msec)
+{
+  node_t *n;
+
+  if (msec <= 0)
+    msec = 0;
+  if (narmed == 0)
+    jiffies = now_msec () / TICK_MSEC;
+
+  n = node_get (sock->id);
+  if (n->bucket != -1)
+    unlink_node (sock->id);
+  else
+    narmed++;
+  n->version = sock->version;
+  n->expires = (now_msec () + msec + TICK_MSEC - 1) / TICK_MSEC;
+  place (sock->id);
+
+  /* Keep this around for informational purposes.  */
+  sock->idle_counter = (msec + 999) / 1000;
+}
+
+/**
+ * Cancel the idle timer of socket @var{sock}, if it is armed.
+ */
+void
+svz_sock_idle_cancel (svz_socket_t *sock)
+{
+  if (!svz_timer_armed_p (sock))
+    return;
+  unlink_node (sock->id);
+  narmed--;
+  sock->idle_counter = 0;
+}
+
+void
+svz__timer_updn (int direction)
+{
+  int i;
+
+  for (i = 0; i < NBUCKETS; i++)
+    bucket[i] = -1;
+  nroot = narmed = 0;
+  if (direction)
+    jiffies = now_msec () / TICK_MSEC;
+  else
+    {
+      svz_free_and_zero (node);
+      nnodes = 0;
+    }
+}
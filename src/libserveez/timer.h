@@ -0,0 +1,35 @@
+/*
+ * timer.h - socket timer wheel
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TIMER_H__
+#define __TIMER_H__ 1
+
+/* begin svzint */
+#include "libserveez/defines.h"
+#include "libserveez/socket.h"
+/* end svzint */
+
+__BEGIN_DECLS
+SBO void svz_timer_run (void);
+SBO int svz_timer_timeout (int);
+SBO int svz_timer_armed_p (svz_socket_t *);
+SBO unsigned long svz_timer_msec (void);
+__END_DECLS
+
+#endif /* not __TIMER_H__ */
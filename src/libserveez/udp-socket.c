@@ -67,8 +67,16 @@ udp_read_socket (svz_socket_t *sock)
 
   len = sizeof (struct sockaddr_in);
 
+  /* Allocate the buffer on first use, or make room by moving the
+     data to the beginning of the buffer.  */
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_INBUF);
+  if (sock->recv_buffer_head + sock->recv_buffer_fill
+      >= sock->recv_buffer_size)
+    svz_sock_compact_recv (sock);
+
   /* Check if there is enough space to save the packet.  */
-  do_read = sock->recv_buffer_size - sock->recv_buffer_fill;
+  do_read = sock->recv_buffer_size - sock->recv_buffer_head
+    - sock->recv_buffer_fill;
   if (do_read <= 0)
     {
       svz_log (SVZ_LOG_ERROR, "receive buffer overflow on udp socket %d\n",
@@ -147,13 +147,20 @@ svz_log (int level, const char *format, ...)
   va_list args;
   time_t tm;
   struct tm *t;
+#if HAVE_LOCALTIME_R
+  struct tm tm_buf;
+#endif
 
   if (level > SVZ_RUNPARM (VERBOSITY) || logfile == NULL ||
       feof (logfile) || ferror (logfile))
     return;
 
   tm = time (NULL);
+#if HAVE_LOCALTIME_R
+  t = localtime_r (&tm, &tm_buf);
+#else
   t = localtime (&tm);
+#endif
   w = strftime (buf, LOGBUFSIZE, "[%Y/%m/%d %H:%M:%S]", t);
   w += snprintf (buf + w, LOGBUFSIZE - w, " %s: ", log_level[level]);
   va_start (args, format);
@@ -338,7 +345,7 @@ int svz_errno = 0;
 static char *
 neterror (int error)
 {
-  static char message[MESSAGE_BUF_SIZE];
+  static SVZ_TLS char message[MESSAGE_BUF_SIZE];
 
   switch (error)
     {
@@ -441,7 +448,7 @@ neterror (int error)
 static char *
 syserror (int nr)
 {
-  static char message[MESSAGE_BUF_SIZE];
+  static SVZ_TLS char message[MESSAGE_BUF_SIZE];
 
   /* save the last error */
   svz_errno = nr;
@@ -628,7 +635,7 @@ svz_mingw_at_least_nt4_p (void)
 char *
 svz_itoa (unsigned int i)
 {
-  static char buffer[32];
+  static SVZ_TLS char buffer[32];
   char *p = buffer + sizeof (buffer) - 1;
 
   *p = '\0';
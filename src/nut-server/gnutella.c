@@ -168,9 +168,9 @@ svz_servertype_t nut_server_definition =
 };
 
 /*
- * The next three functions `nut_hash_keylen', `nut_hash_equals' and
- * `nut_hash_code' are the routing table hash callbacks to handle
- * GUIDs as keys instead of plain NULL terminated character strings.
+ * The next two functions `nut_hash_keylen' and `nut_hash_equals' are
+ * the routing table hash callbacks to handle GUIDs as keys instead of
+ * plain NULL terminated character strings.
  */
 static size_t
 nut_hash_keylen (UNUSED const char *id)
@@ -184,27 +184,18 @@ nut_hash_equals (const char *id1, const char *id2)
   return memcmp (id1, id2, NUT_GUID_SIZE);
 }
 
-static unsigned long
-nut_hash_code (const char *id)
-{
-  int n;
-  unsigned long code = 0;
-
-  for (n = 0; n < NUT_GUID_SIZE; n++)
-    {
-      code = (code << 2) ^ id[n];
-    }
-
-  return code;
-}
-
+/*
+ * Create a hash table keyed by GUIDs.  These tables lose many entries
+ * at once when a connection goes away and then fill up again, so they
+ * do not shrink.
+ */
 static svz_hash_t *
 make_nut_kce_hash_table (svz_free_func_t destroy)
 {
-  return svz_hash_configure (svz_hash_create (4, destroy),
-                             nut_hash_keylen,
-                             nut_hash_code,
-                             nut_hash_equals);
+  svz_hash_t *hash = svz_hash_create (4, destroy);
+
+  svz_hash_configure (hash, nut_hash_keylen, NULL, nut_hash_equals);
+  return svz_hash_configure_shrink (hash, 0);
 }
 
 /*
@@ -249,7 +240,7 @@ nut_connect_ip (nut_config_t *cfg, in_addr_t ip, in_port_t port)
       sock->flags |= SVZ_SOFLG_NOFLOOD;
       sock->check_request = nut_detect_connect;
       sock->idle_func = nut_connect_timeout;
-      sock->idle_counter = NUT_CONNECT_TIMEOUT;
+      svz_sock_idle_arm (sock, NUT_CONNECT_TIMEOUT * 1000);
       svz_sock_printf (sock, NUT_CONNECT);
       svz_free (addr);
       return 0;
@@ -689,7 +680,9 @@ server_notify_packet_internal (void *k, void *v, void *closure)
     {
       struct dead_packet *d = svz_malloc (sizeof (struct dead_packet));
 
-      d->key = key;
+      /* The key moves when deleting other keys, so make a copy.  */
+      d->key = svz_malloc (NUT_GUID_SIZE);
+      memcpy (d->key, key, NUT_GUID_SIZE);
       d->pkt = pkt;
       svz_array_add (x->dead, d);
     }
@@ -703,7 +696,7 @@ server_notify_query_internal (void *k, void *v, void *closure)
   struct server_notify_closure *x = closure;
 
   if (x->t - received > NUT_ENTRY_AGE)
-    svz_array_add (x->dead, key);
+    svz_array_add (x->dead, svz_strdup (key));
 }
 
 /*
@@ -744,6 +737,7 @@ nut_server_notify (svz_server_t *server)
       svz_array_foreach (x.dead, d, n)
         {
           svz_hash_delete (cfg->packet, d->key);
+          svz_free (d->key);
           svz_free (d->pkt);
         }
       svz_array_destroy (x.dead);
@@ -755,7 +749,7 @@ nut_server_notify (svz_server_t *server)
       char *key;
 
       x.t = time (NULL);
-      x.dead = svz_array_create (4, NULL);
+      x.dead = svz_array_create (4, svz_free);
       svz_hash_foreach (server_notify_query_internal, cfg->query, &x);
       svz_array_foreach (x.dead, key, n)
         svz_hash_delete (cfg->query, key);
@@ -892,7 +886,7 @@ nut_idle_searching (svz_socket_t *sock)
     }
 
   /* wake up in a certain time */
-  sock->idle_counter = NUT_SEARCH_INTERVAL;
+  svz_sock_idle_arm (sock, NUT_SEARCH_INTERVAL * 1000);
   return 0;
 }
 
@@ -1198,7 +1192,7 @@ nut_connect_socket (svz_server_t *server, svz_socket_t *sock)
       sock->disconnected_socket = nut_disconnect;
       sock->check_request = nut_check_request;
       sock->idle_func = nut_idle_searching;
-      sock->idle_counter = NUT_SEARCH_INTERVAL;
+      svz_sock_idle_arm (sock, NUT_SEARCH_INTERVAL * 1000);
       sock->data = nut_create_client ();
 
       /* send initial ping */
@@ -58,13 +58,7 @@ nut_hosts_write (svz_socket_t *sock)
       sock->last_send = time (NULL);
 
       /* reduce send buffer */
-      if (sock->send_buffer_fill > num_written)
-        {
-          memmove (sock->send_buffer,
-                   sock->send_buffer + num_written,
-                   sock->send_buffer_fill - num_written);
-        }
-      sock->send_buffer_fill -= num_written;
+      svz_sock_reduce_send (sock, num_written);
     }
   /* seems like an error */
   else if (num_written < 0)
@@ -200,7 +200,7 @@ nut_push_request (svz_socket_t *sock, nut_header_t *hdr, uint8_t *packet)
                 }
               xsock->check_request = nut_check_upload;
               xsock->idle_func = nut_connect_timeout;
-              xsock->idle_counter = NUT_CONNECT_TIMEOUT;
+              svz_sock_idle_arm (xsock, NUT_CONNECT_TIMEOUT * 1000);
             }
         }
     }
@@ -256,6 +256,7 @@ nut_check_transfer (svz_socket_t *sock)
           sock->check_request = nut_save_transfer;
           sock->write_socket = NULL;
           sock->idle_func = NULL;
+          svz_sock_idle_cancel (sock);
 
           /* crop header from receive buffer */
           len = (p - sock->recv_buffer) + 4;
@@ -414,7 +415,7 @@ nut_init_transfer (svz_socket_t *sock, nut_reply_t *reply,
       xsock->userflags = NUT_FLAG_DNLOAD;
       xsock->file_desc = fd;
       xsock->idle_func = nut_connect_timeout;
-      xsock->idle_counter = NUT_CONNECT_TIMEOUT;
+      svz_sock_idle_arm (xsock, NUT_CONNECT_TIMEOUT * 1000);
 
       /* initialize transfer data */
       transfer = svz_calloc (sizeof (nut_transfer_t));
@@ -497,6 +498,7 @@ nut_check_given (svz_socket_t *sock)
       sock->check_request = nut_check_transfer;
       sock->userflags |= NUT_FLAG_DNLOAD;
       sock->idle_func = NULL;
+      svz_sock_idle_cancel (sock);
       transfer->start = time (NULL);
 
       /* test the file to download once again */
@@ -852,6 +854,7 @@ nut_check_upload (svz_socket_t *sock)
 
       /* disable connection timeout */
       sock->idle_func = NULL;
+      svz_sock_idle_cancel (sock);
       sock->userflags |= NUT_FLAG_HDR;
 
       if (nut_init_upload (sock, entry) == -1)
@@ -954,7 +957,8 @@ nut_file_read (svz_socket_t *sock)
   int do_read;
   nut_transfer_t *transfer = sock->data;
 
-  do_read = sock->send_buffer_size - sock->send_buffer_fill;
+  svz_sock_alloc_buffers (sock, SVZ_SOFLG_OUTBUF);
+  do_read = svz_sock_compact_send (sock);
 
   /*
    * This means the send buffer is currently full, we have to
@@ -1031,23 +1035,17 @@ nut_file_write (svz_socket_t *sock)
    * Write as many bytes as possible, remember how many
    * were actually sent.
    */
-  do_write = (sock->send_buffer_fill > SVZ_SOCK_MAX_WRITE)
-    ? SVZ_SOCK_MAX_WRITE : sock->send_buffer_fill;
+  do_write = (sock->send_buffer_fill > sock->write_quantum)
+    ? sock->write_quantum : sock->send_buffer_fill;
 
   num_written = send (sock->sock_desc, sock->send_buffer, do_write, 0);
+  svz_sock_adapt_quantum (sock, do_write, num_written);
 
   /* some data has been written */
   if (num_written > 0)
     {
       sock->last_send = t;
-
-      if (sock->send_buffer_fill > num_written)
-        {
-          memmove (sock->send_buffer,
-                   sock->send_buffer + num_written,
-                   sock->send_buffer_fill - num_written);
-        }
-      sock->send_buffer_fill -= num_written;
+      svz_sock_reduce_send (sock, num_written);
     }
 
   /* write error occurred */
@@ -184,6 +184,8 @@ usage (int exitval)
     {'P', "STRING", "set the password for control connections"},
 #endif
     {'m', "COUNT", "set the max. number of socket descriptors"},
+    {'T', "COUNT", "run the coservers in COUNT threads of their own"},
+    {'w', "COUNT", "set the number of worker processes"},
     {'d', NULL, "start as daemon in background"},
     {'c', NULL, "use standard input as configuration file"},
     {'s', NULL, "don't start any coservers"}
@@ -248,15 +250,17 @@ static struct option serveez_options[] = {
   {"password", required_argument, NULL, 'P'},
 #endif
   {"max-sockets", required_argument, NULL, 'm'},
+  {"coserver-threads", required_argument, NULL, 'T'},
+  {"workers", required_argument, NULL, 'w'},
   {"solitary", no_argument, NULL, 's'},
   {NULL, 0, NULL, 0}
 };
 #endif /* HAVE_GETOPT_LONG */
 
 #if ENABLE_CONTROL_PROTO
-#define SERVEEZ_OPTIONS "l:hVLiv:f:P:m:dcs"
+#define SERVEEZ_OPTIONS "l:hVLiv:f:P:m:T:w:dcs"
 #else
-#define SERVEEZ_OPTIONS "l:hVLiv:f:m:dcs"
+#define SERVEEZ_OPTIONS "l:hVLiv:f:m:T:w:dcs"
 #endif
 
 static int
@@ -297,6 +301,8 @@ handle_options (int argc, char **argv)
   options.cfgfile = cfgfile;
   options.verbosity = -1;
   options.sockets = -1;
+  options.coserver_threads = -1;
+  options.workers = 1;
 #if ENABLE_CONTROL_PROTO
   options.pass = NULL;
 #endif
@@ -384,6 +390,18 @@ handle_options (int argc, char **argv)
           options.sockets = atoi (optarg);
           break;
 
+        case 'T':
+          if (!optarg)
+            usage (EXIT_FAILURE);
+          options.coserver_threads = atoi (optarg);
+          break;
+
+        case 'w':
+          if (!optarg)
+            usage (EXIT_FAILURE);
+          options.workers = atoi (optarg);
+          break;
+
         case 'd':
           options.daemon = 1;
           break;
@@ -41,6 +41,8 @@ typedef struct
   char *cfgfile;   /* configuration file */
   int verbosity;   /* verbosity level */
   int sockets;     /* maximum amount of open files (sockets) */
+  int coserver_threads; /* number of threads running the coservers */
+  int workers;     /* number of processes running the server loop */
 #if ENABLE_CONTROL_PROTO
   char *pass;      /* password */
 #endif
@@ -0,0 +1,383 @@
+/*
+ * prefork.c - worker processes sharing the listening sockets
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * After the configuration has been loaded (and thus the servers have
+ * been bound to their ports), the master process forks a number of
+ * worker processes.  Each of them inherits the listening sockets and
+ * runs its own server loop on them; the kernel hands every incoming
+ * connection to one of the workers.  The master itself does not serve
+ * anything.  It restarts workers that die, passes SIGHUP on to them,
+ * and on shutdown terminates them and waits for them to exit.  A worker
+ * which keeps dying right after its start is restarted with an
+ * increasing delay, and if that does not help the master gives up.
+ *
+ * The workers publish their statistics in a shared memory segment, so
+ * that the control protocol can report on all of them, no matter which
+ * worker the control connection happens to land on.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#if HAVE_WAIT_H
+# include <wait.h>
+#endif
+#if HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+
+#include "networking-headers.h"
+#include "libserveez.h"
+#include "misc-macros.h"
+#include "prefork.h"
+
+#if !defined MAP_ANONYMOUS && defined MAP_ANON
+# define MAP_ANONYMOUS  MAP_ANON
+#endif
+
+prefork_stat_t *prefork_stat = NULL;
+int prefork_workers = 0;
+int prefork_self = -1;
+
+/*
+ * Fill in @var{con} with the description of the socket structure
+ * @var{sock}.
+ */
+void
+prefork_describe (svz_socket_t *sock, prefork_con_t *con)
+{
+  svz_server_t *server;
+  const char *id;
+
+  if (sock->flags & SVZ_SOFLG_LISTENING)
+    id = "Listener";
+  else if (sock->flags & SVZ_SOFLG_COSERVER)
+    id = "Co-Server";
+  else if ((server = svz_server_find (sock->cfg)) != NULL)
+    id = server->name;
+  else
+    id = "None";
+
+  snprintf (con->proto, sizeof con->proto, "%s", id);
+  con->id = sock->id;
+  con->recvq = sock->recv_buffer_fill;
+  con->sendq = sock->send_buffer_fill;
+  SVZ_PP_ADDR_PORT (con->local, sock->local_addr, sock->local_port);
+  SVZ_PP_ADDR_PORT (con->foreign, sock->remote_addr, sock->remote_port);
+}
+
+#if ENABLE_PREFORK
+
+/* A worker process exiting within this many seconds after its start
+   counts as failing.  */
+#define PREFORK_QUICK      10
+
+/* The maximum number of seconds to wait before restarting a worker.  */
+#define PREFORK_DELAY_MAX  60
+
+/* The master gives up after this many failures of a worker in a row.  */
+#define PREFORK_GIVE_UP    8
+
+/* The master's restart schedule of a worker process.  */
+typedef struct
+{
+  time_t next;          /* earliest time of the next start */
+  int delay;            /* seconds between the last two starts */
+  int failures;         /* number of failures in a row */
+}
+backoff_t;
+
+static backoff_t *backoff = NULL;
+
+/* Set if a worker process failed too often.  */
+static int gave_up;
+
+/* Set by the master's signal handler.  */
+static volatile sig_atomic_t hangup;
+
+/*
+ * Signal handler of the master process for SIGHUP and SIGCHLD.  The
+ * latter does nothing but interrupt the ‘sleep’ in ‘prefork_run’.
+ */
+static void
+supervise_signal (int sig)
+{
+  if (sig == SIGHUP)
+    hangup = 1;
+  signal (sig, supervise_signal);
+}
+
+/*
+ * Schedule the next start of the worker process number @var{i}.  If it
+ * @var{failed}, double the delay, and give up if it failed too often.
+ */
+static void
+schedule (int i, int failed)
+{
+  backoff_t *b = backoff + i;
+
+  if (!failed)
+    {
+      b->failures = 0;
+      b->delay = 1;
+    }
+  else if (b->failures++ == 0)
+    b->delay = 1;
+  else if ((b->delay *= 2) > PREFORK_DELAY_MAX)
+    b->delay = PREFORK_DELAY_MAX;
+
+  b->next = time (NULL) + b->delay;
+  if (b->failures >= PREFORK_GIVE_UP)
+    {
+      svz_log (SVZ_LOG_FATAL, "worker %d failed %d times in a row, "
+               "giving up\n", i, b->failures);
+      gave_up = 1;
+    }
+  else if (b->failures > 1)
+    svz_log (SVZ_LOG_ERROR, "restarting worker %d in %d seconds\n",
+             i, b->delay);
+}
+
+/*
+ * Start the worker process number @var{i}.  Return zero in the
+ * worker, non-zero in the master.
+ */
+static int
+spawn (int i)
+{
+  prefork_stat_t *w = prefork_stat + i;
+  pid_t pid;
+
+  if ((pid = fork ()) == -1)
+    {
+      svz_log_sys_error ("fork");
+      schedule (i, 1);
+      return -1;
+    }
+  if (pid == 0)
+    {
+      svz_free_and_zero (backoff);
+      prefork_self = i;
+      svz_loop_forked ();
+      return 0;
+    }
+
+  w->pid = pid;
+  w->started = time (NULL);
+  svz_log (SVZ_LOG_NOTICE, "worker %d started (pid %d)\n", i, (int) pid);
+  return 1;
+}
+
+/*
+ * Collect the worker processes which died.
+ */
+static void
+reap (void)
+{
+  prefork_stat_t *w;
+  pid_t pid;
+  int status;
+
+  while ((pid = waitpid (-1, &status, WNOHANG)) > 0)
+    for (w = prefork_stat; w < prefork_stat + prefork_workers; w++)
+      if (w->pid == pid)
+        {
+          if (WIFSIGNALED (status))
+            svz_log (SVZ_LOG_ERROR, "worker %d (pid %d) killed by signal %d\n",
+                     (int) (w - prefork_stat), (int) pid, WTERMSIG (status));
+          else
+            svz_log (svz_shutting_down_p () ? SVZ_LOG_NOTICE : SVZ_LOG_ERROR,
+                     "worker %d (pid %d) exited with status %d\n",
+                     (int) (w - prefork_stat), (int) pid,
+                     WEXITSTATUS (status));
+          w->pid = 0;
+          w->connections = w->ncon = w->more = 0;
+          if (!svz_shutting_down_p ())
+            {
+              w->restarts++;
+              schedule (w - prefork_stat,
+                        time (NULL) - w->started < PREFORK_QUICK);
+            }
+          break;
+        }
+}
+
+/*
+ * Send the signal @var{sig} to all running worker processes.  Return
+ * the number of them.
+ */
+static int
+signal_workers (int sig)
+{
+  prefork_stat_t *w;
+  int n = 0;
+
+  for (w = prefork_stat; w < prefork_stat + prefork_workers; w++)
+    if (w->pid)
+      {
+        kill (w->pid, sig);
+        n++;
+      }
+  return n;
+}
+
+/*
+ * Run @var{n} worker processes.  Return -1 if that is not possible
+ * (the caller should then run the server loop itself), 1 in a worker
+ * process, which should then run @code{prefork_loop}, and 0 in the
+ * master after all workers have exited on shutdown, or 2 if that
+ * happened because a worker kept failing.
+ */
+int
+prefork_run (int n)
+{
+  size_t size = n * sizeof (prefork_stat_t);
+  void *segment;
+  int i;
+
+  segment = mmap (NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (segment == MAP_FAILED)
+    {
+      svz_log_sys_error ("mmap");
+      return -1;
+    }
+  memset (segment, 0, size);
+  prefork_stat = segment;
+  prefork_workers = n;
+  backoff = svz_calloc (n * sizeof (backoff_t));
+  gave_up = 0;
+
+  /* The workers get the default handlers back in ‘svz_loop_forked’.  */
+  signal (SIGHUP, supervise_signal);
+  signal (SIGCHLD, supervise_signal);
+  svz_log (SVZ_LOG_NOTICE, "supervising %d worker processes\n", n);
+
+  while (!svz_shutting_down_p () && !gave_up)
+    {
+      /* (Re)start missing workers when their time has come.  */
+      for (i = 0; i < n; i++)
+        if (!prefork_stat[i].pid && backoff[i].next <= time (NULL))
+          if (spawn (i) == 0)
+            return 1;
+
+      sleep (1);
+      reap ();
+
+      if (hangup)
+        {
+          hangup = 0;
+          svz_log (SVZ_LOG_NOTICE, "resetting %d worker processes\n",
+                   signal_workers (SIGHUP));
+        }
+    }
+
+  svz_log (SVZ_LOG_NOTICE, "terminating %d worker processes\n",
+           signal_workers (SIGTERM));
+  while (signal_workers (0))
+    {
+      sleep (1);
+      reap ();
+    }
+
+  signal (SIGHUP, SIG_DFL);
+  signal (SIGCHLD, SIG_DFL);
+  prefork_stat = NULL;
+  prefork_workers = 0;
+  munmap (segment, size);
+  svz_free_and_zero (backoff);
+  return gave_up ? 2 : 0;
+}
+
+static int
+publish_con (svz_socket_t *sock, void *closure)
+{
+  prefork_stat_t *w = closure;
+
+  if (w->ncon < PREFORK_MAX_CON)
+    prefork_describe (sock, &w->con[w->ncon++]);
+  else
+    w->more++;
+  return 0;
+}
+
+/*
+ * Update the statistics of this worker process in the shared segment.
+ */
+static void
+publish (void)
+{
+  prefork_stat_t *w = prefork_stat + prefork_self;
+
+  w->connections = svz_sock_nconnections ();
+  svz_get_pooled (w->pooled);
+  w->ncon = w->more = 0;
+  svz_foreach_socket (publish_con, w);
+}
+
+/*
+ * Run the server loop in a worker process, publishing
+ * its statistics once a second.
+ */
+void
+prefork_loop (void)
+{
+  time_t last = 0;
+
+  svz_loop_pre ();
+  while (!svz_shutting_down_p ())
+    {
+      svz_loop_one ();
+      if (last != time (NULL))
+        {
+          last = time (NULL);
+          publish ();
+        }
+    }
+  svz_loop_post ();
+}
+
+#else /* !ENABLE_PREFORK */
+
+int
+prefork_run (int n)
+{
+  svz_log (SVZ_LOG_WARNING, "worker processes not supported, "
+           "ignoring request for %d\n", n);
+  return -1;
+}
+
+void
+prefork_loop (void)
+{
+  svz_loop ();
+}
+
+#endif /* !ENABLE_PREFORK */
@@ -0,0 +1,82 @@
+/*
+ * prefork.h - worker processes sharing the listening sockets
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PREFORK_H__
+#define __PREFORK_H__ 1
+
+#include <time.h>
+#ifndef __MINGW32__
+# include <sys/types.h>
+#endif
+
+#if HAVE_SYS_MMAN_H && HAVE_MMAP && HAVE_WAITPID
+# define ENABLE_PREFORK 1
+#endif
+
+/* Maximum number of connections a worker process publishes.  */
+#define PREFORK_MAX_CON 64
+
+/*
+ * Description of a socket structure as listed by the
+ * control protocol's ‘stat con’ command.
+ */
+typedef struct
+{
+  char proto[17];       /* server name, "Listener", "Co-Server" or "None" */
+  int id;               /* socket id */
+  int recvq;            /* receive buffer fill */
+  int sendq;            /* send buffer fill */
+  char local[64];       /* local address and port */
+  char foreign[64];     /* remote address and port */
+}
+prefork_con_t;
+
+/*
+ * The statistics of a worker process.  The master process keeps
+ * the first three members up to date, the worker itself the others
+ * (once a second).  Readers in other processes must live with the
+ * occasional torn update.
+ */
+typedef struct
+{
+  pid_t pid;            /* process id, or zero if not running */
+  time_t started;       /* time of the last (re)start */
+  int restarts;         /* number of restarts after dying */
+  int connections;      /* number of connected sockets */
+  size_t pooled[2];     /* bytes and blocks held by the buffer pool */
+  int ncon;             /* number of valid entries in ‘con’ */
+  int more;             /* number of connections not in ‘con’ */
+  prefork_con_t con[PREFORK_MAX_CON];
+}
+prefork_stat_t;
+
+/* The shared statistics segment, or NULL if not running workers.  */
+extern prefork_stat_t *prefork_stat;
+
+/* The number of worker processes.  */
+extern int prefork_workers;
+
+/* The index of this worker process, or -1 in the master process.  */
+extern int prefork_self;
+
+void prefork_describe (svz_socket_t *, prefork_con_t *);
+int prefork_run (int);
+void prefork_loop (void);
+
+#endif /* not __PREFORK_H__ */
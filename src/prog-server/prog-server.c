@@ -117,32 +117,14 @@ prog_detect_proto (UNUSED svz_server_t *server,
  * has been reached and returns non-zero if so.
  */
 static int
-prog_check_frequency (svz_array_t *accepted, size_t frequency)
+prog_check_frequency (svz_ratelimit_t *accepted)
 {
-  time_t current = time (NULL);
-  size_t i;
-  void *t;
-
-  /* Drop all older entries.  */
-  svz_array_foreach (accepted, t, i)
-    {
-      if (SVZ_PTR2NUM (t) < (unsigned long) (current - 60))
-        {
-          svz_array_del (accepted, i);
-          i--;
-        }
-    }
-
-  /* Check if the maximum frequency has been reached.  */
-  if (svz_array_size (accepted) >= frequency)
+  /* All connections count alike: use the empty key.  */
+  if (svz_ratelimit_hit (accepted, "", 0))
     {
       svz_log (SVZ_LOG_ERROR, "prog: thread frequency exceeded\n");
       return -1;
     }
-
-  /* Add yet another timestamp.  */
-  svz_array_add (accepted, SVZ_NUM2PTR (current));
-
   return 0;
 }
 
@@ -159,7 +141,7 @@ prog_passthrough (svz_socket_t *sock)
   size_t argc;
 
   /* Check frequency.  */
-  if (prog_check_frequency (cfg->accepted, cfg->frequency))
+  if (prog_check_frequency (cfg->accepted))
     return -1;
 
   argc = svz_array_size (cfg->argv);
@@ -235,7 +217,7 @@ int
 prog_finalize (svz_server_t *server)
 {
   prog_config_t *cfg = server->cfg;
-  svz_array_destroy (cfg->accepted);
+  svz_ratelimit_destroy (cfg->accepted);
   return 0;
 }
 
@@ -381,7 +363,7 @@ prog_init (svz_server_t *server)
       svz_array_add (cfg->argv, NULL);
     }
 
-  cfg->accepted = svz_array_create (1, NULL);
+  cfg->accepted = svz_ratelimit_create (1, cfg->frequency, 60);
   return ret;
 }
 
@@ -34,7 +34,7 @@ typedef struct
   int single_threaded; /* Flag: single- or multi-threaded packet server.  */
   size_t frequency;    /* Maximum number of threads per minute.  */
   int (* check_request) (svz_socket_t *);
-  svz_array_t *accepted;
+  svz_ratelimit_t *accepted;
 }
 prog_config_t;
 
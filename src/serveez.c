@@ -37,6 +37,7 @@
 #include "misc-macros.h"
 #include "cfgfile.h"
 #include "option.h"
+#include "prefork.h"
 #include "guile-api.h"
 #include "guile.h"
 #include "guile-server.h"
@@ -69,6 +70,8 @@ extern char *control_protocol_password;
 static void
 guile_entry (UNUSED int argc, UNUSED char **argv)
 {
+  int prefork;
+
   /* Detect operating system.  */
   svz_log (SVZ_LOG_NOTICE, "%s\n", svz_sys_version ());
 
@@ -89,6 +92,9 @@ guile_entry (UNUSED int argc, UNUSED char **argv)
   if (options->sockets != -1)
     SVZ_RUNPARM_X (MAX_SOCKETS, options->sockets);
 
+  if (options->coserver_threads != -1)
+    SVZ_RUNPARM_X (COSERVER_THREADS, options->coserver_threads);
+
 #if ENABLE_CONTROL_PROTO
   if (options->pass)
     {
@@ -107,8 +113,11 @@ guile_entry (UNUSED int argc, UNUSED char **argv)
   svz_log (SVZ_LOG_NOTICE, "using %d socket descriptors\n",
            SVZ_RUNPARM (MAX_SOCKETS));
 
+  /* Worker processes start their own internal coservers.  */
+  prefork = options->workers > 1;
+
   /* Startup the internal coservers here.  */
-  if (svz_updn_all_coservers (options->coservers) == -1)
+  if (!prefork && svz_updn_all_coservers (options->coservers) == -1)
     {
       exit (4);
     }
@@ -119,14 +128,42 @@ guile_entry (UNUSED int argc, UNUSED char **argv)
       exit (6);
     }
 
-  svz_loop ();
+  if (prefork)
+    switch (prefork_run (options->workers))
+      {
+      case 1:
+        /* This is a worker process.  The master runs the finalizers.  */
+        if (svz_updn_all_coservers (options->coservers) == -1)
+          exit (4);
+        prefork_loop ();
+        svz_updn_all_coservers (0);
+        exit (global_exit_value);
+      case -1:
+        prefork = 0;
+        if (svz_updn_all_coservers (options->coservers) == -1)
+          exit (4);
+        break;
+      case 2:
+        /* A worker kept failing.  */
+        global_exit_value = EXIT_FAILURE;
+        break;
+      }
+
+  if (prefork)
+    /* The workers have exited; close the listening sockets.  */
+    svz_loop_post ();
+  else
+    svz_loop ();
 
   /* Run the finalizers.  */
   svz_updn_all_servers (0);
 
   /* Disconnect the previously invoked internal coservers.  */
-  svz_log (SVZ_LOG_NOTICE, "destroying internal coservers\n");
-  svz_updn_all_coservers (0);
+  if (!prefork)
+    {
+      svz_log (SVZ_LOG_NOTICE, "destroying internal coservers\n");
+      svz_updn_all_coservers (0);
+    }
 
 #if ENABLE_GUILE_SERVER
   guile_server_finalize ();
@@ -284,7 +284,7 @@ tnl_create_socket (svz_socket_t *sock, int source)
 #endif /* ENABLE_DEBUG */
       xsock->handle_request = tnl_handle_request_udp_target;
       xsock->idle_func = tnl_idle;
-      xsock->idle_counter = TNL_TIMEOUT;
+      svz_sock_idle_arm (xsock, TNL_TIMEOUT * 1000);
     }
 
   /* target is an ICMP connection */
@@ -305,7 +305,7 @@ tnl_create_socket (svz_socket_t *sock, int source)
 #endif /* ENABLE_DEBUG */
       xsock->handle_request = tnl_handle_request_icmp_target;
       xsock->idle_func = tnl_idle;
-      xsock->idle_counter = TNL_TIMEOUT;
+      svz_sock_idle_arm (xsock, TNL_TIMEOUT * 1000);
     }
 
   /* target is a pipe connection */
@@ -795,7 +795,7 @@ tnl_idle (svz_socket_t *sock)
 
   if (t - sock->last_recv < TNL_TIMEOUT || t - sock->last_send < TNL_TIMEOUT)
     {
-      sock->idle_counter = TNL_TIMEOUT;
+      svz_sock_idle_arm (sock, TNL_TIMEOUT * 1000);
       return 0;
     }
   return -1;
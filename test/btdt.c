@@ -32,8 +32,10 @@
 #endif
 
 #ifndef __MINGW32__
+# include <signal.h>
 # include <sys/types.h>
 # include <sys/socket.h>
+# include <sys/wait.h>
 # include <netdb.h>
 #else
 # define sleep(x) Sleep ((x) * 1000)
@@ -44,6 +46,7 @@
 #include "o-binary.h"
 #include <libserveez.h>
 #include "misc-macros.h"
+#include "chained-hash.h"
 
 int verbosep;
 
@@ -380,6 +383,72 @@ hash_main (int argc, char **argv)
     error++;
   test (error);
 
+  /* deleting many keys, short and long */
+  test_print ("        delete many: ");
+  hash_clear (&hash);
+  error = 0;
+  text = svz_malloc (64);
+  for (n = 0; n < repeat; n++)
+    {
+      sprintf (text, n & 1 ? "%lu" : "a rather long key number %lu",
+               (unsigned long) n);
+      svz_hash_put (hash, text, (void *) (n + 1));
+    }
+  for (n = 0; n < repeat; n += 2)
+    {
+      sprintf (text, "a rather long key number %lu", (unsigned long) n);
+      if (svz_hash_delete (hash, text) != (void *) (n + 1))
+        error++;
+    }
+  if (svz_hash_size (hash) != repeat / 2)
+    error++;
+  for (n = 0; n < repeat; n++)
+    {
+      sprintf (text, n & 1 ? "%lu" : "a rather long key number %lu",
+               (unsigned long) n);
+      if (svz_hash_get (hash, text) != (n & 1 ? (void *) (n + 1) : NULL))
+        error++;
+      if (n & 1 && svz_hash_delete (hash, text) != (void *) (n + 1))
+        error++;
+    }
+  svz_free (text);
+  if (svz_hash_size (hash) != 0)
+    error++;
+  test (error);
+
+  /* the keys must stay put while the table is being resized */
+  test_print ("             resize: ");
+  hash_clear (&hash);
+  svz_hash_configure_shrink (hash, 0);
+  error = 0;
+  text = svz_malloc (32);
+  for (n = 0; n < repeat && n < 500; n++)
+    {
+      struct it_test x = { 0L, 0L };
+
+      sprintf (text, "%lu", (unsigned long) n);
+      svz_hash_put (hash, text, (void *) 1);
+      svz_hash_foreach (hash_count, hash, &x);
+      if (x.k_count != (long) n + 1 || x.v_acc != (long) n + 1)
+        error++;
+      if (n % 7 == 3)
+        {
+          sprintf (text, "%lu", (unsigned long) n / 2);
+          if (svz_hash_get (hash, text) == NULL)
+            error++;
+        }
+    }
+  while (n--)
+    {
+      sprintf (text, "%lu", (unsigned long) n);
+      if (svz_hash_delete (hash, text) != (void *) 1)
+        error++;
+    }
+  svz_free (text);
+  if (svz_hash_size (hash) != 0)
+    error++;
+  test (error);
+
   /* keys and values */
   test_print ("    keys and values: ");
   hash_clear (&hash);
@@ -453,6 +522,204 @@ hash_main (int argc, char **argv)
   return result;
 }
 
+
+/*
+ * benchmark: hash table
+ */
+
+/* The key sets of the benchmark, similar to those found in practice.  */
+static const char *hashbench_set[] = { "address", "guid", "path" };
+
+/* Write key number @var{n} of set @var{set} to @var{buf}.  */
+void
+hashbench_key (char *buf, int set, unsigned long n)
+{
+  switch (set)
+    {
+    case 0:
+      sprintf (buf, "10.%lu.%lu.%lu:6346",
+               (n >> 16) & 0xff, (n >> 8) & 0xff, n & 0xff);
+      break;
+    case 1:
+      sprintf (buf, "%08lX%08lX%08lX%08lX",
+               (n * 2654435761UL) & 0xffffffffUL, n, 0UL, n >> 3);
+      break;
+    default:
+      sprintf (buf, "/usr/local/share/www/htdocs/dir%03lu/file%05lu.html",
+               n % 997, n);
+      break;
+    }
+}
+
+/* The contestants, behind a common interface.  */
+struct hashbench_impl
+{
+  char const *name;
+  void * (* create) (size_t);
+  void * (* put) (void *, const char *, void *);
+  void * (* get) (void *, const char *);
+  void * (* delete) (void *, const char *);
+  void (* destroy) (void *);
+};
+
+void *
+svz_create (size_t size)
+{
+  return svz_hash_create (size, NULL);
+}
+
+void *
+svz_put (void *hash, const char *key, void *value)
+{
+  return svz_hash_put (hash, key, value);
+}
+
+void *
+svz_get (void *hash, const char *key)
+{
+  return svz_hash_get (hash, key);
+}
+
+void *
+svz_delete (void *hash, const char *key)
+{
+  return svz_hash_delete (hash, key);
+}
+
+void
+svz_destroy (void *hash)
+{
+  svz_hash_destroy (hash);
+}
+
+void *
+chained_create (size_t size)
+{
+  return chained_hash_create (size, NULL);
+}
+
+void *
+chained_put (void *hash, const char *key, void *value)
+{
+  return chained_hash_put (hash, key, value);
+}
+
+void *
+chained_get (void *hash, const char *key)
+{
+  return chained_hash_get (hash, key);
+}
+
+void *
+chained_delete (void *hash, const char *key)
+{
+  return chained_hash_delete (hash, key);
+}
+
+void
+chained_destroy (void *hash)
+{
+  chained_hash_destroy (hash);
+}
+
+struct hashbench_impl hashbench_impl[] =
+  {
+    { "chained", chained_create, chained_put, chained_get,
+      chained_delete, chained_destroy },
+    { "current", svz_create, svz_put, svz_get,
+      svz_delete, svz_destroy },
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+  };
+
+/* Return nanoseconds per operation for COUNT operations
+   between START and now.  */
+double
+hashbench_ns (clock_t start, unsigned long count)
+{
+  return (double) (clock () - start) * 1e9 / CLOCKS_PER_SEC / count;
+}
+
+/* Flip the top bit of the last byte of each of the COUNT KEYS.  */
+void
+hashbench_flip (char **keys, unsigned long count)
+{
+  while (count--)
+    keys[count][strlen (keys[count]) - 1] ^= 0x80;
+}
+
+int
+hashbench_main (int argc, char **argv)
+{
+  unsigned long count, n;
+  int set, i, result = 0;
+  struct hashbench_impl *impl;
+  char **keys, buf[64];
+  clock_t start;
+  void *hash;
+  double put, get, miss, del;
+
+  check_nargs (argc, 1, "COUNT (integer)");
+  count = atol (argv[1]);
+  if (count < 1)
+    count = 1;
+
+  keys = svz_malloc (count * sizeof (char *));
+  printf ("%-8s %-8s %8s %8s %8s %8s  (ns/op, %lu keys)\n",
+          "keys", "table", "put", "get", "miss", "delete", count);
+  for (set = 0; set < 3; set++)
+    {
+      for (n = 0; n < count; n++)
+        {
+          hashbench_key (buf, set, n);
+          keys[n] = svz_strdup (buf);
+        }
+
+      for (impl = hashbench_impl; impl->name; impl++)
+        {
+          hash = impl->create (4);
+
+          start = clock ();
+          for (n = 0; n < count; n++)
+            impl->put (hash, keys[n], SVZ_NUM2PTR (n + 1));
+          put = hashbench_ns (start, count);
+
+          start = clock ();
+          for (i = 0; i < 4; i++)
+            for (n = 0; n < count; n++)
+              if (impl->get (hash, keys[n]) != SVZ_NUM2PTR (n + 1))
+                result++;
+          get = hashbench_ns (start, 4 * count);
+
+          /* Look up keys which are not there, but almost.  */
+          hashbench_flip (keys, count);
+          start = clock ();
+          for (n = 0; n < count; n++)
+            if (impl->get (hash, keys[n]) != NULL)
+              result++;
+          miss = hashbench_ns (start, count);
+          hashbench_flip (keys, count);
+
+          start = clock ();
+          for (n = 0; n < count; n++)
+            if (impl->delete (hash, keys[n]) != SVZ_NUM2PTR (n + 1))
+              result++;
+          del = hashbench_ns (start, count);
+
+          impl->destroy (hash);
+          printf ("%-8s %-8s %8.1f %8.1f %8.1f %8.1f\n",
+                  hashbench_set[set], impl->name, put, get, miss, del);
+        }
+
+      for (n = 0; n < count; n++)
+        svz_free (keys[n]);
+    }
+  svz_free (keys);
+
+  if (result)
+    fprintf (stderr, "ERROR: %d lookups failed\n", result);
+  return result;
+}
+
 
 /*
  * codec
@@ -638,6 +905,566 @@ codec_main (int argc, char **argv)
 }
 
 
+/*
+ * resolver
+ */
+
+/* The lookups done besides the "hostN.test" ones, and what they yield.  */
+struct resolver_case
+{
+  int type;
+  char const *request;
+  char const *expect;
+};
+
+struct resolver_case resolver_case[] =
+  {
+    { SVZ_COSERVER_DNS, "alias.test", "10.0.0.1" },
+    { SVZ_COSERVER_DNS, "short", "10.9.9.9" },
+    { SVZ_COSERVER_DNS, "slow.test", "10.7.7.7" },
+    { SVZ_COSERVER_DNS, "spoof.test", "10.5.5.5" },
+    { SVZ_COSERVER_DNS, "v6.test", NULL },
+    { SVZ_COSERVER_DNS, "fail.test", NULL },
+    { SVZ_COSERVER_DNS, "missing.test", NULL },
+    { SVZ_COSERVER_DNS, "10.1.2.3", "10.1.2.3" },
+    { SVZ_COSERVER_REVERSE_DNS, "1.2.3.4", "one.test" },
+    { SVZ_COSERVER_REVERSE_DNS, "5.6.7.8", NULL },
+    { 0, NULL, NULL }
+  };
+
+/* Identical lookups issued at once by the cache test.  */
+#define RESOLVER_TWINS 50
+
+/* A lookup in progress.  */
+struct resolver_wait
+{
+  char expect[64];
+  int done;
+};
+
+int resolver_outstanding;
+int resolver_errors;
+
+int
+resolver_done (char *result, void *closure)
+{
+  struct resolver_wait *w = closure;
+
+  if (w->done++
+      || (result ? strcmp (result, w->expect) : *w->expect != '\0'))
+    {
+      if (verbosep)
+        fprintf (stderr, "got %s, expected %s\n",
+                 result ? result : "(none)", w->expect);
+      resolver_errors++;
+    }
+  resolver_outstanding--;
+  return 0;
+}
+
+#ifndef __MINGW32__
+
+/* Append a resource record for the question's name to @var{p},
+   counting it in the message @var{buf}.  */
+unsigned char *
+resolver_rr (unsigned char *buf, unsigned char *p, int type,
+             const void *data, int size)
+{
+  unsigned char rr[10] = { 0, 0, 0, 1, 0, 0, 0, 60, 0, 0 };
+
+  buf[7]++;
+  rr[1] = type;
+  rr[9] = size;
+  *p++ = 0xc0;
+  *p++ = 12;
+  memcpy (p, rr, 10);
+  memcpy (p + 10, data, size);
+  return p + 10 + size;
+}
+
+/* Answer the questions arriving at @var{s} like a name server for
+   the names in ‘resolver_case’ would.  The first question for
+   "slow.test" is dropped.  The answer for "spoof.test" comes after
+   one with another message id.  */
+void
+resolver_stub (int s)
+{
+  unsigned char buf[512], *p, v6[16] = { [15] = 1 };
+  char name[256];
+  struct sockaddr_in from;
+  socklen_t len;
+  int n, i, qtype, slow = 0;
+
+  for (;;)
+    {
+      len = sizeof (from);
+      n = recvfrom (s, buf, sizeof (buf), 0, (struct sockaddr *) &from, &len);
+      if (n < 12)
+        continue;
+      *name = '\0';
+      for (p = buf + 12; p < buf + n && *p; p += *p + 1)
+        {
+          strncat (name, (char *) p + 1, *p);
+          strcat (name, ".");
+        }
+      if (p + 5 > buf + n)
+        continue;
+      qtype = p[2];
+      p += 5;
+
+      buf[2] = 0x81;
+      buf[3] = 0x80;
+      memset (buf + 6, 0, 6);
+      if (sscanf (name, "host%d.test.", &i) == 1 && qtype == 1)
+        {
+          unsigned char ip[4] = { 10, 0, i >> 8, i & 0xff };
+          p = resolver_rr (buf, p, 1, ip, 4);
+        }
+      else if (!strcmp (name, "alias.test.") && qtype == 1)
+        {
+          /* Real servers would point at the alias' name instead.  */
+          p = resolver_rr (buf, p, 5, "\5host1\4test", 12);
+          p = resolver_rr (buf, p, 1, "\12\0\0\1", 4);
+        }
+      else if (!strcmp (name, "short.test.") && qtype == 1)
+        p = resolver_rr (buf, p, 1, "\12\11\11\11", 4);
+      else if (!strcmp (name, "slow.test.") && qtype == 1)
+        {
+          if (!slow++)
+            continue;
+          p = resolver_rr (buf, p, 1, "\12\7\7\7", 4);
+        }
+      else if (!strcmp (name, "spoof.test.") && qtype == 1)
+        {
+          buf[1] ^= 1;
+          n = resolver_rr (buf, p, 1, "\12\6\6\6", 4) - buf;
+          sendto (s, buf, n, 0, (struct sockaddr *) &from, len);
+          buf[1] ^= 1;
+          buf[7] = 0;
+          p = resolver_rr (buf, p, 1, "\12\5\5\5", 4);
+        }
+      else if (!strcmp (name, "v6.test."))
+        {
+          if (qtype == 28)
+            p = resolver_rr (buf, p, 28, v6, 16);
+        }
+      else if (!strcmp (name, "fail.test."))
+        buf[3] |= 2;
+      else if (!strcmp (name, "4.3.2.1.in-addr.arpa.") && qtype == 12)
+        p = resolver_rr (buf, p, 12, "\3one\4test", 10);
+      else
+        buf[3] |= 3;
+      sendto (s, buf, p - buf, 0, (struct sockaddr *) &from, len);
+    }
+}
+
+#endif /* not __MINGW32__ */
+
+int
+resolver_main (int argc, char **argv)
+{
+  int result = 0;
+#ifndef __MINGW32__
+  struct resolver_case *c;
+  struct resolver_wait *wait, *w;
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+  char conf[] = "btdt-resolv.XXXXXX";
+  svz_address_t *address;
+  in_addr_t ip;
+  int count, n, s, fd, round;
+  pid_t pid;
+  FILE *f;
+  time_t start;
+  size_t cur[2];
+  char host[64];
+  svz_coserver_cache_stats_t before, after;
+
+  check_nargs (argc, 1, "COUNT (integer)");
+  count = atoi (argv[1]);
+
+  /* Start the name server.  */
+  s = socket (AF_INET, SOCK_DGRAM, 0);
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (s < 0 || bind (s, (struct sockaddr *) &addr, sizeof (addr)) < 0
+      || getsockname (s, (struct sockaddr *) &addr, &len) < 0)
+    {
+      fprintf (stderr, "stub name server: %s\n", strerror (errno));
+      return 1;
+    }
+  if ((pid = fork ()) == 0)
+    {
+      resolver_stub (s);
+      exit (EXIT_SUCCESS);
+    }
+  close (s);
+
+  if ((fd = mkstemp (conf)) < 0 || (f = fdopen (fd, "w")) == NULL)
+    {
+      fprintf (stderr, "%s: %s\n", conf, strerror (errno));
+      kill (pid, SIGKILL);
+      return 1;
+    }
+  fprintf (f, "nameserver 127.0.0.1:%d\n"
+           "search test\n"
+           "options timeout:1 attempts:2\n", ntohs (addr.sin_port));
+  fclose (f);
+  setenv ("SERVEEZ_RESOLV_CONF", conf, 1);
+
+  test_print ("resolver test suite\n");
+
+  svz_boot ("resolver");
+  svz_updn_all_coservers (-1);
+
+  test_print ("            lookups: ");
+  for (n = 0; resolver_case[n].request; n++)
+    ;
+  w = wait = svz_calloc ((n + count + 2 * RESOLVER_TWINS)
+                         * sizeof (struct resolver_wait));
+  for (c = resolver_case; c->request; c++, w++)
+    {
+      if (c->expect)
+        strcpy (w->expect, c->expect);
+      resolver_outstanding++;
+      if (c->type == SVZ_COSERVER_DNS)
+        svz_coserver_dns_invoke ((char *) c->request, resolver_done, w);
+      else
+        {
+          ip = inet_addr (c->request);
+          address = svz_address_make (AF_INET, &ip);
+          svz_coserver_rdns_invoke (address, resolver_done, w);
+          svz_free (address);
+        }
+    }
+  for (n = 0; n < count; n++, w++)
+    {
+      sprintf (host, "host%d.test", n);
+      sprintf (w->expect, "10.0.%d.%d", (n >> 8) & 0xff, n & 0xff);
+      resolver_outstanding++;
+      svz_coserver_dns_invoke (host, resolver_done, w);
+    }
+
+  svz_loop_pre ();
+  start = time (NULL);
+  while (resolver_outstanding > 0 && time (NULL) - start < 10)
+    svz_loop_one ();
+  test (resolver_outstanding || resolver_errors);
+
+  /* The same name, many times at once: one lookup, the others join
+     it.  Asked again, it comes from the cache.  */
+  test_print ("              cache: ");
+  svz_coserver_cache_stats (SVZ_COSERVER_DNS, &before);
+  sprintf (host, "host%d.test", count);
+  for (round = 0; round < 2; round++)
+    {
+      for (n = 0; n < RESOLVER_TWINS; n++, w++)
+        {
+          sprintf (w->expect, "10.0.%d.%d",
+                   (count >> 8) & 0xff, count & 0xff);
+          resolver_outstanding++;
+          svz_coserver_dns_invoke (host, resolver_done, w);
+        }
+      start = time (NULL);
+      while (resolver_outstanding > 0 && time (NULL) - start < 10)
+        svz_loop_one ();
+    }
+  svz_coserver_cache_stats (SVZ_COSERVER_DNS, &after);
+  if (after.misses - before.misses != 1
+      || after.joined - before.joined != RESOLVER_TWINS - 1
+      || after.hits - before.hits != RESOLVER_TWINS)
+    {
+      if (verbosep)
+        fprintf (stderr, "cache: %lu misses, %lu joined, %lu hits\n",
+                 after.misses - before.misses, after.joined - before.joined,
+                 after.hits - before.hits);
+      resolver_errors++;
+    }
+  test (resolver_outstanding || resolver_errors);
+
+  svz_updn_all_coservers (0);
+  svz_loop_post ();
+  svz_free (wait);
+  svz_halt ();
+
+  kill (pid, SIGKILL);
+  waitpid (pid, NULL, 0);
+  unlink (conf);
+
+  if (resolver_outstanding || resolver_errors)
+    result++;
+
+  /* memory leaks? */
+  svz_get_curalloc (cur);
+  test_print ("                     ");
+  test (cur[0] || cur[1]);
+  if (cur[0] || cur[1])
+    result++;
+#endif /* not __MINGW32__ */
+
+  return result;
+}
+
+
+/*
+ * coserver
+ */
+
+/* The data of the registered coserver type.  */
+int coserver_data;
+
+/* The routine of the registered coserver type: reverse the request.  */
+char *
+coserver_reverse (char *request, void *data)
+{
+  size_t i, n = strlen (request);
+  char c;
+
+  if (data != &coserver_data)
+    return NULL;
+  for (i = 0; i < n / 2; i++)
+    {
+      c = request[i];
+      request[i] = request[n - 1 - i];
+      request[n - 1 - i] = c;
+    }
+  return request;
+}
+
+/* Kill the coserver processes of the type at @var{type}.  */
+int
+coserver_kill (const svz_coserver_t *coserver, void *type)
+{
+  if (coserver->type == *(int *) type)
+    kill (coserver->pid, SIGKILL);
+  return 0;
+}
+
+/* Count the coservers of the type at @var{type}.  */
+int
+coserver_count (const svz_coserver_t *coserver, void *type)
+{
+  if (coserver->type == *(int *) type)
+    ((int *) type)[1]++;
+  return 0;
+}
+
+int
+coserver_main (int argc, char **argv)
+{
+  int result = 0;
+#ifndef __MINGW32__
+  struct resolver_wait *wait;
+  int count, n, threads, type, dns[2];
+  time_t start;
+  size_t cur[2];
+  char host[64];
+
+  check_nargs (argc, 1, "COUNT (integer)");
+  count = atoi (argv[1]);
+
+  /* Without a resolver, the (reverse) DNS coservers take over.  */
+  setenv ("SERVEEZ_RESOLV_CONF", "/nonexistent", 1);
+
+  test_print ("coserver test suite\n");
+
+  /* Once with processes, once with threads (if supported).  */
+  for (threads = 0; threads <= 4; threads += 4)
+    {
+      svz_boot ("coserver");
+      SVZ_RUNPARM_X (COSERVER_THREADS, threads);
+      if (SVZ_RUNPARM (COSERVER_THREADS) != threads)
+        {
+          svz_halt ();
+          break;
+        }
+      svz_updn_all_coservers (1);
+
+      /* Numeric addresses, which need no name server.  */
+      test_print (threads ? "     thread lookups: " : "    process lookups: ");
+      wait = svz_calloc (count * sizeof (struct resolver_wait));
+      for (n = 0; n < count; n++)
+        {
+          sprintf (host, "10.%d.%d.%d",
+                   n >> 16 & 0xff, n >> 8 & 0xff, n & 0xff);
+          strcpy (wait[n].expect, host);
+          resolver_outstanding++;
+          svz_coserver_dns_invoke (host, resolver_done, &wait[n]);
+        }
+
+      svz_loop_pre ();
+      start = time (NULL);
+      while (resolver_outstanding > 0 && time (NULL) - start < 10)
+        svz_loop_one ();
+      test (resolver_outstanding || resolver_errors);
+
+      /* Requests lost with their coserver fail, and are not remembered.  */
+      if (!threads)
+        {
+          test_print ("      dead coserver: ");
+          dns[0] = SVZ_COSERVER_DNS;
+          svz_foreach_coserver (coserver_kill, dns);
+          memset (wait, 0, 2 * sizeof (struct resolver_wait));
+          for (n = 0; n < 2; n++)
+            {
+              resolver_outstanding++;
+              svz_coserver_dns_invoke ("10.9.9.9", resolver_done, &wait[n]);
+            }
+          start = time (NULL);
+          dns[1] = 0;
+          while ((resolver_outstanding > 0 || dns[1] == 0)
+                 && time (NULL) - start < 10)
+            {
+              svz_loop_one ();
+              dns[1] = 0;
+              svz_foreach_coserver (coserver_count, dns);
+            }
+          strcpy (wait[0].expect, "10.9.9.9");
+          wait[0].done = 0;
+          resolver_outstanding++;
+          svz_coserver_dns_invoke ("10.9.9.9", resolver_done, &wait[0]);
+          while (resolver_outstanding > 0 && time (NULL) - start < 10)
+            svz_loop_one ();
+          test (resolver_outstanding || resolver_errors);
+        }
+
+      /* A type of our own, registered while running.  */
+      test_print ("    registered type: ");
+      type = svz_coserver_register ("reverse", coserver_reverse,
+                                    &coserver_data, 2, 0);
+      memset (wait, 0, count * sizeof (struct resolver_wait));
+      for (n = 0; n < count; n++)
+        {
+          sprintf (host, "request %d", n);
+          strcpy (wait[n].expect, host);
+          coserver_reverse (wait[n].expect, &coserver_data);
+          if (svz_coserver_invoke (type, host, resolver_done, &wait[n]))
+            resolver_errors++;
+          else
+            resolver_outstanding++;
+        }
+      start = time (NULL);
+      while (resolver_outstanding > 0 && time (NULL) - start < 10)
+        svz_loop_one ();
+      test (type < 0 || resolver_outstanding || resolver_errors);
+
+      /* Requests dropped when the threads stop fail.  */
+      if (threads)
+        {
+          test_print ("   dropped requests: ");
+          memset (wait, 0, 2 * sizeof (struct resolver_wait));
+          for (n = 0; n < 2; n++)
+            {
+              resolver_outstanding++;
+              svz_coserver_dns_invoke ("10.9.9.8", resolver_done, &wait[n]);
+            }
+        }
+
+      svz_updn_all_coservers (0);
+      if (threads)
+        test (resolver_outstanding || resolver_errors);
+      svz_loop_post ();
+      svz_free (wait);
+      svz_halt ();
+
+      if (resolver_outstanding || resolver_errors)
+        result++;
+      resolver_outstanding = resolver_errors = 0;
+
+      /* memory leaks? */
+      svz_get_curalloc (cur);
+      test_print ("                     ");
+      test (cur[0] || cur[1]);
+      if (cur[0] || cur[1])
+        result++;
+    }
+#endif /* not __MINGW32__ */
+
+  return result;
+}
+
+
+/*
+ * rate limiting
+ */
+
+/* Count @var{n} events for each of @var{count} keys in @var{rl}, and
+   return the number of keys for which not exactly @var{allowed} of them
+   have been allowed.  */
+int
+ratelimit_hits (svz_ratelimit_t *rl, int count, int n, int allowed)
+{
+  int key, i, hits, error = 0;
+
+  for (key = 0; key < count; key++)
+    {
+      for (hits = i = 0; i < n; i++)
+        if (!svz_ratelimit_hit (rl, &key, sizeof (key)))
+          hits++;
+      if (hits != allowed)
+        error++;
+    }
+  return error;
+}
+
+int
+ratelimit_main (int argc, char **argv)
+{
+  int result = 0;
+  svz_ratelimit_t *rl, *full;
+  int count, key, error;
+  time_t start;
+  size_t cur[2];
+
+  check_nargs (argc, 1, "COUNT (integer)");
+  count = atoi (argv[1]);
+
+  test_print ("ratelimit function test suite\n");
+
+  /* Four events per two seconds, refilling two each second.  Start
+     right after the clock ticks, so each step fits in one second.  */
+  rl = svz_ratelimit_create (count, 4, 2);
+  full = svz_ratelimit_create (count, 4, 2);
+  for (start = time (NULL); time (NULL) == start;)
+    ;
+
+  test_print ("     burst: ");
+  error = ratelimit_hits (rl, count, 4 + 1, 4);
+  error += ratelimit_hits (full, count, 1, 1);
+  test (error);
+
+  sleep (1);
+  test_print ("    refill: ");
+  test (ratelimit_hits (rl, count, 2 + 1, 2));
+
+  /* Three events left plus two refilled, but the bucket holds four.  */
+  test_print ("       cap: ");
+  test (ratelimit_hits (full, count, 4 + 1, 4));
+
+  /* Keys beyond the size of the table push out the oldest ones,
+     which then start over with a full bucket.  */
+  test_print ("    forget: ");
+  error = ratelimit_hits (rl, 1, 1, 0);
+  for (key = count; key < 3 * count; key++)
+    svz_ratelimit_hit (rl, &key, sizeof (key));
+  error += ratelimit_hits (rl, 1, 4 + 1, 4);
+  test (error);
+
+  test_print ("   destroy: ");
+  svz_ratelimit_destroy (rl);
+  svz_ratelimit_destroy (full);
+  test_ok ();
+
+  /* is heap ok?  */
+  test_print ("      heap: ");
+  svz_get_curalloc (cur);
+  test (cur[0] || cur[1]);
+
+  return result;
+}
+
+
 /*
  * program passthrough
  */
@@ -735,7 +1562,11 @@ struct avail avail[] =
   {
     SUB (array),
     SUB (hash),
+    SUB (hashbench),
     SUB (codec),
+    SUB (resolver),
+    SUB (coserver),
+    SUB (ratelimit),
     SUB (spew),
     { NULL, NULL }
   };
@@ -0,0 +1,451 @@
+/* chained-hash.c --- the former hash table, for comparison
+ *
+ * Copyright (C) 2011-2013 Thien-Thi Nguyen
+ * Copyright (C) 2000, 2001, 2002, 2003 Stefan Jahn <stefan@lkcc.org>
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This is the hash table implementation libserveez used up to
+ * version 0.2.2 (separate chaining with bucket arrays), stripped down
+ * to the basic functions.  It serves as the baseline for the ‘hashbench’
+ * benchmark of btdt.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <assert.h>
+#include <libserveez.h>
+#include "chained-hash.h"
+
+typedef struct entry entry_t;
+typedef struct bucket bucket_t;
+
+/*
+ * This structure keeps information of a specific hash table.
+ */
+struct chained_hash
+{
+  size_t buckets;                  /* number of buckets in the table */
+  size_t fill;                     /* number of filled buckets */
+  size_t keys;                     /* number of stored keys */
+  int (* equals) (const char *, const char *); /* key equality callback */
+  unsigned long (* code) (const char *); /* hash code calculation callback */
+  size_t (* keylen) (const char *);      /* how to get the hash key length */
+  svz_free_func_t destroy;         /* element destruction callback */
+  bucket_t *table;                 /* hash table */
+};
+
+/* some useful defines */
+#define HASH_SHRINK_LIMIT(hash) (hash->buckets >> 2)
+#define HASH_EXPAND_LIMIT(hash) ((hash->buckets >> 1) + (hash->buckets >> 2))
+#define HASH_BUCKET(code, hash) (code & (hash->buckets - 1))
+
+/* useful defines */
+#define SVZ_HASH_SHRINK   4
+#define SVZ_HASH_EXPAND   8
+#define SVZ_HASH_MIN_SIZE 4
+
+/*
+ * This is the basic structure of a hash entry consisting of its
+ * key, the actual value stored in the hash table and the hash code
+ * of the key.
+ */
+struct entry
+{
+  unsigned long code;
+  char *key;
+  void *value;
+};
+
+/*
+ * The hash table consists of different hash buckets.  This contains the
+ * bucket's size and the entry array.
+ */
+struct bucket
+{
+  int size;
+  entry_t *entry;
+};
+
+/*
+ * Calculate the hash code for a given string @var{key}.  This is the standard
+ * callback for any newly created hash table.
+ */
+static unsigned long
+hash_code (const char *key)
+{
+  unsigned long code = 0;
+  const char *p = key;
+
+  assert (key);
+  while (*p)
+    {
+      code = (code << 1) ^ *p;
+      p++;
+    }
+  return code;
+}
+
+/*
+ * This is the default callback for any newly created hash for determining
+ * two keys (@var{key1} and @var{key2}) being equal.  Return zero if both
+ * strings are equal, otherwise non-zero.
+ */
+static int
+hash_equal (const char *key1, const char *key2)
+{
+  const char *p1, *p2;
+
+  assert (key1 && key2);
+
+  if (key1 == key2)
+    return 0;
+
+  p1 = key1;
+  p2 = key2;
+
+  while (*p1 && *p2)
+    {
+      if (*p1 != *p2)
+        return -1;
+      p1++;
+      p2++;
+    }
+
+  if (!*p1 && !*p2)
+    return 0;
+  return -1;
+}
+
+/*
+ * This is the default routine for determining the actual hash table
+ * key length of the given key @var{key}.
+ */
+static size_t
+hash_key_length (const char *key)
+{
+  size_t len = 0;
+
+  assert (key);
+  while (*key++)
+    len++;
+  len++;
+
+  return len;
+}
+
+/*
+ * Create a new hash table with an initial capacity @var{size}.  Return a
+ * non-zero pointer to the newly created hash.  The size is calculated down
+ * to a binary value.  The @var{destroy} callback specifies an
+ * element destruction callback for use by @code{chained_hash_destroy}
+ * for each value.  If no such operation should be performed the argument
+ * must be @code{NULL}.
+ */
+chained_hash_t *
+chained_hash_create (size_t size, svz_free_func_t destroy)
+{
+  size_t n;
+  chained_hash_t *hash;
+
+  /* set initial hash table size to a binary value */
+  for (n = size, size = 1; n != 1; n >>= 1)
+    size <<= 1;
+  if (size < SVZ_HASH_MIN_SIZE)
+    size = SVZ_HASH_MIN_SIZE;
+
+  /* allocate space for the hash itself */
+  hash = svz_malloc (sizeof (chained_hash_t));
+  hash->buckets = size;
+  hash->fill = 0;
+  hash->keys = 0;
+  hash->code = hash_code;
+  hash->equals = hash_equal;
+  hash->keylen = hash_key_length;
+  hash->destroy = destroy;
+
+  /* allocate space for the hash table and initialize it */
+  hash->table = svz_malloc (sizeof (bucket_t) * size);
+  for (n = 0; n < size; n++)
+    {
+      hash->table[n].size = 0;
+      hash->table[n].entry = NULL;
+    }
+
+  return hash;
+}
+
+/*
+ * Destroy the existing hash table @var{hash}, @code{svz_free}ing
+ * all keys within the hash, the hash table and the hash itself.
+ * If a non-@code{NULL} element destruction callback was specified to
+ * @code{chained_hash_create}, that function is called on each value.
+ */
+void
+chained_hash_destroy (chained_hash_t *hash)
+{
+  size_t n;
+  int e;
+  bucket_t *bucket;
+
+  if (hash == NULL)
+    return;
+
+  for (n = 0; n < hash->buckets; n++)
+    {
+      bucket = &hash->table[n];
+      if (bucket->size)
+        {
+          for (e = 0; e < bucket->size; e++)
+            {
+              svz_free (bucket->entry[e].key);
+              if (hash->destroy)
+                hash->destroy (bucket->entry[e].value);
+            }
+          svz_free (bucket->entry);
+        }
+    }
+  svz_free (hash->table);
+  svz_free (hash);
+}
+
+/*
+ * Rehash a given hash table @var{hash}.  Double (@var{type} is
+ * @code{SVZ_HASH_EXPAND}) its size and expand the hash codes or half (@var{type}
+ * is @code{SVZ_HASH_SHRINK}) its size and shrink the hash codes if these would
+ * be placed somewhere else.
+ */
+static void
+rehash (chained_hash_t *hash, int type)
+{
+  size_t n;
+  int e;
+  bucket_t *bucket, *next_bucket;
+
+  if (type == SVZ_HASH_EXPAND)
+    {
+      /*
+       * Reallocate and initialize the hash table itself.
+       */
+      hash->buckets <<= 1;
+      hash->table = svz_realloc (hash->table,
+                                 sizeof (bucket_t) * hash->buckets);
+      for (n = hash->buckets >> 1; n < hash->buckets; n++)
+        {
+          hash->table[n].size = 0;
+          hash->table[n].entry = NULL;
+        }
+
+      /*
+       * Go through all hash table entries and check if it is necessary
+       * to relocate them.
+       */
+      for (n = 0; n < (hash->buckets >> 1); n++)
+        {
+          bucket = &hash->table[n];
+          for (e = 0; e < bucket->size; e++)
+            {
+              if (n != HASH_BUCKET (bucket->entry[e].code, hash))
+                {
+                  /* copy this entry to the far entry */
+                  next_bucket =
+                    &hash->table[HASH_BUCKET (bucket->entry[e].code, hash)];
+                  next_bucket->entry = svz_realloc (next_bucket->entry,
+                                                    (next_bucket->size + 1) *
+                                                    sizeof (entry_t));
+                  next_bucket->entry[next_bucket->size] = bucket->entry[e];
+                  next_bucket->size++;
+                  if (next_bucket->size == 1)
+                    hash->fill++;
+
+                  /* delete this entry */
+                  bucket->size--;
+                  if (bucket->size == 0)
+                    {
+                      svz_free (bucket->entry);
+                      bucket->entry = NULL;
+                      hash->fill--;
+                    }
+                  else
+                    {
+                      bucket->entry[e] = bucket->entry[bucket->size];
+                      bucket->entry = svz_realloc (bucket->entry,
+                                                   bucket->size *
+                                                   sizeof (entry_t));
+                    }
+                  e--;
+                }
+            }
+        }
+    }
+  else if (type == SVZ_HASH_SHRINK && hash->buckets > SVZ_HASH_MIN_SIZE)
+    {
+      hash->buckets >>= 1;
+      for (n = hash->buckets; n < hash->buckets << 1; n++)
+        {
+          bucket = &hash->table[n];
+          if (bucket->size)
+            {
+              for (e = 0; e < bucket->size; e++)
+                {
+                  next_bucket =
+                    &hash->table[HASH_BUCKET (bucket->entry[e].code, hash)];
+                  next_bucket->entry = svz_realloc (next_bucket->entry,
+                                                    (next_bucket->size + 1) *
+                                                    sizeof (entry_t));
+                  next_bucket->entry[next_bucket->size] = bucket->entry[e];
+                  next_bucket->size++;
+                  if (next_bucket->size == 1)
+                    hash->fill++;
+                }
+              svz_free (bucket->entry);
+            }
+          hash->fill--;
+        }
+      hash->table = svz_realloc (hash->table,
+                                 sizeof (bucket_t) * hash->buckets);
+    }
+}
+
+/*
+ * Add a new element consisting of @var{key} and @var{value} to @var{hash}.
+ * When @var{key} already exists, replace and return the old value.
+ * @strong{Note}: This is sometimes the source of memory leaks.
+ */
+void *
+chained_hash_put (chained_hash_t *hash, const char *key, void *value)
+{
+  unsigned long code = 0;
+  int e;
+  void *old;
+  entry_t *entry;
+  bucket_t *bucket;
+
+  code = hash->code (key);
+
+  /* Check if the key is already stored.  If so replace the value.  */
+  bucket = &hash->table[HASH_BUCKET (code, hash)];
+  for (e = 0; e < bucket->size; e++)
+    {
+      if (bucket->entry[e].code == code &&
+          hash->equals (bucket->entry[e].key, key) == 0)
+        {
+          old = bucket->entry[e].value;
+          bucket->entry[e].value = value;
+          return old;
+        }
+    }
+
+  /* Reallocate this bucket.  */
+  bucket = &hash->table[HASH_BUCKET (code, hash)];
+  bucket->entry = svz_realloc (bucket->entry,
+                               sizeof (entry_t) * (bucket->size + 1));
+
+  /* Fill this entry.  */
+  entry = &bucket->entry[bucket->size];
+  entry->key = svz_malloc (hash->keylen (key));
+  memcpy (entry->key, key, hash->keylen (key));
+  entry->value = value;
+  entry->code = code;
+  bucket->size++;
+  hash->keys++;
+
+  /* 75% filled?  */
+  if (bucket->size == 1)
+    {
+      hash->fill++;
+      if (hash->fill > HASH_EXPAND_LIMIT (hash))
+        {
+          rehash (hash, SVZ_HASH_EXPAND);
+        }
+    }
+  return NULL;
+}
+
+/*
+ * Delete an existing entry accessed via a @var{key} from the
+ * hash table @var{hash}.  Return @code{NULL} if there is no
+ * such key, otherwise the previous value.
+ */
+void *
+chained_hash_delete (chained_hash_t *hash, const char *key)
+{
+  int n;
+  unsigned long code;
+  bucket_t *bucket;
+  void *value;
+
+  code = hash->code (key);
+  bucket = &hash->table[HASH_BUCKET (code, hash)];
+
+  for (n = 0; n < bucket->size; n++)
+    {
+      if (bucket->entry[n].code == code &&
+          hash->equals (bucket->entry[n].key, key) == 0)
+        {
+          value = bucket->entry[n].value;
+          bucket->size--;
+          svz_free (bucket->entry[n].key);
+          if (bucket->size)
+            {
+              bucket->entry[n] = bucket->entry[bucket->size];
+              bucket->entry = svz_realloc (bucket->entry,
+                                           sizeof (entry_t) *
+                                           bucket->size);
+            }
+          else
+            {
+              svz_free (bucket->entry);
+              bucket->entry = NULL;
+              hash->fill--;
+              if (hash->fill < HASH_SHRINK_LIMIT (hash))
+                {
+                  rehash (hash, SVZ_HASH_SHRINK);
+                }
+            }
+          hash->keys--;
+          return value;
+        }
+    }
+
+  return NULL;
+}
+
+/*
+ * Return the value associated with @var{key} in the hash table
+ * @var{hash}, or @code{NULL} if there is no such key.
+ */
+void *
+chained_hash_get (const chained_hash_t *hash, const char *key)
+{
+  int n;
+  unsigned long code;
+  bucket_t *bucket;
+
+  code = hash->code (key);
+  bucket = &hash->table[HASH_BUCKET (code, hash)];
+
+  for (n = 0; n < bucket->size; n++)
+    {
+      if (bucket->entry[n].code == code &&
+          hash->equals (bucket->entry[n].key, key) == 0)
+        {
+          return bucket->entry[n].value;
+        }
+    }
+
+  return NULL;
+}
@@ -0,0 +1,30 @@
+/* chained-hash.h --- the former hash table, for comparison
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHAINED_HASH_H__
+#define __CHAINED_HASH_H__ 1
+
+typedef struct chained_hash chained_hash_t;
+
+chained_hash_t *chained_hash_create (size_t, svz_free_func_t);
+void chained_hash_destroy (chained_hash_t *);
+void *chained_hash_delete (chained_hash_t *, const char *);
+void *chained_hash_put (chained_hash_t *, const char *, void *);
+void *chained_hash_get (const chained_hash_t *, const char *);
+
+#endif /* not __CHAINED_HASH_H__ */